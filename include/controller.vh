@@ -9,6 +9,17 @@
 `define COMMAND_UPDATE_BLOCK_REG_0 	8'd13
 `define COMMAND_UPDATE_BLOCK_REG_1 	8'd14
 `define COMMAND_COMMIT_REG_UPDATES 	8'd15
+`define COMMAND_END_PROGRAM_SPLIT 	8'd16
+`define COMMAND_END_SPLIT 			8'd17
+`define COMMAND_SELECT_SEGMENT 		8'd18
+`define COMMAND_CLONE_PROGRAM 		8'd19
+`define COMMAND_FREE_DELAY 			8'd20
+`define COMMAND_RESIZE_DELAY 		8'd21
+`define COMMAND_RAMP_BLOCK_REG_0 	8'd22
+`define COMMAND_RAMP_BLOCK_REG_1 	8'd23
+`define COMMAND_SET_SAMPLE_RATE 	8'd24
+`define COMMAND_SET_TELEMETRY 		8'd25
+`define COMMAND_SET_DIRECT 			8'd26
 
 // If we're in a 'waiting' state, but no new data has
 // appeared for a whole 100ms, then it's likely
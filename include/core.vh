@@ -71,4 +71,19 @@
 
 `define CORE_STATE_RESETTING		16'hFFFF
 
-`define COMMIT_ID_WIDTH 4
\ No newline at end of file
+`define COMMIT_ID_WIDTH 4
+
+// Define to build the cores stereo: each block is fetched and decoded
+// once, then run for a left and a right lane, which have channels, an
+// accumulator, memory and delay buffers of their own and the block's
+// registers in common. Channel addresses carry the lane as their top bit
+//`define CORE_STEREO
+
+`ifdef CORE_STEREO
+`define CHANNEL_ADDR_WIDTH 5
+`else
+`define CHANNEL_ADDR_WIDTH 4
+`endif
+
+// Resource requests carry the lane above the 8-bit resource address
+`define LANE_HANDLE_BIT 8
@@ -1,4 +1,20 @@
-`define ENGINE_STATE_READY 				0
-`define ENGINE_STATE_PROCESSING_WAIT 	1
-`define ENGINE_STATE_PROCESSING 		2
-`define ENGINE_STATE_MIXING				3
\ No newline at end of file
+`define ENGINE_MODE_SWAP 		2'd0
+`define ENGINE_MODE_SERIES 		2'd1
+`define ENGINE_MODE_PARALLEL 	2'd2
+
+// Sample rates, by the frame they give in sys_clk cycles. 44.1kHz is
+// the 1280-cycle frame; the others are scaled from it
+`define SAMPLE_RATE_44K1 		3'd0
+`define SAMPLE_RATE_48K 		3'd1
+`define SAMPLE_RATE_88K2 		3'd2
+`define SAMPLE_RATE_96K 		3'd3
+`define SAMPLE_RATE_192K 		3'd4
+`define N_SAMPLE_RATES 			5
+
+// Telemetry packets; see src/telemetry.v
+`define TELEMETRY_SYNC 				8'hA5
+`define TELEMETRY_PACKET_BYTES 		26
+
+`define TELEMETRY_STATUS_PIPELINE 	0
+`define TELEMETRY_STATUS_HEALTH 	1
+`define TELEMETRY_STATUS_RATE 		2
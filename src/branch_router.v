@@ -27,8 +27,8 @@ module branch_router #(parameter data_width = 16, parameter n_blocks = 256, para
 		input wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_in,
 		output reg [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_out,
 		
-		input wire [3 : 0] dest_in,
-		output reg [3 : 0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 
 		input wire signed [data_width - 1 : 0] arg_a_in,
 		input wire signed [data_width - 1 : 0] arg_b_in,
@@ -14,17 +14,23 @@ module commit_master #(parameter data_width = 16, parameter n_blocks = 256, para
 		input wire sample_tick,
 		input wire signed [data_width - 1 : 0] sample_in,
 		
+		`ifdef CORE_STEREO
+		input wire signed [data_width - 1 : 0] sample_in_r,
+		
+		// Whose accumulator a write is for
+		output reg accumulator_write_lane,
+		`endif
 		
 		input wire   [`N_INSTR_BRANCHES - 1 : 0] in_valid,
 		output logic [`N_INSTR_BRANCHES - 1 : 0] in_ready,
 		
 		input wire [$clog2(n_blocks)  - 1 : 0] block_in		[`N_INSTR_BRANCHES - 1 : 0],
 		input wire [full_width	 	  - 1 : 0] result		[`N_INSTR_BRANCHES - 1 : 0],
-		input wire [3 					  : 0] dest			[`N_INSTR_BRANCHES - 1 : 0],
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest		[`N_INSTR_BRANCHES - 1 : 0],
 		input wire [`COMMIT_ID_WIDTH  - 1 : 0] commit_id	[`N_INSTR_BRANCHES - 1 : 0],
 		input wire [`N_INSTR_BRANCHES - 1 : 0] commit_flag,
 		
-		output reg [3 : 0] channel_write_addr,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] channel_write_addr,
 		output reg signed [data_width - 1 : 0] channel_write_val,
 		output reg channel_write_enable,
 		
@@ -37,17 +43,33 @@ module commit_master #(parameter data_width = 16, parameter n_blocks = 256, para
 		output reg [7 : 0] byte_probe
 	);
 	
+	// A stereo core takes the right lane's sample the cycle after the
+	// left's, into its channel 0
+	`ifdef CORE_STEREO
+	reg sample_tick_r;
+	reg signed [data_width - 1 : 0] sample_latched_r;
+	
+	always @(posedge clk) begin
+		sample_tick_r <= sample_tick & ~reset;
+		
+		if (sample_tick)
+			sample_latched_r <= sample_in_r;
+	end
+	`else
+	wire sample_tick_r = 0;
+	`endif
+	
 	genvar i;
 	generate
 		for (i = 0; i < `N_INSTR_BRANCHES; i = i + 1) begin : one_hot
-			assign in_ready[i] = (in_valid[i] && commit_id[i] == next_commit_id) & ~sample_tick;
+			assign in_ready[i] = (in_valid[i] && commit_id[i] == next_commit_id) & ~sample_tick & ~sample_tick_r;
 		end
 	endgenerate
 	
 	reg [`N_INSTR_BRANCHES - 1 : 0] in_ready_prev;
 	reg acc_overwrite_prev;
 	reg [full_width	- 1 : 0] result_prev [`N_INSTR_BRANCHES - 1 : 0];
-	reg [3 		        : 0] dest_prev	 [`N_INSTR_BRANCHES - 1 : 0];
+	reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_prev [`N_INSTR_BRANCHES - 1 : 0];
 
 	integer j;
 	integer k;
@@ -78,6 +100,19 @@ module commit_master #(parameter data_width = 16, parameter n_blocks = 256, para
 				result_prev <= result_prev;
 				dest_prev <= dest_prev;
 			end
+		`ifdef CORE_STEREO
+		end else if (sample_tick_r) begin
+			channel_write_addr 		<= 1 << (`CHANNEL_ADDR_WIDTH - 1);
+			channel_write_val  		<= sample_latched_r;
+			channel_write_enable 	<= 1;
+			
+			if (enable) begin
+				in_ready_prev <= in_ready_prev;
+				acc_overwrite_prev <= acc_overwrite_prev;
+				result_prev <= result_prev;
+				dest_prev <= dest_prev;
+			end
+		`endif
 		end else if (enable) begin
 			if (|in_ready) next_commit_id <= next_commit_id + 1;
 			
@@ -87,6 +122,10 @@ module commit_master #(parameter data_width = 16, parameter n_blocks = 256, para
 						accumulator_write_val <= result_prev[j];
 						accumulator_write_enable <= 1;
 						accumulator_add_enable <= ~acc_overwrite_prev;
+						
+						`ifdef CORE_STEREO
+						accumulator_write_lane <= dest_prev[j][`CHANNEL_ADDR_WIDTH - 1];
+						`endif
 					end else begin
 						channel_write_val <= result_prev[j][data_width - 1 : 0];
 						channel_write_addr <= dest_prev[j];
@@ -96,6 +135,21 @@ module commit_master #(parameter data_width = 16, parameter n_blocks = 256, para
 			end
 		end
 	end
+	
+	`ifdef SIM_PROFILE
+	// Blocks as they commit, by branch, for the testbench's profiler
+	import "DPI-C" context function void sim_profile_commit(input int block, input int branch);
+	
+	integer p;
+	always @(posedge clk) begin
+		if (!reset && enable) begin
+			for (p = 0; p < `N_INSTR_BRANCHES; p = p + 1) begin
+				if (in_ready[p])
+					sim_profile_commit(int'(block_in[p]), p);
+			end
+		end
+	end
+	`endif
 endmodule
 
 `default_nettype wire
@@ -1,3 +1,5 @@
+`include "core.vh"
+
 `default_nettype none
 
 module commit_stage #(parameter data_width = 16, parameter n_blocks = 256, parameter full_width = 2 * data_width + 8)
@@ -19,8 +21,8 @@ module commit_stage #(parameter data_width = 16, parameter n_blocks = 256, param
 		input  wire signed [full_width - 1 : 0] result_in,
 		output wire signed [full_width - 1 : 0] result_out,
 		
-		input  wire [3:0] dest_in,
-		output wire [3:0] dest_out,
+		input  wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input  wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -29,7 +31,7 @@ module commit_stage #(parameter data_width = 16, parameter n_blocks = 256, param
 		output wire commit_flag_out
 	);
 	
-	localparam payload_width = $clog2(n_blocks) + full_width + 4 + `COMMIT_ID_WIDTH + 1;
+	localparam payload_width = $clog2(n_blocks) + full_width + `CHANNEL_ADDR_WIDTH + `COMMIT_ID_WIDTH + 1;
 
 	wire [payload_width - 1 : 0] skid_payload_in = 
 		{block_in, result_in, dest_in, commit_id_in, commit_flag_in};
@@ -1,6 +1,7 @@
 `include "controller.vh"
 `include "instr_dec.vh"
 `include "core.vh"
+`include "engine.vh"
 
 `default_nettype none
 
@@ -25,28 +26,57 @@ module control_unit
 		
 		output reg [1:0] block_instr_write,
 		output reg [1:0] block_reg_write,
+		output reg [1:0] block_reg_ramp,
+		output reg [15:0] ramp_length_out,
 		output reg [1:0] reg_writes_commit,
 		input wire [1:0] pipeline_regfiles_syncing,
 		output reg [1:0] alloc_delay,
+		output reg [1:0] free_delay,
+		output reg [1:0] resize_delay,
+		output reg [7:0] delay_handle_out,
+		input wire [1:0] pipeline_delays_busy,
+		
+		// The back pipeline's share of the delay pool is fixed as it's
+		// programmed: whatever the front one isn't holding; see engine.v
+		output reg set_delay_partition,
+		
 		output reg [1:0] pipeline_full_reset,
 		input wire [1:0] pipeline_resetting,
 		output reg [1:0] pipeline_enables,
 		output reg [1:0] pipeline_reset,
+		input wire [1:0] pipeline_overruns,
+		
+		output reg [1:0] pipeline_clone,
+		output reg clone_mem,
+		output reg clone_delays,
+		input wire [1:0] pipeline_cloning,
 		
 		output reg swap_pipelines,
 		input wire pipelines_swapping,
-		output reg current_pipeline,
+		output reg current_pipeline /* verilator public_flat_rd */,
+		
+		output reg [1:0] engine_mode /* verilator public_flat_rd */,
+		output reg [1:0] mix_mode,
+		output reg set_mix_mode,
 		
 		output reg set_input_gain,
 		output reg set_output_gain,
 		
+		output reg [2:0] sample_rate,
+		
+		// MISO carries telemetry packets rather than responses; see telemetry.v
+		output reg telemetry_enable,
+		
+		// Outputs go out the frame they're taken in; see engine.v
+		output reg direct_enable,
+		
 		output reg next,
 		
 		output reg health_monitor_enable,
 		output reg health_monitor_reset,
 		input wire health,
 		
-		output reg invalid,
+		output reg invalid /* verilator public_flat_rd */,
 		
 		output wire [7:0] control_state,
 		output reg  [7:0] spi_byte_out
@@ -57,8 +87,8 @@ module control_unit
 	
 	localparam instr_n_bytes = `BLOCK_INSTR_WIDTH / 8;
 	
-	reg [2:0] state = READY;
-	reg [2:0] state_prev = READY;
+	reg [3:0] state /* verilator public_flat_rd */ = READY;
+	reg [3:0] state_prev = READY;
     assign control_state = {4'd0, timeout_blinker, timeout_active, programming, |state};
 	
 	reg wait_one = 0;
@@ -69,6 +99,7 @@ module control_unit
 	localparam data_bytes		= (data_width == 24) ? 3 : 2;
 	localparam instr_bytes   	= 4;
 	localparam delay_addr_bytes = 3;
+	localparam ramp_length_bytes = 2;
 	localparam max_bytes_needed = 6;
 	
 	reg [$clog2(max_bytes_needed) - 1 : 0] byte_ctr;
@@ -84,26 +115,45 @@ module control_unit
 	
 	wire [8 * block_bytes - 1 : 0] instr_write_block;
 	wire [8 * block_bytes - 1 : 0] reg_write_block;
+	wire [8 * block_bytes - 1 : 0] reg_ramp_block;
 	generate
 		if (block_bytes == 2) begin
 			assign instr_write_block = {byte_5_in, byte_4_in};
 			assign reg_write_block = {byte_3_in, byte_2_in};
+			assign reg_ramp_block = {byte_5_in, byte_4_in};
 		end else begin
 			assign instr_write_block = byte_4_in;
 			assign reg_write_block = byte_2_in;
+			assign reg_ramp_block = byte_4_in;
 		end
 	endgenerate
 	
-    localparam READY      		  = 3'd0;
-    localparam LISTEN     		  = 3'd1;
-    localparam EXECUTE    		  = 3'd2;
-    localparam SWAP_WARMUP  	  = 3'd3;
-    localparam SWAP_WAIT  		  = 3'd4;
-    localparam RESET_WAIT 		  = 3'd5;
-    localparam INITIAL_RESET_WAIT = 3'd6;
+    localparam READY      		  = 4'd0;
+    localparam LISTEN     		  = 4'd1;
+    localparam EXECUTE    		  = 4'd2;
+    localparam SWAP_WARMUP  	  = 4'd3;
+    localparam SWAP_WAIT  		  = 4'd4;
+    localparam RESET_WAIT 		  = 4'd5;
+    localparam INITIAL_RESET_WAIT = 4'd6;
+    localparam MODE_WAIT 		  = 4'd7;
+    localparam CLONE_WAIT 		  = 4'd8;
 
 	wire front_pipeline = current_pipeline;
 	wire back_pipeline = ~current_pipeline;
+	
+	// In a split mode the back pipeline runs the second program
+	// segment; register updates may be pointed at either segment
+	reg update_segment;
+	wire update_pipeline = current_pipeline ^ update_segment;
+	
+	wire split = (engine_mode != `ENGINE_MODE_SWAP);
+	
+	reg [1:0] split_mode_pending;
+	reg split_ending;
+	
+	// The back pipeline missed a tick during a split program's warmup:
+	// the segment doesn't fit the frame, so the split is turned down
+	reg split_overrun /* verilator public_flat_rd */;
 
     reg [15 : 0] total_bytes;
     
@@ -138,14 +188,22 @@ module control_unit
 		swap_pipelines <= 0;
 		pipeline_reset <= 0;
 		pipeline_full_reset <= 0;
+		pipeline_clone <= 0;
 		
 		block_instr_write <= 0;
 		block_reg_write   <= 0;
+		block_reg_ramp 	  <= 0;
 		
-		alloc_delay <= 0;
+		alloc_delay  <= 0;
+		free_delay   <= 0;
+		resize_delay <= 0;
+		
+		set_delay_partition <= 0;
 		
 		set_input_gain  <= 0;
 		set_output_gain <= 0;
+		
+		set_mix_mode <= 0;
 
         timeout <= 0;
         
@@ -182,8 +240,24 @@ module control_unit
             timeout_max <= `CONTROLLER_TIMEOUT_CYCLES;
             
             spi_byte_out <= SPI_RESPONSE_INITIALISING;
+            
+            engine_mode 		<= `ENGINE_MODE_SWAP;
+            mix_mode 			<= `ENGINE_MODE_SWAP;
+            split_mode_pending 	<= `ENGINE_MODE_SWAP;
+            split_ending 		<= 0;
+            split_overrun 		<= 0;
+            update_segment 		<= 0;
+            
+            clone_mem 	 <= 0;
+            clone_delays <= 0;
+            
+            sample_rate <= `SAMPLE_RATE_44K1;
+            telemetry_enable <= 0;
+            direct_enable <= 0;
 		end else if (timeout) begin
-			pipeline_full_reset[back_pipeline] <= 1;
+			// In a split mode the back pipeline is live, not half-programmed
+			if (!split)
+				pipeline_full_reset[back_pipeline] <= 1;
 			programming 	<= 0;
 			timeout_active 	<= 0;
 			timeout_ctr 	<= 0;
@@ -211,7 +285,9 @@ module control_unit
 					timeout_active <= 0;
 					ignore_command <= 0;
 					
-					if (!wait_one && in_valid) begin
+					// Delay allocations take a while; later commands,
+					// including the end of the program, wait for them
+					if (!wait_one && in_valid && !(|pipeline_delays_busy)) begin
 						command <= in_byte;
 						wait_one <= 1;
 						next <= 1;
@@ -225,11 +301,17 @@ module control_unit
 						
 						case (in_byte)
 							`COMMAND_BEGIN_PROGRAM: begin
-								programming <= 1;
 								state <= READY;
-								spi_byte_out <= 0;
 								
-								spi_byte_out <= SPI_RESPONSE_PROGRAMMING;
+								// The back pipeline must be released with
+								// COMMAND_END_SPLIT before it can be reprogrammed
+								if (split) begin
+									spi_byte_out <= SPI_RESPONSE_REJECTED;
+								end else begin
+									programming <= 1;
+									set_delay_partition <= 1;
+									spi_byte_out <= SPI_RESPONSE_PROGRAMMING;
+								end
 							end
 						
 							`COMMAND_WRITE_BLOCK_INSTR: begin
@@ -269,8 +351,20 @@ module control_unit
 								bytes_needed <= block_bytes + data_bytes;
 							end
 							
+							// A target and a ramp length; the register glides
+							// there, one step a sample, once committed
+							`COMMAND_RAMP_BLOCK_REG_0: begin
+								reg_target <= 0;
+								bytes_needed <= block_bytes + data_bytes + ramp_length_bytes;
+							end
+							
+							`COMMAND_RAMP_BLOCK_REG_1: begin
+								reg_target <= 1;
+								bytes_needed <= block_bytes + data_bytes + ramp_length_bytes;
+							end
+							
 							`COMMAND_COMMIT_REG_UPDATES: begin
-								reg_writes_commit[front_pipeline] <= 1;
+								reg_writes_commit[update_pipeline] <= 1;
 								state <= READY;
 							end
 							
@@ -285,6 +379,7 @@ module control_unit
 									health_monitor_reset <= 1;
 									
 									warmup_ctr <= 0;
+									split_mode_pending <= `ENGINE_MODE_SWAP;
 									
 									state <= SWAP_WARMUP;
 								end else begin
@@ -292,6 +387,46 @@ module control_unit
 								end
 							end
 							
+							`COMMAND_END_PROGRAM_SPLIT: begin
+								bytes_needed <= 1;
+								
+								if (!programming) ignore_command <= 1;
+							end
+							
+							`COMMAND_END_SPLIT: begin
+								if (split && !programming) begin
+									mix_mode <= `ENGINE_MODE_SWAP;
+									set_mix_mode <= 1;
+									split_ending <= 1;
+									
+									state <= MODE_WAIT;
+								end else begin
+									state <= READY;
+								end
+							end
+							
+							`COMMAND_SELECT_SEGMENT: begin
+								bytes_needed <= 1;
+							end
+							
+							`COMMAND_CLONE_PROGRAM: begin
+								bytes_needed <= 1;
+								
+								if (!programming) ignore_command <= 1;
+							end
+							
+							`COMMAND_FREE_DELAY: begin
+								bytes_needed <= 1;
+								
+								if (!programming) ignore_command <= 1;
+							end
+							
+							`COMMAND_RESIZE_DELAY: begin
+								bytes_needed <= 1 + delay_addr_bytes;
+								
+								if (!programming) ignore_command <= 1;
+							end
+							
 							`COMMAND_SET_INPUT_GAIN: begin
 								bytes_needed <= data_bytes;
 							end
@@ -300,6 +435,18 @@ module control_unit
 								bytes_needed <= data_bytes;
 							end
 							
+							`COMMAND_SET_SAMPLE_RATE: begin
+								bytes_needed <= 1;
+							end
+							
+							`COMMAND_SET_TELEMETRY: begin
+								bytes_needed <= 1;
+							end
+							
+							`COMMAND_SET_DIRECT: begin
+								bytes_needed <= 1;
+							end
+							
 							default: begin
 								state <= READY;
 							end
@@ -363,6 +510,22 @@ module control_unit
 							delay_size_out <= {8'd0, byte_5_in, byte_4_in, byte_3_in};
 							init_delay_out <= {8'd0, byte_2_in, byte_1_in, byte_0_in};
 							alloc_delay[back_pipeline] <= 1;
+							wait_one <= 1;
+							state <= READY;
+						end
+						
+						`COMMAND_FREE_DELAY: begin
+							delay_handle_out <= byte_0_in;
+							free_delay[back_pipeline] <= 1;
+							wait_one <= 1;
+							state <= READY;
+						end
+						
+						`COMMAND_RESIZE_DELAY: begin
+							delay_handle_out <= byte_3_in;
+							delay_size_out 	 <= {8'd0, byte_2_in, byte_1_in, byte_0_in};
+							resize_delay[back_pipeline] <= 1;
+							wait_one <= 1;
 							state <= READY;
 						end
 
@@ -370,12 +533,12 @@ module control_unit
 							timeout_active <= 1;
 							if (pipelines_swapping) begin
 								state <= READY;
-							end else if (!pipeline_regfiles_syncing[front_pipeline]) begin
+							end else if (!pipeline_regfiles_syncing[update_pipeline]) begin
 								block_target <= reg_write_block;
 								reg_target <= 0;
 								
 								data_out <= {byte_1_in, byte_0_in};
-								block_reg_write[front_pipeline] <= 1;
+								block_reg_write[update_pipeline] <= 1;
 								state <= READY;
 							end
 						end
@@ -384,16 +547,85 @@ module control_unit
 							timeout_active <= 1;
 							if (pipelines_swapping) begin
 								state <= READY;
-							end else if (!pipeline_regfiles_syncing[front_pipeline]) begin
+							end else if (!pipeline_regfiles_syncing[update_pipeline]) begin
 								block_target <= reg_write_block;
 								reg_target <= 1;
 								
 								data_out <= {byte_1_in, byte_0_in};
-								block_reg_write[front_pipeline] <= 1;
+								block_reg_write[update_pipeline] <= 1;
 								state <= READY;
 							end
 						end
 						
+						`COMMAND_RAMP_BLOCK_REG_0: begin
+							timeout_active <= 1;
+							if (pipelines_swapping) begin
+								state <= READY;
+							end else if (!pipeline_regfiles_syncing[update_pipeline]) begin
+								block_target <= reg_ramp_block;
+								reg_target <= 0;
+								
+								data_out <= {byte_3_in, byte_2_in};
+								ramp_length_out <= {byte_1_in, byte_0_in};
+								block_reg_write[update_pipeline] <= 1;
+								block_reg_ramp [update_pipeline] <= 1;
+								state <= READY;
+							end
+						end
+
+						`COMMAND_RAMP_BLOCK_REG_1: begin
+							timeout_active <= 1;
+							if (pipelines_swapping) begin
+								state <= READY;
+							end else if (!pipeline_regfiles_syncing[update_pipeline]) begin
+								block_target <= reg_ramp_block;
+								reg_target <= 1;
+								
+								data_out <= {byte_3_in, byte_2_in};
+								ramp_length_out <= {byte_1_in, byte_0_in};
+								block_reg_write[update_pipeline] <= 1;
+								block_reg_ramp [update_pipeline] <= 1;
+								state <= READY;
+							end
+						end
+						
+						`COMMAND_END_PROGRAM_SPLIT: begin
+							programming <= 0;
+							
+							reg_writes_commit[back_pipeline] <= 1;
+							pipeline_enables [back_pipeline] <= 1;
+							
+							health_monitor_enable <= 1;
+							health_monitor_reset <= 1;
+							
+							warmup_ctr <= 0;
+							split_overrun <= 0;
+							
+							// Route the back pipeline's input now, so that the
+							// health monitor watches the combined output; the
+							// output mix only moves over once warmup passes
+							split_mode_pending <= (byte_0_in[1:0] == `ENGINE_MODE_PARALLEL) ? `ENGINE_MODE_PARALLEL : `ENGINE_MODE_SERIES;
+							engine_mode 	   <= (byte_0_in[1:0] == `ENGINE_MODE_PARALLEL) ? `ENGINE_MODE_PARALLEL : `ENGINE_MODE_SERIES;
+							
+							state <= SWAP_WARMUP;
+						end
+						
+						`COMMAND_SELECT_SEGMENT: begin
+							update_segment <= split & byte_0_in[0];
+							state <= READY;
+						end
+						
+						// Copy the front pipeline's program into the back one, so
+						// that only the blocks that differ need to be sent after
+						`COMMAND_CLONE_PROGRAM: begin
+							pipeline_clone[back_pipeline] <= 1;
+							clone_mem 	 <= byte_0_in[0];
+							clone_delays <= byte_0_in[1];
+							
+							wait_one <= 1;
+							state <= CLONE_WAIT;
+						end
+						
 						`COMMAND_SET_INPUT_GAIN: begin
 							data_out <= {byte_1_in, byte_0_in};
 							set_input_gain <= 1;
@@ -405,22 +637,56 @@ module control_unit
 							set_output_gain <= 1;
 							state <= READY;
 						end
+						
+						// Takes effect at the start of the next frame. The
+						// programs running aren't checked against the new
+						// budget; that's up to whoever asks for it
+						`COMMAND_SET_SAMPLE_RATE: begin
+							if (byte_0_in < `N_SAMPLE_RATES)
+								sample_rate <= byte_0_in[2:0];
+							else
+								spi_byte_out <= SPI_RESPONSE_REJECTED;
+							
+							state <= READY;
+						end
+						
+						`COMMAND_SET_TELEMETRY: begin
+							telemetry_enable <= byte_0_in[0];
+							state <= READY;
+						end
+						
+						`COMMAND_SET_DIRECT: begin
+							direct_enable <= byte_0_in[0];
+							state <= READY;
+						end
 					endcase
 				end
 				
 				SWAP_WARMUP: begin
 					timeout_active <= 0;
+					
+					if (pipeline_overruns[back_pipeline])
+						split_overrun <= 1;
+					
 					if (warmup_ctr == warmup_cycles) begin
-						if (health) begin
-							swap_pipelines <= 1;
-							
-							
-							swap_pipelines <= 1;
+						if (health && !(split_overrun && split_mode_pending != `ENGINE_MODE_SWAP)) begin
+							if (split_mode_pending != `ENGINE_MODE_SWAP) begin
+								mix_mode <= split_mode_pending;
+								set_mix_mode <= 1;
+								split_ending <= 0;
+								
+								state <= MODE_WAIT;
+							end else begin
+								swap_pipelines <= 1;
+								
+								state <= SWAP_WAIT;
+							end
 							
-							state <= SWAP_WAIT;
+							wait_one <= 1;
 							spi_byte_out <= SPI_RESPONSE_OK;
 						end else begin
 							pipeline_full_reset[back_pipeline] <= 1;
+							engine_mode <= `ENGINE_MODE_SWAP;
 							state <= READY;
 							spi_byte_out <= SPI_RESPONSE_REJECTED;
 						end
@@ -446,6 +712,31 @@ module control_unit
 					end
 				end
 				
+				MODE_WAIT: begin
+					timeout_active <= 1;
+					if (!wait_one && !pipelines_swapping) begin
+						if (split_ending) begin
+							engine_mode 	<= `ENGINE_MODE_SWAP;
+							update_segment 	<= 0;
+							split_ending 	<= 0;
+							
+							pipeline_full_reset[back_pipeline] <= 1;
+							
+							wait_one <= 1;
+							state <= RESET_WAIT;
+						end else begin
+							state <= READY;
+						end
+					end
+				end
+				
+				CLONE_WAIT: begin
+					timeout_active <= 1;
+					if (!wait_one && !pipeline_cloning[back_pipeline]) begin
+						state <= READY;
+					end
+				end
+				
 				RESET_WAIT: begin
 					timeout_active <= 1;
 					if (!wait_one && !(|pipeline_resetting)) begin
@@ -32,6 +32,23 @@ module dsp_core #(
 		input wire signed [data_width - 1 : 0] sample_in,
 		output reg signed [data_width - 1 : 0] sample_out,
 		
+		`ifdef CORE_STEREO
+		input wire signed [data_width - 1 : 0] sample_in_r,
+		output reg signed [data_width - 1 : 0] sample_out_r,
+		`endif
+		
+		// The pass's result as soon as it's in, rather than on the next
+		// tick; see below
+		output reg pass_done,
+		output reg signed [data_width - 1 : 0] pass_sample,
+		
+		// A tick came before the last pass was done with
+		output reg pass_overrun,
+		
+		`ifdef CORE_STEREO
+		output reg signed [data_width - 1 : 0] pass_sample_r,
+		`endif
+		
 		output reg ready,
 		
 		input wire command_reg_write,
@@ -42,6 +59,10 @@ module dsp_core #(
 		input wire [31 : 0] command_instr_write_val,
 		input wire signed [data_width - 1 : 0] command_reg_write_val,
 		
+		// Register updates that ramp to their value over a number of samples
+		input wire command_reg_ramp,
+		input wire [15 : 0] command_ramp_length,
+		
 		output reg lut_req,
 		output reg signed [data_width - 1 : 0] lut_handle,
 		output reg signed [data_width - 1 : 0] lut_arg,
@@ -63,6 +84,29 @@ module dsp_core #(
 		input wire full_reset,
 		output reg resetting,
 		
+		// Program cloning; copying the other core's program into this one
+		input wire clone,
+		input wire clone_mem,
+		output reg cloning,
+		
+		input wire [$clog2(n_blocks)		- 1 : 0] clone_block_addr,
+		input wire [31 							: 0] clone_instr,
+		input wire [2 * data_width 			- 1 : 0] clone_regs,
+		input wire [$clog2(n_blocks) 			: 0] clone_n_blocks,
+		output wire [$clog2(memory_size) 	- 1 : 0] clone_mem_addr,
+		input wire signed [data_width 		- 1 : 0] clone_mem_val,
+		
+		// ...and exposing this core's program to be cloned by the other
+		output wire [$clog2(n_blocks) 		- 1 : 0] snoop_block_addr,
+		output wire [31 						: 0] snoop_instr,
+		output wire [2 * data_width 		- 1 : 0] snoop_regs,
+		output wire [$clog2(n_blocks) 			: 0] snoop_n_blocks,
+		input wire [$clog2(memory_size) 	- 1 : 0] snoop_mem_addr,
+		output reg signed [data_width 		- 1 : 0] snoop_mem_val,
+		
+		// The last commit span; see below
+		output wire [15 : 0] cycles_per_sample,
+		
 		output wire [7:0] out
 	);
 	
@@ -126,12 +170,65 @@ module dsp_core #(
 
 	localparam block_addr_w 	= $clog2(n_blocks);
 	localparam mem_addr_w 		= $clog2(memory_size);
-	localparam ch_addr_w 		= $clog2(16);
+	localparam ch_addr_w 		= `CHANNEL_ADDR_WIDTH;
+	localparam n_channels 		= 1 << ch_addr_w;
 	localparam reg_addr_w		= $clog2(n_blocks) + 1;
 	localparam full_width		= 2 * data_width + 8;
 	
+	`ifdef CORE_STEREO
+	localparam res_handle_w 	= `LANE_HANDLE_BIT + 1;
+	`else
+	localparam res_handle_w 	= `LANE_HANDLE_BIT;
+	`endif
+	
 	always @(posedge clk) begin
 		if (tick) sample_out <= channels[0];
+		
+		`ifdef CORE_STEREO
+		if (tick) sample_out_r <= channels[n_channels / 2];
+		`endif
+	end
+	
+	// A pass is over once its last block is through operand fetch and
+	// everything it issued has committed; the next pass can't touch
+	// channel 0 until the tick has written it. The last commit's write
+	// lands two cycles after it's taken, so the result is read then. A
+	// core with nothing to run passes its sample straight through
+	reg pass_pending;
+	reg [1:0] pass_drain;
+	reg pass_complete;
+	
+	always @(posedge clk) begin
+		pass_done 	 <= 0;
+		pass_overrun <= 0;
+		
+		if (reset | resetting) begin
+			pass_pending  <= 0;
+			pass_drain 	  <= 0;
+			pass_complete <= 1;
+		end else if (tick) begin
+			pass_pending  <= ~enable_core | (n_blocks_running == 0);
+			pass_drain 	  <= 0;
+			pass_complete <= 0;
+			pass_overrun  <= enable_core & ~pass_complete;
+		end else if (pass_drain != 0) begin
+			pass_drain <= pass_drain - 1;
+			
+			if (pass_drain == 1) begin
+				pass_done 	  <= 1;
+				pass_complete <= 1;
+				pass_sample   <= channels[0];
+				
+				`ifdef CORE_STEREO
+				pass_sample_r <= channels[n_channels / 2];
+				`endif
+			end
+		end else if (pass_issued) begin
+			pass_pending <= 1;
+		end else if (pass_pending && next_commit_id == issued_commit_id) begin
+			pass_pending <= 0;
+			pass_drain 	 <= 2;
+		end
 	end
 	
 	reg [31 : 0] instrs [n_blocks - 1 : 0];
@@ -140,13 +237,13 @@ module dsp_core #(
 	reg [block_addr_w     : 0] n_blocks_running;
 	
 	wire [block_addr_w - 1 : 0] block_read_addr  = block_read_addr_bfds;
-	wire [block_addr_w - 1 : 0] instr_write_addr = (resetting) ? blk_reset_ctr : command_block_target;
+	wire [block_addr_w - 1 : 0] instr_write_addr = (resetting) ? blk_reset_ctr : ((cloning) ? clone_block_addr_prev : command_block_target);
 	reg  [31 			   : 0] instr_read_val;
-	wire [31 			   : 0] instr_write_val  = (resetting) ? 0 : command_instr_write_val;
+	wire [31 			   : 0] instr_write_val  = (resetting) ? 0 : ((cloning) ? clone_instr : command_instr_write_val);
 	
-	wire instr_write_enable = (resetting) ? 1 : command_instr_write;
+	wire instr_write_enable = (resetting) ? 1 : ((cloning) ? clone_instr_write : command_instr_write);
 	
-	reg signed [data_width - 1 : 0] channels [16 - 1 : 0];
+	reg signed [data_width - 1 : 0] channels [n_channels - 1 : 0];
 	
 	wire [ch_addr_w  - 1 : 0] channel_read_addr;
 	wire [ch_addr_w  - 1 : 0] channel_write_addr;
@@ -158,12 +255,12 @@ module dsp_core #(
 	reg signed [data_width - 1 : 0] mem [memory_size - 1 : 0];
 	
 	wire [mem_addr_w - 1 : 0] mem_read_addr;
-	wire [mem_addr_w - 1 : 0] mem_write_addr = (resetting) ? mem_reset_ctr : mem_read_addr;
+	wire [mem_addr_w - 1 : 0] mem_write_addr = (resetting) ? mem_reset_ctr : ((cloning) ? clone_mem_write_addr : mem_read_addr);
 	reg  signed [data_width - 1 : 0] mem_read_val;
-	wire signed [data_width - 1 : 0] mem_write_val = (resetting) ? 0 : mem_write_val_pl;
+	wire signed [data_width - 1 : 0] mem_write_val = (resetting) ? 0 : ((cloning) ? clone_mem_val : mem_write_val_pl);
 	wire signed [data_width - 1 : 0] mem_write_val_pl;
 	
-	wire mem_write_enable = resetting | mem_write_req;
+	wire mem_write_enable = resetting | clone_mem_write | mem_write_req;
 	
 	always @(posedge clk) begin
 		if (reset) begin
@@ -172,6 +269,9 @@ module dsp_core #(
 		end else if (full_reset) begin
 			last_block <= 0;
 			n_blocks_running <= 0;
+		end else if (clone && !cloning && !resetting && |clone_n_blocks) begin
+			last_block <= clone_n_blocks - 1;
+			n_blocks_running <= clone_n_blocks;
 		end
 	
 		instr_read_val <= instrs[block_read_addr];
@@ -189,7 +289,7 @@ module dsp_core #(
 	integer i;
 	always @(posedge clk) begin
 		if (reset | resetting) begin
-			for (i = 0; i < 16; i = i + 1) begin
+			for (i = 0; i < n_channels; i = i + 1) begin
 				channels[i] = 0;
 			end
 		end else begin
@@ -199,12 +299,65 @@ module dsp_core #(
 		end
 	end
 	
+	reg active_regfile;
+	
+	reg [n_blocks - 1 : 0] regs_dirty;
+	
+	reg bank_flip_pending;
+	reg bank_copying;
+	
+	reg bank_copy_read;
+	reg [block_addr_w - 1 : 0] bank_copy_read_addr;
+	reg bank_copy_write;
+	reg [block_addr_w - 1 : 0] bank_copy_write_addr;
+	reg [2 * data_width - 1 : 0] bank_copy_write_value;
+	
+	// The lowest dirty block is the next one copied. It's found in two
+	// levels, the lowest group of 16 with a dirty block in it and then the
+	// lowest block in that group, so the path is two 16-wide encoders and
+	// a 16-way mux rather than one encoder n_blocks wide
+	localparam dirty_group_w 	= 16;
+	localparam n_dirty_groups 	= (n_blocks + dirty_group_w - 1) / dirty_group_w;
+	
+	wire [n_dirty_groups * dirty_group_w - 1 : 0] regs_dirty_padded = regs_dirty;
+	
+	reg [n_dirty_groups - 1 : 0] dirty_groups;
+	reg [$clog2(n_dirty_groups + 1) - 1 : 0] dirty_group;
+	reg [dirty_group_w - 1 : 0] dirty_in_group;
+	reg [$clog2(dirty_group_w) - 1 : 0] dirty_index;
+	
+	integer dg;
+	always @(*) begin
+		for (dg = 0; dg < n_dirty_groups; dg = dg + 1)
+			dirty_groups[dg] = |regs_dirty_padded[dg * dirty_group_w +: dirty_group_w];
+		
+		dirty_group = 0;
+		for (dg = n_dirty_groups - 1; dg >= 0; dg = dg - 1) begin
+			if (dirty_groups[dg])
+				dirty_group = dg;
+		end
+		
+		dirty_in_group = regs_dirty_padded[dirty_group * dirty_group_w +: dirty_group_w];
+		
+		dirty_index = 0;
+		for (dg = dirty_group_w - 1; dg >= 0; dg = dg - 1) begin
+			if (dirty_in_group[dg])
+				dirty_index = dg;
+		end
+	end
+	
+	wire [block_addr_w - 1 : 0] bank_copy_addr = dirty_group * dirty_group_w + dirty_index;
+	wire any_dirty = |dirty_groups;
+	
+	wire bank_flip;
+	
 	wire register_read_valid_a;
 	wire signed [2 * data_width - 1 : 0] register_read_packed_a;
 	wire signed [data_width - 1 : 0] register_0_read_a;
 	wire signed [data_width - 1 : 0] register_1_read_a;
 	reg regfile_sync_a;
 	wire regfile_syncing_a;
+	wire [2 * data_width - 1 : 0] bank_copy_value_a;
 
 	block_regfile #(.data_width(data_width), .n_blocks(n_blocks)) regfile_a (
 		.clk(clk),
@@ -224,9 +377,16 @@ module dsp_core #(
 		.register_1_out(register_1_read_a),
 		
 		.sync(regfile_sync_a),
-		.sync_addr(block_read_addr),
-		.sync_value(register_read_packed_b),
-		.syncing(regfile_syncing_a)
+		.sync_addr(clone_block_addr),
+		.sync_value(clone_regs),
+		.syncing(regfile_syncing_a),
+		
+		.copy_addr(bank_copy_addr),
+		.copy_value(bank_copy_value_a),
+		
+		.copy_write(bank_copy_write & active_regfile == 1),
+		.copy_write_addr(bank_copy_write_addr),
+		.copy_write_value(bank_copy_write_value)
 	);
 	
 	wire register_read_valid_b;
@@ -235,6 +395,7 @@ module dsp_core #(
 	wire signed [data_width - 1 : 0] register_1_read_b;
 	reg regfile_sync_b;
 	wire regfile_syncing_b;
+	wire [2 * data_width - 1 : 0] bank_copy_value_b;
 
 	block_regfile #(.data_width(data_width), .n_blocks(n_blocks)) regfile_b (
 		.clk(clk),
@@ -254,34 +415,141 @@ module dsp_core #(
 		.register_1_out(register_1_read_b),
 		
 		.sync(regfile_sync_b),
-		.sync_addr(block_read_addr),
-		.sync_value(register_read_packed_a),
-		.syncing(regfile_syncing_b)
+		.sync_addr(clone_block_addr),
+		.sync_value(clone_regs),
+		.syncing(regfile_syncing_b),
+		
+		.copy_addr(bank_copy_addr),
+		.copy_value(bank_copy_value_b),
+		
+		.copy_write(bank_copy_write & active_regfile == 0),
+		.copy_write_addr(bank_copy_write_addr),
+		.copy_write_value(bank_copy_write_value)
 	);
 	
-	assign regfile_syncing = regfile_syncing_b | regfile_syncing_a;
+	// Only a clone walks the regfiles now
+	wire regfile_walk_syncing = regfile_syncing_b | regfile_syncing_a;
 
 	wire [block_addr_w - 1 : 0] reg_read_addr = (command_reg_write) ? command_block_target : block_read_addr;
 	
 	wire signed [data_width - 1 : 0] register_0_read_value = (active_regfile) ? register_0_read_b : register_0_read_a;
 	wire signed [data_width - 1 : 0] register_1_read_value = (active_regfile) ? register_1_read_b : register_1_read_a;
 
-	reg active_regfile;
+	// The block whose registers the regfiles are presenting this cycle
+	reg [block_addr_w - 1 : 0] reg_read_block;
+	
+	always @(posedge clk) begin
+		reg_read_block <= block_read_addr;
+	end
+	
+	wire signed [data_width - 1 : 0] register_0_ramped;
+	wire signed [data_width - 1 : 0] register_1_ramped;
+	wire ramp_commit;
+	wire ramp_commit_held;
+	wire ramps_active;
+	
+	block_reg_ramp #(.data_width(data_width), .n_blocks(n_blocks), .n_ramps(8), .length_width(16)) reg_ramps (
+		.clk(clk),
+		.reset(reset | full_reset),
+		
+		.tick(tick),
+		
+		.start(command_reg_write & command_reg_ramp),
+		.start_block(command_block_target),
+		.start_reg(command_reg_target),
+		.start_target(command_reg_write_val),
+		.start_length(command_ramp_length),
+		
+		.write(command_reg_write),
+		.write_block(command_block_target),
+		.write_reg(command_reg_target),
+		
+		.commit_req(reg_writes_commit),
+		.commit(ramp_commit),
+		.commit_held(ramp_commit_held),
+		
+		.bank_flip(bank_flip),
+		
+		.read_block(reg_read_block),
+		
+		.register_0_in(register_0_read_value),
+		.register_1_in(register_1_read_value),
+		.register_0_out(register_0_ramped),
+		.register_1_out(register_1_ramped),
+		
+		.active(ramps_active)
+	);
+
+	/**************************/
+	/* Register bank flipping */
+	/**************************/
+	
+	// Register writes land in the inactive bank, and each marks its block
+	// dirty. A commit flips the banks at the start of the next pass, so
+	// every block of a pass sees the same bank, and the dirty blocks alone
+	// are then copied from the new active bank into the stale one, one a
+	// cycle. A commit is thus done within a pass and a few cycles per block
+	// edited, rather than the whole pass a walking sync needed afterward.
+	
+	// The fetcher has just wrapped around to block 0. With fewer than two
+	// blocks there is no wrap to see, so wait for the tick instead
+	wire pass_start = (n_blocks_running > 1) ? (block_read_addr == 0 && reg_read_block != 0) : tick;
+	
+	assign bank_flip = bank_flip_pending & (~enable_core | pass_start);
+	
+	wire [2 * data_width - 1 : 0] bank_copy_value = (active_regfile) ? bank_copy_value_b : bank_copy_value_a;
+	
+	assign regfile_syncing = regfile_walk_syncing | ramp_commit_held | ramp_commit | bank_flip_pending | bank_copying;
 	
 	always @(posedge clk) begin
-		regfile_sync_a <= 0;
-		regfile_sync_b <= 0;
+		regfile_sync_a 	<= 0;
+		regfile_sync_b 	<= 0;
+		bank_copy_write <= 0;
 		
 		if (reset) begin
-			active_regfile <= 0;
-		end else if (reg_writes_commit) begin
-			if (active_regfile == 0) begin
-				regfile_sync_a <= 1;
-			end else if (active_regfile == 1) begin
-				regfile_sync_b <= 1;
-			end
+			active_regfile 		<= 0;
+			regs_dirty 			<= 0;
+			bank_copy_read 		<= 0;
+			bank_flip_pending 	<= 0;
+			bank_copying 		<= 0;
+		end else if (clone_sync) begin
+			// A clone fills both regfiles from the other core
+			regfile_sync_a 		<= 1;
+			regfile_sync_b 		<= 1;
+			regs_dirty 			<= 0;
+			bank_copy_read 		<= 0;
+			bank_flip_pending 	<= 0;
+			bank_copying 		<= 0;
+		end else begin
+			if (command_reg_write)
+				regs_dirty[command_block_target] <= 1;
+			
+			if (ramp_commit)
+				bank_flip_pending <= 1;
 			
-			active_regfile <= ~active_regfile;
+			bank_copy_read <= 0;
+			
+			if (bank_flip) begin
+				active_regfile 		<= ~active_regfile;
+				bank_flip_pending 	<= 0;
+				bank_copying 		<= 1;
+			end else if (bank_copying) begin
+				// The copy port read lags its address by a cycle
+				if (any_dirty) begin
+					regs_dirty[bank_copy_addr] <= 0;
+					bank_copy_read 		<= 1;
+					bank_copy_read_addr <= bank_copy_addr;
+				end
+				
+				if (bank_copy_read) begin
+					bank_copy_write 		<= 1;
+					bank_copy_write_addr 	<= bank_copy_read_addr;
+					bank_copy_write_value 	<= bank_copy_value;
+				end
+				
+				if (!any_dirty && !bank_copy_read)
+					bank_copying <= 0;
+			end
 		end
 	end
 
@@ -291,6 +559,10 @@ module dsp_core #(
 			mem[mem_write_addr] <= mem_write_val;
 	end
 	
+	always @(posedge clk) begin
+		snoop_mem_val <= mem[snoop_mem_addr];
+	end
+	
 	reg signed [full_width - 1 : 0] accumulator;
 	wire [full_width - 1 : 0] abs_accumulator = (accumulator < 0) ? -accumulator : accumulator;
 	
@@ -304,12 +576,18 @@ module dsp_core #(
 	wire accumulator_write_enable;
 	wire accumulator_add_enable;
 	
+	`ifdef CORE_STEREO
+	wire accumulator_write_lane;
+	`else
+	wire accumulator_write_lane = 0;
+	`endif
+	
 	always @(posedge clk) begin
 		if (reset) begin
 			accumulator <= 0;
 		end else if (full_reset) begin
 			accumulator <= 0;
-		end else if (accumulator_write_enable) begin
+		end else if (accumulator_write_enable && !accumulator_write_lane) begin
 			if (accumulator_add_enable)
 				accumulator <= accumulator + accumulator_write_val;
 			else
@@ -317,6 +595,22 @@ module dsp_core #(
 		end
 	end
 	
+	`ifdef CORE_STEREO
+	// The right lane's accumulator
+	reg signed [full_width - 1 : 0] accumulator_r;
+	
+	always @(posedge clk) begin
+		if (reset | full_reset) begin
+			accumulator_r <= 0;
+		end else if (accumulator_write_enable && accumulator_write_lane) begin
+			if (accumulator_add_enable)
+				accumulator_r <= accumulator_r + accumulator_write_val;
+			else
+				accumulator_r <= accumulator_write_val;
+		end
+	end
+	`endif
+	
 	/*--------------------*/
 	/**********************/
 	/* Execution pipeline */
@@ -345,8 +639,8 @@ module dsp_core #(
 		.operation_out(operation_out_bfds),
 		.misc_op_out(misc_op_out_bfds),
 		
-		.register_0_in(register_0_read_value),
-		.register_1_in(register_1_read_value),
+		.register_0_in(register_0_ramped),
+		.register_1_in(register_1_ramped),
 		.register_0_out(register_0_out_bfds),
 		.register_1_out(register_1_out_bfds),
 		
@@ -380,6 +674,85 @@ module dsp_core #(
 		.branch_out(branch_out_bfds)
 	);
 	
+	/**************/
+	/* Lane issue */
+	/**************/
+	
+	// Stereo cores put each decoded block through twice, once a lane; see
+	// lane_replay.v. The right lane's channels sit above the left's, so
+	// its pass reads and writes them by the top bit of the address, and
+	// the other stages only have to carry the wider address along
+	localparam issue_payload_width = block_addr_w + 5 + $clog2(`N_MISC_OPS) + 2 * data_width
+		+ 4 * 4 + 3 + 3 + 5 + 12 + 3 + 5 + $clog2(`N_INSTR_BRANCHES);
+	
+	wire [issue_payload_width - 1 : 0] issue_payload_bfds = {
+		block_out_bfds, operation_out_bfds, misc_op_out_bfds,
+		register_0_out_bfds, register_1_out_bfds,
+		src_a_out_bfds, src_b_out_bfds, src_c_out_bfds, dest_out_bfds,
+		src_a_reg_out_bfds, src_b_reg_out_bfds, src_c_reg_out_bfds,
+		saturate_disable_out_bfds, shift_disable_out_bfds, signedness_out_bfds,
+		shift_out_bfds, res_addr_out_bfds,
+		arg_a_needed_out_bfds, arg_b_needed_out_bfds, arg_c_needed_out_bfds,
+		accumulator_needed_out_bfds, writes_channel_out_bfds, writes_accumulator_out_bfds,
+		commit_flag_out_bfds, writes_external_out_bfds,
+		branch_out_bfds
+	};
+	
+	wire [issue_payload_width - 1 : 0] issue_payload;
+	wire [3 : 0] src_a_decoded;
+	wire [3 : 0] src_b_decoded;
+	wire [3 : 0] src_c_decoded;
+	wire [3 : 0] dest_decoded;
+	
+	assign {
+		block_out_issue, operation_out_issue, misc_op_out_issue,
+		register_0_out_issue, register_1_out_issue,
+		src_a_decoded, src_b_decoded, src_c_decoded, dest_decoded,
+		src_a_reg_out_issue, src_b_reg_out_issue, src_c_reg_out_issue,
+		saturate_disable_out_issue, shift_disable_out_issue, signedness_out_issue,
+		shift_out_issue, res_addr_out_issue,
+		arg_a_needed_out_issue, arg_b_needed_out_issue, arg_c_needed_out_issue,
+		accumulator_needed_out_issue, writes_channel_out_issue, writes_accumulator_out_issue,
+		commit_flag_out_issue, writes_external_out_issue,
+		branch_out_issue
+	} = issue_payload;
+	
+	`ifdef CORE_STEREO
+	wire issue_lane;
+	
+	lane_replay #(.payload_width(issue_payload_width)) replay (
+		.clk(clk),
+		.reset(reset | resetting),
+		.enable(enable_core),
+		
+		.in_valid(out_valid_bfds),
+		.in_ready(out_ready_bfds),
+		
+		.out_valid(out_valid_issue),
+		.out_ready(out_ready_issue),
+		
+		.payload_in(issue_payload_bfds),
+		.payload_out(issue_payload),
+		
+		.lane(issue_lane)
+	);
+	
+	// Registers and constants are the same for both lanes
+	assign src_a_out_issue = {issue_lane & ~src_a_reg_out_issue, src_a_decoded};
+	assign src_b_out_issue = {issue_lane & ~src_b_reg_out_issue, src_b_decoded};
+	assign src_c_out_issue = {issue_lane & ~src_c_reg_out_issue, src_c_decoded};
+	assign dest_out_issue  = {issue_lane, dest_decoded};
+	`else
+	assign issue_payload 	= issue_payload_bfds;
+	assign out_valid_issue 	= out_valid_bfds;
+	assign out_ready_bfds 	= out_ready_issue;
+	
+	assign src_a_out_issue = src_a_decoded;
+	assign src_b_out_issue = src_b_decoded;
+	assign src_c_out_issue = src_c_decoded;
+	assign dest_out_issue  = dest_decoded;
+	`endif
+	
 	/***********************/
 	/* Operand Fetch Stage */
 	/***********************/
@@ -390,84 +763,87 @@ module dsp_core #(
 		
 		.enable(enable_core),
 	
-		.in_valid(out_valid_bfds),
-		.in_ready(out_ready_bfds),
+		.in_valid(out_valid_issue),
+		.in_ready(out_ready_issue),
 		
 		.out_valid(out_valid_ofs),
 		.out_ready(in_ready_router),
 		
 		.n_blocks_running(n_blocks_running),
 		
-		.block_in(block_out_bfds),
+		.block_in(block_out_issue),
 		.block_out(block_out_ofs),
 		
-		.operation_in(operation_out_bfds),
+		.operation_in(operation_out_issue),
 		.operation_out(operation_out_ofs),
 
-		.misc_op_in(misc_op_out_bfds),
+		.misc_op_in(misc_op_out_issue),
 		.misc_op_out(misc_op_out_ofs),
 		
-		.register_0_in(register_0_out_bfds),
+		.register_0_in(register_0_out_issue),
 		.register_0_out(register_0_out_ofs),
-		.register_1_in(register_1_out_bfds),
+		.register_1_in(register_1_out_issue),
 		.register_1_out(register_1_out_ofs),
 		
-		.dest_in(dest_out_bfds),
+		.dest_in(dest_out_issue),
 		.dest_out(dest_out_ofs),
 
-		.src_a_in(src_a_out_bfds),
-		.src_b_in(src_b_out_bfds),
-		.src_c_in(src_c_out_bfds),
+		.src_a_in(src_a_out_issue),
+		.src_b_in(src_b_out_issue),
+		.src_c_in(src_c_out_issue),
 
-		.src_a_reg_in(src_a_reg_out_bfds),
-		.src_b_reg_in(src_b_reg_out_bfds),
-		.src_c_reg_in(src_c_reg_out_bfds),
+		.src_a_reg_in(src_a_reg_out_issue),
+		.src_b_reg_in(src_b_reg_out_issue),
+		.src_c_reg_in(src_c_reg_out_issue),
 		
-		.arg_a_needed_in(arg_a_needed_out_bfds),
-		.arg_b_needed_in(arg_b_needed_out_bfds),
-		.arg_c_needed_in(arg_c_needed_out_bfds),
+		.arg_a_needed_in(arg_a_needed_out_issue),
+		.arg_b_needed_in(arg_b_needed_out_issue),
+		.arg_c_needed_in(arg_c_needed_out_issue),
 
 		.arg_a_out(arg_a_out_ofs),
 		.arg_b_out(arg_b_out_ofs),
 		.arg_c_out(arg_c_out_ofs),
 		
-		.saturate_disable_in(saturate_disable_out_bfds),
+		.saturate_disable_in(saturate_disable_out_issue),
 		.saturate_disable_out(saturate_disable_out_ofs),
 		
-		.signedness_in(signedness_out_bfds),
+		.signedness_in(signedness_out_issue),
 		.signedness_out(signedness_out_ofs),
 		
-		.accumulator_needed_in(accumulator_needed_out_bfds),
+		.accumulator_needed_in(accumulator_needed_out_issue),
 		.accumulator_needed_out(accumulator_needed_out_ofs),
 
-		.shift_in(shift_out_bfds),
+		.shift_in(shift_out_issue),
 		.shift_out(shift_out_ofs),
-		.shift_disable_in(shift_disable_out_bfds),
+		.shift_disable_in(shift_disable_out_issue),
 		.shift_disable_out(shift_disable_out_ofs),
 		
-		.res_addr_in(res_addr_out_bfds),
+		.res_addr_in(res_addr_out_issue),
 		.res_addr_out(res_addr_out_ofs),
 		
-		.writes_channel_in(writes_channel_out_bfds),
+		.writes_channel_in(writes_channel_out_issue),
 		
-		.writes_external_in(writes_external_out_bfds),
+		.writes_external_in(writes_external_out_issue),
 		.writes_external_out(writes_external_out_ofs),
 		
-		.writes_accumulator_in(writes_accumulator_out_bfds),
+		.writes_accumulator_in(writes_accumulator_out_issue),
 		
 		.commit_id_out(commit_id_out_ofs),
 		
-		.commit_flag_in(commit_flag_out_bfds),
+		.commit_flag_in(commit_flag_out_issue),
 		.commit_flag_out(commit_flag_out_ofs),
 
-		.branch_in(branch_out_bfds),
+		.branch_in(branch_out_issue),
 		.branch_out(branch_out_ofs),
 		
 		.channel_write_addr(channel_write_addr),
 		.channel_write_val(channel_write_val),
 		.channel_write_enable(channel_write_enable),
 		
-		.accumulator_write_enable(accumulator_write_enable)
+		.accumulator_write_enable(accumulator_write_enable),
+		
+		.pass_issued(pass_issued),
+		.issued_commit_id(issued_commit_id)
 	);
 	
 	/*****************/
@@ -534,7 +910,7 @@ module dsp_core #(
 		.commit_flag_in(commit_flag_out_ofs),
 		.commit_flag_out(commit_flag_out_router),
 		
-		.accumulator_in(accumulator),
+		.accumulator_in(accumulator_ofs),
 		.accumulator_out(accumulator_out_router),
 		
 		.branch(branch_out_ofs)
@@ -663,7 +1039,7 @@ module dsp_core #(
 	/**********/
 	/* Delays */
 	/**********/
-	resource_branch #(.data_width(data_width), .handle_width(8), .n_blocks(n_blocks), .full_width(full_width)) delay_stage (
+	resource_branch #(.data_width(data_width), .handle_width(res_handle_w), .n_blocks(n_blocks), .full_width(full_width)) delay_stage (
 		.clk(clk),
 		.reset(reset | resetting),
 		
@@ -680,7 +1056,7 @@ module dsp_core #(
 		
 		.write(writes_external_out_router),
 		
-		.handle_in(res_addr_out_router),
+		.handle_in(res_handle_router),
 		.handle_out(delay_req_handle),
 		
 		.arg_a_in(arg_a_out_router),
@@ -753,7 +1129,7 @@ module dsp_core #(
 	/**********/
 	/* Memory */
 	/**********/
-	resource_branch #(.data_width(data_width), .handle_width(8), .full_width(full_width)) mem_stage (
+	resource_branch #(.data_width(data_width), .handle_width(res_handle_w), .full_width(full_width)) mem_stage (
 		.clk(clk),
 		.reset(reset | resetting),
 		
@@ -770,7 +1146,7 @@ module dsp_core #(
 		
 		.write(writes_external_out_router),
 		
-		.handle_in(res_addr_out_router),
+		.handle_in(res_handle_router),
 		
 		.arg_a_in(arg_a_out_router),
 		.arg_a_out(mem_write_val_pl),
@@ -829,6 +1205,11 @@ module dsp_core #(
 		.sample_tick(tick),
 		.sample_in(sample_in),
 		
+		`ifdef CORE_STEREO
+		.sample_in_r(sample_in_r),
+		.accumulator_write_lane(accumulator_write_lane),
+		`endif
+		
 		.in_valid(out_valid_commit_stage),
 		.in_ready(in_ready_commit_master),
 		
@@ -849,8 +1230,69 @@ module dsp_core #(
 		.accumulator_add_enable(accumulator_add_enable),
 		.accumulator_write_enable(accumulator_write_enable),
 		
+		.next_commit_id(next_commit_id),
+		
 		.byte_probe()
 	);
+	
+	// Cycles from each sample tick to the last commit before the next,
+	// for the testbench to check its cycle estimates against, and for
+	// telemetry
+	reg [15 : 0] commit_span_ctr;
+	reg [15 : 0] commit_span_last;
+	reg [15 : 0] commit_span /* verilator public_flat_rd */;
+	
+	always @(posedge clk) begin
+		if (reset | resetting) begin
+			commit_span_ctr  <= 0;
+			commit_span_last <= 0;
+			commit_span 	 <= 0;
+		end else if (tick) begin
+			commit_span 	 <= commit_span_last;
+			commit_span_ctr  <= 0;
+			commit_span_last <= 0;
+		end else begin
+			commit_span_ctr <= commit_span_ctr + 1;
+			
+			if (channel_write_enable | accumulator_write_enable)
+				commit_span_last <= commit_span_ctr + 1;
+		end
+	end
+	
+	assign cycles_per_sample = commit_span;
+	
+	// Only elaborated for a harness built with SIM_PROFILE or SIM_FUZZ,
+	// which verilate.sh passes on as defines; otherwise nothing calls out
+	`ifdef SIM_PROFILE
+	// Sample ticks and blocks issued to operand fetch, for the
+	// testbench's profiler; see verilator/profile.cpp
+	import "DPI-C" context function void sim_profile_tick();
+	import "DPI-C" context function void sim_profile_issue(input int block, input int operation);
+	
+	always @(posedge clk) begin
+		if (!(reset | resetting) && enable_core) begin
+			if (tick)
+				sim_profile_tick();
+			
+			if (out_valid_bfds & out_ready_bfds)
+				sim_profile_issue(int'(block_out_bfds), int'(operation_out_bfds));
+		end
+	end
+	`endif
+	
+	`ifdef SIM_FUZZ
+	// Each tick: whether the core is running a program (0 no, 1 from this
+	// tick on, 2 yes), the sample it takes, and what the last pass left in
+	// channel 0, for the testbench's differential fuzzer; see
+	// verilator/fuzz.cpp
+	import "DPI-C" context function void sim_fuzz_tick(input int state, input int sample, input int result);
+	
+	always @(posedge clk) begin
+		if (tick)
+			sim_fuzz_tick((reset | resetting) ? 0 : (enable_core ? 2 : (enable_req_r ? 1 : 0)),
+				int'(sample_in), int'(channels[0]));
+	end
+	`endif
 
 	/*---------------------------*/
 	/*****************************/
@@ -894,13 +1336,43 @@ module dsp_core #(
 	wire writes_external_out_bfds;
 	wire [$clog2(`N_INSTR_BRANCHES) - 1 : 0] branch_out_bfds;
 	
+	// Lane issue
+	wire out_ready_issue;
+	wire out_valid_issue;
+	wire [$clog2(n_blocks) - 1 : 0] block_out_issue;
+	wire [data_width - 1 : 0] register_0_out_issue;
+	wire [data_width - 1 : 0] register_1_out_issue;
+	wire [4 : 0] operation_out_issue;
+	wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_out_issue;
+	wire [ch_addr_w - 1 : 0] src_a_out_issue;
+	wire [ch_addr_w - 1 : 0] src_b_out_issue;
+	wire [ch_addr_w - 1 : 0] src_c_out_issue;
+	wire [ch_addr_w - 1 : 0] dest_out_issue;
+	wire src_a_reg_out_issue;
+	wire src_b_reg_out_issue;
+	wire src_c_reg_out_issue;
+	wire saturate_disable_out_issue;
+	wire shift_disable_out_issue;
+	wire signedness_out_issue;
+	wire [4  : 0] shift_out_issue;
+	wire [11 : 0] res_addr_out_issue;
+	wire arg_a_needed_out_issue;
+	wire arg_b_needed_out_issue;
+	wire arg_c_needed_out_issue;
+	wire accumulator_needed_out_issue;
+	wire writes_channel_out_issue;
+	wire writes_accumulator_out_issue;
+	wire commit_flag_out_issue;
+	wire writes_external_out_issue;
+	wire [$clog2(`N_INSTR_BRANCHES) - 1 : 0] branch_out_issue;
+	
 	// Operand fetch stage
 	wire out_ready_ofs;
 	wire out_valid_ofs;
 	wire [$clog2(n_blocks) - 1 : 0] block_out_ofs;
 	wire [4 : 0] operation_out_ofs;
 	wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_out_ofs;
-	wire [3 : 0] dest_out_ofs;
+	wire [ch_addr_w - 1 : 0] dest_out_ofs;
 	wire signed [data_width - 1 : 0] register_0_out_ofs;
 	wire signed [data_width - 1 : 0] register_1_out_ofs;
 	wire signed [data_width - 1 : 0] arg_a_out_ofs;
@@ -914,6 +1386,9 @@ module dsp_core #(
 	wire shift_disable_out_ofs;
 	wire [7 : 0] res_addr_out_ofs;
 	wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out_ofs;
+	wire [`COMMIT_ID_WIDTH - 1 : 0] issued_commit_id;
+	wire [`COMMIT_ID_WIDTH - 1 : 0] next_commit_id;
+	wire pass_issued;
 	wire commit_flag_out_ofs;
 	wire [$clog2(`N_INSTR_BRANCHES) - 1 : 0] branch_out_ofs;
 	
@@ -924,7 +1399,7 @@ module dsp_core #(
 	wire [$clog2(n_blocks)  - 1 : 0] block_out_router;
 	wire [4 : 0] operation_out_router;
 	wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_out_router;
-	wire [3 : 0] dest_out_router;
+	wire [ch_addr_w - 1 : 0] dest_out_router;
 	wire signed [data_width - 1 : 0] arg_a_out_router;
 	wire signed [data_width - 1 : 0] arg_b_out_router;
 	wire signed [data_width - 1 : 0] arg_c_out_router;
@@ -938,6 +1413,16 @@ module dsp_core #(
 	wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out_router;
 	wire commit_flag_out_router;
 	wire signed [full_width - 1 : 0] accumulator_out_router;
+	
+	// The router takes the accumulator of the lane the block is for, and
+	// the memory and delay branches the lane above the resource address
+	`ifdef CORE_STEREO
+	wire signed [full_width - 1 : 0] accumulator_ofs = dest_out_ofs[ch_addr_w - 1] ? accumulator_r : accumulator;
+	wire [res_handle_w - 1 : 0] res_handle_router = {dest_out_router[ch_addr_w - 1], res_addr_out_router};
+	`else
+	wire signed [full_width - 1 : 0] accumulator_ofs = accumulator;
+	wire [res_handle_w - 1 : 0] res_handle_router = res_addr_out_router;
+	`endif
 	assign out_ready_router[0] = in_ready_madd;
 	assign out_ready_router[1] = in_ready_mac;
 	assign out_ready_router[2] = in_ready_misc;
@@ -995,8 +1480,8 @@ module dsp_core #(
 	wire [$clog2(n_blocks)  - 1 : 0] block_out_commit_stage [`N_INSTR_BRANCHES - 1 : 0];
 	wire [full_width    - 1 : 0] result_final_stages	[`N_INSTR_BRANCHES - 1 : 0];
 	wire [full_width    - 1 : 0] result_commit_stage	[`N_INSTR_BRANCHES - 1 : 0];
-	wire [3					 	: 0] dest_final_stages		[`N_INSTR_BRANCHES - 1 : 0];
-	wire [3					 	: 0] dest_commit_stage		[`N_INSTR_BRANCHES - 1 : 0];
+	wire [ch_addr_w 	    - 1 : 0] dest_final_stages		[`N_INSTR_BRANCHES - 1 : 0];
+	wire [ch_addr_w 	    - 1 : 0] dest_commit_stage		[`N_INSTR_BRANCHES - 1 : 0];
 	wire [`COMMIT_ID_WIDTH  - 1 : 0] commit_id_final_stages	[`N_INSTR_BRANCHES - 1 : 0];
 	wire [`COMMIT_ID_WIDTH  - 1 : 0] commit_id_commit_stage	[`N_INSTR_BRANCHES - 1 : 0];
 	wire [`N_INSTR_BRANCHES - 1 : 0] commit_flag_final_stages;
@@ -1008,6 +1493,90 @@ module dsp_core #(
 	/*****************/
 	wire [`N_INSTR_BRANCHES - 1 : 0] in_ready_commit_master;
 	
+	/*******************/
+	/* Clone mechanism */
+	/*******************/
+	
+	// Rather than being programmed block by block, a freshly reset core
+	// may copy the program running in the other pipeline. Instructions and
+	// registers are picked up as the other core's block fetcher reads them,
+	// walking the regfiles in sync with it, so the copy takes about one pass and
+	// needs no extra ports on either. The memory, if asked for, is then
+	// walked through a dedicated read port on the other core.
+	
+	assign snoop_block_addr = block_read_addr;
+	assign snoop_instr 		= instr_read_val;
+	assign snoop_regs 		= (active_regfile) ? register_read_packed_b : register_read_packed_a;
+	assign snoop_n_blocks 	= n_blocks_running;
+	
+	localparam CLONE_IDLE 		= 2'd0;
+	localparam CLONE_SYNC_WAIT 	= 2'd1;
+	localparam CLONE_BLOCKS 	= 2'd2;
+	localparam CLONE_MEM 		= 2'd3;
+	
+	reg [1:0] clone_state;
+	reg clone_sync;
+	reg clone_mem_req;
+	
+	reg [block_addr_w - 1 : 0] clone_block_addr_prev;
+	reg [mem_addr_w 	  : 0] clone_mem_ctr;
+	
+	wire clone_instr_write = (clone_state == CLONE_SYNC_WAIT) || (clone_state == CLONE_BLOCKS);
+	
+	// The other core's memory read lags the address by one cycle
+	assign clone_mem_addr = clone_mem_ctr[mem_addr_w - 1 : 0];
+	wire clone_mem_write = (clone_state == CLONE_MEM) && (clone_mem_ctr != 0);
+	wire [mem_addr_w - 1 : 0] clone_mem_write_addr = clone_mem_ctr - 1;
+	
+	always @(posedge clk) begin
+		clone_sync <= 0;
+		
+		clone_block_addr_prev <= clone_block_addr;
+		
+		if (reset | full_reset | resetting) begin
+			clone_state <= CLONE_IDLE;
+			cloning 	<= 0;
+		end else begin
+			case (clone_state)
+				CLONE_IDLE: begin
+					if (clone && |clone_n_blocks) begin
+						cloning 		<= 1;
+						clone_sync 		<= 1;
+						clone_mem_req 	<= clone_mem;
+						clone_state 	<= CLONE_SYNC_WAIT;
+					end
+				end
+				
+				CLONE_SYNC_WAIT: begin
+					if (regfile_walk_syncing)
+						clone_state <= CLONE_BLOCKS;
+				end
+				
+				CLONE_BLOCKS: begin
+					if (!regfile_walk_syncing) begin
+						clone_mem_ctr <= 0;
+						
+						if (clone_mem_req) begin
+							clone_state <= CLONE_MEM;
+						end else begin
+							cloning 	<= 0;
+							clone_state <= CLONE_IDLE;
+						end
+					end
+				end
+				
+				CLONE_MEM: begin
+					clone_mem_ctr <= clone_mem_ctr + 1;
+					
+					if (clone_mem_ctr == memory_size) begin
+						cloning 	<= 0;
+						clone_state <= CLONE_IDLE;
+					end
+				end
+			endcase
+		end
+	end
+	
 	/*******************/
 	/* Reset mechanism */
 	/*******************/
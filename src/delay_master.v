@@ -1,8 +1,24 @@
 `default_nettype none
 
+/*
+ * Delay buffers are carved out of the memory in whole pages, which are
+ * tracked in a bitmap and handed out first-fit. A freed buffer's pages
+ * simply become free again, so neighbouring free space coalesces by
+ * itself, and the freed handle is reused by the next allocation.
+ *
+ * A buffer can be resized in place when it shrinks or the pages after it
+ * are free, and is otherwise moved. Either way its contents are shuffled
+ * so that every delay it could produce before still reads the same sample.
+ *
+ * The memory is shared with the other pipeline's delay master, which
+ * holds the pages it is given in reserved_pages; those are never handed
+ * out here, whether to a new buffer, one growing or one cloned.
+ */
+
 module delay_master #(parameter data_width  = 16,
 					  parameter n_buffers   = 32,
-					  parameter memory_size = 8192)
+					  parameter memory_size = 8192,
+					  parameter page_size   = 128)
 	(
 		input wire clk,
 		input wire reset,
@@ -11,8 +27,12 @@ module delay_master #(parameter data_width  = 16,
 		
 		input wire read_req,
 		input wire alloc_req,
+		input wire free_req,
+		input wire resize_req,
 		input wire write_req,
 		
+		output wire busy,
+		
 		output reg signed [data_width - 1 : 0] data_out,
 		output reg read_valid,
 		output reg write_ack,
@@ -25,6 +45,24 @@ module delay_master #(parameter data_width  = 16,
 		
 		input wire [	addr_width - 1 : 0] alloc_size,
 		input wire [2 * data_width - 1 : 0] alloc_delay,
+		input wire [  handle_width - 1 : 0] alloc_handle,
+		
+		input wire [memory_size / page_size - 1 : 0] reserved_pages,
+		
+		// The pipeline's output is being heard. A resize holds off reads
+		// and writes while it copies, so it's turned down instead
+		input wire live,
+		
+		// Copying the other pipeline's buffer table, so handles carry over
+		input wire clone_req,
+		output wire [handle_width - 1 : 0] clone_handle,
+		input  wire [clone_info_width - 1 : 0] clone_info,
+		input  wire [n_buffers - 1 : 0] clone_initd,
+		
+		input  wire [handle_width - 1 : 0] snoop_handle,
+		output reg  [clone_info_width - 1 : 0] snoop_info,
+		output wire [memory_size / page_size - 1 : 0] snoop_pages,
+		output wire [n_buffers - 1 : 0] snoop_initd,
 		
 		output reg mem_read_req,
 		output reg mem_write_req,
@@ -50,7 +88,13 @@ module delay_master #(parameter data_width  = 16,
 	localparam delay_width  = addr_width + DELAY_FORMAT;
 	localparam handle_width = $clog2(n_buffers);
 	
-	assign any_buffers = |n_buffers_allocd;
+	localparam n_pages 		= memory_size / page_size;
+	localparam page_shift 	= $clog2(page_size);
+	localparam page_w 		= $clog2(n_pages);
+	
+	localparam clone_info_width = addr_width + addr_width + delay_width;
+	
+	assign any_buffers = |buffer_initd;
 	
 	localparam IDLE 	 	= 3'd0;
 	localparam WRITE_1		= 3'd1;
@@ -84,6 +128,8 @@ module delay_master #(parameter data_width  = 16,
 			buf_info[buf_info_write_handle] <= buf_info_write_data;
 		
 		buf_info_read <= buf_info[buf_info_read_handle];
+		
+		snoop_info <= buf_info[snoop_handle][buf_info_width - 1 : buf_info_width - clone_info_width];
 	end
 	
 	reg [n_buffers  - 1 : 0] buf_data_invalid;
@@ -98,8 +144,6 @@ module delay_master #(parameter data_width  = 16,
 	end
 	
 	
-	reg [addr_width - 1 : 0] alloc_addr;
-	
 	reg [2:0] write_state;
 	
 	wire [addr_width - 1 : 0] delay_offset = delay >> DELAY_FORMAT;
@@ -112,11 +156,6 @@ module delay_master #(parameter data_width  = 16,
 	wire signed [addr_width + DELAY_FORMAT - 1 : 0] max_delay_inc = max_delay - delay;
 	wire signed [addr_width + DELAY_FORMAT - 1 : 0] min_delay_inc = -delay;
 	
-	reg [$clog2(n_buffers + 1) - 1 : 0] n_buffers_allocd;
-	
-	wire buffers_exhausted 	= (n_buffers_allocd == n_buffers);
-	wire alloc_too_big		= alloc_addr + alloc_size > memory_size;
-	
 	reg read_wait;
 	reg [data_width - 1 : 0] read_wait_handle;
 	
@@ -134,6 +173,114 @@ module delay_master #(parameter data_width  = 16,
 	
 	reg read_wait_one;
 	
+	/*************/
+	/* Allocator */
+	/*************/
+	
+	localparam ALLOC_IDLE 		= 4'd0;
+	localparam ALLOC_SCAN 		= 4'd1;
+	localparam ALLOC_COMMIT 	= 4'd2;
+	localparam ALLOC_INFO_1 	= 4'd3;
+	localparam ALLOC_INFO_2 	= 4'd4;
+	localparam ALLOC_FREE 		= 4'd5;
+	localparam ALLOC_RESIZE 	= 4'd6;
+	localparam ALLOC_COPY_READ 	= 4'd7;
+	localparam ALLOC_COPY_WAIT 	= 4'd8;
+	localparam ALLOC_COPY_WRITE = 4'd9;
+	localparam ALLOC_ZERO 		= 4'd10;
+	localparam ALLOC_FINISH 	= 4'd11;
+	localparam ALLOC_CLONE 		= 4'd12;
+	localparam ALLOC_CLONE_INFO = 4'd13;
+	
+	localparam OP_ALLOC  = 3'd0;
+	localparam OP_FREE 	 = 3'd1;
+	localparam OP_RESIZE = 3'd2;
+	localparam OP_MOVE 	 = 3'd3;
+	localparam OP_CLONE  = 3'd4;
+	
+	reg [3:0] alloc_state;
+	reg [2:0] alloc_op;
+	
+	assign busy = (alloc_state != ALLOC_IDLE);
+	
+	reg [n_pages - 1 : 0] page_used;
+	
+	wire [n_pages - 1 : 0] page_taken = page_used | reserved_pages;
+	
+	assign snoop_pages = page_used;
+	assign snoop_initd = buffer_initd;
+	
+	// Lowest free handle; matches the order in which handles are
+	// assigned by the compiler when nothing has been freed
+	reg [handle_width - 1 : 0] free_handle;
+	reg any_free_handle;
+	
+	integer k;
+	always @(*) begin
+		free_handle 	= 0;
+		any_free_handle = 0;
+		
+		for (k = n_buffers - 1; k >= 0; k = k - 1) begin
+			if (!buffer_initd[k]) begin
+				free_handle 	= k;
+				any_free_handle = 1;
+			end
+		end
+	end
+	
+	function [n_pages - 1 : 0] page_mask(input [page_w : 0] first, input [page_w : 0] count);
+		page_mask = (count == 0) ? 0 : (({n_pages{1'b1}} >> (n_pages - count)) << first);
+	endfunction
+	
+	function [page_w : 0] pages_for(input [addr_width : 0] n);
+		pages_for = (n == 0) ? 1 : ((n + page_size - 1) >> page_shift);
+	endfunction
+	
+	reg [handle_width - 1 : 0] op_handle;
+	reg [addr_width 	  : 0] op_size;
+	reg [delay_width  - 1 : 0] op_delay;
+	reg [page_w 		  : 0] op_pages;
+	
+	wire [delay_width - 1 : 0] op_max_delay = op_size << DELAY_FORMAT;
+	
+	reg [page_w 		  : 0] scan_page;
+	reg [page_w 		  : 0] run_start;
+	reg [page_w 		  : 0] run_len;
+	
+	wire scan_free = !page_taken[scan_page[page_w - 1 : 0]];
+	wire scan_hit  = scan_free && (run_len + 1 == op_pages);
+	wire [page_w : 0] scan_hit_start = (run_len == 0) ? scan_page : run_start;
+	
+	// The buffer being resized, and where it ends up
+	wire [page_w : 0] old_first = addr >> page_shift;
+	wire [page_w : 0] old_pages = pages_for(size);
+	
+	reg [addr_width - 1 : 0] new_addr;
+	reg [addr_width - 1 : 0] new_position;
+	reg relocating;
+	
+	// Up to two blocks of samples are moved, then a gap zeroed
+	reg [addr_width - 1 : 0] copy_src;
+	reg [addr_width - 1 : 0] copy_dst;
+	reg [addr_width 	: 0] copy_count;
+	reg copy_down;
+	
+	reg [addr_width - 1 : 0] copy_src_2;
+	reg [addr_width - 1 : 0] copy_dst_2;
+	reg [addr_width 	: 0] copy_count_2;
+	
+	reg [addr_width - 1 : 0] zero_addr;
+	reg [addr_width 	: 0] zero_count;
+	
+	reg [handle_width : 0] clone_ctr;
+	assign clone_handle = clone_ctr[handle_width - 1 : 0];
+	
+	wire [addr_width  - 1 : 0] clone_size  = clone_info[addr_width + delay_width - 1 : delay_width];
+	wire [delay_width - 1 : 0] clone_delay = clone_info[delay_width - 1 : 0];
+	
+	wire [addr_width : 0] size_ext 		= {1'b0, size};
+	wire [addr_width : 0] position_ext 	= {1'b0, position};
+	
 	always @(posedge clk) begin
 		write_ack <= 0;
 		read_valid <= 0;
@@ -149,35 +296,276 @@ module delay_master #(parameter data_width  = 16,
 	
 		if (reset) begin
 			write_state <= IDLE;
+			alloc_state <= ALLOC_IDLE;
 			buf_data_invalid <= 0;
-			n_buffers_allocd <= 0;
 			buffer_initd <= 0;
-			alloc_addr <= 0;
+			page_used <= 0;
 			read_wait <= 0;
 			
 			mem_read_req <= 0;
 			mem_write_req <= 0;
-		end else if (alloc_req) begin
-			if (alloc_too_big || buffers_exhausted) begin
-				invalid_alloc <= 1;
-			end else begin
-				alloc_addr <= alloc_addr + alloc_size;
-				buffer_initd[n_buffers_allocd] <= 1;
-				n_buffers_allocd <= n_buffers_allocd + 1;
+		end else if (alloc_state != ALLOC_IDLE || ((alloc_req || free_req || resize_req || clone_req) && write_state == IDLE)) begin
+			case (alloc_state)
+				ALLOC_IDLE: begin
+					op_handle 	<= alloc_handle;
+					op_size 	<= {1'b0, alloc_size_wm};
+					op_delay 	<= alloc_delay_wm;
+					op_pages 	<= pages_for({1'b0, alloc_size_wm});
+					
+					scan_page 	<= 0;
+					run_len 	<= 0;
+					
+					if (clone_req) begin
+						page_used 	 <= 0;
+						buffer_initd <= 0;
+						clone_ctr 	 <= 0;
+						alloc_state  <= ALLOC_CLONE;
+					end else if (alloc_req) begin
+						alloc_op <= OP_ALLOC;
+						
+						if (any_free_handle) begin
+							op_handle 	<= free_handle;
+							alloc_state <= ALLOC_SCAN;
+						end else begin
+							invalid_alloc <= 1;
+						end
+					end else begin
+						alloc_op <= (free_req) ? OP_FREE : OP_RESIZE;
+						buf_info_read_handle <= alloc_handle;
+						
+						if (buffer_initd[alloc_handle] && (free_req || !live))
+							alloc_state <= ALLOC_INFO_1;
+						else
+							invalid_alloc <= 1;
+					end
+				end
 				
-                buf_info_write_data <= '0;
-				buf_info_write_data[buf_info_width                  - 1 : buf_info_width -     addr_width              ] <= alloc_addr;
-				buf_info_write_data[buf_info_width - 1 * addr_width - 1 : buf_info_width - 2 * addr_width              ] <= alloc_size_wm;
-				buf_info_write_data[buf_info_width - 2 * addr_width - 1 : buf_info_width - 2 * addr_width - delay_width] <= alloc_delay_wm;
+				// First-fit search for a run of op_pages free pages
+				ALLOC_SCAN: begin
+					if (scan_hit) begin
+						run_start 	<= scan_hit_start;
+						alloc_state <= (alloc_op == OP_ALLOC || alloc_op == OP_CLONE) ? ALLOC_COMMIT : ALLOC_RESIZE;
+					end else if (scan_page == n_pages - 1) begin
+						invalid_alloc <= 1;
+						alloc_state <= (alloc_op == OP_CLONE) ? ALLOC_CLONE : ALLOC_IDLE;
+					end else begin
+						if (scan_free) begin
+							if (run_len == 0) run_start <= scan_page;
+							run_len <= run_len + 1;
+						end else begin
+							run_len <= 0;
+						end
+						
+						scan_page <= scan_page + 1;
+					end
+				end
 				
-				buf_info_write_handle <= n_buffers_allocd;
-				buf_info_write_enable <= 1;
+				ALLOC_COMMIT: begin
+					page_used <= page_used | page_mask(run_start, op_pages);
+					buffer_initd[op_handle] <= 1;
+					
+					buf_info_write_data <= '0;
+					buf_info_write_data[buf_info_width                  - 1 : buf_info_width -     addr_width              ] <= run_start << page_shift;
+					buf_info_write_data[buf_info_width - 1 * addr_width - 1 : buf_info_width - 2 * addr_width              ] <= op_size[addr_width - 1 : 0];
+					buf_info_write_data[buf_info_width - 2 * addr_width - 1 : buf_info_width - 2 * addr_width - delay_width] <= op_delay;
+					
+					buf_info_write_handle <= op_handle;
+					buf_info_write_enable <= 1;
+					
+					// Clear the buffer's output slot
+					buf_data_new <= 0;
+					write_handle_r <= op_handle;
+					buf_data_write_enable <= 1;
+					
+					alloc_state <= (alloc_op == OP_CLONE) ? ALLOC_CLONE : ALLOC_IDLE;
+				end
 				
-				// Clear the buffer's output slot
-				buf_data_new <= 0;
-				write_handle_r <= n_buffers_allocd;
-				buf_data_write_enable <= 1;
-			end
+				ALLOC_INFO_1: begin
+					alloc_state <= ALLOC_INFO_2;
+				end
+				
+				ALLOC_INFO_2: begin
+					{addr, size, delay, position, gain, wrapped} <= buf_info_read;
+					alloc_state <= (alloc_op == OP_FREE) ? ALLOC_FREE : ALLOC_RESIZE;
+				end
+				
+				ALLOC_FREE: begin
+					page_used <= page_used & ~page_mask(old_first, old_pages);
+					buffer_initd[op_handle] <= 0;
+					alloc_state <= ALLOC_IDLE;
+				end
+				
+				// Work out where the buffer goes and what has to move. Each
+				// delay d it can currently produce reads (position - d) mod
+				// size; samples are moved so that this still holds afterwards
+				ALLOC_RESIZE: begin
+					copy_count_2 <= 0;
+					zero_count 	 <= 0;
+					
+					if (op_size <= size_ext) begin
+						// Shrinking: keep the most recent op_size samples
+						page_used <= page_used & ~page_mask(old_first + op_pages, old_pages - op_pages);
+						new_addr <= addr;
+						relocating <= 0;
+						copy_down <= 0;
+						
+						if (position_ext < op_size) begin
+							copy_src 	 <= addr + position + (size - op_size);
+							copy_dst 	 <= addr + position;
+							copy_count 	 <= op_size - position_ext;
+							new_position <= position;
+						end else begin
+							copy_src 	 <= addr + position - op_size;
+							copy_dst 	 <= addr;
+							copy_count 	 <= op_size;
+							new_position <= 0;
+						end
+						
+						alloc_state <= ALLOC_COPY_READ;
+					end else if (op_pages <= old_pages || (old_first + op_pages <= n_pages
+							&& !(page_taken & page_mask(old_first + old_pages, op_pages - old_pages)))) begin
+						// Growing in place: the older samples move up to the new end
+						page_used <= page_used | page_mask(old_first + old_pages, (op_pages > old_pages) ? op_pages - old_pages : 0);
+						new_addr <= addr;
+						relocating <= 0;
+						copy_down <= 1;
+						
+						copy_src 	<= addr + size - 1;
+						copy_dst 	<= addr + op_size - 1;
+						copy_count 	<= size_ext - position_ext;
+						
+						zero_addr 	<= addr + position;
+						zero_count 	<= op_size - size_ext;
+						
+						new_position <= position;
+						alloc_state <= ALLOC_COPY_READ;
+					end else if (alloc_op == OP_MOVE) begin
+						// Growing into a freshly found run elsewhere
+						page_used <= page_used | page_mask(run_start, op_pages);
+						new_addr <= run_start << page_shift;
+						relocating <= 1;
+						copy_down <= 1;
+						
+						copy_src 	<= addr + size - 1;
+						copy_dst 	<= (run_start << page_shift) + op_size - 1;
+						copy_count 	<= size_ext - position_ext;
+						
+						copy_src_2 	 <= addr + position - 1;
+						copy_dst_2 	 <= (run_start << page_shift) + position - 1;
+						copy_count_2 <= position_ext;
+						
+						zero_addr 	<= (run_start << page_shift) + position;
+						zero_count 	<= op_size - size_ext;
+						
+						new_position <= position;
+						alloc_state <= ALLOC_COPY_READ;
+					end else begin
+						// No room where it is; look for somewhere to put it
+						alloc_op <= OP_MOVE;
+						alloc_state <= ALLOC_SCAN;
+					end
+				end
+				
+				ALLOC_COPY_READ: begin
+					if (copy_count == 0) begin
+						if (copy_count_2 != 0) begin
+							copy_src 	 <= copy_src_2;
+							copy_dst 	 <= copy_dst_2;
+							copy_count 	 <= copy_count_2;
+							copy_count_2 <= 0;
+						end else begin
+							alloc_state <= ALLOC_ZERO;
+						end
+					end else begin
+						mem_read_addr <= copy_src;
+						mem_read_req  <= 1;
+						alloc_state <= ALLOC_COPY_WAIT;
+					end
+				end
+				
+				ALLOC_COPY_WAIT: begin
+					if (mem_read_valid) begin
+						mem_read_req 	<= 0;
+						mem_data_out 	<= mem_data_in;
+						mem_write_addr 	<= copy_dst;
+						mem_write_req 	<= 1;
+						alloc_state <= ALLOC_COPY_WRITE;
+					end
+				end
+				
+				ALLOC_COPY_WRITE: begin
+					if (mem_write_ack) begin
+						mem_write_req <= 0;
+						
+						copy_src 	<= (copy_down) ? copy_src - 1 : copy_src + 1;
+						copy_dst 	<= (copy_down) ? copy_dst - 1 : copy_dst + 1;
+						copy_count 	<= copy_count - 1;
+						
+						alloc_state <= ALLOC_COPY_READ;
+					end
+				end
+				
+				// History the buffer never had reads as silence
+				ALLOC_ZERO: begin
+					if (zero_count == 0) begin
+						mem_write_req <= 0;
+						alloc_state <= ALLOC_FINISH;
+					end else if (!mem_write_req) begin
+						mem_data_out 	<= 0;
+						mem_write_addr 	<= zero_addr;
+						mem_write_req 	<= 1;
+					end else if (mem_write_ack) begin
+						mem_write_req 	<= 0;
+						zero_addr 		<= zero_addr + 1;
+						zero_count 		<= zero_count - 1;
+					end
+				end
+				
+				ALLOC_FINISH: begin
+					if (relocating)
+						page_used <= page_used & ~page_mask(old_first, old_pages);
+					
+					buf_info_write_data <= {new_addr, op_size[addr_width - 1 : 0],
+						(delay > op_max_delay) ? op_max_delay : delay,
+						new_position, gain, wrapped};
+					buf_info_write_handle <= op_handle;
+					buf_info_write_enable <= 1;
+					
+					alloc_state <= ALLOC_IDLE;
+				end
+				
+				// Take the other pipeline's table a handle at a time. The
+				// memory is shared, so each buffer is allocated afresh with
+				// the other's size and delay rather than at its address.
+				// Contents aren't copied, so each buffer fades back in
+				ALLOC_CLONE: begin
+					alloc_state <= (clone_ctr == n_buffers) ? ALLOC_IDLE : ALLOC_CLONE_INFO;
+				end
+				
+				// The other table's entry for clone_handle is in by now
+				ALLOC_CLONE_INFO: begin
+					clone_ctr <= clone_ctr + 1;
+					
+					if (clone_initd[clone_handle]) begin
+						alloc_op 	<= OP_CLONE;
+						op_handle 	<= clone_handle;
+						op_size 	<= {1'b0, clone_size};
+						op_delay 	<= clone_delay;
+						op_pages 	<= pages_for({1'b0, clone_size});
+						
+						scan_page 	<= 0;
+						run_len 	<= 0;
+						
+						alloc_state <= ALLOC_SCAN;
+					end else begin
+						alloc_state <= ALLOC_CLONE;
+					end
+				end
+				
+				default: begin
+					alloc_state <= ALLOC_IDLE;
+				end
+			endcase
 		end else if (enable) begin
 			if (read_wait) begin
 				if (buf_data_write_enable) begin
@@ -212,12 +600,6 @@ module delay_master #(parameter data_width  = 16,
 						
 						invalid_write <= !buffer_initd[write_handle];
 						
-						write_inc_clamped <= (write_inc > max_delay_inc)
-											  ? max_delay_inc
-											  : ((write_inc < min_delay_inc)
-												  ? min_delay_inc
-												  : write_inc);
-						
 						write_state <= buffer_initd[write_handle] ? WRITE_1 : IDLE;
 						write_ack <= 1;
 					end
@@ -232,7 +614,15 @@ module delay_master #(parameter data_width  = 16,
 					write_state <= WRITE_3;
 				end
 				
+				// The increment is clamped against this buffer's delay and
+				// size, which are only loaded by now
 				WRITE_3: begin
+					write_inc_clamped <= (write_inc_r > max_delay_inc)
+										  ? max_delay_inc
+										  : ((write_inc_r < min_delay_inc)
+											  ? min_delay_inc
+											  : write_inc_r);
+					
 					buf_data_invalid[write_handle_r] <= 1;
 					mem_data_out   <= write_data_r;
 					mem_write_addr <= addr + position;
@@ -0,0 +1,112 @@
+`default_nettype none
+
+/*
+ * Delay memory shared by the two pipelines.
+ *
+ * Each pipeline's delay_master addresses the whole pool, and the pages
+ * one holds are closed to the other (see delay_partition in engine.v),
+ * so the memory is one block RAM with a read port and a write port
+ * rather than one per pipeline. Each port serves the pipelines a cycle
+ * about, so a pipeline's request waits at most a cycle longer than it
+ * did on a memory of its own; the handshakes are the same as before.
+ *
+ * A request is only taken again once the pipeline has seen the one
+ * before it answered, so one held over the cycle its answer arrives in
+ * isn't served twice.
+ */
+
+module delay_pool #(parameter data_width  = 16,
+					parameter memory_size = 32768)
+	(
+		input wire clk,
+		input wire reset,
+
+		input wire [1:0] read_req,
+		input wire [addr_width - 1 : 0] read_addr_a,
+		input wire [addr_width - 1 : 0] read_addr_b,
+		output reg signed [data_width - 1 : 0] read_data,
+		output reg [1:0] read_valid,
+
+		input wire [1:0] write_req,
+		input wire [addr_width - 1 : 0] write_addr_a,
+		input wire [addr_width - 1 : 0] write_addr_b,
+		input wire signed [data_width - 1 : 0] write_data_a,
+		input wire signed [data_width - 1 : 0] write_data_b,
+		output reg [1:0] write_ack
+	);
+
+	localparam addr_width = $clog2(memory_size);
+
+	reg [data_width - 1 : 0] mem [memory_size - 1 : 0];
+
+	reg turn;
+
+	reg [1:0] read_busy;
+	reg [1:0] write_busy;
+
+	reg [addr_width - 1 : 0] mem_read_addr;
+	reg signed [data_width - 1 : 0] mem_read_data;
+	reg mem_read;
+	reg mem_read_for;
+	reg mem_read_wait;
+	reg mem_read_wait_for;
+
+	reg [addr_width - 1 : 0] mem_write_addr;
+	reg [data_width - 1 : 0] mem_write_data;
+	reg mem_write_enable;
+
+	wire read_taken  = read_req [turn] & ~read_busy [turn];
+	wire write_taken = write_req[turn] & ~write_busy[turn];
+
+	always @(posedge clk) begin
+		read_valid 		 <= 0;
+		write_ack 		 <= 0;
+		mem_read 		 <= 0;
+		mem_read_wait 	 <= 0;
+		mem_write_enable <= 0;
+
+		mem_read_data <= mem[mem_read_addr];
+
+		if (mem_write_enable)
+			mem[mem_write_addr] <= mem_write_data;
+
+		if (reset) begin
+			turn 		<= 0;
+			read_busy 	<= 0;
+			write_busy 	<= 0;
+		end else begin
+			turn <= ~turn;
+
+			// Cleared once the answer has been seen
+			read_busy  <= read_busy  & ~read_valid;
+			write_busy <= write_busy & ~write_ack;
+
+			if (read_taken) begin
+				mem_read_addr 	<= turn ? read_addr_b : read_addr_a;
+				mem_read 		<= 1;
+				mem_read_for 	<= turn;
+				read_busy[turn] <= 1;
+			end
+
+			if (mem_read) begin
+				mem_read_wait 	  <= 1;
+				mem_read_wait_for <= mem_read_for;
+			end
+
+			if (mem_read_wait) begin
+				read_data <= mem_read_data;
+				read_valid[mem_read_wait_for] <= 1;
+			end
+
+			if (write_taken) begin
+				mem_write_addr 	 <= turn ? write_addr_b : write_addr_a;
+				mem_write_data 	 <= turn ? write_data_b : write_data_a;
+				mem_write_enable <= 1;
+				write_ack[turn]  <= 1;
+				write_busy[turn] <= 1;
+			end
+		end
+	end
+endmodule
+
+`default_nettype wire
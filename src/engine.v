@@ -14,6 +14,11 @@ module dsp_engine #(
 		input wire [data_width - 1 : 0]  in_sample,
 		output reg [data_width - 1 : 0] out_sample,
 		
+		`ifdef CORE_STEREO
+		input wire [data_width - 1 : 0]  in_sample_r,
+		output reg [data_width - 1 : 0] out_sample_r,
+		`endif
+		
 		input wire sample_valid,
 		
 		input  wire [7:0] command_in,
@@ -25,6 +30,12 @@ module dsp_engine #(
 		output wire [$clog2(spi_fifo_length) : 0] fifo_count,
 
 		output wire current_pipeline,
+		
+		// For the I2S clocks; see top.v
+		output wire [2:0] sample_rate,
+		
+		// A low-latency frame's output wasn't in by the next frame
+		output reg deadline_miss,
 
 		output wire [7:0] out,
 		
@@ -43,18 +54,55 @@ module dsp_engine #(
 	/* Dual DSP piplines for atomic, artifact-free runtime DSP reconfiguration */
 	/***************************************************************************/
 	
+	localparam core_memory_size = 1024;
+	
+	// The pipelines' delay buffers come out of one pool, the size of both
+	// the memories they used to have to themselves. Stereo pipelines keep
+	// a pool per lane, each half the size, so the block RAM used is the
+	// same either way
+	`ifdef CORE_STEREO
+	localparam delay_pool_size 	= 16384;
+	`else
+	localparam delay_pool_size 	= 32768;
+	`endif
+	localparam delay_buffers 	= 16;
+	localparam delay_page_size 	= 128;
+	localparam delay_pool_pages = delay_pool_size / delay_page_size;
+	
     wire [7:0] byte_probe = current_pipeline ? byte_probe_b : byte_probe_a;
 	wire [7:0] byte_probe_a;
 	wire [7:0] byte_probe_b;
 	
-	dsp_pipeline #(.data_width(data_width), .n_blocks(n_blocks)) pipeline_a (
+	wire [15:0] cycles_per_sample [1:0];
+	
+	dsp_pipeline #(
+		.data_width(data_width),
+		.n_blocks(n_blocks),
+		.core_memory_size(core_memory_size),
+		.delay_mem_size(delay_pool_size),
+		.delay_buffers(delay_buffers),
+		.delay_page_size(delay_page_size)
+	) pipeline_a (
 		.clk(clk),
 		.reset(reset | pipeline_a_reset),
 		
-		.in_sample(in_sample_amped),
-		.in_valid(pipeline_tick),
+		.in_sample(pipeline_a_in_sample),
+		.in_valid(pipeline_a_tick),
 		.out_sample(out_samples[0]),
 		
+		`ifdef CORE_STEREO
+		.in_sample_r(pipeline_a_in_sample_r),
+		.out_sample_r(out_samples_r[0]),
+		`endif
+		
+		.pass_done(pass_done[0]),
+		.pass_sample(pass_samples[0]),
+		.pass_overrun(pass_overrun[0]),
+		
+		`ifdef CORE_STEREO
+		.pass_sample_r(pass_samples_r[0]),
+		`endif
+		
 		.ready(pipeline_a_ready),
 		.error(pipeline_a_error),
 		
@@ -68,30 +116,109 @@ module dsp_engine #(
 		.delay_size(delay_alloc_size),
 		.init_delay(delay_init_delay),
 		.reg_write(pipeline_a_block_reg_write),
+		.reg_ramp(block_reg_ramp[0]),
+		.ramp_length(ramp_length),
 		.reg_write_ack(reg_write_acks[0]),
 		.reg_update(pipeline_a_block_reg_update),
 		
 		.reg_writes_commit(pipeline_a_reg_writes_commit),
-		.regfile_syncing(pipeline_b_regfile_syncing),
+		.regfile_syncing(pipeline_a_regfile_syncing),
 	
 		.alloc_delay(pipeline_a_alloc_delay),
+		.free_delay(free_delay[0]),
+		.resize_delay(resize_delay[0]),
+		.delay_handle(delay_handle[$clog2(delay_buffers) - 1 : 0]),
+		.delays_busy(pipeline_delays_busy[0]),
+		.delay_alloc_failed(delay_alloc_failed[0]),
+		
+		.delay_pages_reserved(pipeline_a_delay_reserved),
+		.delay_live(!current_pipeline || mix_mode != `ENGINE_MODE_SWAP),
+		
+		.delay_mem_read_req	 (delay_pool_read_req[0]),
+		.delay_mem_read_addr (delay_pool_read_addr[0]),
+		.delay_mem_read_data (delay_pool_read_data),
+		.delay_mem_read_valid(delay_pool_read_valid[0]),
+		.delay_mem_write_req (delay_pool_write_req[0]),
+		.delay_mem_write_addr(delay_pool_write_addr[0]),
+		.delay_mem_write_data(delay_pool_write_data[0]),
+		.delay_mem_write_ack (delay_pool_write_ack[0]),
+		
+		`ifdef CORE_STEREO
+		.delay_r_mem_read_req  (delay_pool_r_read_req[0]),
+		.delay_r_mem_read_addr (delay_pool_r_read_addr[0]),
+		.delay_r_mem_read_data (delay_pool_r_read_data),
+		.delay_r_mem_read_valid(delay_pool_r_read_valid[0]),
+		.delay_r_mem_write_req (delay_pool_r_write_req[0]),
+		.delay_r_mem_write_addr(delay_pool_r_write_addr[0]),
+		.delay_r_mem_write_data(delay_pool_r_write_data[0]),
+		.delay_r_mem_write_ack (delay_pool_r_write_ack[0]),
+		`endif
 		
 		.full_reset(pipeline_a_full_reset),
 		.enable(pipeline_a_enable),
 		
 		.resetting(pipeline_a_resetting),
 		
+		.clone(pipeline_clone[0]),
+		.clone_mem(clone_mem),
+		.clone_delays(clone_delays),
+		.cloning(pipeline_a_cloning),
+		
+		.clone_block_addr(snoop_block_addr[1]),
+		.clone_instr(snoop_instr[1]),
+		.clone_regs(snoop_regs[1]),
+		.clone_n_blocks(snoop_n_blocks[1]),
+		.clone_mem_addr(snoop_mem_addr[0]),
+		.clone_mem_val(snoop_mem_val[1]),
+		
+		.snoop_block_addr(snoop_block_addr[0]),
+		.snoop_instr(snoop_instr[0]),
+		.snoop_regs(snoop_regs[0]),
+		.snoop_n_blocks(snoop_n_blocks[0]),
+		.snoop_mem_addr(snoop_mem_addr[1]),
+		.snoop_mem_val(snoop_mem_val[0]),
+		
+		.clone_delay_handle(snoop_delay_handle[1]),
+		.clone_delay_info(snoop_delay_info[1]),
+		.clone_delay_initd(snoop_delay_initd[1]),
+		
+		.snoop_delay_handle(snoop_delay_handle[0]),
+		.snoop_delay_info(snoop_delay_info[0]),
+		.snoop_delay_pages(snoop_delay_pages[0]),
+		.snoop_delay_initd(snoop_delay_initd[0]),
+		
+		.cycles_per_sample(cycles_per_sample[0]),
 		.byte_probe(byte_probe_a)
 	);
 	
-	dsp_pipeline #(.data_width(data_width), .n_blocks(n_blocks)) pipeline_b (
+	dsp_pipeline #(
+		.data_width(data_width),
+		.n_blocks(n_blocks),
+		.core_memory_size(core_memory_size),
+		.delay_mem_size(delay_pool_size),
+		.delay_buffers(delay_buffers),
+		.delay_page_size(delay_page_size)
+	) pipeline_b (
 		.clk(clk),
 		.reset(reset | pipeline_b_reset),
 		
-		.in_sample(in_sample_amped),
-		.in_valid(pipeline_tick),
+		.in_sample(pipeline_b_in_sample),
+		.in_valid(pipeline_b_tick),
 		.out_sample(out_samples[1]),
 		
+		`ifdef CORE_STEREO
+		.in_sample_r(pipeline_b_in_sample_r),
+		.out_sample_r(out_samples_r[1]),
+		`endif
+		
+		.pass_done(pass_done[1]),
+		.pass_sample(pass_samples[1]),
+		.pass_overrun(pass_overrun[1]),
+		
+		`ifdef CORE_STEREO
+		.pass_sample_r(pass_samples_r[1]),
+		`endif
+		
 		.ready(pipeline_b_ready),
 		.error(pipeline_b_error),
 		
@@ -105,21 +232,191 @@ module dsp_engine #(
 		.delay_size(delay_alloc_size),
 		.init_delay(delay_init_delay),
 		.reg_write(pipeline_b_block_reg_write),
+		.reg_ramp(block_reg_ramp[1]),
+		.ramp_length(ramp_length),
 		.reg_update(pipeline_b_block_reg_update),
 		
 		.reg_writes_commit(pipeline_b_reg_writes_commit),
-		.regfile_syncing(pipeline_a_regfile_syncing),
+		.regfile_syncing(pipeline_b_regfile_syncing),
 	
 		.alloc_delay(pipeline_b_alloc_delay),
+		.free_delay(free_delay[1]),
+		.resize_delay(resize_delay[1]),
+		.delay_handle(delay_handle[$clog2(delay_buffers) - 1 : 0]),
+		.delays_busy(pipeline_delays_busy[1]),
+		.delay_alloc_failed(delay_alloc_failed[1]),
+		
+		.delay_pages_reserved(pipeline_b_delay_reserved),
+		.delay_live(current_pipeline || mix_mode != `ENGINE_MODE_SWAP),
+		
+		.delay_mem_read_req	 (delay_pool_read_req[1]),
+		.delay_mem_read_addr (delay_pool_read_addr[1]),
+		.delay_mem_read_data (delay_pool_read_data),
+		.delay_mem_read_valid(delay_pool_read_valid[1]),
+		.delay_mem_write_req (delay_pool_write_req[1]),
+		.delay_mem_write_addr(delay_pool_write_addr[1]),
+		.delay_mem_write_data(delay_pool_write_data[1]),
+		.delay_mem_write_ack (delay_pool_write_ack[1]),
+		
+		`ifdef CORE_STEREO
+		.delay_r_mem_read_req  (delay_pool_r_read_req[1]),
+		.delay_r_mem_read_addr (delay_pool_r_read_addr[1]),
+		.delay_r_mem_read_data (delay_pool_r_read_data),
+		.delay_r_mem_read_valid(delay_pool_r_read_valid[1]),
+		.delay_r_mem_write_req (delay_pool_r_write_req[1]),
+		.delay_r_mem_write_addr(delay_pool_r_write_addr[1]),
+		.delay_r_mem_write_data(delay_pool_r_write_data[1]),
+		.delay_r_mem_write_ack (delay_pool_r_write_ack[1]),
+		`endif
 
 		.full_reset(pipeline_b_full_reset),
 		.enable(pipeline_b_enable),
 		
 		.resetting(pipeline_b_resetting),
 		
+		.clone(pipeline_clone[1]),
+		.clone_mem(clone_mem),
+		.clone_delays(clone_delays),
+		.cloning(pipeline_b_cloning),
+		
+		.clone_block_addr(snoop_block_addr[0]),
+		.clone_instr(snoop_instr[0]),
+		.clone_regs(snoop_regs[0]),
+		.clone_n_blocks(snoop_n_blocks[0]),
+		.clone_mem_addr(snoop_mem_addr[1]),
+		.clone_mem_val(snoop_mem_val[0]),
+		
+		.snoop_block_addr(snoop_block_addr[1]),
+		.snoop_instr(snoop_instr[1]),
+		.snoop_regs(snoop_regs[1]),
+		.snoop_n_blocks(snoop_n_blocks[1]),
+		.snoop_mem_addr(snoop_mem_addr[0]),
+		.snoop_mem_val(snoop_mem_val[1]),
+		
+		.clone_delay_handle(snoop_delay_handle[0]),
+		.clone_delay_info(snoop_delay_info[0]),
+		.clone_delay_initd(snoop_delay_initd[0]),
+		
+		.snoop_delay_handle(snoop_delay_handle[1]),
+		.snoop_delay_info(snoop_delay_info[1]),
+		.snoop_delay_pages(snoop_delay_pages[1]),
+		.snoop_delay_initd(snoop_delay_initd[1]),
+		
+		.cycles_per_sample(cycles_per_sample[1]),
 		.byte_probe(byte_probe_b)
 	);
 	
+	/***********************************************/
+	/* Delay memory, pooled between both pipelines */
+	/***********************************************/
+	
+	localparam delay_pool_addr_width = $clog2(delay_pool_size);
+	
+	wire [1:0] delay_pool_read_req;
+	wire [delay_pool_addr_width - 1 : 0] delay_pool_read_addr [1:0];
+	wire [data_width - 1 : 0] delay_pool_read_data;
+	wire [1:0] delay_pool_read_valid;
+	wire [1:0] delay_pool_write_req;
+	wire [delay_pool_addr_width - 1 : 0] delay_pool_write_addr [1:0];
+	wire [data_width - 1 : 0] delay_pool_write_data [1:0];
+	wire [1:0] delay_pool_write_ack;
+	
+	delay_pool #(.data_width(data_width), .memory_size(delay_pool_size)) delay_pool (
+		.clk(clk),
+		.reset(reset),
+		
+		.read_req(delay_pool_read_req),
+		.read_addr_a(delay_pool_read_addr[0]),
+		.read_addr_b(delay_pool_read_addr[1]),
+		.read_data(delay_pool_read_data),
+		.read_valid(delay_pool_read_valid),
+		
+		.write_req(delay_pool_write_req),
+		.write_addr_a(delay_pool_write_addr[0]),
+		.write_addr_b(delay_pool_write_addr[1]),
+		.write_data_a(delay_pool_write_data[0]),
+		.write_data_b(delay_pool_write_data[1]),
+		.write_ack(delay_pool_write_ack)
+	);
+	
+	`ifdef CORE_STEREO
+	wire [1:0] delay_pool_r_read_req;
+	wire [delay_pool_addr_width - 1 : 0] delay_pool_r_read_addr [1:0];
+	wire [data_width - 1 : 0] delay_pool_r_read_data;
+	wire [1:0] delay_pool_r_read_valid;
+	wire [1:0] delay_pool_r_write_req;
+	wire [delay_pool_addr_width - 1 : 0] delay_pool_r_write_addr [1:0];
+	wire [data_width - 1 : 0] delay_pool_r_write_data [1:0];
+	wire [1:0] delay_pool_r_write_ack;
+	
+	delay_pool #(.data_width(data_width), .memory_size(delay_pool_size)) delay_pool_r (
+		.clk(clk),
+		.reset(reset),
+		
+		.read_req(delay_pool_r_read_req),
+		.read_addr_a(delay_pool_r_read_addr[0]),
+		.read_addr_b(delay_pool_r_read_addr[1]),
+		.read_data(delay_pool_r_read_data),
+		.read_valid(delay_pool_r_read_valid),
+		
+		.write_req(delay_pool_r_write_req),
+		.write_addr_a(delay_pool_r_write_addr[0]),
+		.write_addr_b(delay_pool_r_write_addr[1]),
+		.write_data_a(delay_pool_r_write_data[0]),
+		.write_data_b(delay_pool_r_write_data[1]),
+		.write_ack(delay_pool_r_write_ack)
+	);
+	`endif
+	
+	// Only the back pipeline allocates, and only while it's programmed,
+	// when the front one's pages don't change; the controller has them
+	// taken as the partition when programming starts. After a swap the
+	// old front pipeline is reset, so its pages are back in the pool for
+	// the next program, and a program running alone can have the lot
+	wire set_delay_partition;
+	
+	reg [delay_pool_pages - 1 : 0] delay_partition /* verilator public_flat_rd */;
+	
+	always @(posedge clk) begin
+		if (reset)
+			delay_partition <= 0;
+		else if (set_delay_partition)
+			delay_partition <= snoop_delay_pages[current_pipeline];
+	end
+	
+	wire [delay_pool_pages - 1 : 0] pipeline_a_delay_reserved = ( current_pipeline) ? delay_partition : 0;
+	wire [delay_pool_pages - 1 : 0] pipeline_b_delay_reserved = (~current_pipeline) ? delay_partition : 0;
+	
+	// For the harness: what each pipeline holds, and buffers that
+	// couldn't be placed
+	wire [delay_pool_pages - 1 : 0] delay_pages_a /* verilator public_flat_rd */ = snoop_delay_pages[0];
+	wire [delay_pool_pages - 1 : 0] delay_pages_b /* verilator public_flat_rd */ = snoop_delay_pages[1];
+	
+	wire [1:0] delay_alloc_failed;
+	reg [15:0] delay_alloc_failures /* verilator public_flat_rd */;
+	
+	always @(posedge clk) begin
+		if (reset)
+			delay_alloc_failures <= 0;
+		else if (|delay_alloc_failed)
+			delay_alloc_failures <= delay_alloc_failures + 1;
+	end
+	
+	// In series mode the back pipeline runs the second half of the
+	// program on the front pipeline's output, one tick behind it
+	wire series = (engine_mode == `ENGINE_MODE_SERIES);
+	
+	wire signed [data_width - 1 : 0] pipeline_a_in_sample = (series &&  current_pipeline) ? out_samples[1] : in_sample_amped;
+	wire signed [data_width - 1 : 0] pipeline_b_in_sample = (series && !current_pipeline) ? out_samples[0] : in_sample_amped;
+	
+	`ifdef CORE_STEREO
+	wire signed [data_width - 1 : 0] pipeline_a_in_sample_r = (series &&  current_pipeline) ? out_samples_r[1] : in_sample_amped_r;
+	wire signed [data_width - 1 : 0] pipeline_b_in_sample_r = (series && !current_pipeline) ? out_samples_r[0] : in_sample_amped_r;
+	`endif
+	
+	wire pipeline_a_tick = (series &&  current_pipeline) ? pipeline_tick_r : pipeline_tick;
+	wire pipeline_b_tick = (series && !current_pipeline) ? pipeline_tick_r : pipeline_tick;
+	
 	/**********************************************************/
 	/* Mixer; applies input/output gain, crossfades pipelines */
 	/**********************************************************/
@@ -131,11 +428,21 @@ module dsp_engine #(
 		.in_sample(in_sample_latched),
 		.in_sample_out(in_sample_amped),
 		
-		.out_sample_in_a(out_samples[0]),
-		.out_sample_in_b(out_samples[1]),
+		.out_sample_in_a(direct ? pass_samples[0] : out_samples[0]),
+		.out_sample_in_b(direct ? pass_samples[1] : out_samples[1]),
 		
 		.out_sample(out_sample_mixed),
 		
+		`ifdef CORE_STEREO
+		.in_sample_r(in_sample_latched_r),
+		.in_sample_out_r(in_sample_amped_r),
+		
+		.out_sample_in_a_r(direct ? pass_samples_r[0] : out_samples_r[0]),
+		.out_sample_in_b_r(direct ? pass_samples_r[1] : out_samples_r[1]),
+		
+		.out_sample_r(out_sample_mixed_r),
+		`endif
+		
 		.data_in(ctrl_data_out),
 		
 		.in_sample_valid(apply_input_gain),
@@ -149,14 +456,17 @@ module dsp_engine #(
 		
 		.swap_pipelines(swap_pipelines),
 		.pipelines_swapping(pipelines_swapping),
-		.current_pipeline(current_pipeline)
+		.current_pipeline(current_pipeline),
+		
+		.mix_mode(mix_mode),
+		.set_mix_mode(set_mix_mode)
 	);
 	
 	/********************************************************/
 	/* Health monitor; reports busted configs/DSP disasters */
 	/********************************************************/
 	
-	wire health;
+	wire health /* verilator public_flat_rd */;
 	wire peak_detect;
 	wire envl_detect;
 	
@@ -178,6 +488,42 @@ module dsp_engine #(
 		.envl_detect(envl_detect)
 	);
 	
+	/*************************************************/
+	/* Telemetry; levels and timing streamed on MISO */
+	/*************************************************/
+	
+	wire telemetry_enable;
+	wire [7:0] telemetry_byte;
+	wire [7:0] control_byte_out;
+	
+	telemetry #(.data_width(data_width)) telemetry (
+		.clk(clk),
+		.reset(reset),
+		
+		.enable(telemetry_enable),
+		
+		.sample_valid(in_sample_valid),
+		
+		.in_sample_a(pipeline_a_in_sample),
+		.out_sample_a(out_samples[0]),
+		.in_sample_b(pipeline_b_in_sample),
+		.out_sample_b(out_samples[1]),
+		.out_sample(out_sample),
+		
+		.cycles_a(cycles_per_sample[0]),
+		.cycles_b(cycles_per_sample[1]),
+		
+		.current_pipeline(current_pipeline),
+		.health(health),
+		.sample_rate(sample_rate),
+		
+		.next(command_in_valid),
+		
+		.byte_out(telemetry_byte)
+	);
+	
+	assign spi_byte_out = telemetry_enable ? telemetry_byte : control_byte_out;
+	
 	/*****************/
 	/*****************/
 	/* Input/control */
@@ -224,10 +570,17 @@ module dsp_engine #(
 		
 		.block_instr_write(block_instr_write),
 		.block_reg_write(block_reg_write),
+		.block_reg_ramp(block_reg_ramp),
+		.ramp_length_out(ramp_length),
 		
 		.reg_writes_commit(reg_writes_commit),
 		
 		.alloc_delay(alloc_delay),
+		.free_delay(free_delay),
+		.resize_delay(resize_delay),
+		.delay_handle_out(delay_handle),
+		.pipeline_delays_busy(pipeline_delays_busy),
+		.set_delay_partition(set_delay_partition),
 		.delay_size_out(delay_alloc_size),
 		.init_delay_out(delay_init_delay),
 		
@@ -238,9 +591,24 @@ module dsp_engine #(
 		.pipeline_full_reset(pipeline_full_reset),
 		.pipeline_resetting(pipeline_resetting),
 		.pipeline_enables(pipeline_enables),
+		.pipeline_overruns(pass_overrun),
+		
+		.pipeline_clone(pipeline_clone),
+		.clone_mem(clone_mem),
+		.clone_delays(clone_delays),
+		.pipeline_cloning(pipeline_cloning),
+		
+		.engine_mode(engine_mode),
+		.mix_mode(mix_mode),
+		.set_mix_mode(set_mix_mode),
+		
 		.set_input_gain(set_input_gain),
 		.set_output_gain(set_output_gain),
 		
+		.sample_rate(sample_rate),
+		.telemetry_enable(telemetry_enable),
+		.direct_enable(direct_enable),
+		
 		.invalid(invalid_command),
 		
 		.health(health),
@@ -249,57 +617,102 @@ module dsp_engine #(
 		
 		.control_state(control_state),
 		
-		.spi_byte_out(spi_byte_out)
+		.spi_byte_out(control_byte_out)
 	);
 	
-	/*******/
-	/* FSM */
-	/*******/
+	/********************/
+	/* Frame pipelining */
+	/********************/
+	
+	// Input gain, program pass and output mix are overlapped across
+	// frames rather than run back to back. The cores free-run, latching
+	// their previous pass's result as they take in a new sample on the
+	// tick, so the mix of frame N-1 can proceed while frame N is in the
+	// pipelines and frame N+1's input gain is applied.
+	//
+	// In low-latency mode the mix instead waits on this frame's passes,
+	// and goes out at the next lrclk, a frame sooner. That's the
+	// deadline: the mixed sample has to be in out_sample before the I2S
+	// latches it, as the next sample comes in. A frame that misses is
+	// dropped, so the last sample goes out again, rather than slipping
+	// the ones after it. Series mode, where the back pipeline runs a
+	// tick behind, goes on as before
+	wire direct = direct_enable & ~series;
+	
+	// The back pipeline's pass is waited on too while it's in the mix
+	wire direct_passes_done = pass_done_seen[current_pipeline]
+		& (pass_done_seen[~current_pipeline] | (~pipelines_swapping & (mix_mode == `ENGINE_MODE_SWAP)));
+	
 	always @(posedge clk) begin
 		pipeline_tick 		<= 0;
+		pipeline_tick_r 	<= 0;
 		
 		apply_input_gain 	<= 0;
 		mix_outputs			<= 0;
+		deadline_miss 		<= 0;
 		
-		case (state)
-			`ENGINE_STATE_READY: begin
-				if (sample_valid) begin
-					in_sample_latched <= in_sample;
-					apply_input_gain <= 1;
-					ready <= 0;
-				end
+		sample_valid_prev <= sample_valid;
+		out_sample_valid_prev <= out_sample_valid;
+		
+		if (reset) begin
+			ready <= 1;
+			
+			direct_waiting 	<= 0;
+			direct_pending 	<= 0;
+			direct_misses 	<= 0;
+		end else begin
+			if (sample_valid && !sample_valid_prev) begin
+				in_sample_latched <= in_sample;
+				`ifdef CORE_STEREO
+				in_sample_latched_r <= in_sample_r;
+				`endif
+				apply_input_gain <= 1;
+				ready <= 0;
 				
-				if (in_sample_valid) begin
-					apply_input_gain <= 0;
-					
-					sample_ctr <= sample_ctr + 1;
-					pipeline_tick <= 1;	
-					
-					ready <= 0;
-					state <= `ENGINE_STATE_PROCESSING_WAIT;
+				// The I2S took out_sample as this came in, so a frame
+				// landing now, or still to land, has missed it
+				if (direct && (direct_pending | out_sample_valid_prev)) begin
+					deadline_miss <= 1;
+					direct_misses <= direct_misses + 1;
 				end
+				
+				direct_waiting <= 0;
+				direct_pending <= 0;
 			end
 			
-			`ENGINE_STATE_PROCESSING_WAIT: begin
-				state <= `ENGINE_STATE_PROCESSING;
+			if (in_sample_valid) begin
+				sample_ctr <= sample_ctr + 1;
+				pipeline_tick <= 1;
 			end
 			
-			`ENGINE_STATE_PROCESSING: begin
-				if (pipeline_a_ready && pipeline_b_ready) begin
-					mix_outputs <= 1;
-					
-					state <= `ENGINE_STATE_MIXING;
-				end
+			// Pipeline outputs are latched on the tick
+			pipeline_tick_r <= pipeline_tick;
+			
+			if (pipeline_tick_r && !direct)
+				mix_outputs <= 1;
+			
+			if (pipeline_tick && direct) begin
+				pass_done_seen <= 0;
+				direct_waiting <= 1;
+				direct_pending <= 1;
+			end else begin
+				pass_done_seen <= pass_done_seen | pass_done;
 			end
 			
-			`ENGINE_STATE_MIXING: begin
-				if (out_sample_valid) begin
-					out_sample <= out_sample_mixed;
-					ready <= 1;
-					state <= `ENGINE_STATE_READY;
-				end
+			if (direct_waiting && direct_passes_done) begin
+				mix_outputs <= 1;
+				direct_waiting <= 0;
 			end
-		endcase
+			
+			if (out_sample_valid && (!direct || direct_pending)) begin
+				out_sample <= out_sample_mixed;
+				`ifdef CORE_STEREO
+				out_sample_r <= out_sample_mixed_r;
+				`endif
+				ready <= 1;
+				direct_pending <= 0;
+			end
+		end
 	end
 	
 	/**********/
@@ -309,7 +722,28 @@ module dsp_engine #(
 	reg  signed [data_width - 1 : 0]  in_sample_latched;
 	wire signed [data_width - 1 : 0]  in_sample_amped;
 	wire signed [data_width - 1 : 0] out_samples [1:0];
+	wire signed [data_width - 1 : 0] pass_samples [1:0];
 	wire signed [data_width - 1 : 0] out_sample_mixed;
+	
+	`ifdef CORE_STEREO
+	reg  signed [data_width - 1 : 0]  in_sample_latched_r;
+	wire signed [data_width - 1 : 0]  in_sample_amped_r;
+	wire signed [data_width - 1 : 0] out_samples_r [1:0];
+	wire signed [data_width - 1 : 0] pass_samples_r [1:0];
+	wire signed [data_width - 1 : 0] out_sample_mixed_r;
+	`endif
+	
+	wire [1:0] pass_done;
+	wire [1:0] pass_overrun;
+	reg  [1:0] pass_done_seen = 0;
+	
+	wire direct_enable;
+	reg direct_waiting = 0;
+	reg direct_pending = 0;
+	reg out_sample_valid_prev = 0;
+	
+	// Frames low-latency mode has dropped, for the testbench
+	reg [15:0] direct_misses /* verilator public_flat_rd */ = 0;
 
 	wire in_valid;
 
@@ -319,20 +753,47 @@ module dsp_engine #(
 	wire pipeline_a_error;
 	wire pipeline_b_error;
 
-	wire pipelines_swapping;
+	wire pipelines_swapping /* verilator public_flat_rd */;
 
 	wire [1:0] block_instr_write;
 	wire [1:0] block_reg_write;
 	wire [1:0] block_reg_update;
+	wire [1:0] block_reg_ramp;
+	wire [15:0] ramp_length;
 	wire [1:0] reg_writes_commit;
 	wire [1:0] alloc_delay;
 	wire [1:0] pipeline_reset;
 	wire [1:0] pipeline_full_reset;
 	wire [1:0] pipeline_enables;
 	wire [1:0] pipeline_resetting;
-	wire [1:0] pipeline_regfiles_syncing;
+	wire [1:0] pipeline_regfiles_syncing /* verilator public_flat_rd */;
+	wire [1:0] pipeline_clone;
+	wire [1:0] pipeline_cloning;
+	wire clone_mem;
+	wire clone_delays;
+	
+	wire [1:0] free_delay;
+	wire [1:0] resize_delay;
+	wire [7:0] delay_handle;
+	wire [1:0] pipeline_delays_busy /* verilator public_flat_rd */;
+	
+	wire [$clog2(n_blocks) - 1 : 0] snoop_block_addr [1:0];
+	wire [31 				   : 0] snoop_instr		 [1:0];
+	wire [2 * data_width   - 1 : 0] snoop_regs		 [1:0];
+	wire [$clog2(n_blocks) 	   : 0] snoop_n_blocks	 [1:0];
+	wire [$clog2(core_memory_size) - 1 : 0] snoop_mem_addr	 [1:0];
+	wire [data_width 	   - 1 : 0] snoop_mem_val	 [1:0];
+	
+	// The other pipeline's delay table is read by handle, a handle a cycle
+	wire [$clog2(delay_buffers) 		- 1 : 0] snoop_delay_handle [1:0];
+	wire [3 * $clog2(delay_pool_size) + 8 - 1 : 0] snoop_delay_info  [1:0];
+	wire [delay_pool_pages 				- 1 : 0] snoop_delay_pages [1:0];
+	wire [delay_buffers 				- 1 : 0] snoop_delay_initd  [1:0];
 
 	reg pipeline_tick = 0;
+	reg pipeline_tick_r = 0;
+	
+	reg sample_valid_prev = 0;
 
 	wire [$clog2(n_blocks) - 1 : 0] block_target;
 	wire reg_target;
@@ -340,18 +801,22 @@ module dsp_engine #(
 	wire [data_width 		 - 1 : 0] ctrl_data_out;
 	wire [`BLOCK_INSTR_WIDTH - 1 : 0] ctrl_instr_out;
 
-	wire swap_pipelines;
+	wire swap_pipelines /* verilator public_flat_rd */;
 	wire controller_ready;
+	
+	wire [1:0] engine_mode;
+	wire [1:0] mix_mode;
+	wire set_mix_mode;
 
 	reg  ctrl_inp_ready = 0;
 	wire ctrl_inp_req;
 	wire ctrl_inp_ack;
 
-	wire [7:0] command_byte;
+	wire [7:0] command_byte /* verilator public_flat_rd */;
 	wire inp_fifo_nonempty;
 	wire inp_fifo_full;
 
-	wire inp_fifo_next;
+	wire inp_fifo_next /* verilator public_flat_rd */;
 
 	reg [63 : 0] sample_ctr = 0;
 
@@ -362,8 +827,6 @@ module dsp_engine #(
 	wire in_sample_valid;
 	wire out_sample_valid;
 
-	reg [7:0] state = `ENGINE_STATE_READY;
-
 	reg inp_fifo_waiting = 0;
 
 	wire [1:0] reg_write_acks;
@@ -383,6 +846,7 @@ module dsp_engine #(
 	wire pipeline_a_enable 				= pipeline_enables 		[0];
 	wire pipeline_a_full_reset 			= pipeline_full_reset	[0];
 	wire pipeline_a_resetting;
+	wire pipeline_a_cloning;
 	wire pipeline_a_reset	 			= pipeline_reset		[0];
 
 	wire pipeline_b_block_instr_write 	= block_instr_write		[1];
@@ -394,9 +858,11 @@ module dsp_engine #(
 	wire pipeline_b_enable 				= pipeline_enables 		[1];
 	wire pipeline_b_full_reset 			= pipeline_full_reset	[1];
 	wire pipeline_b_resetting;
+	wire pipeline_b_cloning;
 	wire pipeline_b_reset	 			= pipeline_reset		[1];
 	
 	assign pipeline_resetting = {pipeline_b_resetting, pipeline_a_resetting};
+	assign pipeline_cloning   = {pipeline_b_cloning,   pipeline_a_cloning};
 	assign pipeline_regfiles_syncing = {pipeline_b_regfile_syncing, pipeline_a_regfile_syncing};
 endmodule
 
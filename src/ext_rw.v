@@ -36,8 +36,8 @@ module resource_branch #(parameter data_width = 16, parameter handle_width = 8,
 		input wire read_valid,
 		input wire write_ack,
 		
-		input wire [3:0] dest_in,
-		output reg [3:0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		output reg signed [full_width - 1 : 0] result_out,
 		
@@ -57,7 +57,7 @@ module resource_branch #(parameter data_width = 16, parameter handle_width = 8,
 	
 	reg [$clog2(n_blocks) - 1 : 0] block_latched;
 	reg [`COMMIT_ID_WIDTH - 1 : 0] commit_id_latched;
-	reg [3:0] dest_latched;
+	reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_latched;
 	reg write_latched;
 	reg [1:0] state;
 	
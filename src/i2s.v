@@ -16,6 +16,7 @@ module i2s_trx #(parameter sample_size = 16)
 	reg [sample_size-1:0] tx_l_latched;
 	reg [sample_size-1:0] tx_r_latched;
 
+	// Left in the lrclk-low slot, right in the high one
 	wire [sample_size-1:0] sample_out = lrclk_prev ? tx_r_latched : tx_l_latched;
 
 	reg lrclk_prev;
@@ -38,7 +39,9 @@ module i2s_trx #(parameter sample_size = 16)
 				
 				if (lrclk != lrclk_prev) begin
 					
-					if (lrclk) begin
+					// A frame is a low slot and then a high one, so both of
+					// its samples are in once lrclk falls again
+					if (~lrclk) begin
 						rx_l <= rx_sr[sample_size * 2 - 1 : sample_size];
 						rx_r <= rx_sr[sample_size * 1 - 1 : 0];
 
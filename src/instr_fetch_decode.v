@@ -507,6 +507,26 @@ module block_fetch_decode_stage #(parameter data_width = 16, parameter n_blocks
 	
 	wire in_ready_3;
 	
+	`ifdef SIM_FETCH_COUNTERS
+	// Cycles the decoder was free but had no block to take, and blocks
+	// it took; read out by the testbench
+	reg [31 : 0] fetch_bubbles /* verilator public_flat_rd */;
+	reg [31 : 0] fetch_blocks  /* verilator public_flat_rd */;
+	
+	always @(posedge clk) begin
+		if (reset) begin
+			fetch_bubbles <= 0;
+			fetch_blocks  <= 0;
+		end else if (enable && n_blocks_running != 0) begin
+			if (in_ready_3 & ~out_valid_2)
+				fetch_bubbles <= fetch_bubbles + 1;
+			
+			if (in_ready_3 & out_valid_2)
+				fetch_blocks <= fetch_blocks + 1;
+		end
+	end
+	`endif
+	
 	instr_decode_stage #(.data_width(data_width), .n_blocks(n_blocks)) decoder
 	(
 		.clk(clk),
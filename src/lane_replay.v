@@ -0,0 +1,57 @@
+`default_nettype none
+
+/*
+ * Sits between block fetch/decode and operand fetch in a stereo core.
+ * Each decoded block is taken in once and handed on twice, for the left
+ * lane and then the right, so fetch, decode and the register reads are
+ * paid for once a frame rather than once a lane. The two passes of a
+ * block don't depend on each other, so the right lane's can issue while
+ * the left's is still waiting on its operands further down.
+ */
+
+module lane_replay #(parameter payload_width = 64)
+	(
+		input wire clk,
+		input wire reset,
+
+		input wire enable,
+
+		input wire  in_valid,
+		output wire in_ready,
+
+		output reg out_valid,
+		input wire out_ready,
+
+		input wire [payload_width - 1 : 0] payload_in,
+		output reg [payload_width - 1 : 0] payload_out,
+
+		output reg lane
+	);
+
+	wire take_out = out_valid & out_ready;
+
+	// A new block goes in as the right lane of the last one goes out
+	assign in_ready = ~out_valid | (take_out & lane);
+
+	wire take_in = in_ready & in_valid;
+
+	always @(posedge clk) begin
+		if (reset) begin
+			out_valid <= 0;
+			lane <= 0;
+		end else if (enable) begin
+			if (take_in) begin
+				payload_out <= payload_in;
+				out_valid <= 1;
+				lane <= 0;
+			end else if (take_out) begin
+				if (lane)
+					out_valid <= 0;
+
+				lane <= ~lane;
+			end
+		end
+	end
+endmodule
+
+`default_nettype wire
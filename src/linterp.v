@@ -104,6 +104,7 @@ module sequential_interp #(parameter data_width = 16, parameter interp_bits = 3)
 			else if (busy) begin
 				if (index == 0) begin
 					interpolated <= interp_sum + (frac_latched[0] ? diff_latched : 0);
+					out_valid <= 1;
 					busy <= 0;
 				end
 				else begin
@@ -1,4 +1,5 @@
 `include "madd.vh"
+`include "core.vh"
 
 `default_nettype none
 
@@ -34,8 +35,8 @@ module multiply_stage #(parameter data_width = 16, parameter n_blocks = 256, par
 		input wire signed [data_width - 1 : 0] arg_c_in,
 		output reg signed [data_width - 1 : 0] arg_c_out,
 		
-		input wire [3:0] dest_in,
-		output reg [3:0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output reg [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -124,8 +125,8 @@ module shift_stage_1 #(parameter data_width = 16, parameter n_blocks = 256, para
 		input wire signed [data_width - 1 : 0] arg_c_in,
 		output reg signed [data_width - 1 : 0] arg_c_out,
 		
-		input wire [3:0] dest_in,
-		output reg [3:0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output reg [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -229,8 +230,8 @@ module shift_stage_2 #(parameter data_width = 16, parameter n_blocks = 256, para
 		input wire signed [data_width - 1 : 0] arg_c_in,
 		output reg signed [data_width - 1 : 0] arg_c_out,
 		
-		input wire [3:0] dest_in,
-		output reg [3:0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output reg [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -312,8 +313,8 @@ module add_stage #(parameter data_width = 16, parameter n_blocks = 256, paramete
 		
 		output reg signed [full_width - 1 : 0] result_out,
 		
-		input wire [3:0] dest_in,
-		output reg [3:0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output reg [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -371,8 +372,8 @@ module saturate_stage #(parameter data_width = 16, parameter n_blocks = 256, par
 		input wire signed [full_width - 1 : 0] result_in,
 		output reg signed [full_width - 1 : 0] result_out,
 		
-		input wire [3:0] dest_in,
-		output reg [3:0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		output reg out_valid,
 		input wire out_ready,
@@ -453,8 +454,8 @@ module mac_pipeline #(parameter data_width = 16, parameter n_blocks = 256, param
 		
 		output wire signed [full_width - 1 : 0] result_out,
 		
-		input  wire [3:0] dest_in,
-		output wire [3:0] dest_out,
+		input  wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input  wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -476,7 +477,7 @@ module mac_pipeline #(parameter data_width = 16, parameter n_blocks = 256, param
 	wire signed [data_width - 1 : 0] arg_c_out_muls;
 	wire signed [full_width - 1 : 0] product_out_muls;
 	wire signed [full_width - 1 : 0] accumulator_out_muls;
-	wire [3:0] dest_out_muls;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out_muls;
 	wire writes_accumulator_out_muls;
 	wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out_muls;
 	wire commit_flag_out_muls;
@@ -540,7 +541,7 @@ module mac_pipeline #(parameter data_width = 16, parameter n_blocks = 256, param
 	wire signed [data_width - 1 : 0] arg_c_out_sh1;
 	wire signed [full_width - 1 : 0] result_out_sh1;
 	wire signed [full_width - 1 : 0] accumulator_out_sh1;
-	wire [3:0] dest_out_sh1;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out_sh1;
 	wire writes_accumulator_out_sh1;
 	wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out_sh1;
 	wire commit_flag_out_sh1;
@@ -665,8 +666,8 @@ module madd_pipeline #(parameter data_width = 16, parameter n_blocks = 256, para
 		
 		output wire signed [full_width - 1 : 0] result_out,
 		
-		input  wire [3:0] dest_in,
-		output wire [3:0] dest_out,
+		input  wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input  wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -684,7 +685,7 @@ module madd_pipeline #(parameter data_width = 16, parameter n_blocks = 256, para
 	wire signed [full_width - 1 : 0] accumulator_out_mac;
 	wire signed [full_width - 1 : 0] result_out_mac;
 	wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out_mac;
-	wire [3:0] dest_out_mac;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out_mac;
 	wire commit_flag_out_mac;
 
 	mac_pipeline #(.data_width(data_width), .n_blocks(n_blocks), .full_width(full_width)) madd_main
@@ -733,7 +734,7 @@ module madd_pipeline #(parameter data_width = 16, parameter n_blocks = 256, para
 	wire in_ready_add;
 	wire out_valid_add;
 	wire [full_width - 1 : 0] result_out_add;
-	wire [3:0] dest_out_add;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out_add;
 	wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out_add;
 	wire commit_flag_out_add;
 
@@ -1,4 +1,5 @@
 `include "instr_dec.vh"
+`include "core.vh"
 
 `default_nettype none
 
@@ -58,8 +59,8 @@ module misc_branch_stage_1 #(parameter data_width = 16, parameter n_blocks = 256
 		input wire [4 : 0] shift_in,
 		output reg [4 : 0] shift_out,
 		
-		input wire [3 : 0] dest_in,
-		output reg [3 : 0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output reg [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -214,8 +215,8 @@ module misc_branch_stage_2 #(parameter data_width = 16, parameter n_blocks = 256
 		input wire [4 : 0] shift_in,
 		output reg [4 : 0] shift_out,
 		
-		input wire [3 : 0] dest_in,
-		output reg [3 : 0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output reg [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -229,10 +230,10 @@ module misc_branch_stage_2 #(parameter data_width = 16, parameter n_blocks = 256
 	wire take_in  = in_ready & in_valid;
 	wire take_out = out_valid & out_ready;
 
-	wire signed [data_width - 1 : 0] lsh_1 = shift_in[1] ? (arg_a_in << 2) : arg_a_in;
+	wire signed [data_width - 1 : 0] lsh_1 = shift_in[1] ? (lsh_in << 2) : lsh_in;
 	wire signed [data_width - 1 : 0] lsh_2 = shift_in[0] ? (lsh_1	<< 1) : lsh_1;
 
-	wire [data_width - 1 : 0] rsh_1 = shift_in[1] ? (arg_a_in >> 2) : arg_a_in;
+	wire [data_width - 1 : 0] rsh_1 = shift_in[1] ? (rsh_in >> 2) : rsh_in;
 	wire [data_width - 1 : 0] rsh_2 = shift_in[0] ? (rsh_1	>> 1) : rsh_1;
 
 	always @(posedge clk) begin
@@ -342,8 +343,8 @@ module misc_branch_stage_3 #(parameter data_width = 16, parameter n_blocks = 256
 		input wire saturate_disable_in,
 		input wire [4 : 0] shift_in,
 		
-		input wire [3 : 0] dest_in,
-		output reg [3 : 0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_in,
 		output reg [`COMMIT_ID_WIDTH - 1 : 0] commit_id_out,
@@ -436,8 +437,8 @@ module misc_branch #(parameter data_width = 16, parameter n_blocks = 256, parame
 		input wire saturate_disable_in,
 		input wire [4 : 0] shift_in,
 		
-		input  wire [3 : 0] dest_in,
-		output wire [3 : 0] dest_out,
+		input  wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		output wire signed [full_width - 1 : 0] result_out,
 		
@@ -477,7 +478,7 @@ module misc_branch #(parameter data_width = 16, parameter n_blocks = 256, parame
 	wire saturate_disable_1_out;
 	wire shift_disable_1_out;
 	wire [4 : 0] shift_1_out;
-	wire [3 : 0] dest_1_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_1_out;
 	wire signed [full_width - 1 : 0] result_1_out;
 	wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_1_out;
 	wire commit_flag_1_out;
@@ -561,7 +562,7 @@ module misc_branch #(parameter data_width = 16, parameter n_blocks = 256, parame
 	wire saturate_disable_2_out;
 	wire shift_disable_2_out;
 	wire [4 : 0] shift_2_out;
-	wire [3 : 0] dest_2_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_2_out;
 	wire signed [full_width - 1 : 0] result_2_out;
 	wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_2_out;
 	wire commit_flag_2_out;
@@ -621,7 +622,7 @@ module misc_branch #(parameter data_width = 16, parameter n_blocks = 256, parame
 		.clamp_in(clamp_1_out),
 		.clamp_out(clamp_2_out),
 		
-		.saturate_disable_in(saturate_disable_in),
+		.saturate_disable_in(saturate_disable_1_out),
 		.saturate_disable_out(saturate_disable_2_out),
 		.shift_in(shift_1_out),
 		.shift_out(shift_2_out),
@@ -642,7 +643,7 @@ module misc_branch #(parameter data_width = 16, parameter n_blocks = 256, parame
 	wire [4 : 0] operation_3_out;
 	wire saturate_disable_3_out;
 	wire [4 : 0] shift_3_out;
-	wire [3 : 0] dest_3_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_3_out;
 	wire signed [full_width - 1 : 0] result_3_out;
 	wire [`COMMIT_ID_WIDTH - 1 : 0] commit_id_3_out;
 	wire commit_flag_3_out;
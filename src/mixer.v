@@ -1,3 +1,6 @@
+`include "core.vh"
+`include "engine.vh"
+
 `define MIXER_STATE_READY		 		0
 `define MIXER_APPLY_INPUT_GAIN_1 		1
 `define MIXER_APPLY_INPUT_GAIN_2 		2
@@ -10,10 +13,23 @@
 `define MIXER_APPLY_OUTPUT_GAIN_2 		9
 `define MIXER_APPLY_OUTPUT_GAIN_3 		10
 `define MIXER_APPLY_OUTPUT_GAIN_DONE 	11
-`define MIXER_REST				 		12
 
 `default_nettype none
 
+/*
+ * The input and output paths have a multiplier each and
+ * run independently, so that frame N's input gain can be
+ * applied while frame N-1's pipeline outputs are being mixed.
+ *
+ * The per-pipeline output gains ramp towards a target pair;
+ * a swap targets the back pipeline alone, while the split
+ * modes keep both pipelines in the mix.
+ *
+ * Built stereo, each path goes round twice a frame, left
+ * lane then right, on the same multipliers; the crossfade
+ * steps on the left pass, so both lanes share its gains.
+ */
+
 module mixer #(parameter data_width = 16, parameter gain_shift = 4) (
 		input wire clk,
 		input wire reset,
@@ -26,6 +42,16 @@ module mixer #(parameter data_width = 16, parameter gain_shift = 4) (
 		
 		output reg signed [data_width - 1 : 0] out_sample,
 		
+		`ifdef CORE_STEREO
+		input wire signed [data_width - 1 : 0] in_sample_r,
+		output reg signed [data_width - 1 : 0] in_sample_out_r,
+		
+		input wire signed [data_width - 1 : 0] out_sample_in_a_r,
+		input wire signed [data_width - 1 : 0] out_sample_in_b_r,
+		
+		output reg signed [data_width - 1 : 0] out_sample_r,
+		`endif
+		
 		input wire [data_width - 1 : 0] data_in,
 		
 		input wire in_sample_valid,
@@ -39,7 +65,10 @@ module mixer #(parameter data_width = 16, parameter gain_shift = 4) (
 		
 		input wire swap_pipelines,
 		output reg pipelines_swapping,
-		input wire current_pipeline
+		input wire current_pipeline,
+		
+		input wire [1:0] mix_mode,
+		input wire set_mix_mode
 	);
 	
 	/* All gains herein are stored as q5.n */
@@ -54,6 +83,19 @@ module mixer #(parameter data_width = 16, parameter gain_shift = 4) (
 	reg [data_width - 1 : 0] output_b_gain;
 	reg [data_width - 1 : 0] output_gain;
 	
+	/* Input path multiplier */
+	reg signed [data_width - 1 : 0] mul_arg_ia;
+	reg signed [data_width - 1 : 0] mul_arg_ib;
+	
+	wire signed [2 * data_width - 1 : 0] prod_i = mul_arg_ia * mul_arg_ib;
+	
+	reg signed [2 * data_width - 1 : 0] prod_i_latched;
+
+	wire signed [2 * data_width - 1 : 0] prod_i_shifted = $signed(prod_i_latched) >>> (data_width - 1 - gain_shift);
+	wire signed [2 * data_width - 1 : 0] prod_i_shifted_sat = (prod_i_shifted > sat_max) ? sat_max : ((prod_i_shifted < sat_min) ? sat_min : prod_i_shifted);
+	wire signed [	 data_width - 1 : 0] prod_i_final = prod_i_shifted_sat[data_width - 1 : 0];
+	
+	/* Output path multipliers */
 	reg signed [data_width - 1 : 0] mul_arg_aa;
 	reg signed [data_width - 1 : 0] mul_arg_ab;
 	
@@ -79,146 +121,229 @@ module mixer #(parameter data_width = 16, parameter gain_shift = 4) (
 	wire signed [data_width - 1 : 0] prod_sum = prod_a_final + prod_b_final;
 	wire signed [data_width - 1 : 0] prod_sum_final = (prod_sum > sat_max_dw) ? sat_max_dw : ((prod_sum < sat_min_dw) ? sat_min_dw : prod_sum);
 	
-	reg [7:0] state = 0;
+	reg [7:0] in_state  = `MIXER_STATE_READY;
+	reg [7:0] out_state = `MIXER_STATE_READY;
+	
+	// Which lane each path is on; a path starts its right lane's pass
+	// as soon as it's done with the left's
+	`ifdef CORE_STEREO
+	reg in_lane  = 0;
+	reg out_lane = 0;
+	
+	localparam last_lane = 1'b1;
+	
+	wire in_start  = in_sample_valid   | in_lane;
+	wire out_start = out_samples_valid | out_lane;
+	
+	wire signed [data_width - 1 : 0] in_sample_lane 	 = in_lane  ? in_sample_r 		: in_sample;
+	wire signed [data_width - 1 : 0] out_sample_in_a_lane = out_lane ? out_sample_in_a_r : out_sample_in_a;
+	wire signed [data_width - 1 : 0] out_sample_in_b_lane = out_lane ? out_sample_in_b_r : out_sample_in_b;
+	`else
+	wire in_lane  = 0;
+	wire out_lane = 0;
+	
+	localparam last_lane = 1'b0;
+	
+	wire in_start  = in_sample_valid;
+	wire out_start = out_samples_valid;
+	
+	wire signed [data_width - 1 : 0] in_sample_lane 	 = in_sample;
+	wire signed [data_width - 1 : 0] out_sample_in_a_lane = out_sample_in_a;
+	wire signed [data_width - 1 : 0] out_sample_in_b_lane = out_sample_in_b;
+	`endif
 	
 	localparam [data_width - 1 : 0] unity_gain = 1 << (data_width - 1 - gain_shift);
 	localparam [data_width - 1 : 0] switch_velocity = unity_gain >> 7;
 	
-	reg target_pipeline = 0;
+	reg [data_width - 1 : 0] target_a_gain;
+	reg [data_width - 1 : 0] target_b_gain;
+	
+	wire [data_width - 1 : 0] output_a_gain_next =
+		(output_a_gain + switch_velocity < target_a_gain) ? output_a_gain + switch_velocity :
+		((output_a_gain > target_a_gain + switch_velocity) ? output_a_gain - switch_velocity : target_a_gain);
+	wire [data_width - 1 : 0] output_b_gain_next =
+		(output_b_gain + switch_velocity < target_b_gain) ? output_b_gain + switch_velocity :
+		((output_b_gain > target_b_gain + switch_velocity) ? output_b_gain - switch_velocity : target_b_gain);
 	
-	reg pipeline_swap_requested = 0;
+	// Target gains for the front and back pipelines in each mode
+	wire [data_width - 1 : 0] mode_front_gain = (mix_mode == `ENGINE_MODE_SERIES)   ? 0 :
+												((mix_mode == `ENGINE_MODE_PARALLEL) ? (unity_gain >> 1) : unity_gain);
+	wire [data_width - 1 : 0] mode_back_gain  = (mix_mode == `ENGINE_MODE_SERIES)   ? unity_gain :
+												((mix_mode == `ENGINE_MODE_PARALLEL) ? (unity_gain >> 1) : 0);
+	
+	/**************/
+	/* Input path */
+	/**************/
 	
 	always @(posedge clk) begin
-		in_sample_mixed  <= 0;
-		out_sample_valid <= 0;
-		
-		if (swap_pipelines)
-			pipeline_swap_requested <= 1;
+		in_sample_mixed <= 0;
 		
 		if (set_input_gain)
 			input_gain <= data_in;
-
-		if (set_output_gain)
-			output_gain <= data_in;
 		
 		if (reset) begin
-			pipelines_swapping 	<= 0;
-			target_pipeline		<= 0;
-			pipeline_swap_requested <= 0;
+			in_state <= `MIXER_STATE_READY;
+			input_gain <= 1 << (data_width - 1 - gain_shift);
 			
-			input_gain  <= 1 << (data_width - 1 - gain_shift);
-			output_gain <= 1 << (data_width - 1 - gain_shift);
-			
-			output_a_gain <= 1 << (data_width - 1 - gain_shift);
-			output_b_gain <= 0;
+			`ifdef CORE_STEREO
+			in_lane <= 0;
+			`endif
 		end
 		else begin
-			case (state)
+			case (in_state)
 				`MIXER_STATE_READY: begin
-					if (swap_pipelines || pipeline_swap_requested) begin
-						pipelines_swapping <= 1;
-						target_pipeline <= ~target_pipeline;
-						pipeline_swap_requested <= 0;
-					end
-					
-					if (in_sample_valid) begin
-						mul_arg_aa <= in_sample;
-						mul_arg_ab <= input_gain;
-						in_sample_mixed <= 0;
-						state <= `MIXER_APPLY_INPUT_GAIN_1;
-						
-						if (pipelines_swapping) begin
-							if (target_pipeline) begin
-								if (output_a_gain == 0) begin
-									output_b_gain <= unity_gain;
-									output_a_gain <= 0;
-									pipelines_swapping <= 0;
-								end
-								else begin
-									output_b_gain <= output_b_gain + switch_velocity;
-									output_a_gain <= output_a_gain - switch_velocity;
-								end
-							end
-							else begin
-								if (output_b_gain == 0) begin
-									output_a_gain <= unity_gain;
-									output_b_gain <= 0;
-									pipelines_swapping <= 0;
-								end
-								else begin
-									output_a_gain <= output_a_gain + switch_velocity;
-									output_b_gain <= output_b_gain - switch_velocity;
-								end
-							end
-						end
-					end
-					else if (out_samples_valid) begin
-						mul_arg_aa <= out_sample_in_a;
-						mul_arg_ab <= output_a_gain;
-						
-						mul_arg_ba <= out_sample_in_b;
-						mul_arg_bb <= output_b_gain;
-						
-						state <= `MIXER_MIX_PIPELINES_1;
+					if (in_start) begin
+						mul_arg_ia <= in_sample_lane;
+						mul_arg_ib <= input_gain;
+						in_state <= `MIXER_APPLY_INPUT_GAIN_1;
 					end
 				end
 				
 				`MIXER_APPLY_INPUT_GAIN_1: begin
-					state <= `MIXER_APPLY_INPUT_GAIN_2;
+					in_state <= `MIXER_APPLY_INPUT_GAIN_2;
 				end
 				
 				`MIXER_APPLY_INPUT_GAIN_2: begin
-					prod_a_latched <= prod_a;
-					state <= `MIXER_APPLY_INPUT_GAIN_3;
+					prod_i_latched <= prod_i;
+					in_state <= `MIXER_APPLY_INPUT_GAIN_3;
 				end
 
 				`MIXER_APPLY_INPUT_GAIN_3: begin
-					state <= `MIXER_APPLY_INPUT_GAIN_DONE;
+					in_state <= `MIXER_APPLY_INPUT_GAIN_DONE;
 				end
 
 				`MIXER_APPLY_INPUT_GAIN_DONE: begin
-					in_sample_out <= prod_a_final;
-					in_sample_mixed <= 1;
-					state <= `MIXER_REST;
+					`ifdef CORE_STEREO
+					if (in_lane)
+						in_sample_out_r <= prod_i_final;
+					else
+					`endif
+						in_sample_out <= prod_i_final;
+					
+					`ifdef CORE_STEREO
+					in_lane <= ~in_lane;
+					`endif
+					
+					in_sample_mixed <= (in_lane == last_lane);
+					in_state <= `MIXER_STATE_READY;
+				end
+				
+				default: begin
+					in_state <= `MIXER_STATE_READY;
+				end
+			endcase
+		end
+	end
+	
+	/***************/
+	/* Output path */
+	/***************/
+	
+	always @(posedge clk) begin
+		out_sample_valid <= 0;
+		
+		// Retargeting takes effect at once so that the controller
+		// sees pipelines_swapping raised on the following cycle
+		if (swap_pipelines) begin
+			target_a_gain <= current_pipeline ? unity_gain : 0;
+			target_b_gain <= current_pipeline ? 0 : unity_gain;
+			pipelines_swapping <= 1;
+		end else if (set_mix_mode) begin
+			target_a_gain <= current_pipeline ? mode_back_gain  : mode_front_gain;
+			target_b_gain <= current_pipeline ? mode_front_gain : mode_back_gain;
+			pipelines_swapping <= 1;
+		end
+
+		if (set_output_gain)
+			output_gain <= data_in;
+		
+		if (reset) begin
+			out_state <= `MIXER_STATE_READY;
+			
+			pipelines_swapping 	<= 0;
+			
+			output_gain <= 1 << (data_width - 1 - gain_shift);
+			
+			output_a_gain <= 1 << (data_width - 1 - gain_shift);
+			output_b_gain <= 0;
+			
+			target_a_gain <= 1 << (data_width - 1 - gain_shift);
+			target_b_gain <= 0;
+			
+			`ifdef CORE_STEREO
+			out_lane <= 0;
+			`endif
+		end
+		else begin
+			case (out_state)
+				`MIXER_STATE_READY: begin
+					if (out_start) begin
+						mul_arg_aa <= out_sample_in_a_lane;
+						mul_arg_ab <= output_a_gain;
+						
+						mul_arg_ba <= out_sample_in_b_lane;
+						mul_arg_bb <= output_b_gain;
+						
+						out_state <= `MIXER_MIX_PIPELINES_1;
+						
+						// Crossfade advances one step per mixed frame
+						if (pipelines_swapping && !swap_pipelines && !set_mix_mode && !out_lane) begin
+							output_a_gain <= output_a_gain_next;
+							output_b_gain <= output_b_gain_next;
+							
+							if (output_a_gain == target_a_gain && output_b_gain == target_b_gain)
+								pipelines_swapping <= 0;
+						end
+					end
 				end
 				
 				`MIXER_MIX_PIPELINES_1: begin
-					state <= `MIXER_MIX_PIPELINES_2;
+					out_state <= `MIXER_MIX_PIPELINES_2;
 				end
 				
 				`MIXER_MIX_PIPELINES_2: begin
 					prod_a_latched <= prod_a;
 					prod_b_latched <= prod_b;
-					state <= `MIXER_MIX_PIPELINES_3;
+					out_state <= `MIXER_MIX_PIPELINES_3;
 				end
 
 				`MIXER_MIX_PIPELINES_3: begin
-					state <= `MIXER_APPLY_OUTPUT_GAIN_1;
+					out_state <= `MIXER_APPLY_OUTPUT_GAIN_1;
 				end
 
 				`MIXER_APPLY_OUTPUT_GAIN_1: begin
 					mul_arg_aa <= prod_sum_final;
 					mul_arg_ab <= output_gain;
-					state <= `MIXER_APPLY_OUTPUT_GAIN_2;
+					out_state <= `MIXER_APPLY_OUTPUT_GAIN_2;
 				end
 				
 				`MIXER_APPLY_OUTPUT_GAIN_2: begin
-					state <= `MIXER_APPLY_OUTPUT_GAIN_3;
+					out_state <= `MIXER_APPLY_OUTPUT_GAIN_3;
 				end
 				
 				`MIXER_APPLY_OUTPUT_GAIN_3: begin
 					prod_a_latched <= prod_a;
-					state <= 11;
+					out_state <= `MIXER_APPLY_OUTPUT_GAIN_DONE;
 				end
 
 				`MIXER_APPLY_OUTPUT_GAIN_DONE: begin
-					out_sample <= prod_a_final;
-					out_sample_valid <= 1;
-					state <= `MIXER_REST;
+					`ifdef CORE_STEREO
+					if (out_lane)
+						out_sample_r <= prod_a_final;
+					else
+					`endif
+						out_sample <= prod_a_final;
+					
+					`ifdef CORE_STEREO
+					out_lane <= ~out_lane;
+					`endif
+					
+					out_sample_valid <= (out_lane == last_lane);
+					out_state <= `MIXER_STATE_READY;
 				end
 				
-				`MIXER_REST: begin
-					state <= `MIXER_STATE_READY;
+				default: begin
+					out_state <= `MIXER_STATE_READY;
 				end
 			endcase
 		end
@@ -36,38 +36,38 @@ module operand_fetch_substage #(parameter data_width = 16, parameter n_blocks =
 		input wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_in,
 		output reg [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_out,
 		
-		input wire [3 : 0] dest_in,
-		output reg [3 : 0] dest_out,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 		
 		input wire arg_needed,
-		input wire [3 : 0] src,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src,
 		input wire src_reg,
 		output reg signed [data_width - 1 : 0] fetched_out,		
 		
 		input wire arg_a_needed_in,
-		input wire [3 : 0] src_a_in,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_a_in,
 		input wire src_a_reg_in,
 		input wire signed [data_width - 1 : 0] arg_a_in,
 		output reg arg_a_needed_out,
-		output reg [3 : 0] src_a_out,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] src_a_out,
 		output reg src_a_reg_out,
 		output reg signed [data_width - 1 : 0] arg_a_out,
 		
 		input wire arg_b_needed_in,
-		input wire [3 : 0] src_b_in,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_b_in,
 		input wire src_b_reg_in,
 		input wire signed [data_width - 1 : 0] arg_b_in,
 		output reg arg_b_needed_out,
-		output reg [3 : 0] src_b_out,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] src_b_out,
 		output reg src_b_reg_out,
 		output reg signed [data_width - 1 : 0] arg_b_out,
 		
 		input wire arg_c_needed_in,
-		input wire [3 : 0] src_c_in,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_c_in,
 		input wire src_c_reg_in,
 		input wire signed [data_width - 1 : 0] arg_c_in,
 		output reg arg_c_needed_out,
-		output reg [3 : 0] src_c_out,
+		output reg [`CHANNEL_ADDR_WIDTH - 1 : 0] src_c_out,
 		output reg src_c_reg_out,
 		output reg signed [data_width - 1 : 0] arg_c_out,
 		
@@ -104,14 +104,21 @@ module operand_fetch_substage #(parameter data_width = 16, parameter n_blocks =
 		input wire [$clog2(`N_INSTR_BRANCHES) - 1 : 0] branch_in,
 		output reg [$clog2(`N_INSTR_BRANCHES) - 1 : 0] branch_out,
 		
-		input wire [3 : 0] channel_write_addr,
+		input wire [`CHANNEL_ADDR_WIDTH - 1 : 0] channel_write_addr,
 		input wire signed [data_width - 1 : 0] channel_write_val,
 		input wire channel_write_enable,
 		
-		input wire accumulator_write_enable
+		input wire accumulator_write_enable,
+		
+		// The last block of the pass is through, and the commit ID the
+		// next block to write will get
+		output wire pass_issued,
+		output wire [`COMMIT_ID_WIDTH - 1 : 0] issued_commit_id
 	);
 	
-	reg [data_width - 1 : 0] channels [15 : 0];
+	localparam n_channels = 1 << `CHANNEL_ADDR_WIDTH;
+	
+	reg [data_width - 1 : 0] channels [n_channels - 1 : 0];
 	
 	wire take_in = in_ready & in_valid;
 	wire [data_width - 1 : 0] channel_read_val = channels[src_live];
@@ -119,7 +126,7 @@ module operand_fetch_substage #(parameter data_width = 16, parameter n_blocks =
 	integer j;
 	always @(posedge clk) begin
 		if (reset) begin
-			for (j = 0; j < 16; j = j + 1) begin
+			for (j = 0; j < n_channels; j = j + 1) begin
 				channels[j] <= 0;
 			end
 		end else begin
@@ -128,73 +135,38 @@ module operand_fetch_substage #(parameter data_width = 16, parameter n_blocks =
 		end
 	end
 	
-	reg [3 : 0] channels_scoreboard [15 : 0];
+	reg [3 : 0] channels_scoreboard [n_channels - 1 : 0];
 	reg [3 : 0] accumulator_pending_writes;
 	
-	reg [15 : 0] busy_bits;
+	reg [n_channels - 1 : 0] busy_bits;
 	reg accumulator_busy;
 
 	integer i;
 	always @(posedge clk) begin
-		for (i = 0; i < 16; i = i + 1)
+		for (i = 0; i < n_channels; i = i + 1)
 			channels_scoreboard[i] <= channels_scoreboard[i];
 	
 		if (reset) begin
 			busy_bits <= 0;
 			accumulator_busy <= 0;
 			
-			for (i = 0; i < 16; i = i + 1)
+			for (i = 0; i < n_channels; i = i + 1)
 				channels_scoreboard[i] <= 0;
 			
 			accumulator_pending_writes <= 0;
 		end else if (enable) begin
-			case ({inject_pending_ch0_write, (add_pending_write && dest_live == 0 && !writes_accumulator_live),
-					channel_write_enable && channel_write_addr == 0})
-				3'b010: begin
-					channels_scoreboard[0] <= channels_scoreboard[0] + 1;
-					busy_bits[0] <= 1;
-				end
-				
-				3'b001: begin
-					if (channels_scoreboard[0] != 0) begin
-						channels_scoreboard[0] <= channels_scoreboard[0] - 1;
-						busy_bits[0] <= (channels_scoreboard[0] != 1);
-					end else begin
-						channels_scoreboard[0] <= channels_scoreboard[0];
-						busy_bits[0] <= 0;
-					end
-				end
-				
-				3'b100: begin
-					channels_scoreboard[0] <= channels_scoreboard[0] + 1;
-					busy_bits[0] <= 1;
-				end
-				
-				3'b110: begin
-					channels_scoreboard[0] <= channels_scoreboard[0] + 2;
-					busy_bits[0] <= 1;
-				end
-				
-				3'b111: begin
-					channels_scoreboard[0] <= channels_scoreboard[0] + 1;
-					busy_bits[0] <= 1;
-				end
-				
-				default: begin
-					channels_scoreboard[0] <= channels_scoreboard[0];
-					busy_bits[0] <= (channels_scoreboard[0] != 0);
-				end
-			endcase
-		
-			for (i = 1; i < 16; i = i + 1) begin
-				case ({(add_pending_write && dest_live == i && !writes_accumulator_live),
+			// The sample tick writes channel 0 of each lane; the last block
+			// of the pass marks it pending for its own lane, ahead of that
+			for (i = 0; i < n_channels; i = i + 1) begin
+				case ({inject_pending_ch0_write && inject_addr == i,
+						(add_pending_write && dest_live == i && !writes_accumulator_live),
 						channel_write_enable && channel_write_addr == i})
-					2'b10: begin
+					3'b010: begin
 						channels_scoreboard[i] <= channels_scoreboard[i] + 1;
 						busy_bits[i] <= 1;
 					end
 					
-					2'b01: begin
+					3'b001: begin
 						if (channels_scoreboard[i] != 0) begin
 							channels_scoreboard[i] <= channels_scoreboard[i] - 1;
 							busy_bits[i] <= (channels_scoreboard[i] != 1);
@@ -204,6 +176,21 @@ module operand_fetch_substage #(parameter data_width = 16, parameter n_blocks =
 						end
 					end
 					
+					3'b100: begin
+						channels_scoreboard[i] <= channels_scoreboard[i] + 1;
+						busy_bits[i] <= 1;
+					end
+					
+					3'b110: begin
+						channels_scoreboard[i] <= channels_scoreboard[i] + 2;
+						busy_bits[i] <= 1;
+					end
+					
+					3'b111: begin
+						channels_scoreboard[i] <= channels_scoreboard[i] + 1;
+						busy_bits[i] <= 1;
+					end
+					
 					default: begin
 						channels_scoreboard[i] <= channels_scoreboard[i];
 						busy_bits[i] <= (channels_scoreboard[i] != 0);
@@ -242,39 +229,39 @@ module operand_fetch_substage #(parameter data_width = 16, parameter n_blocks =
 	
 	reg [4 : 0] operation_latched;
 	
-	reg [3 : 0] dest_latched;
+	reg [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_latched;
 	reg writes_channel_latched;
 	reg accumulator_needed_latched;
 	reg writes_accumulator_latched;
 
-	reg [3 : 0] src_latched;
+	reg [`CHANNEL_ADDR_WIDTH - 1 : 0] src_latched;
 	reg arg_needed_latched;
 	reg src_reg_latched;
 	reg arg_valid;
 	
 	reg arg_a_needed_latched;
-	reg [3 : 0] src_a_latched;
+	reg [`CHANNEL_ADDR_WIDTH - 1 : 0] src_a_latched;
 	reg src_a_reg_latched;
 	reg signed [data_width - 1 : 0] arg_a_latched;
 
 	reg arg_b_needed_latched;
-	reg [3 : 0] src_b_latched;
+	reg [`CHANNEL_ADDR_WIDTH - 1 : 0] src_b_latched;
 	reg src_b_reg_latched;
 	reg signed [data_width - 1 : 0] arg_b_latched;
 
 	reg arg_c_needed_latched;
-	reg [3 : 0] src_c_latched;
+	reg [`CHANNEL_ADDR_WIDTH - 1 : 0] src_c_latched;
 	reg src_c_reg_latched;
 	reg signed [data_width - 1 : 0] arg_c_latched;
 	
 	wire [$clog2(n_blocks) - 1 : 0] block_live = busy ? block_latched : block_in;
 	
-	wire [3 : 0] dest_live = (busy) ? dest_latched : dest_in;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_live = (busy) ? dest_latched : dest_in;
 	wire writes_channel_live = (busy) ? writes_channel_latched : writes_channel_in;
 	wire accumulator_needed_live = (busy) ? accumulator_needed_latched : accumulator_needed_in;
 	wire writes_accumulator_live = (busy) ? writes_accumulator_latched : writes_accumulator_in;
 
-	wire [3 : 0] src_live = (busy) ? src_latched : src;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_live = (busy) ? src_latched : src;
 	wire arg_needed_live = (busy) ? arg_needed_latched : arg_needed;
 	wire src_reg_live = (busy) ? src_reg_latched : src_reg;
 	
@@ -367,6 +354,15 @@ module operand_fetch_substage #(parameter data_width = 16, parameter n_blocks =
 	wire add_pending_write = last_cycle & creates_dependency;
 	wire inject_pending_ch0_write = last_cycle & last_block;
 	
+	assign pass_issued 		= enable & inject_pending_ch0_write;
+	assign issued_commit_id = commit_id;
+	
+	`ifdef CORE_STEREO
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] inject_addr = {dest_live[`CHANNEL_ADDR_WIDTH - 1], 4'd0};
+	`else
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] inject_addr = 0;
+	`endif
+	
 	always @(posedge clk) begin
 		if (reset) begin
 			busy	<= 0;
@@ -536,6 +532,17 @@ module operand_fetch_substage #(parameter data_width = 16, parameter n_blocks =
 			end
 		end
 	end
+	
+	`ifdef SIM_PROFILE
+	// Each cycle a block is held here, for the testbench's profiler:
+	// reason 0 is waiting on channel `channel', 1 on the accumulator
+	import "DPI-C" context function void sim_profile_stall(input int block, input int reason, input int channel);
+	
+	always @(posedge clk) begin
+		if (!reset && enable && busy && !stall_done)
+			sim_profile_stall(int'(block_latched), arg_resolved ? 1 : 0, int'(src_latched));
+	end
+	`endif
 endmodule
 
 module operand_fetch_stage #(parameter data_width = 16, parameter n_blocks = 256)
@@ -569,12 +576,12 @@ module operand_fetch_stage #(parameter data_width = 16, parameter n_blocks = 256
 		input  wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_in,
 		output wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_out,
 		
-		input  wire [3 : 0] dest_in,
-		output wire [3 : 0] dest_out,
+		input  wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_in,
+		output wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_out,
 
-		input  wire signed [3 : 0] src_a_in,
-		input  wire signed [3 : 0] src_b_in,
-		input  wire signed [3 : 0] src_c_in,
+		input  wire signed [`CHANNEL_ADDR_WIDTH - 1 : 0] src_a_in,
+		input  wire signed [`CHANNEL_ADDR_WIDTH - 1 : 0] src_b_in,
+		input  wire signed [`CHANNEL_ADDR_WIDTH - 1 : 0] src_c_in,
 
 		input  wire src_a_reg_in,
 		input  wire src_b_reg_in,
@@ -620,13 +627,16 @@ module operand_fetch_stage #(parameter data_width = 16, parameter n_blocks = 256
 		input  wire [`N_INSTR_BRANCHES - 1 : 0] branch_in,
 		output wire [`N_INSTR_BRANCHES - 1 : 0] branch_out,
 		
-		input  wire [3 : 0] channel_write_addr,
+		input  wire [`CHANNEL_ADDR_WIDTH - 1 : 0] channel_write_addr,
 		input  wire signed [data_width - 1 : 0] channel_write_val,
 		input  wire channel_write_enable,
 		
 		input  wire signed [data_width - 1 : 0] channel_read_val,
 		
-		input  wire accumulator_write_enable
+		input  wire accumulator_write_enable,
+		
+		output wire pass_issued,
+		output wire [`COMMIT_ID_WIDTH - 1 : 0] issued_commit_id
 	);
 	
 	wire out_valid_1;
@@ -635,11 +645,11 @@ module operand_fetch_stage #(parameter data_width = 16, parameter n_blocks = 256
 	wire signed [data_width - 1 : 0] register_1_1_out;
 	wire [4 : 0] operation_1_out;
 	wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_1_out;
-	wire [3 : 0] dest_1_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_1_out;
 	
-	wire [3 : 0] src_a_1_out;
-	wire [3 : 0] src_b_1_out;
-	wire [3 : 0] src_c_1_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_a_1_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_b_1_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_c_1_out;
 	
 	wire src_a_reg_1_out;
 	wire src_b_reg_1_out;
@@ -767,7 +777,10 @@ module operand_fetch_stage #(parameter data_width = 16, parameter n_blocks = 256
 		.channel_write_val(channel_write_val),
 		.channel_write_enable(channel_write_enable),
 		
-		.accumulator_write_enable(accumulator_write_enable)
+		.accumulator_write_enable(accumulator_write_enable),
+		
+		.pass_issued(),
+		.issued_commit_id()
 	);
 	
 	wire in_ready_2;
@@ -777,11 +790,11 @@ module operand_fetch_stage #(parameter data_width = 16, parameter n_blocks = 256
 	wire signed [data_width - 1 : 0] register_1_2_out;
 	wire [4 : 0] operation_2_out;
 	wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_2_out;
-	wire [3 : 0] dest_2_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_2_out;
 	
-	wire [3 : 0] src_a_2_out;
-	wire [3 : 0] src_b_2_out;
-	wire [3 : 0] src_c_2_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_a_2_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_b_2_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_c_2_out;
 	
 	wire src_a_reg_2_out;
 	wire src_b_reg_2_out;
@@ -909,7 +922,10 @@ module operand_fetch_stage #(parameter data_width = 16, parameter n_blocks = 256
 		.channel_write_val(channel_write_val),
 		.channel_write_enable(channel_write_enable),
 		
-		.accumulator_write_enable(accumulator_write_enable)
+		.accumulator_write_enable(accumulator_write_enable),
+		
+		.pass_issued(),
+		.issued_commit_id()
 	);
 
 	wire in_ready_3;
@@ -921,10 +937,10 @@ module operand_fetch_stage #(parameter data_width = 16, parameter n_blocks = 256
 	wire signed [data_width - 1 : 0] register_1_3_out;
 	wire [4 : 0] operation_3_out;
 	wire [$clog2(`N_MISC_OPS) - 1 : 0] misc_op_3_out;
-	wire [3 : 0] dest_3_out;
-	wire [3 : 0] src_a_3_out;
-	wire [3 : 0] src_b_3_out;
-	wire [3 : 0] src_c_3_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] dest_3_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_a_3_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_b_3_out;
+	wire [`CHANNEL_ADDR_WIDTH - 1 : 0] src_c_3_out;
 	wire src_a_reg_3_out;
 	wire src_b_reg_3_out;
 	wire src_c_reg_3_out;
@@ -1047,7 +1063,10 @@ module operand_fetch_stage #(parameter data_width = 16, parameter n_blocks = 256
 		.channel_write_val(channel_write_val),
 		.channel_write_enable(channel_write_enable),
 		
-		.accumulator_write_enable(accumulator_write_enable)
+		.accumulator_write_enable(accumulator_write_enable),
+		
+		.pass_issued(pass_issued),
+		.issued_commit_id(issued_commit_id)
 	);
 	
 	localparam payload_width = 
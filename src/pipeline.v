@@ -10,7 +10,11 @@
 
 module dsp_pipeline #(
 		parameter data_width 		= 16,
-		parameter n_blocks 			= 256
+		parameter n_blocks 			= 256,
+		parameter core_memory_size	= 1024,
+		parameter delay_mem_size 	= 16384,
+		parameter delay_buffers 	= 16,
+		parameter delay_page_size 	= 128
 	) (
 		input wire clk,
 		input wire reset,
@@ -24,6 +28,20 @@ module dsp_pipeline #(
 		output wire [data_width - 1:0] out_sample,
 		output reg ready,
 		
+		`ifdef CORE_STEREO
+		input wire signed [data_width - 1:0] in_sample_r,
+		output wire [data_width - 1:0] out_sample_r,
+		`endif
+		
+		// This tick's result, as soon as the pass is done with it
+		output wire pass_done,
+		output wire [data_width - 1:0] pass_sample,
+		output wire pass_overrun,
+		
+		`ifdef CORE_STEREO
+		output wire [data_width - 1:0] pass_sample_r,
+		`endif
+		
 		output wire error,
 		
 		input wire [$clog2(n_blocks) - 1 : 0] block_target,
@@ -37,6 +55,8 @@ module dsp_pipeline #(
 		input wire [2 * data_width - 1 : 0] init_delay,
 		input wire reg_update,
 		input wire reg_write,
+		input wire reg_ramp,
+		input wire [15 : 0] ramp_length,
 		
 		input wire reg_writes_commit,
 		output wire regfile_syncing,
@@ -45,12 +65,74 @@ module dsp_pipeline #(
 		output wire instr_write_ack,
 	
 		input wire alloc_delay,
+		input wire free_delay,
+		input wire resize_delay,
+		input wire [$clog2(delay_buffers) - 1 : 0] delay_handle,
+		output wire delays_busy,
+		output wire delay_alloc_failed,
+		
+		// Pages of the shared pool the other pipeline holds
+		input wire [delay_mem_size / delay_page_size - 1 : 0] delay_pages_reserved,
+		
+		// The output's being heard; the delay buffers can't be resized
+		input wire delay_live,
+		
+		// The delay memory is shared with the other pipeline; see delay_pool.v
+		output wire delay_mem_read_req,
+		output wire [$clog2(delay_mem_size) - 1 : 0] delay_mem_read_addr,
+		input  wire [data_width - 1 : 0] delay_mem_read_data,
+		input  wire delay_mem_read_valid,
+		output wire delay_mem_write_req,
+		output wire [$clog2(delay_mem_size) - 1 : 0] delay_mem_write_addr,
+		output wire [data_width - 1 : 0] delay_mem_write_data,
+		input  wire delay_mem_write_ack,
+		
+		`ifdef CORE_STEREO
+		output wire delay_r_mem_read_req,
+		output wire [$clog2(delay_mem_size) - 1 : 0] delay_r_mem_read_addr,
+		input  wire [data_width - 1 : 0] delay_r_mem_read_data,
+		input  wire delay_r_mem_read_valid,
+		output wire delay_r_mem_write_req,
+		output wire [$clog2(delay_mem_size) - 1 : 0] delay_r_mem_write_addr,
+		output wire [data_width - 1 : 0] delay_r_mem_write_data,
+		input  wire delay_r_mem_write_ack,
+		`endif
+		
 		output wire resetting,
+		
+		input wire clone,
+		input wire clone_mem,
+		input wire clone_delays,
+		output wire cloning,
+		
+		input  wire [$clog2(n_blocks) - 1 : 0] clone_block_addr,
+		input  wire [31 				  : 0] clone_instr,
+		input  wire [2 * data_width   - 1 : 0] clone_regs,
+		input  wire [$clog2(n_blocks) 	  : 0] clone_n_blocks,
+		output wire [$clog2(core_memory_size) - 1 : 0] clone_mem_addr,
+		input  wire [data_width 	  - 1 : 0] clone_mem_val,
+		
+		output wire [$clog2(n_blocks) - 1 : 0] snoop_block_addr,
+		output wire [31 				  : 0] snoop_instr,
+		output wire [2 * data_width   - 1 : 0] snoop_regs,
+		output wire [$clog2(n_blocks) 	  : 0] snoop_n_blocks,
+		input  wire [$clog2(core_memory_size) - 1 : 0] snoop_mem_addr,
+		output wire [data_width 	  - 1 : 0] snoop_mem_val,
+		
+		output wire [$clog2(delay_buffers) 		  - 1 : 0] clone_delay_handle,
+		input  wire [3 * $clog2(delay_mem_size) + 8 - 1 : 0] clone_delay_info,
+		input  wire [delay_buffers 				  - 1 : 0] clone_delay_initd,
+		
+		input  wire [$clog2(delay_buffers) 		  - 1 : 0] snoop_delay_handle,
+		output wire [3 * $clog2(delay_mem_size) + 8 - 1 : 0] snoop_delay_info,
+		output wire [delay_mem_size / delay_page_size - 1 : 0] snoop_delay_pages,
+		output wire [delay_buffers 				  - 1 : 0] snoop_delay_initd,
 
 		output wire[7:0] out,
 
 		output wire [$clog2(n_blocks) - 1 : 0] n_blocks_running,
 		output wire [31:0] commits_accepted,
+		output wire [15:0] cycles_per_sample,
 		output wire [ 7:0] byte_probe
 	);
 
@@ -64,7 +146,8 @@ module dsp_pipeline #(
 
 	dsp_core #(
 		.data_width(data_width),
-		.n_blocks(n_blocks)
+		.n_blocks(n_blocks),
+		.memory_size(core_memory_size)
 	) core (
 		.clk(clk),
 		.reset(reset),
@@ -76,6 +159,19 @@ module dsp_pipeline #(
 		.sample_in(in_sample),
 		.sample_out(out_sample),
 		
+		`ifdef CORE_STEREO
+		.sample_in_r(in_sample_r),
+		.sample_out_r(out_sample_r),
+		`endif
+		
+		.pass_done(pass_done),
+		.pass_sample(pass_sample),
+		.pass_overrun(pass_overrun),
+		
+		`ifdef CORE_STEREO
+		.pass_sample_r(pass_sample_r),
+		`endif
+		
 		.ready(core_ready),
 		
 		.command_reg_write(reg_write),
@@ -86,6 +182,8 @@ module dsp_pipeline #(
 		.command_block_target(block_target),
 		.command_reg_target(reg_target),
 		.command_reg_write_val(ctrl_data),
+		.command_reg_ramp(reg_ramp),
+		.command_ramp_length(ramp_length),
 		
 		.lut_req(lut_req),
 		.lut_handle(lut_req_handle),
@@ -108,6 +206,26 @@ module dsp_pipeline #(
 		.full_reset(full_reset),
 		.resetting(resetting),
 		
+		.clone(clone),
+		.clone_mem(clone_mem),
+		.cloning(core_cloning),
+		
+		.clone_block_addr(clone_block_addr),
+		.clone_instr(clone_instr),
+		.clone_regs(clone_regs),
+		.clone_n_blocks(clone_n_blocks),
+		.clone_mem_addr(clone_mem_addr),
+		.clone_mem_val(clone_mem_val),
+		
+		.snoop_block_addr(snoop_block_addr),
+		.snoop_instr(snoop_instr),
+		.snoop_regs(snoop_regs),
+		.snoop_n_blocks(snoop_n_blocks),
+		.snoop_mem_addr(snoop_mem_addr),
+		.snoop_mem_val(snoop_mem_val),
+		
+		.cycles_per_sample(cycles_per_sample),
+		
 		.out(core_out)
 	);
 	
@@ -131,60 +249,7 @@ module dsp_pipeline #(
 	);
 	
 	// Delay buffers
-	localparam delay_mem_size = 16384;
 	localparam delay_mem_addr_width = $clog2(delay_mem_size);
-	reg [data_width - 1 : 0] delay_mem [delay_mem_size - 1 : 0];
-	
-	wire delay_mem_read_req;
-	reg  delay_mem_read_wait;
-	wire delay_mem_write_req;
-	
-	reg delay_mem_write_cooldown;
-	reg delay_mem_write_enable;
-	
-	reg [delay_mem_addr_width - 1 : 0] delay_mem_write_addr_r;
-	reg [data_width 		  - 1 : 0] delay_mem_write_data_r;
-	
-	always @(posedge clk) begin
-		delay_mem_write_ack <= 0;
-		delay_mem_read_valid <= 0;
-		delay_mem_write_enable <= 0;
-		delay_mem_write_cooldown <= 0;
-		
-		delay_mem_read_wait <= 0;
-		
-		delay_mem_data_out <= delay_mem[delay_mem_read_addr];
-		
-		if (!delay_mem_write_cooldown && delay_mem_write_req) begin
-			delay_mem_write_addr_r <= delay_mem_write_addr;
-			delay_mem_write_data_r <= delay_mem_data_in;
-			delay_mem_write_cooldown <= 1;
-			delay_mem_write_enable <= 1;
-			delay_mem_write_ack <= 1;
-		end
-		
-		if (delay_mem_write_enable)
-			delay_mem[delay_mem_write_addr_r] <= delay_mem_write_data_r;
-		
-		if (!delay_mem_read_wait && delay_mem_read_req) begin
-			delay_mem_read_wait <= 1;
-		end
-		
-		if (delay_mem_read_wait) begin
-			delay_mem_data_out_r <= delay_mem_data_out;
-			delay_mem_read_valid <= 1;
-		end
-	end
-	
-	wire [delay_mem_addr_width - 1 : 0] delay_mem_read_addr;
-	reg  signed    [data_width - 1 : 0] delay_mem_data_out;
-	reg  signed    [data_width - 1 : 0] delay_mem_data_out_r;
-	
-	wire [delay_mem_addr_width - 1 : 0] delay_mem_write_addr;
-	wire signed    [data_width - 1 : 0] delay_mem_data_in;
-	
-	reg delay_mem_read_valid;
-	reg delay_mem_write_ack;
 	
     wire any_delay_buffers;
 
@@ -203,8 +268,9 @@ module dsp_pipeline #(
 
 	delay_master #(
 		.data_width(data_width), 
-		.n_buffers(16),
-		.memory_size(delay_mem_size)
+		.n_buffers(delay_buffers),
+		.memory_size(delay_mem_size),
+		.page_size(delay_page_size)
 	) delays (
 		.clk(clk),
 		.reset(reset | full_reset),
@@ -212,37 +278,156 @@ module dsp_pipeline #(
 		.enable(1'b1),
 		
 		.alloc_req  (alloc_delay),
+		.free_req	(free_delay),
+		.resize_req (resize_delay),
 		.alloc_size (delay_size[delay_mem_addr_width-1:0]),
 		.alloc_delay(init_delay),
+		.alloc_handle(delay_handle),
+		
+		.reserved_pages(delay_pages_reserved),
+		.live(delay_live),
+		
+		.busy(delays_busy_l),
+		
+		.clone_req	 (clone & clone_delays),
+		.clone_handle(clone_delay_handle),
+		.clone_info	 (clone_delay_info),
+		.clone_initd (clone_delay_initd),
 		
-		.read_req (delay_read_req),
-		.write_req(delay_write_req),
+		.snoop_handle(snoop_delay_handle),
+		.snoop_info	 (snoop_delay_info),
+		.snoop_pages (snoop_delay_pages),
+		.snoop_initd (snoop_delay_initd),
 		
-		.write_handle(delay_req_handle),
-		.read_handle (delay_req_handle),
+		.read_req (delay_read_req_l),
+		.write_req(delay_write_req_l),
+		
+		.write_handle(delay_lane_handle),
+		.read_handle (delay_lane_handle),
 		.write_data  (delay_write_data),
 		.write_inc   (delay_write_inc),
 			
-		.data_out(delay_read_data),
+		.data_out(delay_read_data_l),
 		
-		.read_valid(delay_read_valid),
-		.write_ack(delay_write_ack),
+		.read_valid(delay_read_valid_l),
+		.write_ack(delay_write_ack_l),
 		
 		.mem_read_req (delay_mem_read_req),
 		.mem_write_req(delay_mem_write_req),
 		
 		.mem_read_addr(delay_mem_read_addr),
-		.mem_data_in  (delay_mem_data_out_r),
+		.mem_data_in  (delay_mem_read_data),
 		
 		.mem_write_addr(delay_mem_write_addr),
-		.mem_data_out  (delay_mem_data_in),
+		.mem_data_out  (delay_mem_write_data),
 		
 		.mem_read_valid(delay_mem_read_valid),
 		.mem_write_ack (delay_mem_write_ack),
+		
+		.invalid_alloc(delay_alloc_failed),
 
         .any_buffers(any_delay_buffers)
 	);
 	
+	`ifdef CORE_STEREO
+	// The right lane's delay buffers, in a pool of their own. Both tables
+	// are built by the same commands, so a handle names the same buffer in
+	// each, and cloning takes the other pipeline's left table for both.
+	// The core asks for the right lane's above the handle
+	wire delay_req_lane = delay_req_handle[`LANE_HANDLE_BIT];
+	
+	wire [data_width - 1 : 0] delay_read_data_r;
+	wire delay_read_valid_r;
+	wire delay_write_ack_r;
+	wire delays_busy_r;
+	
+	wire [data_width - 1 : 0] delay_lane_handle = delay_req_handle & ~(1 << `LANE_HANDLE_BIT);
+	
+	wire delay_read_req_l  = delay_read_req  & ~delay_req_lane;
+	wire delay_write_req_l = delay_write_req & ~delay_req_lane;
+	wire delay_read_req_r  = delay_read_req  &  delay_req_lane;
+	wire delay_write_req_r = delay_write_req &  delay_req_lane;
+	
+	assign delay_read_data 	= delay_read_valid_r ? delay_read_data_r : delay_read_data_l;
+	assign delay_read_valid = delay_read_valid_l | delay_read_valid_r;
+	assign delay_write_ack 	= delay_write_ack_l  | delay_write_ack_r;
+	
+	assign delays_busy = delays_busy_l | delays_busy_r;
+	
+	delay_master #(
+		.data_width(data_width), 
+		.n_buffers(delay_buffers),
+		.memory_size(delay_mem_size),
+		.page_size(delay_page_size)
+	) delays_r (
+		.clk(clk),
+		.reset(reset | full_reset),
+		
+		.enable(1'b1),
+		
+		.alloc_req  (alloc_delay),
+		.free_req	(free_delay),
+		.resize_req (resize_delay),
+		.alloc_size (delay_size[delay_mem_addr_width-1:0]),
+		.alloc_delay(init_delay),
+		.alloc_handle(delay_handle),
+		
+		// The left table's pages; the right lane's pool is laid out the same
+		.reserved_pages(delay_pages_reserved),
+		.live(delay_live),
+		
+		.busy(delays_busy_r),
+		
+		.clone_req	 (clone & clone_delays),
+		.clone_handle(),
+		.clone_info	 (clone_delay_info),
+		.clone_initd (clone_delay_initd),
+		
+		.snoop_handle(snoop_delay_handle),
+		.snoop_info	 (),
+		.snoop_pages (),
+		.snoop_initd (),
+		
+		.read_req (delay_read_req_r),
+		.write_req(delay_write_req_r),
+		
+		.write_handle(delay_lane_handle),
+		.read_handle (delay_lane_handle),
+		.write_data  (delay_write_data),
+		.write_inc   (delay_write_inc),
+			
+		.data_out(delay_read_data_r),
+		
+		.read_valid(delay_read_valid_r),
+		.write_ack(delay_write_ack_r),
+		
+		.mem_read_req (delay_r_mem_read_req),
+		.mem_write_req(delay_r_mem_write_req),
+		
+		.mem_read_addr(delay_r_mem_read_addr),
+		.mem_data_in  (delay_r_mem_read_data),
+		
+		.mem_write_addr(delay_r_mem_write_addr),
+		.mem_data_out  (delay_r_mem_write_data),
+		
+		.mem_read_valid(delay_r_mem_read_valid),
+		.mem_write_ack (delay_r_mem_write_ack),
+
+		.any_buffers()
+	);
+	`else
+	wire [data_width - 1 : 0] delay_lane_handle = delay_req_handle;
+	
+	wire delay_read_req_l  = delay_read_req;
+	wire delay_write_req_l = delay_write_req;
+	
+	assign delay_read_data 	= delay_read_data_l;
+	assign delay_read_valid = delay_read_valid_l;
+	assign delay_write_ack 	= delay_write_ack_l;
+	
+	assign delays_busy = delays_busy_l;
+	`endif
+	
 	/**********/
 	/* Wiring */
 	/**********/
@@ -259,6 +444,9 @@ module dsp_pipeline #(
 	reg wait_one = 0;
 	
 	wire core_ready;
+	wire core_cloning;
+	
+	assign cloning = core_cloning | delays_busy;
 
 	wire lut_req;
 	wire [`LUT_HANDLE_WIDTH - 1 : 0] lut_req_handle;
@@ -281,6 +469,11 @@ module dsp_pipeline #(
 	wire delay_read_valid;
 	wire delay_write_ack;
 	
+	wire [data_width - 1 : 0] delay_read_data_l;
+	wire delay_read_valid_l;
+	wire delay_write_ack_l;
+	wire delays_busy_l;
+	
 	wire invalid_delay_read;
 	wire invalid_delay_write;
 	wire invalid_delay_alloc;
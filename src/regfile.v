@@ -23,7 +23,16 @@ module block_regfile #(parameter data_width = 16, parameter n_blocks = 256)
 		input wire sync,
 		input wire [$clog2(n_blocks) - 1 : 0] sync_addr,
 		input wire [2 * data_width   - 1 : 0] sync_value,
-		output reg syncing
+		output reg syncing,
+		
+		// Second port; whole-block reads from the active bank and
+		// writes into the inactive one, bringing it up to date
+		input wire [$clog2(n_blocks) - 1 : 0] copy_addr,
+		output reg [2 * data_width   - 1 : 0] copy_value,
+		
+		input wire copy_write,
+		input wire [$clog2(n_blocks) - 1 : 0] copy_write_addr,
+		input wire [2 * data_width   - 1 : 0] copy_write_value
 	);
 	
 	(* ram_style = "block" *)
@@ -50,8 +59,13 @@ module block_regfile #(parameter data_width = 16, parameter n_blocks = 256)
 	assign register_1_out = registers_packed_out[2 * data_width - 1 : data_width];
 	
 	
+	// A bank is only ever copied from or written on the second port,
+	// never both at once, so it stays a dual-port memory
+	wire [$clog2(n_blocks) - 1 : 0] port_b_addr = (write_enable_int) ? write_addr_int : copy_addr;
+	
 	always @(posedge clk) begin
 		registers_packed_out <= registers[read_addr_int];
+		copy_value 			 <= registers[port_b_addr];
 	
 		if (write_enable_int)
 			registers[write_addr_int] <= write_val_int;
@@ -110,6 +124,283 @@ module block_regfile #(parameter data_width = 16, parameter n_blocks = 256)
 					write_val_int <= {register_1_out, write_val_latched};
 				
 				write_enable_int <= 1;
+			end else if (copy_write) begin
+				write_addr_int 	 <= copy_write_addr;
+				write_val_int 	 <= copy_write_value;
+				write_enable_int <= 1;
+			end
+		end
+	end
+	
+endmodule
+
+/*
+ * Register ramps; an update that glides to its target over a number of
+ * samples rather than landing at once, the way the mixer moves its gains.
+ *
+ * The target is written to the inactive regfile like any other update.
+ * Meanwhile a ramp slot stands in for the register whenever its block is
+ * read, starting from the value the register held when the block was
+ * next fetched and stepping towards the target once per sample. A slot is
+ * released once the ramp is over and the target has been committed, at
+ * which point the regfile reads the same value the slot was giving.
+ *
+ * Commits are held back while a slot is still waiting to see its block,
+ * since the flip would otherwise show it the target as its starting point.
+ * Slots are released on the flip itself, which follows the commit at the
+ * next pass boundary.
+ */
+
+module block_reg_ramp #(
+		parameter data_width 	= 16,
+		parameter n_blocks 		= 256,
+		parameter n_ramps 		= 4,
+		parameter length_width 	= 16
+	) (
+		input wire clk,
+		input wire reset,
+		
+		input wire tick,
+		
+		input wire start,
+		input wire [$clog2(n_blocks) - 1 : 0] start_block,
+		input wire start_reg,
+		input wire signed [data_width - 1 : 0] start_target,
+		input wire [length_width - 1 : 0] start_length,
+		
+		// A plain update of a ramping register takes over at the next commit
+		input wire write,
+		input wire [$clog2(n_blocks) - 1 : 0] write_block,
+		input wire write_reg,
+		
+		input wire commit_req,
+		output reg commit,
+		output wire commit_held,
+		
+		// The banks flip some time after the commit, at a pass boundary
+		input wire bank_flip,
+		
+		// The block whose registers are on register_*_in this cycle
+		input wire [$clog2(n_blocks) - 1 : 0] read_block,
+		
+		input wire signed [data_width - 1 : 0] register_0_in,
+		input wire signed [data_width - 1 : 0] register_1_in,
+		output reg signed [data_width - 1 : 0] register_0_out,
+		output reg signed [data_width - 1 : 0] register_1_out,
+		
+		output wire active
+	);
+	
+	localparam block_w 	= $clog2(n_blocks);
+	localparam slot_w 	= (n_ramps > 1) ? $clog2(n_ramps) : 1;
+	
+	// Values are carried with a fractional part as wide as the ramp
+	// length, so that even the longest ramp moves by a nonzero step
+	localparam frac_w 	= length_width;
+	localparam acc_w 	= data_width + 1 + frac_w;
+	
+	localparam RAMP_FREE 	= 3'd0;
+	localparam RAMP_CAPTURE = 3'd1;
+	localparam RAMP_DIVIDE 	= 3'd2;
+	localparam RAMP_RUN 	= 3'd3;
+	localparam RAMP_HOLD 	= 3'd4;
+	
+	reg [2 : 0] 			ramp_state 		[n_ramps - 1 : 0];
+	reg [block_w - 1 : 0] 	ramp_block 		[n_ramps - 1 : 0];
+	reg 					ramp_reg 		[n_ramps - 1 : 0];
+	reg signed [data_width - 1 : 0] ramp_target [n_ramps - 1 : 0];
+	reg [length_width - 1 : 0] ramp_remaining 	[n_ramps - 1 : 0];
+	reg signed [acc_w - 1 : 0] ramp_value 		[n_ramps - 1 : 0];
+	reg signed [acc_w - 1 : 0] ramp_step 		[n_ramps - 1 : 0];
+	reg 					ramp_waited 	[n_ramps - 1 : 0];
+	reg 					ramp_seen_commit [n_ramps - 1 : 0];
+	reg 					ramp_committed 	[n_ramps - 1 : 0];
+	reg 					ramp_superseded [n_ramps - 1 : 0];
+	
+	reg [slot_w - 1 : 0] match_slot;
+	reg any_match;
+	reg [slot_w - 1 : 0] free_slot;
+	reg any_free;
+	reg [slot_w - 1 : 0] divide_slot;
+	reg any_divide;
+	reg any_capturing;
+	reg any_active;
+	
+	assign active = any_active;
+	
+	integer k;
+	always @(*) begin
+		match_slot 	  = 0;
+		any_match 	  = 0;
+		free_slot 	  = 0;
+		any_free 	  = 0;
+		divide_slot   = 0;
+		any_divide 	  = 0;
+		any_capturing = 0;
+		any_active 	  = 0;
+		
+		register_0_out = register_0_in;
+		register_1_out = register_1_in;
+		
+		for (k = n_ramps - 1; k >= 0; k = k - 1) begin
+			if (ramp_state[k] == RAMP_FREE) begin
+				free_slot = k;
+				any_free  = 1;
+			end else begin
+				any_active = 1;
+				
+				if (ramp_block[k] == start_block && ramp_reg[k] == start_reg) begin
+					match_slot = k;
+					any_match  = 1;
+				end
+			end
+			
+			if (ramp_state[k] == RAMP_DIVIDE) begin
+				divide_slot = k;
+				any_divide 	= 1;
+			end
+			
+			if (ramp_state[k] == RAMP_CAPTURE)
+				any_capturing = 1;
+			
+			if (ramp_state[k] != RAMP_FREE && ramp_state[k] != RAMP_CAPTURE && ramp_block[k] == read_block) begin
+				if (ramp_reg[k])
+					register_1_out = ramp_value[k][frac_w + data_width - 1 : frac_w];
+				else
+					register_0_out = ramp_value[k][frac_w + data_width - 1 : frac_w];
+			end
+		end
+	end
+	
+	/* Step calculation; (target - start) / length, one bit a cycle */
+	localparam div_w = data_width + 1 + frac_w;
+	
+	reg div_busy;
+	reg [slot_w 	  - 1 : 0] div_slot;
+	reg [$clog2(div_w) 	  : 0] div_ctr;
+	reg [div_w 		  - 1 : 0] div_quot;
+	reg [length_width - 1 : 0] div_rem;
+	reg [length_width - 1 : 0] div_divisor;
+	reg div_neg;
+	
+	wire [length_width : 0] div_rem_shift = {div_rem, div_quot[div_w - 1]};
+	wire div_sub = (div_rem_shift >= {1'b0, div_divisor});
+	wire [div_w - 1 : 0] div_quot_next = {div_quot[div_w - 2 : 0], div_sub};
+	
+	wire signed [data_width + 1 : 0] divide_diff = ramp_target[divide_slot] - $signed(ramp_value[divide_slot][acc_w - 1 : frac_w]);
+	wire [data_width + 1 : 0] divide_diff_abs = (divide_diff < 0) ? -divide_diff : divide_diff;
+	
+	// A commit also waits out a ramp being started, whose slot is
+	// about to go looking for its block
+	reg commit_pending;
+	wire commit_wanted = commit_req | commit_pending;
+	wire commit_now 	= commit_wanted & ~any_capturing & ~start;
+	
+	assign commit_held = commit_pending;
+	
+	integer i;
+	always @(posedge clk) begin
+		commit <= 0;
+		
+		if (reset) begin
+			for (i = 0; i < n_ramps; i = i + 1)
+				ramp_state[i] <= RAMP_FREE;
+			
+			div_busy 		<= 0;
+			commit_pending 	<= 0;
+		end else begin
+			commit 		   <= commit_now;
+			commit_pending <= commit_wanted & ~commit_now;
+			
+			for (i = 0; i < n_ramps; i = i + 1) begin
+				case (ramp_state[i])
+					RAMP_CAPTURE: begin
+						if (ramp_block[i] == read_block) begin
+							ramp_value[i] <= $signed(ramp_reg[i] ? register_1_in : register_0_in) <<< frac_w;
+							ramp_state[i] <= RAMP_DIVIDE;
+						end else if (tick) begin
+							// Every block is fetched at least once a sample. If
+							// this one wasn't, it isn't running; give up
+							if (ramp_waited[i])
+								ramp_state[i] <= RAMP_FREE;
+							ramp_waited[i] <= 1;
+						end
+					end
+					
+					RAMP_RUN: begin
+						if (tick) begin
+							if (ramp_remaining[i] <= 1) begin
+								ramp_value[i] <= ramp_target[i] <<< frac_w;
+								ramp_state[i] <= (ramp_committed[i]) ? RAMP_FREE : RAMP_HOLD;
+							end else begin
+								ramp_value[i] 	  <= ramp_value[i] + ramp_step[i];
+								ramp_remaining[i] <= ramp_remaining[i] - 1;
+							end
+						end
+					end
+				endcase
+				
+				if (write && !start && ramp_state[i] != RAMP_FREE && ramp_block[i] == write_block && ramp_reg[i] == write_reg)
+					ramp_superseded[i] <= 1;
+				
+				if (commit_now && ramp_state[i] != RAMP_FREE)
+					ramp_seen_commit[i] <= 1;
+				
+				// The regfiles have flipped by the time this lands
+				if (bank_flip && ramp_seen_commit[i]) begin
+					ramp_committed[i] <= 1;
+					
+					if (ramp_state[i] == RAMP_HOLD || ramp_superseded[i])
+						ramp_state[i] <= RAMP_FREE;
+				end
+			end
+			
+			if (div_busy) begin
+				div_rem  <= div_sub ? div_rem_shift - div_divisor : div_rem_shift[length_width - 1 : 0];
+				div_quot <= div_quot_next;
+				div_ctr  <= div_ctr + 1;
+				
+				if (div_ctr == div_w - 1) begin
+					ramp_step [div_slot] <= div_neg ? -$signed({1'b0, div_quot_next}) : $signed({1'b0, div_quot_next});
+					ramp_state[div_slot] <= RAMP_RUN;
+					div_busy <= 0;
+				end
+			end else if (any_divide) begin
+				div_busy 	<= 1;
+				div_slot 	<= divide_slot;
+				div_ctr 	<= 0;
+				div_rem 	<= 0;
+				div_quot 	<= divide_diff_abs << frac_w;
+				div_divisor <= ramp_remaining[divide_slot];
+				div_neg 	<= (divide_diff < 0);
+			end
+			
+			if (start) begin
+				if (any_match) begin
+					ramp_target   	[match_slot] <= start_target;
+					ramp_remaining	[match_slot] <= (start_length == 0) ? 1 : start_length;
+					ramp_seen_commit[match_slot] <= 0;
+					ramp_committed	[match_slot] <= 0;
+					ramp_superseded [match_slot] <= 0;
+					
+					// A ramp already under way sets off again from where it's got to
+					if (ramp_state[match_slot] != RAMP_CAPTURE)
+						ramp_state[match_slot] <= RAMP_DIVIDE;
+					
+					if (div_busy && div_slot == match_slot)
+						div_busy <= 0;
+				end else if (any_free) begin
+					ramp_state 		[free_slot] <= RAMP_CAPTURE;
+					ramp_block 		[free_slot] <= start_block;
+					ramp_reg 		[free_slot] <= start_reg;
+					ramp_target 	[free_slot] <= start_target;
+					ramp_remaining 	[free_slot] <= (start_length == 0) ? 1 : start_length;
+					ramp_waited 	[free_slot] <= 0;
+					ramp_seen_commit[free_slot] <= 0;
+					ramp_committed 	[free_slot] <= 0;
+					ramp_superseded [free_slot] <= 0;
+				end
+				// With every slot taken, the target simply lands at the commit
 			end
 		end
 	end
@@ -49,7 +49,7 @@ module rr_arbiter
 			case (state)
 				`RR_ARBITER_STATE_READY: begin
 					if (reqs[client]) begin
-						arbiter_req_data <= req_data[n_clients * client +: req_data_width];
+						arbiter_req_data <= req_data[req_data_width * client +: req_data_width];
 						arbiter_req <= 1;
 					
 						state <= `RR_ARBITER_STATE_WAIT;
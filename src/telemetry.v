@@ -0,0 +1,222 @@
+`include "engine.vh"
+
+`default_nettype none
+
+/*
+ * Metering over SPI
+ *
+ * With telemetry on (COMMAND_SET_TELEMETRY), each SPI transfer clocks
+ * out the next byte of a rolling packet in place of the controller's
+ * status byte. The host keeps transfers going with zero bytes, which
+ * the controller takes for no command at all. A packet is:
+ *
+ *	 0		TELEMETRY_SYNC
+ *	 1		sequence number
+ *	 2-11	pipeline A: input peak, input envelope, output peak,
+ *			output envelope, cycles per sample
+ *	12-21	pipeline B: the same
+ *	22-23	samples clipped at the engine's output
+ *	24		current_pipeline, health, sample rate; see TELEMETRY_STATUS_*
+ *	25		XOR of bytes 0-24
+ *
+ * Two-byte fields go high byte first. Peaks and clips are since the last
+ * packet was taken, which is as its sync byte goes out; envelopes are as
+ * they stood then. Levels are the top 16 bits of a sample's magnitude.
+ */
+
+module level_meter #(parameter data_width = 16)
+	(
+		input wire clk,
+		input wire reset,
+
+		input wire sample_valid,
+		input wire signed [data_width - 1 : 0] sample_in,
+
+		// Start the peak and clip count over
+		input wire clear,
+
+		output reg [data_width - 1 : 0] peak,
+		output reg [data_width - 1 : 0] envelope,
+		output reg [15 : 0] clips
+	);
+
+	localparam sat_min = -(1 << (data_width - 1));
+	localparam sat_max =  (1 << (data_width - 1)) - 1;
+
+	reg [data_width - 1 : 0] abs;
+	reg [data_width - 1 : 0] envelope_1;
+	reg [data_width - 1 : 0] envelope_2;
+	reg clipped;
+
+	reg abs_valid;
+	reg envelope_1_valid;
+	reg envelope_2_valid;
+
+	always @(posedge clk) begin
+		abs_valid <= sample_valid;
+		envelope_1_valid <= abs_valid;
+		envelope_2_valid <= envelope_1_valid;
+
+		if (reset) begin
+			peak 	 <= 0;
+			envelope <= 0;
+			clips 	 <= 0;
+
+			abs_valid <= 0;
+			envelope_1_valid <= 0;
+			envelope_2_valid <= 0;
+		end else begin
+			if (sample_valid) begin
+				abs 	<= sample_in < 0 ? -sample_in : sample_in;
+				clipped <= (sample_in == sat_min || sample_in == sat_max);
+			end
+
+			if (clear) begin
+				peak  <= abs_valid ? abs : 0;
+				clips <= (abs_valid && clipped) ? 1 : 0;
+			end else if (abs_valid) begin
+				if (abs > peak) peak <= abs;
+				if (clipped && ~&clips) clips <= clips + 1;
+			end
+
+			// The same cascade as health_monitor's
+			if (abs_valid) envelope_1 		 <= (envelope >> 1) + (abs >> 3);
+			if (envelope_1_valid) envelope_2 <=  envelope_1 + (envelope >> 2);
+			if (envelope_2_valid) envelope   <=  envelope_2 + (envelope >> 3);
+		end
+	end
+endmodule
+
+module telemetry #(parameter data_width = 16)
+	(
+		input wire clk,
+		input wire reset,
+
+		input wire enable,
+
+		// Once a frame; the samples are held between
+		input wire sample_valid,
+
+		input wire signed [data_width - 1 : 0] in_sample_a,
+		input wire signed [data_width - 1 : 0] out_sample_a,
+		input wire signed [data_width - 1 : 0] in_sample_b,
+		input wire signed [data_width - 1 : 0] out_sample_b,
+		input wire signed [data_width - 1 : 0] out_sample,
+
+		input wire [15 : 0] cycles_a,
+		input wire [15 : 0] cycles_b,
+
+		input wire current_pipeline,
+		input wire health,
+		input wire [2 : 0] sample_rate,
+
+		// An SPI transfer has finished
+		input wire next,
+
+		output wire [7 : 0] byte_out
+	);
+
+	localparam last_byte = `TELEMETRY_PACKET_BYTES - 1;
+
+	reg [4 : 0] index;
+	reg [7 : 0] seq_no;
+	reg [7 : 0] checksum;
+
+	// Bytes 0-24 of the packet going out
+	reg [7 : 0] packet [last_byte - 1 : 0];
+
+	wire take = ~enable | (next & (index == last_byte));
+
+	wire [data_width - 1 : 0] levels [7 : 0];
+	wire [15 : 0] clips [4 : 0];
+
+	wire signed [data_width - 1 : 0] meter_samples [4 : 0];
+
+	assign meter_samples[0] = in_sample_a;
+	assign meter_samples[1] = out_sample_a;
+	assign meter_samples[2] = in_sample_b;
+	assign meter_samples[3] = out_sample_b;
+	assign meter_samples[4] = out_sample;
+
+	genvar i;
+	generate
+		for (i = 0; i < 4; i = i + 1) begin : meters
+			level_meter #(.data_width(data_width)) meter (
+				.clk(clk),
+				.reset(reset),
+
+				.sample_valid(sample_valid),
+				.sample_in(meter_samples[i]),
+
+				.clear(take),
+
+				.peak(levels[2 * i]),
+				.envelope(levels[2 * i + 1]),
+				.clips(clips[i])
+			);
+		end
+	endgenerate
+
+	// Only the clip count of the engine's output is sent
+	level_meter #(.data_width(data_width)) out_meter (
+		.clk(clk),
+		.reset(reset),
+
+		.sample_valid(sample_valid),
+		.sample_in(meter_samples[4]),
+
+		.clear(take),
+
+		.peak(),
+		.envelope(),
+		.clips(clips[4])
+	);
+
+	// Bytes 0-24 as they stand now, to be taken as a packet
+	wire [7 : 0] packet_next [last_byte - 1 : 0];
+
+	assign packet_next[0] = `TELEMETRY_SYNC;
+	assign packet_next[1] = seq_no;
+
+	generate
+		for (i = 0; i < 8; i = i + 1) begin : level_bytes
+			assign packet_next[2 + 2 * i + (i >> 2) * 2]     = levels[i][data_width - 1 : data_width - 8];
+			assign packet_next[2 + 2 * i + (i >> 2) * 2 + 1] = levels[i][data_width - 9 : data_width - 16];
+		end
+	endgenerate
+
+	assign packet_next[10] = cycles_a[15 : 8];
+	assign packet_next[11] = cycles_a[ 7 : 0];
+	assign packet_next[20] = cycles_b[15 : 8];
+	assign packet_next[21] = cycles_b[ 7 : 0];
+	assign packet_next[22] = clips[4][15 : 8];
+	assign packet_next[23] = clips[4][ 7 : 0];
+
+	assign packet_next[24] = {3'd0, sample_rate, health, current_pipeline};
+
+	assign byte_out = (index == last_byte) ? checksum : packet[index];
+
+	integer j;
+
+	always @(posedge clk) begin
+		if (reset) begin
+			index 	 <= 0;
+			seq_no 	 <= 0;
+			checksum <= 0;
+		end else if (take) begin
+			index 	 <= 0;
+			checksum <= 0;
+
+			for (j = 0; j < last_byte; j = j + 1)
+				packet[j] <= packet_next[j];
+
+			if (enable)
+				seq_no <= seq_no + 1;
+		end else if (next) begin
+			index 	 <= index + 1;
+			checksum <= checksum ^ packet[index];
+		end
+	end
+endmodule
+
+`default_nettype wire
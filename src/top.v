@@ -1,3 +1,6 @@
+`include "core.vh"
+`include "engine.vh"
+
 `default_nettype none
 
 module top #(
@@ -47,6 +50,11 @@ module top #(
 
 		.in_sample(sample_in),
 		.out_sample(sample_out),
+		
+		`ifdef CORE_STEREO
+		.in_sample_r(sample_in_r),
+		.out_sample_r(sample_out_r),
+		`endif
 	
 		.sample_valid(sample_valid),
 	
@@ -54,6 +62,8 @@ module top #(
 		.command_in_valid(spi_in_valid),
 
 		.current_pipeline(current_pipeline),
+		.sample_rate(sample_rate),
+		.deadline_miss(deadline_miss),
 		
 		.out(out),
 		.spi_byte_out(spi_byte_out)
@@ -63,6 +73,8 @@ module top #(
 	wire [7:0] spi_byte_out;
 	
 	wire current_pipeline;
+	wire [2:0] sample_rate;
+	wire deadline_miss;
 	
 	wire reset = ~pll_lock;
 	
@@ -76,6 +88,18 @@ module top #(
 	assign led3 = ~out[1];
 	assign led4 = ~out[2];
 	assign led5 = ~out[3];
+	
+	// Lit for a while after each low-latency frame that misses its deadline
+	reg [23:0] miss_ctr = 0;
+	
+	always @(posedge sys_clk) begin
+		if (deadline_miss)
+			miss_ctr <= 24'hFFFFFF;
+		else if (miss_ctr != 0)
+			miss_ctr <= miss_ctr - 1;
+	end
+	
+	assign led2 = ~(miss_ctr != 0);
 
 	// I2S
 	wire sample_valid;
@@ -83,12 +107,24 @@ module top #(
 	wire [data_width - 1 : 0] sample_out;
 	wire [data_width - 1 : 0] sample_in;
 
+	`ifdef CORE_STEREO
+	wire [data_width - 1 : 0] sample_out_r;
+	wire [data_width - 1 : 0] sample_in_r;
+	
+	i2s_trx #(.sample_size(data_width)) i2s_driver (
+		.sys_clk(sys_clk), .bclk(bclk), .lrclk(lrclk), .din(i2s_din), .dout(i2s_dout),
+		.enable(1'b1), .reset(reset), .rx_valid(sample_valid),
+		.tx_l(sample_out), .tx_r(sample_out_r),
+		.rx_l(sample_in), .rx_r(sample_in_r)
+	);
+	`else
 	i2s_trx #(.sample_size(data_width)) i2s_driver (
 		.sys_clk(sys_clk), .bclk(bclk), .lrclk(lrclk), .din(i2s_din), .dout(i2s_dout),
 		.enable(1'b1), .reset(reset), .rx_valid(sample_valid),
 		.tx_l(sample_out), .tx_r(sample_out),
 		.rx_l(sample_in), .rx_r()
 	);
+	`endif
 	
 	// SPI
 	wire [7:0] spi_in;
@@ -141,7 +177,6 @@ module top #(
 	reg bclk = 1'b0;
 	wire lrclk;
 	
-	reg [2:0] mclk_ctr = 0;
 	reg [3:0] bclk_counter = 4'd0;
 	
 	reg [5:0] lrclk_counter = 6'd0;
@@ -151,22 +186,51 @@ module top #(
 	assign bclk_out  = bclk;
 	assign lrclk_out = lrclk;
 	
+	// MCLK edges per sys_clk cycle, as a fraction num/den. A frame is
+	// 256 MCLK edges, so 256 * den / num cycles: 1280 at 44.1kHz, and
+	// the rest scaled from that. The 48kHz family doesn't divide evenly,
+	// so its edges come a cycle early or late to keep the average right
+	reg [2:0] rate_r = `SAMPLE_RATE_44K1;
+	
+	reg [7:0] mclk_num;
+	reg [7:0] mclk_den;
+	
+	always @(*) begin
+		case (rate_r)
+			`SAMPLE_RATE_48K:  begin mclk_num = 32;  mclk_den = 147; end
+			`SAMPLE_RATE_88K2: begin mclk_num = 2;   mclk_den = 5;   end
+			`SAMPLE_RATE_96K:  begin mclk_num = 64;  mclk_den = 147; end
+			`SAMPLE_RATE_192K: begin mclk_num = 128; mclk_den = 147; end
+			default: 		   begin mclk_num = 1;   mclk_den = 5;   end
+		endcase
+	end
+	
+	reg  [7:0] mclk_acc = 0;
+	wire [8:0] mclk_acc_next = mclk_acc + mclk_num;
+	
 	always @(posedge sys_clk) begin
 		if (pll_lock) begin
-			if (mclk_ctr == 4) begin
+			if (mclk_acc_next >= mclk_den) begin
 				mclk <= ~mclk;
-				mclk_ctr <= 0;
+				mclk_acc <= mclk_acc_next - mclk_den;
 
 				bclk_counter <= bclk_counter + 1'b1;
 				if (bclk_counter == 1) begin
 					bclk <= ~bclk;
 					bclk_counter <= 0;
 
-					if (bclk)
+					if (bclk) begin
 						lrclk_counter <= lrclk_counter + 1;
+						
+						// A new rate starts with a new frame
+						if (lrclk_counter == 6'd63 && rate_r != sample_rate) begin
+							rate_r <= sample_rate;
+							mclk_acc <= 0;
+						end
 					end
+				end
 			end else begin
-				mclk_ctr <= mclk_ctr + 1;
+				mclk_acc <= mclk_acc_next;
 			end
 		end   
 	end
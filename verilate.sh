@@ -1,3 +1,15 @@
-verilator  src/*.v \
-	--top-module top  --x-assign unique --x-initial unique -Wno-fatal -Isrc -Iinclude -cc -CFLAGS "-fpermissive -Wno-error"  -LDFLAGS "-lM" --trace-fst -exe verilator/sim_main.cpp verilator/sim_io.cpp \
-	&& make -C obj_dir -j -f Vtop.mk Vtop
+# The harness options in verilator/sim_main.h that need hooks in the RTL
+# as well: each one set there is passed on as a define of the same name
+RTL_DEFINES=""
+
+for option in SIM_PROFILE SIM_FUZZ SIM_FETCH_COUNTERS; do
+	if grep -Eq "^#define ${option}([[:space:]]|$)" verilator/sim_main.h; then
+		RTL_DEFINES="$RTL_DEFINES +define+${option}"
+	fi
+done
+
+verilator  src/*.v $RTL_DEFINES \
+	--top-module top  --x-assign unique --x-initial unique -Wno-fatal -Isrc -Iinclude -cc -CFLAGS "-std=c++20 -fpermissive -Wno-error"  -LDFLAGS "-lM -lrt -pthread" --trace-fst -exe verilator/sim_main.cpp verilator/sim_io.cpp verilator/patch.cpp verilator/delay_alloc.cpp verilator/automation.cpp verilator/regcommit_bench.cpp verilator/cycle_estimate.cpp verilator/schedule.cpp verilator/link.cpp verilator/profile.cpp verilator/txlog.cpp verilator/measure.cpp verilator/bridge.cpp verilator/stereo.cpp verilator/rate_sweep.cpp verilator/telemetry.cpp verilator/model.cpp verilator/fuzz.cpp verilator/session.cpp verilator/latency.cpp verilator/batch_cache.cpp verilator/delay_pool.cpp verilator/agents.cpp verilator/mode_compare.cpp \
+	&& make -C obj_dir -j -f Vtop.mk Vtop \
+	&& g++ -std=c++17 -O2 -o obj_dir/txlog verilator/txlog_tool.cpp \
+	&& g++ -std=c++17 -O2 -fPIC -c -o obj_dir/bridge_client.o verilator/bridge_client.cpp
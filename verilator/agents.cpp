@@ -0,0 +1,492 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include "sim_main.h"
+#include "agents.h"
+#include "Vtop___024root.h"
+
+/*
+ * Testbench agents, as coroutines.
+ *
+ * Rather than checking on every tick everything the harness might have
+ * to do (whether a frame is done, whether a batch is due, whether SPI is
+ * free for the next byte), each of those is an agent of its own, which
+ * says what it's waiting for with co_await, and the scheduler clocks the
+ * model and resumes only the agents whose wait is over: a number of
+ * edges or frames, kept in heaps so only the soonest is looked at, an
+ * event another agent fires, or a condition on the model. Conditions
+ * are the one thing looked at every edge, and only while some agent is
+ * waiting on one, so an edge with nothing due costs the model's eval and
+ * a few compares.
+ *
+ * Agents are resumed in the order their waits come due, and all of them
+ * on the thread that clocks the model, so they can read and drive it
+ * and the I2S and SPI state freely between edges.
+ *
+ * The main harness runs this way, with the SPI driver below sending its
+ * send queue and agents of its own for the frames and the progress line.
+ */
+
+static bool due_later(const sim_agent_wait &a, const sim_agent_wait &b)
+{
+	return a.due > b.due;
+}
+
+static void clock_model(sim_scheduler *sched)
+{
+	Vtop *top = sched->top;
+
+	if (sched->clock)
+	{
+		sched->clock();
+		return;
+	}
+
+	top->sys_clk = 1;
+	sim_io_drive(sched->io, top);
+	top->eval();
+
+	top->sys_clk = 0;
+	sim_io_drive(sched->io, top);
+	top->eval();
+}
+
+static void resume(sim_scheduler *sched, std::coroutine_handle<> handle)
+{
+	sched->resumes++;
+
+	handle.resume();
+
+	if (handle.done())
+		sched->running--;
+}
+
+static void resume_due(sim_scheduler *sched, std::vector<sim_agent_wait> *waits, long now)
+{
+	while (!waits->empty() && waits->front().due <= now)
+	{
+		std::pop_heap(waits->begin(), waits->end(), due_later);
+
+		std::coroutine_handle<> handle = waits->back().handle;
+		waits->pop_back();
+
+		resume(sched, handle);
+	}
+}
+
+// Those that hold are taken out before any is resumed, since resuming
+// one may well add more
+static void resume_conds(sim_scheduler *sched)
+{
+	std::vector<std::coroutine_handle<>> fired;
+
+	for (size_t i = 0; i < sched->cond_waits.size();)
+	{
+		if (sched->cond_waits[i].cond())
+		{
+			fired.push_back(sched->cond_waits[i].handle);
+
+			sched->cond_waits[i] = std::move(sched->cond_waits.back());
+			sched->cond_waits.pop_back();
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	for (size_t i = 0; i < fired.size(); i++)
+		resume(sched, fired[i]);
+}
+
+static void resume_ready(sim_scheduler *sched)
+{
+	while (!sched->ready.empty())
+	{
+		std::vector<std::coroutine_handle<>> ready;
+		ready.swap(sched->ready);
+
+		for (size_t i = 0; i < ready.size(); i++)
+			resume(sched, ready[i]);
+	}
+}
+
+void sim_scheduler_init(sim_scheduler *sched, Vtop *top, sim_io_state *io)
+{
+	sched->top 	 = top;
+	sched->io 	 = io;
+	sched->clock = NULL;
+
+	sched->cycle = 0;
+	sched->frame = 0;
+
+	sched->cycle_waits.clear();
+	sched->frame_waits.clear();
+	sched->cond_waits.clear();
+	sched->ready.clear();
+	sched->agents.clear();
+
+	sched->running = 0;
+	sched->stop    = 0;
+	sched->resumes = 0;
+}
+
+void sim_scheduler_free(sim_scheduler *sched)
+{
+	for (size_t i = 0; i < sched->agents.size(); i++)
+		sched->agents[i].destroy();
+
+	sched->agents.clear();
+	sched->cycle_waits.clear();
+	sched->frame_waits.clear();
+	sched->cond_waits.clear();
+	sched->ready.clear();
+
+	sched->running = 0;
+}
+
+void sim_scheduler_spawn(sim_scheduler *sched, sim_agent agent)
+{
+	sched->agents.push_back(agent.handle);
+	sched->ready.push_back(agent.handle);
+	sched->running++;
+}
+
+void sim_scheduler_stop(sim_scheduler *sched)
+{
+	sched->stop = 1;
+}
+
+void sim_event_fire(sim_scheduler *sched, sim_event *event)
+{
+	sched->ready.insert(sched->ready.end(), event->waiting.begin(), event->waiting.end());
+	event->waiting.clear();
+}
+
+long sim_scheduler_run(sim_scheduler *sched, long max_cycles)
+{
+	long started_at = sched->cycle;
+
+	sched->stop = 0;
+
+	resume_ready(sched);
+
+	while (sched->running > 0 && !sched->stop && sched->cycle - started_at < max_cycles)
+	{
+		clock_model(sched);
+		sched->cycle++;
+
+		resume_due(sched, &sched->cycle_waits, sched->cycle);
+
+		if (sched->io->i2s_ready)
+		{
+			sched->io->i2s_ready = 0;
+			sched->frame++;
+
+			resume_due(sched, &sched->frame_waits, sched->frame);
+		}
+
+		if (!sched->cond_waits.empty())
+			resume_conds(sched);
+
+		resume_ready(sched);
+	}
+
+	return sched->cycle - started_at;
+}
+
+void sim_await_cycles::await_suspend(std::coroutine_handle<> handle)
+{
+	sched->cycle_waits.push_back({sched->cycle + n, handle});
+	std::push_heap(sched->cycle_waits.begin(), sched->cycle_waits.end(), due_later);
+}
+
+void sim_await_frames::await_suspend(std::coroutine_handle<> handle)
+{
+	sched->frame_waits.push_back({sched->frame + n, handle});
+	std::push_heap(sched->frame_waits.begin(), sched->frame_waits.end(), due_later);
+}
+
+void sim_await_until::await_suspend(std::coroutine_handle<> handle)
+{
+	sched->cond_waits.push_back({cond, handle});
+}
+
+void sim_spi_queue_init(sim_spi_queue *queue)
+{
+	queue->head 	= 0;
+	queue->count 	= 0;
+	queue->sending 	= 0;
+	queue->settling = 0;
+
+	queue->queued.waiting.clear();
+	queue->sent.waiting.clear();
+}
+
+int sim_spi_queue_put(sim_scheduler *sched, sim_spi_queue *queue, m_fpga_transfer_batch batch)
+{
+	if (queue->count == AGENTS_MAX_BATCHES)
+		return 1;
+
+	queue->batches[(queue->head + queue->count) % AGENTS_MAX_BATCHES] = batch;
+	queue->count++;
+
+	sim_event_fire(sched, &queue->queued);
+
+	return 0;
+}
+
+void sim_spi_queue_free(sim_spi_queue *queue)
+{
+	for (int i = 0; i < queue->count; i++)
+		free(queue->batches[(queue->head + i) % AGENTS_MAX_BATCHES].buf);
+
+	queue->count = 0;
+}
+
+/**********/
+/* Agents */
+/**********/
+
+static bool spi_idle(const sim_io_state *io)
+{
+	return !io->spi_sending && io->spi_read_head == io->spi_write_head;
+}
+
+sim_agent sim_agent_i2s_source(sim_scheduler *sched, const int16_t *samples, int n)
+{
+	for (;;)
+	{
+		sched->io->sample_in 	= samples[sched->frame % n];
+		sched->io->sample_in_r 	= samples[sched->frame % n];
+
+		co_await sim_frames(sched, 1);
+	}
+}
+
+sim_agent sim_agent_i2s_sink(sim_scheduler *sched, int16_t *out, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		co_await sim_frames(sched, 1);
+
+		out[i] = sched->io->sample_out;
+	}
+
+	sim_scheduler_stop(sched);
+}
+
+sim_agent sim_agent_spi_driver(sim_scheduler *sched, sim_spi_queue *queue)
+{
+	sim_io_state *io = sched->io;
+	Vtop *top = sched->top;
+
+	for (;;)
+	{
+		if (!queue->count)
+			co_await sim_wait(sched, &queue->queued);
+
+		// led1 is the controller, idle
+		co_await sim_until(sched, [io, top]() { return spi_idle(io) && top->led1; });
+
+		m_fpga_transfer_batch *batch = &queue->batches[queue->head];
+
+		queue->sending = 1;
+
+		for (int i = 0; i < batch->len; i++)
+		{
+			co_await sim_until(sched, [io]() { return spi_idle(io); });
+
+			spi_enqueue(io, batch->buf[i]);
+		}
+
+		free(batch->buf);
+
+		queue->head = (queue->head + 1) % AGENTS_MAX_BATCHES;
+		queue->count--;
+
+		queue->sending 	= 0;
+		queue->settling = 1;
+
+		sim_event_fire(sched, &queue->sent);
+
+		// For the last byte to reach the controller before led1 means
+		// anything again
+		co_await sim_frames(sched, AGENTS_SETTLE_FRAMES + 1);
+
+		queue->settling = 0;
+	}
+}
+
+sim_agent sim_agent_script(sim_scheduler *sched, sim_spi_queue *queue, const m_fpga_transfer_batch *batches, const long *at, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		co_await sim_frames(sched, at[i] - sched->frame);
+
+		while (sim_spi_queue_put(sched, queue, batches[i]))
+			co_await sim_wait(sched, &queue->sent);
+	}
+}
+
+sim_agent sim_agent_monitor(sim_scheduler *sched, long every)
+{
+	for (;;)
+	{
+		co_await sim_frames(sched, every);
+
+		printf("\rFrame %ld, cycle %ld", sched->frame, sched->cycle);
+		fflush(stdout);
+	}
+}
+
+sim_agent sim_agent_checker(sim_scheduler *sched, int n_swaps, int *swaps, long *swapped_at)
+{
+	Vtop *top = sched->top;
+	int pipeline = top->rootp->top__DOT__engine__DOT__controller__DOT__current_pipeline;
+
+	while (*swaps < n_swaps)
+	{
+		co_await sim_until(sched, [top, pipeline]() {
+			return top->rootp->top__DOT__engine__DOT__controller__DOT__current_pipeline != pipeline;
+		});
+
+		pipeline ^= 1;
+		swapped_at[(*swaps)++] = sched->frame;
+	}
+}
+
+/*********/
+/* Bench */
+/*********/
+
+// Ten periods of 1500Hz at 44.1kHz
+#define AGENTS_TONE_LENGTH 	294
+
+int sim_agents_bench()
+{
+	static int16_t tone[AGENTS_TONE_LENGTH];
+	static int16_t out[AGENTS_BENCH_FRAMES];
+
+	const char *paths[2] = {"eff/gain.eff", "eff/del.eff"};
+	const long at[2] = {0, AGENTS_BENCH_FRAMES / 2};
+
+	for (int i = 0; i < AGENTS_TONE_LENGTH; i++)
+		tone[i] = (int16_t)(sinf(2.0f * (float)M_PI * 10.0f * i / AGENTS_TONE_LENGTH) * 16383.0f);
+
+	// Bare: the model and I2S, and the sample in each frame
+	VerilatedContext *context = new VerilatedContext;
+	context->randReset(2);
+	context->randSeed(1);
+
+	Vtop *top = new Vtop(context);
+	sim_io_state bare_io;
+	sim_io_init(&bare_io);
+
+	long bare_cycles = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (long frame = 0; frame < AGENTS_BENCH_FRAMES; bare_cycles++)
+	{
+		top->sys_clk = 1;
+		sim_io_drive(&bare_io, top);
+		top->eval();
+
+		top->sys_clk = 0;
+		sim_io_drive(&bare_io, top);
+		top->eval();
+
+		if (bare_io.i2s_ready)
+		{
+			bare_io.i2s_ready = 0;
+			frame++;
+
+			bare_io.sample_in 	= tone[frame % AGENTS_TONE_LENGTH];
+			bare_io.sample_in_r = tone[frame % AGENTS_TONE_LENGTH];
+		}
+	}
+
+	double bare_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	top->final();
+	delete top;
+	delete context;
+
+	// Agents, on an engine of their own
+	m_fpga_transfer_batch batches[2];
+
+	for (int i = 0; i < 2; i++)
+	{
+		if (sim_session_effect_batch(paths[i], &batches[i]))
+		{
+			fprintf(stderr, "Agent bench: can't read %s\n", paths[i]);
+
+			if (i)
+				free(batches[0].buf);
+
+			return 1;
+		}
+	}
+
+	context = new VerilatedContext;
+	context->randReset(2);
+	context->randSeed(1);
+
+	top = new Vtop(context);
+	sim_io_state agents_io;
+	sim_io_init(&agents_io);
+
+	static sim_scheduler sched;
+	static sim_spi_queue queue;
+
+	sim_scheduler_init(&sched, top, &agents_io);
+
+	sim_spi_queue_init(&queue);
+
+	int swaps = 0;
+	long swapped_at[2] = {-1, -1};
+
+	sim_scheduler_spawn(&sched, sim_agent_i2s_source(&sched, tone, AGENTS_TONE_LENGTH));
+	sim_scheduler_spawn(&sched, sim_agent_i2s_sink(&sched, out, AGENTS_BENCH_FRAMES));
+	sim_scheduler_spawn(&sched, sim_agent_spi_driver(&sched, &queue));
+	sim_scheduler_spawn(&sched, sim_agent_script(&sched, &queue, batches, at, 2));
+	sim_scheduler_spawn(&sched, sim_agent_monitor(&sched, 4096));
+	sim_scheduler_spawn(&sched, sim_agent_checker(&sched, 2, &swaps, swapped_at));
+
+	start = std::chrono::steady_clock::now();
+
+	long agents_cycles = sim_scheduler_run(&sched, 1L << 40);
+
+	double agents_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("\n");
+
+	// Anything the driver hadn't got to yet
+	sim_spi_queue_free(&queue);
+
+	int peak = 0;
+
+	for (long i = (swapped_at[0] < 0) ? 0 : swapped_at[0]; i < AGENTS_BENCH_FRAMES; i++)
+		peak = (abs(out[i]) > peak) ? abs(out[i]) : peak;
+
+	printf("Bare:   %ld cycles over %d frames in %.2fs (%.2f Mcycles/s)\n",
+		bare_cycles, AGENTS_BENCH_FRAMES, bare_seconds, bare_cycles / bare_seconds / 1e6);
+	printf("Agents: %ld cycles over %ld frames in %.2fs (%.2f Mcycles/s), %ld resumes, %.1f%% over bare\n",
+		agents_cycles, sched.frame, agents_seconds, agents_cycles / agents_seconds / 1e6, sched.resumes,
+		100.0 * (agents_seconds / agents_cycles) / (bare_seconds / bare_cycles) - 100.0);
+	printf("Swaps:  %d of 2, at frames %ld and %ld; output peak %d after the first\n",
+		swaps, swapped_at[0], swapped_at[1], peak);
+
+	sim_scheduler_free(&sched);
+
+	top->final();
+	delete top;
+	delete context;
+
+	return (swaps == 2) ? 0 : 1;
+}
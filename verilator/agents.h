@@ -0,0 +1,199 @@
+#ifndef DSP_SIM_AGENTS_H_
+#define DSP_SIM_AGENTS_H_
+
+#include <coroutine>
+#include <functional>
+#include <vector>
+
+// Frames the agent bench runs for, once with agents and once bare
+#define AGENTS_BENCH_FRAMES 	22050
+
+// Frames after a batch's last byte before the SPI driver takes led1 to
+// mean the controller's done with it
+#define AGENTS_SETTLE_FRAMES 	2
+
+// Batches waiting for the driver; a session may queue a good few
+#define AGENTS_MAX_BATCHES 		64
+
+// An agent is a coroutine, started by sim_scheduler_spawn and resumed by
+// the scheduler only when what it co_awaits comes about
+struct sim_agent {
+	struct promise_type {
+		sim_agent get_return_object() { return sim_agent{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { abort(); }
+	};
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+typedef struct {
+	long due;
+	std::coroutine_handle<> handle;
+} sim_agent_wait;
+
+typedef struct {
+	std::function<bool()> cond;
+	std::coroutine_handle<> handle;
+} sim_agent_cond;
+
+// Something agents wait on and other agents fire, for what the model
+// can't be asked directly
+typedef struct {
+	std::vector<std::coroutine_handle<>> waiting;
+} sim_event;
+
+typedef struct {
+	Vtop *top;
+	sim_io_state *io;
+
+	// Clocks the model a cycle: both edges, with the I2S and SPI driven
+	// between, if NULL; the main harness gives its tick, which dumps and
+	// logs as it goes
+	int (*clock)();
+
+	// sys_clk rising edges and lrclk frames so far
+	long cycle;
+	long frame;
+
+	// Heaps, soonest first, by cycle and by frame
+	std::vector<sim_agent_wait> cycle_waits;
+	std::vector<sim_agent_wait> frame_waits;
+
+	// Looked at each cycle, but only while there are any
+	std::vector<sim_agent_cond> cond_waits;
+
+	// Fired events' waiters, resumed before the next edge
+	std::vector<std::coroutine_handle<>> ready;
+
+	std::vector<std::coroutine_handle<sim_agent::promise_type>> agents;
+	int running;
+
+	int stop;
+	long resumes;
+} sim_scheduler;
+
+void sim_scheduler_init(sim_scheduler *sched, Vtop *top, sim_io_state *io);
+
+// Destroys any agents still suspended
+void sim_scheduler_free(sim_scheduler *sched);
+
+// Take an agent on; it starts at the next sim_scheduler_run
+void sim_scheduler_spawn(sim_scheduler *sched, sim_agent agent);
+
+// Clock the model until every agent has finished, one has called
+// sim_scheduler_stop, or max_cycles edges have gone by. Returns the
+// cycles run
+long sim_scheduler_run(sim_scheduler *sched, long max_cycles);
+
+void sim_scheduler_stop(sim_scheduler *sched);
+
+void sim_event_fire(sim_scheduler *sched, sim_event *event);
+
+/*************/
+/* Awaitable */
+/*************/
+
+// co_await sim_cycles(sched, n): resumed n rising edges on
+struct sim_await_cycles {
+	sim_scheduler *sched;
+	long n;
+
+	bool await_ready() const noexcept { return n <= 0; }
+	void await_suspend(std::coroutine_handle<> handle);
+	void await_resume() const noexcept {}
+};
+
+// co_await sim_frames(sched, n): resumed at the n-th lrclk fall from
+// now, after the sample that came in has been taken and before the next
+// one goes out
+struct sim_await_frames {
+	sim_scheduler *sched;
+	long n;
+
+	bool await_ready() const noexcept { return n <= 0; }
+	void await_suspend(std::coroutine_handle<> handle);
+	void await_resume() const noexcept {}
+};
+
+// co_await sim_until(sched, cond): resumed on the first edge after
+// which cond holds, or straight away if it holds already
+struct sim_await_until {
+	sim_scheduler *sched;
+	std::function<bool()> cond;
+
+	bool await_ready() const { return cond(); }
+	void await_suspend(std::coroutine_handle<> handle);
+	void await_resume() const noexcept {}
+};
+
+struct sim_await_event {
+	sim_scheduler *sched;
+	sim_event *event;
+
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<> handle) { event->waiting.push_back(handle); }
+	void await_resume() const noexcept {}
+};
+
+inline sim_await_cycles sim_cycles(sim_scheduler *sched, long n) { return {sched, n}; }
+inline sim_await_frames sim_frames(sim_scheduler *sched, long n) { return {sched, n}; }
+inline sim_await_until 	sim_until (sim_scheduler *sched, std::function<bool()> cond) { return {sched, cond}; }
+inline sim_await_event 	sim_wait  (sim_scheduler *sched, sim_event *event) { return {sched, event}; }
+
+/**********/
+/* Agents */
+/**********/
+
+// Batches for the SPI driver, each sent once the controller is idle
+typedef struct {
+	m_fpga_transfer_batch batches[AGENTS_MAX_BATCHES];
+	int head;
+	int count;
+
+	// The driver's partway through a batch, or waiting after one for
+	// the controller to have taken it
+	int sending;
+	int settling;
+
+	sim_event queued;
+	sim_event sent;
+} sim_spi_queue;
+
+void sim_spi_queue_init(sim_spi_queue *queue);
+
+// Hand a batch to the driver, which frees it once sent. Nonzero if the
+// queue is full, and the batch is still the caller's
+int sim_spi_queue_put(sim_scheduler *sched, sim_spi_queue *queue, m_fpga_transfer_batch batch);
+
+// Free whatever the driver hadn't got to
+void sim_spi_queue_free(sim_spi_queue *queue);
+
+// Puts samples[frame % n] in every frame, on both channels
+sim_agent sim_agent_i2s_source(sim_scheduler *sched, const int16_t *samples, int n);
+
+// Takes the sample out every frame into `out'; once n are in, stops the
+// scheduler
+sim_agent sim_agent_i2s_sink(sim_scheduler *sched, int16_t *out, int n);
+
+// Sends each batch put on `queue', a byte at a time as SPI goes idle,
+// waiting for the controller between batches; runs until stopped
+sim_agent sim_agent_spi_driver(sim_scheduler *sched, sim_spi_queue *queue);
+
+// Queues each batch in turn, `batches[i]' at frame `at[i]'
+sim_agent sim_agent_script(sim_scheduler *sched, sim_spi_queue *queue, const m_fpga_transfer_batch *batches, const long *at, int n);
+
+// Prints the frame and cycle every `every' frames
+sim_agent sim_agent_monitor(sim_scheduler *sched, long every);
+
+// Notes the frame each of the next n_swaps pipeline swaps comes at in
+// `swapped_at', and counts them in `swaps'
+sim_agent sim_agent_checker(sim_scheduler *sched, int n_swaps, int *swaps, long *swapped_at);
+
+// The chain loaded by a script into an engine fed a tone, with every
+// agent above, against the same frames clocked bare
+int sim_agents_bench();
+
+#endif
@@ -0,0 +1,264 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "automation.h"
+
+/*
+ * Parameter automation workload.
+ *
+ * A scripted set of knob gestures, each a run of straight-line segments,
+ * sent to the engine two ways: streamed as register updates at a fixed
+ * control rate, which is how a host keeps zipper noise down on its own,
+ * or as one ramp per segment, left to the engine to interpolate.
+ */
+
+static int rand_range(int lo, int hi)
+{
+	return lo + rand() % (hi - lo + 1);
+}
+
+static int segment_cmp(const void *a, const void *b)
+{
+	return ((const sim_automation_segment*)a)->start - ((const sim_automation_segment*)b)->start;
+}
+
+// Each knob alternates between resting and being turned; a turn
+// is a few segments of varying speed and direction
+void sim_automation_generate(sim_automation_workload *workload, int n_knobs, int duration, unsigned int seed)
+{
+	if (!workload)
+		return;
+	
+	if (n_knobs > AUTOMATION_MAX_KNOBS)
+		n_knobs = AUTOMATION_MAX_KNOBS;
+	
+	srand(seed);
+	
+	workload->n_knobs 	 = n_knobs;
+	workload->duration 	 = duration;
+	workload->n_segments = 0;
+	
+	const int ms = AUTOMATION_SAMPLE_RATE / 1000;
+	
+	for (int k = 0; k < n_knobs; k++)
+	{
+		int t = rand_range(0, 500 * ms);
+		int16_t value = rand_range(-16384, 16383);
+		
+		while (t < duration)
+		{
+			int n_moves = rand_range(1, 4);
+			
+			for (int m = 0; m < n_moves && t < duration; m++)
+			{
+				if (workload->n_segments >= AUTOMATION_MAX_SEGMENTS)
+					break;
+				
+				sim_automation_segment *seg = &workload->segments[workload->n_segments++];
+				
+				seg->start 	= t;
+				seg->length = rand_range(40 * ms, 600 * ms);
+				seg->knob 	= k;
+				seg->from 	= value;
+				seg->to 	= rand_range(-16384, 16383);
+				
+				if (seg->start + seg->length > duration)
+					seg->length = duration - seg->start;
+				
+				value = seg->to;
+				t += seg->length;
+			}
+			
+			t += rand_range(200 * ms, 2000 * ms);
+		}
+	}
+	
+	qsort(workload->segments, workload->n_segments, sizeof(sim_automation_segment), segment_cmp);
+}
+
+static int16_t segment_value_at(const sim_automation_segment *seg, int t)
+{
+	if (t >= seg->start + seg->length)
+		return seg->to;
+	
+	return seg->from + (int)((int64_t)(seg->to - seg->from) * (t - seg->start) / seg->length);
+}
+
+static void append_update(m_fpga_transfer_batch *batch, int block, int reg, int16_t value)
+{
+	m_fpga_batch_append(batch, reg ? COMMAND_UPDATE_BLOCK_REG_1 : COMMAND_UPDATE_BLOCK_REG_0);
+	m_fpga_batch_append(batch, block);
+	m_fpga_batch_append(batch, (value >> 8) & 0xFF);
+	m_fpga_batch_append(batch,  value 		& 0xFF);
+}
+
+static void append_ramp(m_fpga_transfer_batch *batch, int block, int reg, int16_t value, int length)
+{
+	if (length > 0xFFFF)
+		length = 0xFFFF;
+	
+	m_fpga_batch_append(batch, reg ? COMMAND_RAMP_BLOCK_REG_1 : COMMAND_RAMP_BLOCK_REG_0);
+	m_fpga_batch_append(batch, block);
+	m_fpga_batch_append(batch, (value  >> 8) & 0xFF);
+	m_fpga_batch_append(batch,  value 		 & 0xFF);
+	m_fpga_batch_append(batch, (length >> 8) & 0xFF);
+	m_fpga_batch_append(batch,  length 		 & 0xFF);
+}
+
+// Encode the automation falling in [from, to). Streamed, each moving knob
+// is sent its current value every `period' samples, and again as its move
+// finishes; ramped, each segment is sent once, as it starts. Either way
+// the updates at one instant share a commit. Returns the number of commits
+int sim_automation_encode(m_fpga_transfer_batch *batch, const sim_automation_workload *workload, const sim_automation_map *map,
+	int from, int to, int ramped, int period)
+{
+	if (!batch || !workload || !map || period < 1)
+		return 0;
+	
+	int commits = 0;
+	
+	if (ramped)
+	{
+		int i = 0;
+		
+		while (i < workload->n_segments)
+		{
+			int t = workload->segments[i].start;
+			int any = 0;
+			
+			for (; i < workload->n_segments && workload->segments[i].start == t; i++)
+			{
+				const sim_automation_segment *seg = &workload->segments[i];
+				
+				if (t < from || t >= to)
+					continue;
+				
+				append_ramp(batch, map->block[seg->knob], map->reg[seg->knob], seg->to, seg->length);
+				any = 1;
+			}
+			
+			if (any)
+			{
+				m_fpga_batch_append(batch, COMMAND_COMMIT_REG_UPDATES);
+				commits++;
+			}
+		}
+		
+		return commits;
+	}
+	
+	int first_tick = ((from + period - 1) / period) * period;
+	
+	for (int t = first_tick; t < to; t += period)
+	{
+		int any = 0;
+		
+		for (int i = 0; i < workload->n_segments; i++)
+		{
+			const sim_automation_segment *seg = &workload->segments[i];
+			
+			if (seg->start > t)
+				break;
+			
+			// Moving now, or came to rest since the last update
+			if (t - period < seg->start + seg->length)
+			{
+				append_update(batch, map->block[seg->knob], map->reg[seg->knob], segment_value_at(seg, t));
+				any = 1;
+			}
+		}
+		
+		if (any)
+		{
+			m_fpga_batch_append(batch, COMMAND_COMMIT_REG_UPDATES);
+			commits++;
+		}
+	}
+	
+	return commits;
+}
+
+// Most ramps under way at once; the engine has a few slots per pipeline,
+// past which a ramp degrades to a plain update
+static int peak_concurrent_ramps(const sim_automation_workload *workload)
+{
+	int peak = 0;
+	
+	for (int i = 0; i < workload->n_segments; i++)
+	{
+		int t = workload->segments[i].start;
+		int n = 0;
+		
+		for (int j = 0; j <= i; j++)
+		{
+			if (workload->segments[j].start + workload->segments[j].length > t)
+				n++;
+		}
+		
+		if (n > peak)
+			peak = n;
+	}
+	
+	return peak;
+}
+
+#define AUTOMATION_BENCH_SECONDS 	60
+#define AUTOMATION_BENCH_SEED 		4321
+
+int sim_automation_bench()
+{
+	static sim_automation_workload workload;
+	
+	const int periods[] = {16, 32, 64, 128, 256};
+	const int n_periods = sizeof(periods) / sizeof(periods[0]);
+	const int knob_counts[] = {1, 4, 8};
+	const int n_knob_counts = sizeof(knob_counts) / sizeof(knob_counts[0]);
+	
+	sim_automation_map map;
+	
+	for (int k = 0; k < AUTOMATION_MAX_KNOBS; k++)
+	{
+		map.block[k] = k;
+		map.reg[k] 	 = k & 1;
+	}
+	
+	printf("Automation workload: %d s of knob gestures at %d Hz\n\n", AUTOMATION_BENCH_SECONDS, AUTOMATION_SAMPLE_RATE);
+	printf("%6s %9s %6s %8s %14s %12s %14s %12s %9s\n",
+		"knobs", "segments", "peak", "period", "stream B/s", "commits/s", "ramp B/s", "commits/s", "saved");
+	
+	for (int n = 0; n < n_knob_counts; n++)
+	{
+		int duration = AUTOMATION_BENCH_SECONDS * AUTOMATION_SAMPLE_RATE;
+		
+		sim_automation_generate(&workload, knob_counts[n], duration, AUTOMATION_BENCH_SEED);
+		
+		m_fpga_transfer_batch ramp_batch = m_new_fpga_transfer_batch();
+		int ramp_commits = sim_automation_encode(&ramp_batch, &workload, &map, 0, duration, 1, 1);
+		
+		double ramp_rate = ramp_batch.len / (double)AUTOMATION_BENCH_SECONDS;
+		int peak = peak_concurrent_ramps(&workload);
+		
+		for (int p = 0; p < n_periods; p++)
+		{
+			m_fpga_transfer_batch stream_batch = m_new_fpga_transfer_batch();
+			int stream_commits = sim_automation_encode(&stream_batch, &workload, &map, 0, duration, 0, periods[p]);
+			
+			double stream_rate = stream_batch.len / (double)AUTOMATION_BENCH_SECONDS;
+			
+			printf("%6d %9d %6d %8d %14.1f %12.1f %14.1f %12.2f %8.1f%%\n",
+				knob_counts[n], workload.n_segments, peak, periods[p],
+				stream_rate, stream_commits / (double)AUTOMATION_BENCH_SECONDS,
+				ramp_rate, ramp_commits / (double)AUTOMATION_BENCH_SECONDS,
+				(stream_rate > 0) ? 100.0 * (1.0 - ramp_rate / stream_rate) : 0.0);
+			
+			free(stream_batch.buf);
+		}
+		
+		free(ramp_batch.buf);
+	}
+	
+	return 0;
+}
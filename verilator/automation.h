@@ -0,0 +1,39 @@
+#ifndef DSP_SIM_AUTOMATION_H_
+#define DSP_SIM_AUTOMATION_H_
+
+#define AUTOMATION_MAX_KNOBS 		8
+#define AUTOMATION_MAX_SEGMENTS 	4096
+
+#define AUTOMATION_SAMPLE_RATE 		44100
+
+// A knob moving in a straight line from one value to another
+typedef struct {
+	int start;
+	int length;
+	int knob;
+	int16_t from;
+	int16_t to;
+} sim_automation_segment;
+
+typedef struct {
+	int n_knobs;
+	int duration;
+	
+	int n_segments;
+	sim_automation_segment segments[AUTOMATION_MAX_SEGMENTS];
+} sim_automation_workload;
+
+// Where each knob lives in the program
+typedef struct {
+	int block[AUTOMATION_MAX_KNOBS];
+	int reg[AUTOMATION_MAX_KNOBS];
+} sim_automation_map;
+
+void sim_automation_generate(sim_automation_workload *workload, int n_knobs, int duration, unsigned int seed);
+
+int sim_automation_encode(m_fpga_transfer_batch *batch, const sim_automation_workload *workload, const sim_automation_map *map,
+	int from, int to, int ramped, int period);
+
+int sim_automation_bench();
+
+#endif
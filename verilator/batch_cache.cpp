@@ -0,0 +1,408 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sim_main.h"
+#include "batch_cache.h"
+
+m_effect_desc *m_read_eff_desc_from_file(char *fname);
+
+/*
+ * Compiled programs, kept between runs.
+ *
+ * Parsing the effects and building a program from them comes to the
+ * same batch every time for the same sources, so a batch is filed under
+ * a hash of what it was built from: the text of each effect's source,
+ * which is where the values of its parameters come from, how the
+ * program ends, the engine's geometry, and the compiler's version. A
+ * changed source is a new key, never a stale batch.
+ *
+ * The store is one file, mapped, of fixed size slots, and a key goes in
+ * the first free slot of a few from the one it hashes to, or failing
+ * that, evicts that one. Runs side by side share it: a slot is only
+ * ever torn while its key is clear.
+ *
+ * Misses are built on a thread of their own, one after another, so
+ * the harness can get on with reset and warmup meanwhile; it only waits
+ * when it comes to send a batch that isn't done.
+ */
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+	const uint8_t *bytes = (const uint8_t*)data;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+static uint64_t hash_int(uint64_t hash, int32_t x)
+{
+	return fnv1a(hash, &x, sizeof(x));
+}
+
+void sim_batch_recipe_init(sim_batch_recipe *recipe)
+{
+	memset(recipe, 0, sizeof(sim_batch_recipe));
+
+	recipe->split_mode = -1;
+	recipe->n_blocks   = SIM_N_BLOCKS;
+	recipe->data_width = SIM_DATA_WIDTH;
+}
+
+int sim_batch_recipe_add(sim_batch_recipe *recipe, const char *effect)
+{
+	if (recipe->n_effects == BATCH_CACHE_MAX_EFFECTS)
+		return 1;
+
+	recipe->effects[recipe->n_effects++] = effect;
+
+	return 0;
+}
+
+uint64_t sim_batch_recipe_key(const sim_batch_recipe *recipe)
+{
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	uint8_t buf[4096];
+
+	hash = hash_int(hash, BATCH_CACHE_COMPILER);
+	hash = hash_int(hash, recipe->n_blocks);
+	hash = hash_int(hash, recipe->data_width);
+	hash = hash_int(hash, recipe->split_mode);
+	hash = hash_int(hash, recipe->n_effects);
+
+	for (int i = 0; i < recipe->n_effects; i++)
+	{
+		FILE *file = fopen(recipe->effects[i], "rb");
+		size_t n;
+		int32_t len = 0;
+
+		if (!file)
+			return 0;
+
+		while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+		{
+			hash = fnv1a(hash, buf, n);
+			len += n;
+		}
+
+		fclose(file);
+
+		// So that where one source ends and the next starts counts
+		hash = hash_int(hash, len);
+	}
+
+	return hash ? hash : 1;
+}
+
+int sim_batch_cache_open(sim_batch_cache *cache, const char *path)
+{
+	cache->store 	 = NULL;
+	cache->n_pending = 0;
+	cache->n_effects = 0;
+	cache->hits 	 = 0;
+	cache->misses 	 = 0;
+
+	cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+
+	struct stat st;
+
+	if (cache->fd < 0 || fstat(cache->fd, &st) != 0)
+	{
+		printf("Batch cache: can't open %s\n", path);
+		return 1;
+	}
+
+	int fresh = (st.st_size != sizeof(sim_batch_cache_store));
+
+	if (fresh && ftruncate(cache->fd, sizeof(sim_batch_cache_store)) != 0)
+	{
+		printf("Batch cache: can't size %s\n", path);
+		close(cache->fd);
+		cache->fd = -1;
+		return 2;
+	}
+
+	void *map = mmap(NULL, sizeof(sim_batch_cache_store), PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+
+	if (map == MAP_FAILED)
+	{
+		printf("Batch cache: can't map %s\n", path);
+		close(cache->fd);
+		cache->fd = -1;
+		return 3;
+	}
+
+	cache->store = (sim_batch_cache_store*)map;
+
+	// Anything from another layout is dropped
+	if (fresh || cache->store->magic != BATCH_CACHE_MAGIC || cache->store->version != BATCH_CACHE_VERSION
+		|| cache->store->n_slots != BATCH_CACHE_SLOTS || cache->store->slot_bytes != BATCH_CACHE_SLOT_BYTES)
+	{
+		memset(cache->store, 0, sizeof(sim_batch_cache_store));
+
+		cache->store->n_slots 	 = BATCH_CACHE_SLOTS;
+		cache->store->slot_bytes = BATCH_CACHE_SLOT_BYTES;
+		cache->store->version 	 = BATCH_CACHE_VERSION;
+		cache->store->magic 	 = BATCH_CACHE_MAGIC;
+	}
+
+	return 0;
+}
+
+static int lookup(sim_batch_cache *cache, sim_batch_job *job)
+{
+	if (!cache->store)
+		return 0;
+
+	for (int i = 0; i < BATCH_CACHE_PROBES; i++)
+	{
+		sim_batch_cache_slot *slot = &cache->store->slots[(job->key + i) % BATCH_CACHE_SLOTS];
+
+		if (__atomic_load_n(&slot->key, __ATOMIC_ACQUIRE) != job->key)
+			continue;
+
+		uint32_t len = slot->len;
+
+		if (len > BATCH_CACHE_SLOT_BYTES)
+			return 0;
+
+		m_fpga_transfer_batch batch = m_new_fpga_transfer_batch();
+
+		for (uint32_t j = 0; j < len; j++)
+			m_fpga_batch_append(&batch, slot->data[j]);
+
+		job->res.memory = slot->memory;
+		job->res.delays = slot->delays;
+
+		// Overwritten while it was being read. The fence keeps the reads
+		// of the slot above from being put off past the key's
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&slot->key, __ATOMIC_RELAXED) != job->key)
+		{
+			free(batch.buf);
+			return 0;
+		}
+
+		job->batch = batch;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static void store(sim_batch_cache *cache, const sim_batch_job *job)
+{
+	if (!cache->store || job->batch.len > BATCH_CACHE_SLOT_BYTES)
+		return;
+
+	sim_batch_cache_slot *slot = &cache->store->slots[job->key % BATCH_CACHE_SLOTS];
+
+	for (int i = 0; i < BATCH_CACHE_PROBES; i++)
+	{
+		sim_batch_cache_slot *probe = &cache->store->slots[(job->key + i) % BATCH_CACHE_SLOTS];
+		uint64_t key = __atomic_load_n(&probe->key, __ATOMIC_ACQUIRE);
+
+		if (key == 0 || key == job->key)
+		{
+			slot = probe;
+			break;
+		}
+	}
+
+	// Cleared before any of the slot is written, as a reader sees it
+	__atomic_store_n(&slot->key, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(slot->data, job->batch.buf, job->batch.len);
+	slot->len 	 = job->batch.len;
+	slot->memory = job->res.memory;
+	slot->delays = job->res.delays;
+
+	__atomic_store_n(&slot->key, job->key, __ATOMIC_RELEASE);
+}
+
+static sim_batch_effect *read_effect(sim_batch_cache *cache, const char *path)
+{
+	for (int i = 0; i < cache->n_effects; i++)
+	{
+		if (strcmp(cache->effects[i].path, path) == 0)
+			return &cache->effects[i];
+	}
+
+	if (cache->n_effects == BATCH_CACHE_MAX_READ)
+		return NULL;
+
+	m_effect_desc *desc = m_read_eff_desc_from_file((char*)path);
+
+	if (!desc)
+		return NULL;
+
+	sim_batch_effect *effect = &cache->effects[cache->n_effects++];
+
+	effect->path = strdup(path);
+	effect->desc = desc;
+	init_transformer_from_effect_desc(&effect->trans, desc);
+
+	return effect;
+}
+
+static int compile(sim_batch_cache *cache, sim_batch_job *job)
+{
+	const sim_batch_recipe *recipe = &job->recipe;
+	int pos = 0;
+
+	job->batch = m_new_fpga_transfer_batch();
+	job->res.memory = 0;
+	job->res.delays = 0;
+
+	m_fpga_batch_append(&job->batch, COMMAND_BEGIN_PROGRAM);
+
+	for (int i = 0; i < recipe->n_effects; i++)
+	{
+		sim_batch_effect *effect = read_effect(cache, recipe->effects[i]);
+
+		if (!effect)
+		{
+			printf("Batch cache: can't read %s\n", recipe->effects[i]);
+
+			free(job->batch.buf);
+			memset(&job->batch, 0, sizeof(job->batch));
+			return 1;
+		}
+
+		m_fpga_batch_append_transformer(&job->batch, &effect->trans, &job->res, &pos);
+	}
+
+	if (recipe->split_mode < 0)
+	{
+		m_fpga_batch_append(&job->batch, COMMAND_END_PROGRAM);
+	}
+	else
+	{
+		m_fpga_batch_append(&job->batch, COMMAND_END_PROGRAM_SPLIT);
+		m_fpga_batch_append(&job->batch, recipe->split_mode);
+	}
+
+	return 0;
+}
+
+int sim_batch_cache_request(sim_batch_cache *cache, sim_batch_job *job)
+{
+	memset(&job->batch, 0, sizeof(job->batch));
+	job->hit 	= 0;
+	job->done 	= 0;
+	job->failed = 0;
+
+	job->key = sim_batch_recipe_key(&job->recipe);
+
+	if (!job->key)
+	{
+		job->done 	= 1;
+		job->failed = 1;
+		return 1;
+	}
+
+	if (lookup(cache, job))
+	{
+		job->hit  = 1;
+		job->done = 1;
+		cache->hits++;
+
+		printf("Batch cache: hit on %016llx, %d bytes\n", (unsigned long long)job->key, job->batch.len);
+		return 0;
+	}
+
+	if (cache->n_pending == BATCH_CACHE_MAX_JOBS)
+	{
+		job->done 	= 1;
+		job->failed = 1;
+		return 1;
+	}
+
+	cache->misses++;
+	cache->pending[cache->n_pending++] = job;
+
+	return 0;
+}
+
+static void work(sim_batch_cache *cache, sim_batch_job **jobs, int n_jobs)
+{
+	for (int i = 0; i < n_jobs; i++)
+	{
+		jobs[i]->failed = compile(cache, jobs[i]);
+
+		if (!jobs[i]->failed)
+			store(cache, jobs[i]);
+
+		jobs[i]->done = 1;
+	}
+}
+
+void sim_batch_cache_start(sim_batch_cache *cache)
+{
+	if (!cache->n_pending || cache->worker.joinable())
+		return;
+
+	static sim_batch_job *jobs[BATCH_CACHE_MAX_JOBS];
+	int n_jobs = cache->n_pending;
+
+	memcpy(jobs, cache->pending, n_jobs * sizeof(sim_batch_job*));
+	cache->n_pending = 0;
+
+	printf("Batch cache: building %d program%s\n", n_jobs, (n_jobs == 1) ? "" : "s");
+
+	cache->worker = std::thread(work, cache, jobs, n_jobs);
+}
+
+int sim_batch_cache_wait(sim_batch_cache *cache, sim_batch_job *job)
+{
+	if (job->hit)
+		return 0;
+
+	if (cache->worker.joinable())
+		cache->worker.join();
+
+	// Requested since the worker was started
+	if (!job->done)
+	{
+		sim_batch_cache_start(cache);
+
+		if (cache->worker.joinable())
+			cache->worker.join();
+	}
+
+	return job->failed;
+}
+
+void sim_batch_cache_close(sim_batch_cache *cache)
+{
+	if (cache->worker.joinable())
+		cache->worker.join();
+
+	printf("Batch cache: %d hits, %d misses\n", cache->hits, cache->misses);
+
+	if (cache->store)
+		munmap(cache->store, sizeof(sim_batch_cache_store));
+
+	if (cache->fd >= 0)
+		close(cache->fd);
+
+	for (int i = 0; i < cache->n_effects; i++)
+		free(cache->effects[i].path);
+
+	cache->store 	 = NULL;
+	cache->fd 		 = -1;
+	cache->n_effects = 0;
+}
@@ -0,0 +1,124 @@
+#ifndef DSP_SIM_BATCH_CACHE_H_
+#define DSP_SIM_BATCH_CACHE_H_
+
+#include <thread>
+
+#define BATCH_CACHE_MAGIC 		0x4D464243
+#define BATCH_CACHE_VERSION 	1
+
+// Bump when libM's compiler changes what it makes of the same source,
+// so that nothing built by the old one is found
+#define BATCH_CACHE_COMPILER 	1
+
+#define BATCH_CACHE_SLOTS 		64
+#define BATCH_CACHE_SLOT_BYTES 	32768
+
+// Slots looked at from a key's home slot before one is evicted
+#define BATCH_CACHE_PROBES 		8
+
+#define BATCH_CACHE_MAX_EFFECTS 16
+#define BATCH_CACHE_MAX_JOBS 	16
+
+// What a program is built from: effects in order, each with the values
+// its source gives its parameters, and what it ends on. The geometry
+// isn't used in building it, but a batch is only any good for the
+// engine it was built for
+typedef struct {
+	const char *effects[BATCH_CACHE_MAX_EFFECTS];
+	int n_effects;
+
+	// -1 for END_PROGRAM, or the mode to END_PROGRAM_SPLIT into
+	int split_mode;
+
+	int n_blocks;
+	int data_width;
+} sim_batch_recipe;
+
+typedef struct {
+	sim_batch_recipe recipe;
+	uint64_t key;
+
+	// Once done, the batch is the caller's to free
+	m_fpga_transfer_batch batch;
+	m_eff_resource_report res;
+
+	int hit;
+	int done;
+	int failed;
+} sim_batch_job;
+
+// On disk, and mapped: slots addressed by key, each with a batch and
+// the resources it takes. A slot's key is cleared while it's written,
+// and set again last, so a reader in another process who finds the key
+// the same either side of copying it out got a whole batch
+typedef struct {
+	uint64_t key;
+	uint32_t len;
+	int32_t memory;
+	int32_t delays;
+	uint32_t reserved;
+	uint8_t data[BATCH_CACHE_SLOT_BYTES];
+} sim_batch_cache_slot;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t n_slots;
+	uint32_t slot_bytes;
+
+	sim_batch_cache_slot slots[BATCH_CACHE_SLOTS];
+} sim_batch_cache_store;
+
+// An effect as read for the worker. libM has nothing to free one with,
+// so each source is read once for the cache's life and shared by every
+// recipe that uses it, rather than read again and dropped by each
+typedef struct {
+	char *path;
+	m_effect_desc *desc;
+	m_transformer trans;
+} sim_batch_effect;
+
+#define BATCH_CACHE_MAX_READ 	32
+
+typedef struct {
+	int fd;
+	sim_batch_cache_store *store;
+
+	// The worker's alone, once it's started
+	sim_batch_effect effects[BATCH_CACHE_MAX_READ];
+	int n_effects;
+
+	// Misses, compiled one after another on the worker
+	sim_batch_job *pending[BATCH_CACHE_MAX_JOBS];
+	int n_pending;
+	std::thread worker;
+
+	int hits;
+	int misses;
+} sim_batch_cache;
+
+void sim_batch_recipe_init(sim_batch_recipe *recipe);
+int sim_batch_recipe_add(sim_batch_recipe *recipe, const char *effect);
+
+// The recipe's key, from the contents of the effects' sources rather
+// than their names. 0 if one can't be read
+uint64_t sim_batch_recipe_key(const sim_batch_recipe *recipe);
+
+// Open or create the store. Without one, everything is a miss and
+// nothing is kept
+int sim_batch_cache_open(sim_batch_cache *cache, const char *path);
+
+// Look the job's recipe up. A hit is done at once; a miss waits for
+// sim_batch_cache_start
+int sim_batch_cache_request(sim_batch_cache *cache, sim_batch_job *job);
+
+// Compile the misses requested so far on a thread of their own, and
+// store them as they're done
+void sim_batch_cache_start(sim_batch_cache *cache);
+
+// Wait for a job to be done. Nonzero if it couldn't be built
+int sim_batch_cache_wait(sim_batch_cache *cache, sim_batch_job *job);
+
+void sim_batch_cache_close(sim_batch_cache *cache);
+
+#endif
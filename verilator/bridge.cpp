@@ -0,0 +1,177 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "sim_main.h"
+#include "bridge.h"
+
+/*
+ * Real-time audio bridge, harness side.
+ *
+ * A client on the same machine, typically a plugin in a DAW, writes
+ * blocks of input into shared memory and reads blocks of output back,
+ * and whatever runs behind the bridge, the Verilated engine or the
+ * emulator, takes a sample in and puts a sample out once a frame. When
+ * the input runs dry, it waits: simulated time stands still, so being
+ * ahead of the client costs nothing, and the time spent waiting is left
+ * out of the real-time factor. What the client can't be given in time it
+ * counts itself, as underruns.
+ *
+ * Control messages come in whole on their own ring and go out as
+ * transfer batches, to be sent over SPI or handed to the emulator the
+ * way every other batch is.
+ */
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int sim_bridge_open(sim_bridge *bridge, const char *name, const char *path, int sample_rate)
+{
+	if (!bridge || !name)
+		return 1;
+
+	memset(bridge, 0, sizeof(sim_bridge));
+
+	bridge->name = name;
+	bridge->path = path;
+
+	bridge->fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+	if (bridge->fd < 0 || ftruncate(bridge->fd, sizeof(sim_bridge_shared)) != 0)
+	{
+		printf("Bridge: can't create %s\n", name);
+		return 2;
+	}
+
+	void *map = mmap(NULL, sizeof(sim_bridge_shared), PROT_READ | PROT_WRITE, MAP_SHARED, bridge->fd, 0);
+
+	if (map == MAP_FAILED)
+	{
+		printf("Bridge: can't map %s\n", name);
+		close(bridge->fd);
+		shm_unlink(name);
+		return 3;
+	}
+
+	// Fresh from ftruncate, so all zero: the rings are empty
+	bridge->shared = (sim_bridge_shared*)map;
+
+	bridge->shared->version 	= BRIDGE_VERSION;
+	bridge->shared->sample_rate = sample_rate;
+
+	std::atomic_thread_fence(std::memory_order_release);
+	bridge->shared->magic = BRIDGE_MAGIC;
+
+	bridge->opened_at = now();
+
+	printf("Bridge: %s open on %s\n", path, name);
+
+	return 0;
+}
+
+int sim_bridge_next_sample(sim_bridge *bridge, int16_t *sample)
+{
+	sim_bridge_shared *shared = bridge->shared;
+
+	if (bridge_ring_pop(&shared->audio_in, shared->audio_in_data, BRIDGE_AUDIO_FRAMES, sizeof(int16_t), sample, 1))
+		return 0;
+
+	double waiting_since = now();
+	struct timespec nap = {0, 50000};
+
+	while (!bridge_ring_pop(&shared->audio_in, shared->audio_in_data, BRIDGE_AUDIO_FRAMES, sizeof(int16_t), sample, 1))
+	{
+		if (shared->stop.load(std::memory_order_acquire))
+		{
+			*sample = 0;
+			bridge->waited += now() - waiting_since;
+			return 1;
+		}
+
+		nanosleep(&nap, NULL);
+	}
+
+	bridge->waited += now() - waiting_since;
+
+	return 0;
+}
+
+void sim_bridge_put_sample(sim_bridge *bridge, int16_t sample)
+{
+	sim_bridge_shared *shared = bridge->shared;
+
+	// A client that has stopped reading doesn't hold the engine up
+	if (!bridge_ring_push(&shared->audio_out, shared->audio_out_data, BRIDGE_AUDIO_FRAMES, sizeof(int16_t), &sample, 1))
+		bridge->overruns++;
+
+	bridge->frames++;
+	shared->frames.store(bridge->frames, std::memory_order_release);
+}
+
+int sim_bridge_poll_control(sim_bridge *bridge, m_fpga_transfer_batch *batch)
+{
+	sim_bridge_shared *shared = bridge->shared;
+	uint8_t length_bytes[4];
+
+	if (bridge_ring_peek(&shared->control, shared->control_data, BRIDGE_CONTROL_BYTES, 1, length_bytes, 4) < 4)
+		return 0;
+
+	uint32_t length = length_bytes[0] | (length_bytes[1] << 8) | (length_bytes[2] << 16) | ((uint32_t)length_bytes[3] << 24);
+
+	// Not until the whole message is in
+	if (bridge_ring_count(&shared->control) < length + 4)
+		return 0;
+
+	bridge_ring_pop(&shared->control, shared->control_data, BRIDGE_CONTROL_BYTES, 1, length_bytes, 4);
+
+	*batch = m_new_fpga_transfer_batch();
+
+	for (uint32_t i = 0; i < length; i++)
+	{
+		uint8_t byte = 0;
+
+		bridge_ring_pop(&shared->control, shared->control_data, BRIDGE_CONTROL_BYTES, 1, &byte, 1);
+		m_fpga_batch_append(batch, byte);
+	}
+
+	bridge->batches++;
+
+	return 1;
+}
+
+void sim_bridge_report(sim_bridge *bridge)
+{
+	if (!bridge->shared)
+		return;
+
+	int rate = bridge->shared->sample_rate;
+	double busy = now() - bridge->opened_at - bridge->waited;
+	double factor = (busy > 0) ? (bridge->frames / (double)rate) / busy : 0.0;
+
+	printf("Bridge (%s): %ld frames, %ld control batches, real-time factor %.3f (%s), %u underruns, %ld overruns\n",
+		bridge->path, bridge->frames, bridge->batches, factor, (factor >= 1.0) ? "live" : "too slow to run live",
+		bridge->shared->underruns.load(), bridge->overruns);
+}
+
+void sim_bridge_close(sim_bridge *bridge)
+{
+	if (!bridge->shared)
+		return;
+
+	munmap(bridge->shared, sizeof(sim_bridge_shared));
+	close(bridge->fd);
+	shm_unlink(bridge->name);
+
+	bridge->shared = NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef DSP_SIM_BRIDGE_H_
+#define DSP_SIM_BRIDGE_H_
+
+#include "bridge_shared.h"
+
+// The harness's end
+typedef struct {
+	sim_bridge_shared *shared;
+	int fd;
+	const char *name;
+	const char *path;
+
+	long frames;
+	long overruns;
+	long batches;
+
+	// Wall clock since opening, and the part of it spent waiting on the
+	// client, in seconds
+	double opened_at;
+	double waited;
+} sim_bridge;
+
+// Create the shared memory for a client to connect to. `path' is
+// what sits behind it, for the report
+int sim_bridge_open(sim_bridge *bridge, const char *name, const char *path, int sample_rate);
+
+// The next sample in, waiting for one if need be. Returns nonzero once
+// the client has asked to stop
+int sim_bridge_next_sample(sim_bridge *bridge, int16_t *sample);
+
+void sim_bridge_put_sample(sim_bridge *bridge, int16_t sample);
+
+// A batch of control bytes, if a whole one has come in
+int sim_bridge_poll_control(sim_bridge *bridge, m_fpga_transfer_batch *batch);
+
+// Print the real-time factor and the underruns and overruns
+void sim_bridge_report(sim_bridge *bridge);
+
+void sim_bridge_close(sim_bridge *bridge);
+
+#endif
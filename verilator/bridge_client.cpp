@@ -0,0 +1,105 @@
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "bridge_client.h"
+
+/*
+ * Client side of the real-time audio bridge; see bridge.cpp. A control
+ * message goes in as its length and then its bytes, and the harness
+ * leaves it be until all of it is there.
+ */
+
+int sim_bridge_connect(sim_bridge_client *client, const char *name)
+{
+	if (!client || !name)
+		return 1;
+
+	client->shared = NULL;
+	client->fd = shm_open(name, O_RDWR, 0);
+
+	if (client->fd < 0)
+		return 2;
+
+	void *map = mmap(NULL, sizeof(sim_bridge_shared), PROT_READ | PROT_WRITE, MAP_SHARED, client->fd, 0);
+
+	if (map == MAP_FAILED)
+	{
+		close(client->fd);
+		return 3;
+	}
+
+	sim_bridge_shared *shared = (sim_bridge_shared*)map;
+
+	if (shared->magic != BRIDGE_MAGIC || shared->version != BRIDGE_VERSION)
+	{
+		munmap(map, sizeof(sim_bridge_shared));
+		close(client->fd);
+		return 4;
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	client->shared = shared;
+
+	return 0;
+}
+
+int sim_bridge_send_audio(sim_bridge_client *client, const int16_t *samples, int n)
+{
+	sim_bridge_shared *shared = client->shared;
+
+	return bridge_ring_push(&shared->audio_in, shared->audio_in_data, BRIDGE_AUDIO_FRAMES, sizeof(int16_t), samples, n);
+}
+
+int sim_bridge_receive_audio(sim_bridge_client *client, int16_t *samples, int n)
+{
+	sim_bridge_shared *shared = client->shared;
+
+	int got = bridge_ring_pop(&shared->audio_out, shared->audio_out_data, BRIDGE_AUDIO_FRAMES, sizeof(int16_t), samples, n);
+
+	if (got < n)
+	{
+		memset(samples + got, 0, (n - got) * sizeof(int16_t));
+		shared->underruns.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return got;
+}
+
+int sim_bridge_send_control(sim_bridge_client *client, const uint8_t *bytes, int n)
+{
+	sim_bridge_shared *shared = client->shared;
+
+	if (n < 0 || BRIDGE_CONTROL_BYTES - bridge_ring_count(&shared->control) < (uint32_t)n + 4)
+		return 1;
+
+	uint8_t length[4] = {(uint8_t)n, (uint8_t)(n >> 8), (uint8_t)(n >> 16), (uint8_t)(n >> 24)};
+
+	bridge_ring_push(&shared->control, shared->control_data, BRIDGE_CONTROL_BYTES, 1, length, 4);
+	bridge_ring_push(&shared->control, shared->control_data, BRIDGE_CONTROL_BYTES, 1, bytes, n);
+
+	return 0;
+}
+
+uint64_t sim_bridge_frames(sim_bridge_client *client)
+{
+	return client->shared->frames.load(std::memory_order_acquire);
+}
+
+void sim_bridge_stop(sim_bridge_client *client)
+{
+	client->shared->stop.store(1, std::memory_order_release);
+}
+
+void sim_bridge_disconnect(sim_bridge_client *client)
+{
+	if (!client->shared)
+		return;
+
+	munmap(client->shared, sizeof(sim_bridge_shared));
+	close(client->fd);
+
+	client->shared = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef DSP_SIM_BRIDGE_CLIENT_H_
+#define DSP_SIM_BRIDGE_CLIENT_H_
+
+#include "bridge_shared.h"
+
+// The client's end of the bridge, for a plugin or any other program on
+// the same machine. Needs nothing but this, bridge_shared.h and
+// bridge_client.cpp, and none of it blocks, so it can be called from an
+// audio callback
+
+typedef struct {
+	sim_bridge_shared *shared;
+	int fd;
+} sim_bridge_client;
+
+// Map in the bridge the harness has open. Nonzero if there isn't one
+int sim_bridge_connect(sim_bridge_client *client, const char *name);
+
+// Queue input; returns how many samples there was room for
+int sim_bridge_send_audio(sim_bridge_client *client, const int16_t *samples, int n);
+
+// Take n samples of output. What isn't there yet is filled with silence
+// and counted as an underrun; returns how many were real
+int sim_bridge_receive_audio(sim_bridge_client *client, int16_t *samples, int n);
+
+// Queue the bytes of one transfer batch. Nonzero if there's no room for
+// all of it, in which case none of it goes
+int sim_bridge_send_control(sim_bridge_client *client, const uint8_t *bytes, int n);
+
+// Frames the harness has put out so far
+uint64_t sim_bridge_frames(sim_bridge_client *client);
+
+// Have the harness wind up, and let go
+void sim_bridge_stop(sim_bridge_client *client);
+void sim_bridge_disconnect(sim_bridge_client *client);
+
+#endif
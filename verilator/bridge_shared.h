@@ -0,0 +1,103 @@
+#ifndef DSP_SIM_BRIDGE_SHARED_H_
+#define DSP_SIM_BRIDGE_SHARED_H_
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+// What the harness and a bridge client share: a block of POSIX shared
+// memory holding three single-producer single-consumer rings, audio in
+// from the client, audio out to it, and control bytes from it, as
+// m_fpga_transfer_batch contents prefixed with their length. Nothing
+// in here takes a lock; each side only ever moves its own index
+
+#define BRIDGE_NAME 			"/m_fpga_bridge"
+#define BRIDGE_MAGIC 			0x4D465042
+#define BRIDGE_VERSION 			1
+
+// Ring sizes, in elements; powers of two
+#define BRIDGE_AUDIO_FRAMES 	8192
+#define BRIDGE_CONTROL_BYTES 	65536
+
+typedef struct {
+	alignas(64) std::atomic<uint32_t> head;
+	alignas(64) std::atomic<uint32_t> tail;
+} sim_bridge_ring;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t sample_rate;
+
+	// Set by the client to have the harness wind up
+	std::atomic<uint32_t> stop;
+
+	// Blocks the client asked for and got short, and frames the harness
+	// has put out
+	std::atomic<uint32_t> underruns;
+	std::atomic<uint64_t> frames;
+
+	sim_bridge_ring audio_in;
+	sim_bridge_ring audio_out;
+	sim_bridge_ring control;
+
+	int16_t audio_in_data[BRIDGE_AUDIO_FRAMES];
+	int16_t audio_out_data[BRIDGE_AUDIO_FRAMES];
+	uint8_t control_data[BRIDGE_CONTROL_BYTES];
+} sim_bridge_shared;
+
+static inline uint32_t bridge_ring_count(sim_bridge_ring *ring)
+{
+	return ring->head.load(std::memory_order_acquire) - ring->tail.load(std::memory_order_acquire);
+}
+
+// Copy up to n elements in; the producer's side. Returns how many went
+static inline int bridge_ring_push(sim_bridge_ring *ring, void *data, uint32_t size, int elem, const void *src, int n)
+{
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	uint32_t tail = ring->tail.load(std::memory_order_acquire);
+	uint32_t room = size - (head - tail);
+
+	if ((uint32_t)n > room)
+		n = room;
+
+	uint32_t at = head & (size - 1);
+	uint32_t first = (n < (int)(size - at)) ? n : size - at;
+
+	memcpy((uint8_t*)data + at * elem, src, first * elem);
+	memcpy(data, (const uint8_t*)src + first * elem, (n - first) * elem);
+
+	ring->head.store(head + n, std::memory_order_release);
+
+	return n;
+}
+
+// Copy up to n elements out without taking them; the consumer's side
+static inline int bridge_ring_peek(sim_bridge_ring *ring, const void *data, uint32_t size, int elem, void *dst, int n)
+{
+	uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+	uint32_t head = ring->head.load(std::memory_order_acquire);
+
+	if ((uint32_t)n > head - tail)
+		n = head - tail;
+
+	uint32_t at = tail & (size - 1);
+	uint32_t first = (n < (int)(size - at)) ? n : size - at;
+
+	memcpy(dst, (const uint8_t*)data + at * elem, first * elem);
+	memcpy((uint8_t*)dst + first * elem, data, (n - first) * elem);
+
+	return n;
+}
+
+// Copy up to n elements out. Returns how many came
+static inline int bridge_ring_pop(sim_bridge_ring *ring, const void *data, uint32_t size, int elem, void *dst, int n)
+{
+	n = bridge_ring_peek(ring, data, size, elem, dst, n);
+
+	ring->tail.store(ring->tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+
+	return n;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef DSP_SIM_COMMANDS_H_
+#define DSP_SIM_COMMANDS_H_
+
+// The controller's commands, as include/controller.vh numbers them.
+// libM has the ones it sends itself; the rest are the harness's own
+#ifndef COMMAND_END_PROGRAM_SPLIT
+#define COMMAND_END_PROGRAM_SPLIT 	16
+#define COMMAND_END_SPLIT 			17
+#define COMMAND_SELECT_SEGMENT 		18
+#endif
+
+#ifndef COMMAND_CLONE_PROGRAM
+#define COMMAND_CLONE_PROGRAM 		19
+#endif
+
+#ifndef COMMAND_FREE_DELAY
+#define COMMAND_FREE_DELAY 			20
+#define COMMAND_RESIZE_DELAY 		21
+#endif
+
+#ifndef COMMAND_RAMP_BLOCK_REG_0
+#define COMMAND_RAMP_BLOCK_REG_0 	22
+#define COMMAND_RAMP_BLOCK_REG_1 	23
+#endif
+
+#ifndef COMMAND_SET_SAMPLE_RATE
+#define COMMAND_SET_SAMPLE_RATE 	24
+#endif
+
+#ifndef COMMAND_SET_TELEMETRY
+#define COMMAND_SET_TELEMETRY 		25
+#endif
+
+#ifndef COMMAND_SET_DIRECT
+#define COMMAND_SET_DIRECT 			26
+#endif
+
+// Size and starting delay, three bytes each
+#define DELAY_ALLOC_BYTES	6
+
+// Every command, with the bytes that follow it, and whether the first
+// of them is a block number. A command that isn't here can't be stepped
+// over in a batch, so a new one goes in both the list above and this
+// table
+#define SIM_COMMANDS(X) \
+	X(COMMAND_BEGIN_PROGRAM, 		0, 					0) \
+	X(COMMAND_WRITE_BLOCK_INSTR, 	1 + 4, 				1) \
+	X(COMMAND_WRITE_BLOCK_REG_0, 	1 + 2, 				1) \
+	X(COMMAND_WRITE_BLOCK_REG_1, 	1 + 2, 				1) \
+	X(COMMAND_ALLOC_DELAY, 			DELAY_ALLOC_BYTES, 	0) \
+	X(COMMAND_END_PROGRAM, 			0, 					0) \
+	X(COMMAND_SET_INPUT_GAIN, 		2, 					0) \
+	X(COMMAND_SET_OUTPUT_GAIN, 		2, 					0) \
+	X(COMMAND_UPDATE_BLOCK_REG_0, 	1 + 2, 				1) \
+	X(COMMAND_UPDATE_BLOCK_REG_1, 	1 + 2, 				1) \
+	X(COMMAND_COMMIT_REG_UPDATES, 	0, 					0) \
+	X(COMMAND_END_PROGRAM_SPLIT, 	1, 					0) \
+	X(COMMAND_END_SPLIT, 			0, 					0) \
+	X(COMMAND_SELECT_SEGMENT, 		1, 					0) \
+	X(COMMAND_CLONE_PROGRAM, 		1, 					0) \
+	X(COMMAND_FREE_DELAY, 			1, 					0) \
+	X(COMMAND_RESIZE_DELAY, 		1 + 3, 				0) \
+	X(COMMAND_RAMP_BLOCK_REG_0, 	1 + 2 + 2, 			1) \
+	X(COMMAND_RAMP_BLOCK_REG_1, 	1 + 2 + 2, 			1) \
+	X(COMMAND_SET_SAMPLE_RATE, 		1, 					0) \
+	X(COMMAND_SET_TELEMETRY, 		1, 					0) \
+	X(COMMAND_SET_DIRECT, 			1, 					0)
+
+// Bytes following `command' in a batch; -1 if it isn't one
+int sim_command_arg_bytes(uint8_t command);
+
+// Whether the first byte after `command' is the block it's for
+int sim_command_addresses_block(uint8_t command);
+
+#endif
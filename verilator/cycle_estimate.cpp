@@ -0,0 +1,515 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "sim_main.h"
+#include "cycle_estimate.h"
+
+/*
+ * Static cycle-cost estimate for a program, before it is uploaded.
+ *
+ * Follows each block through dsp_core as a timestamp per stage: decode,
+ * the three operand fetch substages, the branch router, the branch, and
+ * the commit master. Every stage holds one instruction, so a block moves
+ * into a stage no sooner than the block ahead of it has moved out. An
+ * operand still pending in the scoreboard holds its substage until the
+ * commit that writes it, as does the accumulator for the accumulator
+ * moves, and channel 0 for the first reader after the tick. Commits go
+ * in program order, and never on the tick itself.
+ *
+ * A few passes are run back to back, a frame apart, and the last one is
+ * taken as the steady state.
+ */
+
+#define CYCLE_PASSES 	4
+
+// Substages, in operand order, then the router
+#define STAGE_DECODE 	0
+#define STAGE_FETCH_A 	1
+#define STAGE_FETCH_B 	2
+#define STAGE_FETCH_C 	3
+#define STAGE_ROUTER 	4
+#define N_STAGES 		5
+
+#define N_PARAM_FIELDS 	8
+
+// The latencies calibration moves, and their names in the params file
+static const char *param_names[N_PARAM_FIELDS] = {
+	"madd", "mac", "misc", "delay_read", "delay_write", "lut", "mem", "commit"
+};
+
+static void param_fields(sim_cycle_params *params, int **fields)
+{
+	fields[0] = &params->madd_latency;
+	fields[1] = &params->mac_latency;
+	fields[2] = &params->misc_latency;
+	fields[3] = &params->delay_read_latency;
+	fields[4] = &params->delay_write_latency;
+	fields[5] = &params->lut_latency;
+	fields[6] = &params->mem_latency;
+	fields[7] = &params->commit_latency;
+}
+
+void sim_cycle_params_default(sim_cycle_params *params)
+{
+	params->madd_latency 		= 5;
+	params->mac_latency 		= 3;
+	params->misc_latency 		= 3;
+
+	params->delay_read_latency 	= 8;
+	params->delay_write_latency = 6;
+	params->lut_latency 		= 12;
+	params->mem_latency 		= 1;
+
+	params->commit_latency 		= 1;
+
+	params->frame_cycles 		= CYCLE_FRAME_CYCLES;
+
+	// A calibration's fit, where one has been run
+	sim_cycle_params_read(params, SIM_CYCLE_PARAMS_PATH);
+}
+
+int sim_cycle_params_read(sim_cycle_params *params, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	sim_cycle_params read = *params;
+	int *fields[N_PARAM_FIELDS];
+	char name[32];
+	int value;
+	int n = 0;
+
+	if (!f)
+		return 1;
+
+	param_fields(&read, fields);
+
+	while (fscanf(f, "%31s %d", name, &value) == 2)
+	{
+		for (int i = 0; i < N_PARAM_FIELDS; i++)
+		{
+			if (strcmp(name, param_names[i]) == 0 && value >= 1)
+			{
+				*fields[i] = value;
+				n++;
+			}
+		}
+	}
+
+	fclose(f);
+
+	// All or nothing, so a stale or cut-off file can't leave half a fit
+	if (n != N_PARAM_FIELDS)
+		return 1;
+
+	*params = read;
+
+	return 0;
+}
+
+int sim_cycle_params_write(const sim_cycle_params *params, const char *path)
+{
+	FILE *f = fopen(path, "w");
+	sim_cycle_params copy = *params;
+	int *fields[N_PARAM_FIELDS];
+
+	if (!f)
+		return 1;
+
+	param_fields(&copy, fields);
+
+	for (int i = 0; i < N_PARAM_FIELDS; i++)
+		fprintf(f, "%s %d\n", param_names[i], *fields[i]);
+
+	fclose(f);
+
+	return 0;
+}
+
+void sim_decode_instr(uint32_t word, sim_decoded_instr *instr)
+{
+	int format = (word >> 5) & 1;
+	int op = word & 0x1F;
+
+	memset(instr, 0, sizeof(sim_decoded_instr));
+
+	instr->operation = op;
+
+	instr->src[0] 	  = (word >>  6) & 0xF;
+	instr->src_reg[0] = (word >> 10) & 1;
+	instr->src[1] 	  = (word >> 11) & 0xF;
+	instr->src_reg[1] = (word >> 15) & 1;
+
+	if (!format)
+	{
+		instr->src[2] 	  = (word >> 16) & 0xF;
+		instr->src_reg[2] = (word >> 20) & 1;
+	}
+
+	instr->dest = (format) ? (word >> 16) & 0xF : (word >> 21) & 0xF;
+	instr->res_addr = (format) ? (word >> 20) & 0xFF : 0;
+
+	switch (op)
+	{
+		case HW_INSTR_MADD: case HW_INSTR_ARSH: case HW_INSTR_LSH: case HW_INSTR_RSH:
+		case HW_INSTR_ABS: case HW_INSTR_MIN: case HW_INSTR_MAX: case HW_INSTR_CLAMP:
+		case HW_INSTR_MACZ: case HW_INSTR_MAC: case HW_INSTR_UMACZ: case HW_INSTR_UMAC:
+		case HW_INSTR_LUT_READ: case HW_INSTR_DELAY_WRITE: case HW_INSTR_MEM_WRITE:
+			instr->arg_needed[0] = 1;
+	}
+
+	switch (op)
+	{
+		case HW_INSTR_MADD: case HW_INSTR_MIN: case HW_INSTR_MAX: case HW_INSTR_CLAMP:
+		case HW_INSTR_MACZ: case HW_INSTR_MAC: case HW_INSTR_UMACZ: case HW_INSTR_UMAC:
+		case HW_INSTR_DELAY_WRITE:
+			instr->arg_needed[1] = 1;
+	}
+
+	instr->arg_needed[2] = (op == HW_INSTR_MADD || op == HW_INSTR_CLAMP);
+
+	instr->accumulator_needed = (op == HW_INSTR_MOV_ACC || op == HW_INSTR_MOV_LACC || op == HW_INSTR_MOV_UACC);
+	instr->reads_acc = instr->accumulator_needed || op == HW_INSTR_MAC || op == HW_INSTR_UMAC;
+
+	if (op == HW_INSTR_DELAY_READ || op == HW_INSTR_DELAY_WRITE)
+		instr->branch = HW_BRANCH_DELAY;
+	else if (op == HW_INSTR_LUT_READ)
+		instr->branch = HW_BRANCH_LUT;
+	else if (op == HW_INSTR_MEM_READ || op == HW_INSTR_MEM_WRITE)
+		instr->branch = HW_BRANCH_MEM;
+	else if (op >= HW_INSTR_MACZ && op <= HW_INSTR_UMAC)
+		instr->branch = HW_BRANCH_MAC;
+	else if (op >= HW_INSTR_LSH && op <= HW_INSTR_MOV_UACC)
+		instr->branch = HW_BRANCH_MISC;
+	else
+		instr->branch = HW_BRANCH_MADD;
+
+	instr->writes_external 	= (op == HW_INSTR_DELAY_WRITE || op == HW_INSTR_MEM_WRITE);
+	instr->writes_acc 		= (instr->branch == HW_BRANCH_MAC);
+	instr->writes_channel 	= (instr->branch != HW_BRANCH_MAC && !instr->writes_external);
+}
+
+static int max2(int a, int b)
+{
+	return (a > b) ? a : b;
+}
+
+int sim_branch_latency(const sim_cycle_params *params, const sim_decoded_instr *instr)
+{
+	switch (instr->branch)
+	{
+		case HW_BRANCH_MADD: return params->madd_latency;
+		case HW_BRANCH_MAC: 	return params->mac_latency;
+		case HW_BRANCH_MISC: return params->misc_latency;
+		case HW_BRANCH_LUT: 	return params->lut_latency;
+		case HW_BRANCH_MEM: 	return params->mem_latency;
+		case HW_BRANCH_DELAY:
+			return (instr->writes_external) ? params->delay_write_latency : params->delay_read_latency;
+	}
+
+	return 1;
+}
+
+static int is_resource(int branch)
+{
+	return branch == HW_BRANCH_DELAY || branch == HW_BRANCH_LUT || branch == HW_BRANCH_MEM;
+}
+
+int sim_estimate_cycles(const sim_program_image *image, const sim_cycle_params *params, sim_cycle_estimate *est)
+{
+	if (!image || !params || !est)
+		return 1;
+
+	memset(est, 0, sizeof(sim_cycle_estimate));
+
+	int n = image->n_blocks;
+	int frame_cycles = params->frame_cycles;
+
+	if (n <= 0)
+		return 0;
+
+	sim_decoded_instr instrs[PATCH_MAX_BLOCKS];
+
+	for (int i = 0; i < n; i++)
+		sim_decode_instr(image->instrs[i], &instrs[i]);
+
+	// Cycle each register was last left by the block ahead
+	int stage_out[N_STAGES];
+	int branch_in_prev = 0;
+
+	// Cycle each channel, and the accumulator, was last written;
+	// channel 0 also waits on the tick once the pass is over
+	int channel_written[16];
+	int acc_written = -frame_cycles;
+
+	int branch_free[HW_N_BRANCHES];
+	int branch_out_prev[HW_N_BRANCHES];
+
+	int last_commit = 0;
+
+	int pass_last_commit[CYCLE_PASSES];
+	int frame_last_commit[CYCLE_PASSES + 1];
+
+	memset(stage_out, 0, sizeof(stage_out));
+	for (int i = 0; i < 16; i++)
+		channel_written[i] = -frame_cycles;
+	memset(branch_free, 0, sizeof(branch_free));
+	memset(branch_out_prev, 0, sizeof(branch_out_prev));
+	memset(pass_last_commit, 0, sizeof(pass_last_commit));
+	memset(frame_last_commit, 0, sizeof(frame_last_commit));
+
+	for (int pass = 0; pass < CYCLE_PASSES; pass++)
+	{
+		int tick = pass * frame_cycles;
+		int steady = (pass == CYCLE_PASSES - 1);
+
+		// The last block of the pass before left channel 0 pending,
+		// for the commit master to fill with the sample on the tick. A
+		// program that never reads it runs on ahead of the tick
+		channel_written[0] = max2(channel_written[0], tick + 1);
+
+		for (int i = 0; i < n; i++)
+		{
+			const sim_decoded_instr *instr = &instrs[i];
+			int t[N_STAGES];
+
+			// The fetcher keeps ahead of the decoder, so decode is
+			// limited only by the decoder's own register
+			t[STAGE_DECODE] = max2(stage_out[STAGE_DECODE] + 1, stage_out[STAGE_FETCH_A]);
+
+			for (int s = STAGE_FETCH_A; s <= STAGE_FETCH_C; s++)
+			{
+				int k = s - STAGE_FETCH_A;
+				int next_free = (s == STAGE_FETCH_C) ? stage_out[STAGE_ROUTER] : stage_out[s + 1];
+
+				int arrive = max2(t[s - 1] + 1, next_free);
+				int ready = arrive;
+
+				// Held in the substage until the write lands, and the value
+				// forwarded on from there
+				if (instr->arg_needed[k] && !instr->src_reg[k] && channel_written[instr->src[k]] >= arrive)
+				{
+					int waited = max2(arrive + 2, channel_written[instr->src[k]] + 1);
+
+					if (steady)
+					{
+						if (instr->src[k] == 0 && channel_written[0] == tick + 1)
+							est->tick_stalls += waited - arrive;
+						else
+							est->operand_stalls += waited - arrive;
+					}
+
+					ready = waited;
+				}
+
+				if (s == STAGE_FETCH_C && instr->accumulator_needed && acc_written >= ready)
+				{
+					int waited = max2(ready + 2, acc_written + 1);
+
+					if (steady)
+						est->accumulator_stalls += waited - ready;
+
+					ready = waited;
+				}
+
+				t[s] = ready;
+			}
+
+			// The router holds the block until its branch takes it
+			t[STAGE_ROUTER] = max2(t[STAGE_FETCH_C] + 1, branch_in_prev);
+
+			int branch = instr->branch;
+			int enter = max2(t[STAGE_ROUTER] + 1, branch_free[branch]);
+
+			if (steady && enter > t[STAGE_ROUTER] + 1)
+				est->resource_stalls += enter - (t[STAGE_ROUTER] + 1);
+
+			int latency = sim_branch_latency(params, instr);
+			int result;
+
+			if (is_resource(branch))
+			{
+				// One request at a time: taken, asked for, waited on,
+				// then handed to the commit stage
+				result = enter + latency + 1;
+				branch_free[branch] = (instr->writes_external) ? enter + latency + 1 : result + 1;
+			}
+			else
+			{
+				result = max2(enter + latency - 1, branch_out_prev[branch] + 1);
+				branch_free[branch] = enter + 1;
+			}
+
+			branch_out_prev[branch] = result;
+			branch_in_prev = enter;
+
+			for (int s = 0; s < N_STAGES; s++)
+				stage_out[s] = t[s];
+
+			if (instr->writes_channel || instr->writes_acc)
+			{
+				// In order, through the skid in the commit stage, and
+				// never on a tick
+				int commit = max2(result + params->commit_latency, last_commit + 1);
+
+				if ((commit % frame_cycles) == 0)
+					commit++;
+
+				int written = commit + 1;
+
+				last_commit = commit;
+
+				if (instr->writes_acc)
+					acc_written = written;
+				else
+					channel_written[instr->dest] = written;
+
+				pass_last_commit[pass] = written - tick;
+
+				int frame = written / frame_cycles;
+
+				if (frame <= CYCLE_PASSES)
+					frame_last_commit[frame] = written - frame * frame_cycles;
+			}
+		}
+	}
+
+	est->pass_cycles = max2(pass_last_commit[CYCLE_PASSES - 1], 0);
+	est->commit_span = frame_last_commit[CYCLE_PASSES - 1];
+
+	for (int pass = 0; pass < CYCLE_PASSES; pass++)
+	{
+		if (pass_last_commit[pass] >= frame_cycles)
+			est->overruns++;
+	}
+
+	return 0;
+}
+
+static double total_error(const sim_cycle_params *params, const sim_program_image *images, const int *measured, int n_chains)
+{
+	double err = 0.0;
+
+	for (int i = 0; i < n_chains; i++)
+	{
+		sim_cycle_estimate est;
+
+		if (measured[i] <= 0)
+			continue;
+
+		sim_estimate_cycles(&images[i], params, &est);
+
+		double d = est.commit_span - measured[i];
+		err += d * d;
+	}
+
+	return err;
+}
+
+static void print_errors(const char *title, const sim_cycle_params *params, const sim_program_image *images,
+	const int *measured, const char **names, int n_chains)
+{
+	double abs_err = 0.0;
+	double worst = 0.0;
+	int n_measured = 0;
+
+	printf("\n%s\n", title);
+	printf("%-20s %7s %10s %10s %9s %10s\n", "chain", "blocks", "predicted", "measured", "error", "est. time");
+
+	for (int i = 0; i < n_chains; i++)
+	{
+		sim_cycle_estimate est;
+
+		auto start = std::chrono::steady_clock::now();
+		sim_estimate_cycles(&images[i], params, &est);
+		auto end = std::chrono::steady_clock::now();
+
+		double us = std::chrono::duration<double, std::micro>(end - start).count();
+
+		if (measured[i] > 0)
+		{
+			double err = 100.0 * (est.commit_span - measured[i]) / measured[i];
+
+			abs_err += (err < 0) ? -err : err;
+			if (err > worst || -err > worst)
+				worst = (err < 0) ? -err : err;
+			n_measured++;
+
+			printf("%-20s %7d %10d %10d %8.1f%% %8.1fus%s\n", names[i], images[i].n_blocks, est.commit_span,
+				measured[i], err, us, est.overruns ? "  overruns" : "");
+		}
+		else
+		{
+			printf("%-20s %7d %10d %10s %9s %8.1fus%s\n", names[i], images[i].n_blocks, est.commit_span,
+				"-", "-", us, est.overruns ? "  overruns" : "");
+		}
+	}
+
+	if (n_measured)
+		printf("Mean absolute error %.1f%%, worst %.1f%%\n", abs_err / n_measured, worst);
+}
+
+// Coordinate descent over the latencies, one cycle at a time
+int sim_cycle_calibrate(sim_cycle_params *params, const sim_program_image *images, const int *measured,
+	const char **names, int n_chains)
+{
+	if (!params || !images || !measured || n_chains <= 0)
+		return 1;
+
+	int n_measured = 0;
+
+	for (int i = 0; i < n_chains; i++)
+		n_measured += (measured[i] > 0);
+
+	// Nothing to fit to, and nothing worth writing out
+	if (!n_measured)
+		return 1;
+
+	print_errors("Starting latencies:", params, images, measured, names, n_chains);
+
+	int *fields[N_PARAM_FIELDS];
+	const int n_fields = N_PARAM_FIELDS;
+
+	param_fields(params, fields);
+
+	double best = total_error(params, images, measured, n_chains);
+	int improved = 1;
+
+	while (improved)
+	{
+		improved = 0;
+
+		for (int f = 0; f < n_fields; f++)
+		{
+			for (int step = -1; step <= 1; step += 2)
+			{
+				while (*fields[f] + step >= 1 && *fields[f] + step <= 64)
+				{
+					*fields[f] += step;
+
+					double err = total_error(params, images, measured, n_chains);
+
+					if (err < best)
+					{
+						best = err;
+						improved = 1;
+					}
+					else
+					{
+						*fields[f] -= step;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	print_errors("Calibrated latencies:", params, images, measured, names, n_chains);
+
+	printf("madd %d, mac %d, misc %d, delay read %d, delay write %d, lut %d, mem %d, commit %d\n",
+		params->madd_latency, params->mac_latency, params->misc_latency, params->delay_read_latency,
+		params->delay_write_latency, params->lut_latency, params->mem_latency, params->commit_latency);
+
+	return 0;
+}
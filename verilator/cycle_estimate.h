@@ -0,0 +1,117 @@
+#ifndef DSP_SIM_CYCLE_ESTIMATE_H_
+#define DSP_SIM_CYCLE_ESTIMATE_H_
+
+#define CYCLE_FRAME_CYCLES 	1280
+
+#define CYCLE_MAX_CHAINS 	32
+
+// Opcodes and branches as include/instr_dec.vh has them; libM's
+// numbering is the controller's business, not the core's
+#define HW_INSTR_NOP 			0
+#define HW_INSTR_MADD 			1
+#define HW_INSTR_ARSH 			2
+#define HW_INSTR_LSH 			3
+#define HW_INSTR_RSH 			4
+#define HW_INSTR_ABS 			5
+#define HW_INSTR_MIN 			6
+#define HW_INSTR_MAX 			7
+#define HW_INSTR_CLAMP 			8
+#define HW_INSTR_MOV_ACC 		9
+#define HW_INSTR_MOV_LACC 		10
+#define HW_INSTR_MOV_UACC 		11
+#define HW_INSTR_MACZ 			12
+#define HW_INSTR_UMACZ 			13
+#define HW_INSTR_MAC 			14
+#define HW_INSTR_UMAC 			15
+#define HW_INSTR_LUT_READ 		16
+#define HW_INSTR_DELAY_READ 	17
+#define HW_INSTR_DELAY_WRITE 	18
+#define HW_INSTR_MEM_READ 		19
+#define HW_INSTR_MEM_WRITE 		20
+
+#define HW_N_BRANCHES 		6
+#define HW_BRANCH_MADD 		0
+#define HW_BRANCH_MAC 		1
+#define HW_BRANCH_MISC 		2
+#define HW_BRANCH_DELAY 	3
+#define HW_BRANCH_LUT 		4
+#define HW_BRANCH_MEM 		5
+
+// A block's instruction word, taken apart as instr_dec.v does it
+typedef struct {
+	int operation;
+	int branch;
+
+	int src[3];
+	int src_reg[3];
+	int arg_needed[3];
+
+	int dest;
+	int res_addr;
+
+	int accumulator_needed;
+	int reads_acc;
+	int writes_channel;
+	int writes_acc;
+	int writes_external;
+} sim_decoded_instr;
+
+// Latencies the estimate is built from, in sys_clk cycles. The branch
+// pipelines are fixed by their stage counts; the resource round trips
+// depend on the arbiters, and are what calibration mostly moves
+typedef struct {
+	int madd_latency;
+	int mac_latency;
+	int misc_latency;
+
+	int delay_read_latency;
+	int delay_write_latency;
+	int lut_latency;
+	int mem_latency;
+
+	int commit_latency;
+
+	// The sample rate's budget: sys_clk cycles from one tick to the next
+	int frame_cycles;
+} sim_cycle_params;
+
+typedef struct {
+	// Cycles from the tick to the last commit before the next one,
+	// as dsp_core's commit_span counts them
+	int commit_span;
+
+	// Cycles from the tick to the last commit of the pass itself; over
+	// a frame, and the program doesn't fit
+	int pass_cycles;
+	int overruns;
+
+	// Where the time went, in cycles of the steady-state pass
+	int operand_stalls;
+	int accumulator_stalls;
+	int resource_stalls;
+
+	// Waiting on the sample, so idle time between passes included
+	int tick_stalls;
+} sim_cycle_estimate;
+
+// The latencies as read off the RTL, or as last fitted if a calibration
+// has written them to SIM_CYCLE_PARAMS_PATH
+void sim_cycle_params_default(sim_cycle_params *params);
+
+// The fitted latencies, one name and value a line. Reading leaves
+// `params' as it was unless the file has every one of them
+int sim_cycle_params_read(sim_cycle_params *params, const char *path);
+int sim_cycle_params_write(const sim_cycle_params *params, const char *path);
+
+void sim_decode_instr(uint32_t word, sim_decoded_instr *instr);
+
+int sim_branch_latency(const sim_cycle_params *params, const sim_decoded_instr *instr);
+
+int sim_estimate_cycles(const sim_program_image *image, const sim_cycle_params *params, sim_cycle_estimate *est);
+
+// Fit the parameters to measured commit spans, and print the prediction
+// error over every chain before and after. Nonzero if none was measured
+int sim_cycle_calibrate(sim_cycle_params *params, const sim_program_image *images, const int *measured,
+	const char **names, int n_chains);
+
+#endif
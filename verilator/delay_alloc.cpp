@@ -0,0 +1,285 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sim_main.h"
+#include "session.h"
+#include "delay_alloc.h"
+#include "Vtop___024root.h"
+
+/*
+ * Allocation-stress benchmark for the delay buffers, on the engine itself.
+ *
+ * Each trial is an engine of its own, through the session API, with its
+ * back pipeline opened for programming. Random allocations, frees and
+ * resizes then go in one at a time, as the host would send them, until
+ * one fails or enough have been made, and each is timed by the cycles
+ * the back pipeline's delay master spends busy with it.
+ *
+ * What an edit turned out to be is read off the engine rather than
+ * worked out here: a failure from the engine's count of buffers it
+ * couldn't place, and a resize that grew as a move if any page the
+ * buffer held before came free. The handles are tracked on this side,
+ * lowest free first, as delay_master hands them out.
+ *
+ * Nothing is running in the back pipeline, so a buffer's write position
+ * is where it started, and a resize copies everything it keeps.
+ */
+
+#define DELAY_BENCH_SEED 	1234
+
+static const char *op_names[DELAY_N_OPS] = {"alloc", "free", "shrink", "grow", "grow (move)", "failed"};
+
+static int back_pipeline(const sim_session *session)
+{
+	return !session->top->rootp->top__DOT__engine__DOT__controller__DOT__current_pipeline;
+}
+
+static int delays_busy(const sim_session *session)
+{
+	return (session->top->rootp->top__DOT__engine__DOT__pipeline_delays_busy >> back_pipeline(session)) & 1;
+}
+
+static int alloc_failures(const sim_session *session)
+{
+	return session->top->rootp->top__DOT__engine__DOT__delay_alloc_failures;
+}
+
+static void read_pages(const sim_session *session, uint32_t *words)
+{
+	for (int w = 0; w < DELAY_POOL_PAGES / 32; w++)
+	{
+		words[w] = back_pipeline(session)
+			? session->top->rootp->top__DOT__engine__DOT__delay_pages_b[w]
+			: session->top->rootp->top__DOT__engine__DOT__delay_pages_a[w];
+	}
+}
+
+// Send one command and run until it's gone in and delay_master is done
+// with it; nonzero if that doesn't happen in time
+static int send_timed(sim_session *session, const uint8_t *bytes, int n, long *busy)
+{
+	long started = session->sched.cycle;
+
+	*busy = 0;
+
+	if (sim_session_send_command(session, bytes, n))
+		return 1;
+
+	while (!sim_session_idle(session) || delays_busy(session))
+	{
+		if (session->sched.cycle - started > DELAY_BENCH_TIMEOUT)
+			return 1;
+
+		sim_session_step(session);
+
+		if (delays_busy(session))
+			(*busy)++;
+	}
+
+	return 0;
+}
+
+// Delay lengths spread evenly on a log scale, 32 to 4096 samples
+static int random_size()
+{
+	return (int)(32.0 * pow(2.0, 7.0 * (rand() / (double)RAND_MAX)));
+}
+
+static int random_live(const int *valid)
+{
+	int n = 0;
+
+	for (int h = 0; h < DELAY_N_BUFFERS; h++)
+		n += valid[h];
+
+	if (n == 0)
+		return -1;
+
+	int k = rand() % n;
+
+	for (int h = 0; h < DELAY_N_BUFFERS; h++)
+	{
+		if (valid[h] && k-- == 0)
+			return h;
+	}
+
+	return -1;
+}
+
+static int lowest_free(const int *valid)
+{
+	for (int h = 0; h < DELAY_N_BUFFERS; h++)
+	{
+		if (!valid[h])
+			return h;
+	}
+
+	return -1;
+}
+
+static void record(sim_delay_alloc_result *result, int op, long busy)
+{
+	sim_delay_op_time *time = &result->ops[op];
+
+	time->count++;
+	time->cycles += busy;
+
+	if (busy > time->worst)
+		time->worst = busy;
+}
+
+int sim_delay_alloc_trial(int seed, int max_edits, sim_delay_alloc_result *result)
+{
+	int valid[DELAY_N_BUFFERS];
+	int size[DELAY_N_BUFFERS];
+	uint8_t bytes[1 + DELAY_ALLOC_BYTES];
+	long busy;
+
+	memset(valid, 0, sizeof(valid));
+	memset(size, 0, sizeof(size));
+
+	sim_session *session = sim_session_new(seed);
+
+	if (!session)
+		return 1;
+
+	bytes[0] = COMMAND_BEGIN_PROGRAM;
+
+	if (send_timed(session, bytes, 1, &busy))
+	{
+		fprintf(stderr, "Delay alloc: the back pipeline wasn't opened for programming\n");
+		sim_session_free(session);
+		return 1;
+	}
+
+	for (int edit = 0; edit < max_edits; edit++)
+	{
+		uint32_t before[DELAY_POOL_PAGES / 32];
+		uint32_t after[DELAY_POOL_PAGES / 32];
+		int failures = alloc_failures(session);
+		int r = rand() % 10;
+		int h = random_live(valid);
+		int new_size = random_size();
+		int op;
+		int n;
+
+		read_pages(session, before);
+
+		if (r < 5 || h < 0)
+		{
+			h  = lowest_free(valid);
+			op = DELAY_OP_ALLOC;
+
+			// Sent size first, then the delay it starts at
+			bytes[0] = COMMAND_ALLOC_DELAY;
+			bytes[1] = (new_size >> 16) & 0xFF;
+			bytes[2] = (new_size >> 8) & 0xFF;
+			bytes[3] =  new_size & 0xFF;
+			bytes[4] = 0;
+			bytes[5] = 0;
+			bytes[6] = 0;
+			n = 1 + DELAY_ALLOC_BYTES;
+		}
+		else if (r < 8)
+		{
+			op = DELAY_OP_FREE;
+
+			bytes[0] = COMMAND_FREE_DELAY;
+			bytes[1] = h;
+			n = 2;
+		}
+		else
+		{
+			op = (new_size <= size[h]) ? DELAY_OP_SHRINK : DELAY_OP_GROW;
+
+			bytes[0] = COMMAND_RESIZE_DELAY;
+			bytes[1] = h;
+			bytes[2] = (new_size >> 16) & 0xFF;
+			bytes[3] = (new_size >> 8) & 0xFF;
+			bytes[4] =  new_size & 0xFF;
+			n = 5;
+		}
+
+		if (send_timed(session, bytes, n, &busy))
+		{
+			result->stuck++;
+			break;
+		}
+
+		read_pages(session, after);
+
+		if (alloc_failures(session) != failures || h < 0)
+		{
+			record(result, DELAY_OP_FAILED, busy);
+			break;
+		}
+
+		if (op == DELAY_OP_GROW)
+		{
+			for (int w = 0; w < DELAY_POOL_PAGES / 32; w++)
+			{
+				if (before[w] & ~after[w])
+					op = DELAY_OP_MOVE;
+			}
+		}
+
+		record(result, op, busy);
+		result->edits++;
+
+		valid[h] = (op != DELAY_OP_FREE);
+		size[h]  = new_size;
+	}
+
+	for (int h = 0; h < DELAY_N_BUFFERS; h++)
+	{
+		if (valid[h])
+			result->live_words += size[h];
+	}
+
+	sim_session_free(session);
+
+	return 0;
+}
+
+int sim_delay_alloc_bench()
+{
+	sim_delay_alloc_result result;
+
+	memset(&result, 0, sizeof(result));
+
+	printf("Delay allocation stress: %d trials of up to %d edits, %d buffers, %d-word pages\n\n",
+		DELAY_BENCH_TRIALS, DELAY_BENCH_EDITS, DELAY_N_BUFFERS, DELAY_PAGE_SIZE);
+
+	srand(DELAY_BENCH_SEED);
+
+	for (int t = 0; t < DELAY_BENCH_TRIALS; t++)
+	{
+		if (sim_delay_alloc_trial(t + 1, DELAY_BENCH_EDITS, &result))
+			return 1;
+	}
+
+	printf("%-12s %8s %14s %14s\n", "edit", "count", "mean cycles", "worst cycles");
+
+	for (int op = 0; op < DELAY_N_OPS; op++)
+	{
+		sim_delay_op_time *time = &result.ops[op];
+
+		if (!time->count)
+		{
+			printf("%-12s %8d %14s %14s\n", op_names[op], 0, "-", "-");
+			continue;
+		}
+
+		printf("%-12s %8ld %14.1f %14ld\n", op_names[op], time->count,
+			time->cycles / (double)time->count, time->worst);
+	}
+
+	printf("\n%.1f edits a trial, %.1f words live at the end, %ld stuck\n",
+		result.edits / (double)DELAY_BENCH_TRIALS,
+		result.live_words / (double)DELAY_BENCH_TRIALS, result.stuck);
+
+	return 0;
+}
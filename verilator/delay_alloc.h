@@ -0,0 +1,52 @@
+#ifndef DSP_SIM_DELAY_ALLOC_H_
+#define DSP_SIM_DELAY_ALLOC_H_
+
+// Mirror of delay_master's parameters, as instantiated in the pipelines.
+// The memory is a pipeline's half of the pool they share; see delay_pool.h
+#define DELAY_MEM_SIZE 		16384
+#define DELAY_N_BUFFERS 	16
+#define DELAY_PAGE_SIZE 	128
+#define DELAY_N_PAGES 		(DELAY_MEM_SIZE / DELAY_PAGE_SIZE)
+
+// Engines run, and edits made in each at most, before the first failure
+#define DELAY_BENCH_TRIALS 	8
+#define DELAY_BENCH_EDITS 	64
+
+// Cycles an edit is given to be done in before it's counted as stuck
+#define DELAY_BENCH_TIMEOUT (1 << 20)
+
+// What an edit turned out to be, by what delay_master did with it
+#define DELAY_OP_ALLOC 		0
+#define DELAY_OP_FREE 		1
+#define DELAY_OP_SHRINK 	2
+#define DELAY_OP_GROW 		3
+#define DELAY_OP_MOVE 		4
+#define DELAY_OP_FAILED 	5
+#define DELAY_N_OPS 		6
+
+typedef struct {
+	long count;
+
+	// sys_clk cycles the back pipeline's delays were busy for
+	long cycles;
+	long worst;
+} sim_delay_op_time;
+
+typedef struct {
+	sim_delay_op_time ops[DELAY_N_OPS];
+
+	long edits;
+	long stuck;
+
+	// Words held by live buffers when each trial ended
+	long live_words;
+} sim_delay_alloc_result;
+
+// Random allocations, frees and resizes on the back pipeline of an
+// engine of its own, while it's being programmed, each timed until
+// delay_master is done with it; until one fails or `max_edits' are made
+int sim_delay_alloc_trial(int seed, int max_edits, sim_delay_alloc_result *result);
+
+int sim_delay_alloc_bench();
+
+#endif
@@ -0,0 +1,164 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "delay_pool.h"
+#include "Vtop___024root.h"
+
+/*
+ * The delay memory pool, as seen from outside.
+ *
+ * The engine's page bitmaps are read straight out of the model: the
+ * pages each pipeline's buffers hold, and the partition the controller
+ * took when the back pipeline was last programmed, which is the pages
+ * that were closed to it. Buffers that couldn't be placed are counted by
+ * the engine.
+ *
+ * The bench loads one program after another, each a single buffer and
+ * nothing else, into an engine of its own through the session API. The
+ * sizes are picked so that the first two only fit because the pool is
+ * shared: one bigger than a pipeline's memory used to be, taken while the
+ * other pipeline holds nothing, then one that needs exactly what the
+ * first leaves while they're both live. The third is turned away for
+ * want of room beside the second; the fourth, with the pipeline it
+ * replaces holding nothing, gets almost the whole pool.
+ */
+
+static int count_pages(const uint32_t *words, int *largest_run)
+{
+	int count = 0;
+	int run = 0;
+
+	if (largest_run)
+		*largest_run = 0;
+
+	for (int p = 0; p < DELAY_POOL_PAGES; p++)
+	{
+		int used = (words[p / 32] >> (p % 32)) & 1;
+
+		count += used;
+		run = used ? 0 : run + 1;
+
+		if (largest_run && run > *largest_run)
+			*largest_run = run;
+	}
+
+	return count;
+}
+
+void sim_delay_pool_read(Vtop *top, sim_delay_pool_report *report)
+{
+	uint32_t words[3][DELAY_POOL_PAGES / 32];
+	uint32_t taken[DELAY_POOL_PAGES / 32];
+
+	for (int w = 0; w < DELAY_POOL_PAGES / 32; w++)
+	{
+		words[0][w] = top->rootp->top__DOT__engine__DOT__delay_pages_a[w];
+		words[1][w] = top->rootp->top__DOT__engine__DOT__delay_pages_b[w];
+		words[2][w] = top->rootp->top__DOT__engine__DOT__delay_partition[w];
+
+		taken[w] = words[0][w] | words[1][w];
+	}
+
+	report->pages[0]  = count_pages(words[0], NULL);
+	report->pages[1]  = count_pages(words[1], NULL);
+	report->partition = count_pages(words[2], NULL);
+
+	report->free_pages = DELAY_POOL_PAGES - count_pages(taken, &report->largest_free);
+	report->largest_free *= DELAY_PAGE_SIZE;
+
+	report->failures = top->rootp->top__DOT__engine__DOT__delay_alloc_failures;
+}
+
+void sim_delay_pool_print(const sim_delay_pool_report *report)
+{
+	printf("Delay pool: A holds %d pages, B %d; %d of %d free, largest run %d words; %d closed to the last program; %d failed\n",
+		report->pages[0], report->pages[1], report->free_pages, DELAY_POOL_PAGES,
+		report->largest_free, report->partition, report->failures);
+}
+
+/*********/
+/* Bench */
+/*********/
+
+#define DELAY_POOL_BENCH_PROGRAMS 4
+
+static void delay_program(m_fpga_transfer_batch *batch, int size)
+{
+	*batch = m_new_fpga_transfer_batch();
+
+	m_fpga_batch_append(batch, COMMAND_BEGIN_PROGRAM);
+
+	// Size then initial delay, three bytes each, high byte first
+	m_fpga_batch_append(batch, COMMAND_ALLOC_DELAY);
+	m_fpga_batch_append(batch, (size >> 16) & 0xFF);
+	m_fpga_batch_append(batch, (size >>  8) & 0xFF);
+	m_fpga_batch_append(batch,  size 		& 0xFF);
+	m_fpga_batch_append(batch, 0);
+	m_fpga_batch_append(batch, 0);
+	m_fpga_batch_append(batch, 0);
+
+	m_fpga_batch_append(batch, COMMAND_END_PROGRAM);
+}
+
+int sim_delay_pool_bench()
+{
+	static const char *outcomes[] = {"swapped in", "rejected", "timed out"};
+
+	const int sizes[DELAY_POOL_BENCH_PROGRAMS] = {
+		DELAY_POOL_SIZE * 5 / 8,
+		DELAY_POOL_SIZE * 3 / 8,
+		DELAY_POOL_SIZE * 3 / 4,
+		DELAY_POOL_SIZE - 2 * DELAY_PAGE_SIZE
+	};
+
+	sim_session *session = sim_session_new(1);
+	sim_delay_pool_report report;
+
+	if (!session)
+	{
+		fprintf(stderr, "Delay pool bench: can't start a session\n");
+		return 1;
+	}
+
+	printf("Delay pool: %d words in %d-word pages, shared; each pipeline had %d of its own\n\n",
+		DELAY_POOL_SIZE, DELAY_PAGE_SIZE, DELAY_MEM_SIZE);
+
+	int largest_placed = 0;
+
+	for (int i = 0; i < DELAY_POOL_BENCH_PROGRAMS; i++)
+	{
+		m_fpga_transfer_batch batch;
+
+		sim_delay_pool_read(session->top, &report);
+		int failures_before = report.failures;
+
+		delay_program(&batch, sizes[i]);
+
+		int outcome = sim_session_load_program(session, batch);
+		free(batch.buf);
+
+		sim_delay_pool_read(session->top, &report);
+
+		int placed = (report.failures == failures_before);
+
+		printf("Program %d: a %d-word buffer, %s, %s beside %d pages of the outgoing program\n",
+			i, sizes[i], outcomes[outcome], placed ? "placed" : "NOT placed", report.partition);
+
+		sim_delay_pool_print(&report);
+
+		if (outcome == SESSION_LOAD_SWAPPED && placed && sizes[i] > largest_placed)
+			largest_placed = sizes[i];
+
+		printf("\n");
+	}
+
+	printf("Largest buffer placed: %d words (%.2fx a pipeline's memory of its own)\n",
+		largest_placed, (double)largest_placed / DELAY_MEM_SIZE);
+
+	sim_session_free(session);
+
+	return 0;
+}
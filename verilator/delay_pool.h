@@ -0,0 +1,38 @@
+#ifndef DSP_SIM_DELAY_POOL_H_
+#define DSP_SIM_DELAY_POOL_H_
+
+// Mirror of engine.v's delay_pool_size: what both pipelines' memories
+// come to, or in a stereo build, a lane's
+#ifdef SIM_STEREO
+#define DELAY_POOL_SIZE 	DELAY_MEM_SIZE
+#else
+#define DELAY_POOL_SIZE 	(2 * DELAY_MEM_SIZE)
+#endif
+#define DELAY_POOL_PAGES 	(DELAY_POOL_SIZE / DELAY_PAGE_SIZE)
+
+typedef struct {
+	// Pages held by pipelines A and B
+	int pages[2];
+
+	// Pages closed to the back pipeline when it was last programmed
+	int partition;
+
+	int free_pages;
+
+	// The longest run of free pages, in words: the largest buffer a
+	// program could have, were it to go in now
+	int largest_free;
+
+	// Buffers the engine couldn't place, since reset
+	int failures;
+} sim_delay_pool_report;
+
+void sim_delay_pool_read(Vtop *top, sim_delay_pool_report *report);
+void sim_delay_pool_print(const sim_delay_pool_report *report);
+
+// Load programs of one buffer each, of sizes chosen to show what the
+// pool allows alone and during a swap, and report where each one went.
+// Mono builds only
+int sim_delay_pool_bench();
+
+#endif
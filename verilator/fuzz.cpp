@@ -0,0 +1,903 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "sim_main.h"
+#include "model.h"
+#include "fuzz.h"
+
+#include "svdpi.h"
+#ifdef SIM_FUZZ
+#include "Vtop__Dpi.h"
+#endif
+
+/*
+ * Differential fuzzing: the RTL cores against the model.
+ *
+ * A case is a few steps of SPI traffic: random programs over every
+ * opcode the decoder has, with random registers, delay buffers, LUT and
+ * memory handles, shifts and flags, and input and output gain changes
+ * between them. Programs are cut down until the cycle estimate has them
+ * finishing well inside the frame, so that what's compared is what the
+ * program computes and not whether it kept up.
+ *
+ * Each case runs on a Vtop of its own, in a context of its own, so cases
+ * run a thread apiece. A hook in each core reports every tick whether
+ * it's running, the sample it took, and what the last pass left in
+ * channel 0; the thread's model of that core, started on the program as
+ * the core is enabled, runs the same sample and is held to the result.
+ * Gains and the crossfade sit outside the cores, so they're exercised,
+ * and change what the cores are given, but aren't themselves checked.
+ *
+ * The first mismatch stops the run. Its case is shrunk, dropping steps,
+ * then blocks in halving chunks, then buffers nothing uses, then
+ * registers and flags, for as long as it still fails, and written out
+ * as the bytes to send and a listing of each program.
+ *
+ * The bugs it has turned up are kept as directed cases: a program
+ * written to show each one, run ahead of the random cases.
+ */
+
+static std::mutex fuzz_lock;
+
+static uint64_t xorshift(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	return *state = x;
+}
+
+static int rnd(uint64_t *state, int n)
+{
+	return (int)(xorshift(state) % n);
+}
+
+/*************/
+/* Generator */
+/*************/
+
+static uint16_t generate_value(uint64_t *rng)
+{
+	switch (rnd(rng, 8))
+	{
+		case 0: return 0;
+		case 1: return 0x7FFF;
+		case 2: return 0x8000;
+		case 3: return 0x4000;
+		case 4: return (uint16_t)(rnd(rng, 64) - 32);
+	}
+
+	return (uint16_t)xorshift(rng);
+}
+
+static uint32_t generate_instr(uint64_t *rng, int n_delays)
+{
+	sim_decoded_instr needed;
+	int op;
+
+	do {
+		op = rnd(rng, HW_INSTR_MEM_WRITE + 1);
+	} while ((op == HW_INSTR_DELAY_READ || op == HW_INSTR_DELAY_WRITE) && !n_delays);
+
+	sim_decode_instr(op, &needed);
+
+	int resource = (op >= HW_INSTR_LUT_READ);
+	int loose 	 = (op == HW_INSTR_NOP || op == HW_INSTR_ARSH);
+
+	// Resources need the handle; anything else may go without the shift
+	// and flags, except what uses arguments it doesn't wait for
+	int format = resource || (!loose && rnd(rng, 8) == 0);
+
+	int src[3], src_reg[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		src[i] 	   = rnd(rng, 16);
+		src_reg[i] = (loose && !needed.arg_needed[i]) ? 1 : rnd(rng, 3) == 0;
+
+		// Registers 0 to 4 are the only ones with anything in them
+		if (src_reg[i] && rnd(rng, 4))
+			src[i] %= 5;
+	}
+
+	int dest = rnd(rng, 3) ? rnd(rng, 16) : 0;
+
+	uint32_t word = op | (format << 5)
+		| (src[0] << 6) | (src_reg[0] << 10)
+		| (src[1] << 11) | (src_reg[1] << 15);
+
+	if (format)
+	{
+		int res_addr = 0;
+
+		if (op == HW_INSTR_LUT_READ)
+			res_addr = rnd(rng, 2);
+		else if (op == HW_INSTR_DELAY_READ || op == HW_INSTR_DELAY_WRITE)
+			res_addr = rnd(rng, n_delays);
+		else if (resource)
+			res_addr = rnd(rng, 4) ? rnd(rng, 8) : rnd(rng, 256);
+
+		return word | (dest << 16) | ((uint32_t)res_addr << 20);
+	}
+
+	int shift = rnd(rng, 2) ? 0 : rnd(rng, 32);
+
+	word |= (src[2] << 16) | (src_reg[2] << 20) | (dest << 21) | (shift << 25);
+
+	if (rnd(rng, 4) == 0) word |= 1u << 30;
+	if (rnd(rng, 8) == 0) word |= 1u << 31;
+
+	return word;
+}
+
+// Drop blocks off the end until the estimate has the pass done with a
+// quarter of the frame to spare
+static void fit_program(sim_program_image *image)
+{
+	sim_cycle_params params;
+	sim_cycle_params_default(&params);
+
+	while (image->n_blocks > 0)
+	{
+		sim_cycle_estimate est;
+
+		sim_estimate_cycles(image, &params, &est);
+
+		if (!est.overruns && est.pass_cycles < params.frame_cycles * 3 / 4)
+			break;
+
+		image->n_blocks--;
+	}
+}
+
+static void set_delay(sim_program_image *image, int handle, int size, int delay)
+{
+	uint8_t *alloc = image->delays[handle];
+
+	alloc[0] = size >> 16;  alloc[1] = size >> 8;  alloc[2] = size;
+	alloc[3] = delay >> 16; alloc[4] = delay >> 8; alloc[5] = delay;
+
+	image->delay_valid[handle] = 1;
+}
+
+static void generate_program(uint64_t *rng, sim_program_image *image)
+{
+	memset(image, 0, sizeof(sim_program_image));
+
+	int n_delays = rnd(rng, FUZZ_MAX_DELAYS);
+
+	for (int h = 0; h < n_delays; h++)
+	{
+		int size  = 1 + rnd(rng, MODEL_MAX_DELAY);
+		int delay = rnd(rng, (size << 8) + 1);
+
+		set_delay(image, h, size, delay);
+	}
+
+	image->n_blocks = 1 + rnd(rng, FUZZ_MAX_BLOCKS);
+
+	for (int i = 0; i < image->n_blocks; i++)
+	{
+		image->instrs[i] = generate_instr(rng, n_delays);
+
+		for (int r = 0; r < 2; r++)
+			image->regs[i][r] = rnd(rng, 2) ? generate_value(rng) : 0;
+	}
+
+	fit_program(image);
+}
+
+void sim_fuzz_generate(sim_fuzz_case *fc, uint64_t seed)
+{
+	uint64_t rng = seed * 0x9E3779B97F4A7C15ull + 1;
+
+	memset(fc, 0, sizeof(sim_fuzz_case));
+
+	fc->seed 	= seed;
+	fc->n_steps = 1 + rnd(&rng, FUZZ_MAX_STEPS);
+
+	for (int s = 0; s < fc->n_steps; s++)
+	{
+		sim_fuzz_step *step = &fc->steps[s];
+		int kind = rnd(&rng, 6);
+
+		// The last step is always a program, so there's one to check
+		if (s == fc->n_steps - 1 || kind < 4)
+		{
+			step->type = FUZZ_STEP_PROGRAM;
+			generate_program(&rng, &step->image);
+		}
+		else
+		{
+			step->type = (kind == 4) ? FUZZ_STEP_INPUT_GAIN : FUZZ_STEP_OUTPUT_GAIN;
+
+			// q5.11, mostly about unity
+			step->gain = rnd(&rng, 2) ? 1024 + rnd(&rng, 2048) : rnd(&rng, 0x10000);
+		}
+	}
+}
+
+static void step_batch(const sim_fuzz_step *step, m_fpga_transfer_batch *batch)
+{
+	*batch = m_new_fpga_transfer_batch();
+
+	if (step->type == FUZZ_STEP_PROGRAM)
+	{
+		sim_encode_program(batch, &step->image);
+		return;
+	}
+
+	m_fpga_batch_append(batch, (step->type == FUZZ_STEP_INPUT_GAIN) ? COMMAND_SET_INPUT_GAIN : COMMAND_SET_OUTPUT_GAIN);
+	m_fpga_batch_append(batch, step->gain >> 8);
+	m_fpga_batch_append(batch, step->gain & 0xFF);
+}
+
+/*******/
+/* Run */
+/*******/
+
+typedef struct {
+	sim_model model[2];
+	int running[2];
+	int step_of[2];
+	int16_t last_in[2];
+
+	// The program the next core to be enabled has been given
+	const sim_program_image *next_image;
+	int next_step;
+
+	long frame;
+
+	sim_fuzz_result *result;
+} fuzz_run;
+
+static thread_local fuzz_run *current_run = NULL;
+
+static const sim_program_image empty_image = {};
+
+// The hook in dsp_core; see src/core.v
+void sim_fuzz_tick(int state, int sample, int result)
+{
+	fuzz_run *run = current_run;
+
+	if (!run)
+		return;
+
+	int core = strstr(svGetNameFromScope(svGetScope()), "pipeline_b") ? 1 : 0;
+
+	if (state == 0)
+	{
+		run->running[core] = 0;
+		return;
+	}
+
+	if (state == 1)
+	{
+		run->running[core] = !sim_model_init(&run->model[core], run->next_image);
+		run->step_of[core] = run->next_step;
+		run->last_in[core] = (int16_t)sample;
+		return;
+	}
+
+	if (!run->running[core])
+		return;
+
+	int16_t expected = sim_model_process(&run->model[core], run->last_in[core]);
+
+	if (expected != (int16_t)result && !run->result->failed)
+	{
+		run->result->failed 	= 1;
+		run->result->step 		= run->step_of[core];
+		run->result->core 		= core;
+		run->result->frame 		= run->frame;
+		run->result->input 		= run->last_in[core];
+		run->result->expected 	= expected;
+		run->result->got 		= (int16_t)result;
+	}
+
+	run->last_in[core] = (int16_t)sample;
+}
+
+static int16_t stimulus(uint64_t *rng)
+{
+	switch (rnd(rng, 8))
+	{
+		case 0: return 0x7FFF;
+		case 1: return (int16_t)0x8000;
+		case 2: return (int16_t)(rnd(rng, 64) - 32);
+	}
+
+	return (int16_t)xorshift(rng);
+}
+
+static void clock_top(Vtop *top, sim_io_state *io)
+{
+	top->sys_clk = 1;
+	sim_io_drive(io, top);
+	top->eval();
+
+	top->sys_clk = 0;
+	sim_io_drive(io, top);
+	top->eval();
+}
+
+int sim_fuzz_run_case(const sim_fuzz_case *fc, sim_fuzz_result *result)
+{
+	static thread_local sim_io_state io;
+	fuzz_run *run = new fuzz_run;
+
+	memset(result, 0, sizeof(sim_fuzz_result));
+	memset(run, 0, sizeof(fuzz_run));
+
+	run->next_image = &empty_image;
+	run->next_step  = -1;
+	run->result 	= result;
+
+	VerilatedContext *context = new VerilatedContext;
+	context->randReset(2);
+	context->randSeed((int)fc->seed);
+
+	Vtop *top = new Vtop(context);
+
+	sim_io_init(&io);
+	current_run = run;
+
+	uint64_t rng = fc->seed ^ 0xD1B54A32D192ED03ull;
+
+	m_fpga_transfer_batch batch = {};
+	int step = 0;
+	int sending = 0;
+	int position = 0;
+	long step_at = 0;
+	long settled_at = -1;
+
+	long limit = (long)(fc->n_steps + 1) * FUZZ_STEP_FRAMES;
+
+	while (!result->failed)
+	{
+		clock_top(top, &io);
+
+		int spi_idle = !io.spi_sending && io.spi_read_head == io.spi_write_head;
+
+		if (sending && spi_idle)
+		{
+			if (position == batch.len - 1 && fc->steps[step].type == FUZZ_STEP_PROGRAM)
+			{
+				run->next_image = &fc->steps[step].image;
+				run->next_step 	= step;
+			}
+
+			spi_enqueue(&io, batch.buf[position++]);
+
+			if (position == batch.len)
+			{
+				free(batch.buf);
+				sending = 0;
+				step++;
+				step_at = run->frame;
+			}
+		}
+
+		if (!io.i2s_ready)
+			continue;
+
+		io.i2s_ready = 0;
+		io.sample_in = stimulus(&rng);
+		io.sample_in_r = io.sample_in;
+
+		run->frame++;
+
+		// The controller is idle once a command's been taken and whatever
+		// it started has finished: a couple of frames for the byte to get
+		// there, then led1
+		int settled = !sending && spi_idle && top->led1 && run->frame - step_at > 2;
+
+		if (settled && step < fc->n_steps)
+		{
+			step_batch(&fc->steps[step], &batch);
+			sending  = 1;
+			position = 0;
+		}
+		else if (settled && settled_at < 0)
+		{
+			settled_at = run->frame;
+		}
+
+		if (settled_at >= 0 && run->frame - settled_at >= FUZZ_CHECK_FRAMES)
+			break;
+
+		if (run->frame > limit)
+		{
+			result->failed = 1;
+			result->hung   = 1;
+			result->step   = step - 1;
+			result->frame  = run->frame;
+		}
+	}
+
+	if (sending)
+		free(batch.buf);
+
+	result->frames = run->frame;
+
+	current_run = NULL;
+
+	top->final();
+	delete top;
+	delete context;
+	delete run;
+
+	return result->failed;
+}
+
+/**********/
+/* Shrink */
+/**********/
+
+static int still_fails(const sim_fuzz_case *fc, sim_fuzz_result *result, int *budget)
+{
+	sim_fuzz_result attempt;
+
+	if (*budget <= 0)
+		return 0;
+
+	(*budget)--;
+
+	if (!sim_fuzz_run_case(fc, &attempt))
+		return 0;
+
+	*result = attempt;
+	return 1;
+}
+
+static void remove_blocks(sim_program_image *image, int first, int n)
+{
+	int rest = image->n_blocks - first - n;
+
+	memmove(&image->instrs[first], &image->instrs[first + n], rest * sizeof(image->instrs[0]));
+	memmove(&image->regs[first], &image->regs[first + n], rest * sizeof(image->regs[0]));
+
+	image->n_blocks -= n;
+}
+
+static int uses_delay(const sim_program_image *image, int handle)
+{
+	for (int i = 0; i < image->n_blocks; i++)
+	{
+		sim_decoded_instr instr;
+		sim_decode_instr(image->instrs[i], &instr);
+
+		if (instr.branch == HW_BRANCH_DELAY && instr.res_addr == handle)
+			return 1;
+	}
+
+	return 0;
+}
+
+void sim_fuzz_shrink(sim_fuzz_case *fc, sim_fuzz_result *result)
+{
+	sim_fuzz_case *trial = new sim_fuzz_case;
+	int budget = FUZZ_SHRINK_RUNS;
+
+	// Steps, last first, as later ones are more often beside the point
+	for (int s = fc->n_steps - 1; s >= 0 && fc->n_steps > 1; s--)
+	{
+		*trial = *fc;
+		memmove(&trial->steps[s], &trial->steps[s + 1], (trial->n_steps - s - 1) * sizeof(sim_fuzz_step));
+		trial->n_steps--;
+
+		if (still_fails(trial, result, &budget))
+			*fc = *trial;
+	}
+
+	for (int s = 0; s < fc->n_steps; s++)
+	{
+		if (fc->steps[s].type != FUZZ_STEP_PROGRAM)
+			continue;
+
+		// Blocks, in chunks of half the program, then a quarter, and so on
+		for (int chunk = fc->steps[s].image.n_blocks / 2; chunk >= 1; chunk /= 2)
+		{
+			int first = 0;
+
+			while (first + chunk <= fc->steps[s].image.n_blocks)
+			{
+				*trial = *fc;
+				remove_blocks(&trial->steps[s].image, first, chunk);
+
+				if (still_fails(trial, result, &budget))
+					*fc = *trial;
+				else
+					first += chunk;
+			}
+		}
+
+		// Buffers nothing reads or writes any more, from the top, so the
+		// rest keep their handles
+		for (int h = PATCH_MAX_DELAYS - 1; h >= 0; h--)
+		{
+			sim_program_image *image = &fc->steps[s].image;
+
+			if (!image->delay_valid[h])
+				continue;
+
+			if (uses_delay(image, h))
+				break;
+
+			*trial = *fc;
+			trial->steps[s].image.delay_valid[h] = 0;
+
+			if (still_fails(trial, result, &budget))
+				*fc = *trial;
+			else
+				break;
+		}
+
+		// Registers to zero, and the saturate and shift disables off
+		for (int i = 0; i < fc->steps[s].image.n_blocks; i++)
+		{
+			for (int r = 0; r < 2; r++)
+			{
+				if (!fc->steps[s].image.regs[i][r])
+					continue;
+
+				*trial = *fc;
+				trial->steps[s].image.regs[i][r] = 0;
+
+				if (still_fails(trial, result, &budget))
+					*fc = *trial;
+			}
+
+			uint32_t word = fc->steps[s].image.instrs[i];
+
+			if (!(word & (1 << 5)) && (word & (3u << 30)))
+			{
+				*trial = *fc;
+				trial->steps[s].image.instrs[i] &= ~(3u << 30);
+
+				if (still_fails(trial, result, &budget))
+					*fc = *trial;
+			}
+		}
+	}
+
+	delete trial;
+}
+
+/**********/
+/* Output */
+/**********/
+
+static const char *op_names[] = {
+	"nop", "madd", "arsh", "lsh", "rsh", "abs", "min", "max", "clamp",
+	"mov_acc", "mov_lacc", "mov_uacc", "macz", "umacz", "mac", "umac",
+	"lut_read", "delay_read", "delay_write", "mem_read", "mem_write"
+};
+
+static void print_arg(FILE *file, int src, int src_reg)
+{
+	if (src_reg)
+		fprintf(file, " r%d", src);
+	else
+		fprintf(file, " c%d", src);
+}
+
+static void print_program(FILE *file, const sim_program_image *image)
+{
+	for (int h = 0; h < PATCH_MAX_DELAYS; h++)
+	{
+		if (!image->delay_valid[h])
+			continue;
+
+		const uint8_t *alloc = image->delays[h];
+
+		fprintf(file, "\tdelay %d: size %d, delay %d/256\n", h,
+			(alloc[0] << 16) | (alloc[1] << 8) | alloc[2], (alloc[3] << 16) | (alloc[4] << 8) | alloc[5]);
+	}
+
+	for (int i = 0; i < image->n_blocks; i++)
+	{
+		uint32_t word = image->instrs[i];
+		sim_decoded_instr instr;
+
+		sim_decode_instr(word, &instr);
+
+		fprintf(file, "\t%3d  %08x  %-11s c%d <-", i, word,
+			(instr.operation <= HW_INSTR_MEM_WRITE) ? op_names[instr.operation] : "?", instr.dest);
+
+		for (int a = 0; a < 3; a++)
+			print_arg(file, instr.src[a], instr.src_reg[a]);
+
+		if ((word >> 5) & 1)
+			fprintf(file, "  [%d]", instr.res_addr);
+		else
+			fprintf(file, "  shift %d%s%s", (word >> 25) & 31, ((word >> 30) & 1) ? " nosat" : "", ((word >> 31) & 1) ? " noshift" : "");
+
+		fprintf(file, "  r0=%04x r1=%04x\n", image->regs[i][0], image->regs[i][1]);
+	}
+}
+
+int sim_fuzz_write_case(const char *path, const sim_fuzz_case *fc, const sim_fuzz_result *result)
+{
+	FILE *file = fopen(path, "w");
+
+	if (!file)
+	{
+		fprintf(stderr, "Fuzz: can't write %s\n", path);
+		return 1;
+	}
+
+	fprintf(file, "# seed %llu\n", (unsigned long long)fc->seed);
+
+	if (result->hung)
+		fprintf(file, "# the controller never came back after step %d\n", result->step);
+	else
+		fprintf(file, "# step %d, pipeline %c, frame %ld: %d in, expected %d, got %d\n", result->step,
+			'a' + result->core, result->frame, result->input, result->expected, result->got);
+
+	for (int s = 0; s < fc->n_steps; s++)
+	{
+		const sim_fuzz_step *step = &fc->steps[s];
+		m_fpga_transfer_batch batch;
+
+		step_batch(step, &batch);
+
+		if (step->type == FUZZ_STEP_PROGRAM)
+			fprintf(file, "\n# step %d: program, %d blocks\n", s, step->image.n_blocks);
+		else
+			fprintf(file, "\n# step %d: %s gain %04x\n", s, (step->type == FUZZ_STEP_INPUT_GAIN) ? "input" : "output", step->gain);
+
+		for (int i = 0; i < batch.len; i++)
+			fprintf(file, "%02x%c", batch.buf[i], (i % 16 == 15 || i == batch.len - 1) ? '\n' : ' ');
+
+		if (step->type == FUZZ_STEP_PROGRAM)
+			print_program(file, &step->image);
+
+		free(batch.buf);
+	}
+
+	fclose(file);
+
+	return 0;
+}
+
+/************/
+/* Directed */
+/************/
+
+static uint32_t instr_a(int op, int a, int a_reg, int b, int b_reg, int c, int c_reg, int dest, int shift, uint32_t flags)
+{
+	return op | (a << 6) | (a_reg << 10) | (b << 11) | (b_reg << 15)
+		| (c << 16) | (c_reg << 20) | (dest << 21) | (shift << 25) | flags;
+}
+
+static uint32_t instr_b(int op, int a, int a_reg, int b, int b_reg, int dest, int res_addr)
+{
+	return op | (1 << 5) | (a << 6) | (a_reg << 10) | (b << 11) | (b_reg << 15)
+		| (dest << 16) | ((uint32_t)res_addr << 20);
+}
+
+// Register 2 reads as zero, for arguments that aren't used
+#define R_ZERO 2
+
+// sequential_interp never raised out_valid, so a LUT read never came back
+static void directed_lut_read(sim_program_image *image)
+{
+	image->n_blocks  = 1;
+	image->instrs[0] = instr_b(HW_INSTR_LUT_READ, 0, 0, R_ZERO, 1, 0, MODEL_LUT_SIN);
+}
+
+// Stage 2 of the misc branch applied the fine shifts to the argument
+// rather than to what stage 1 had already shifted
+static void directed_misc_shifts(sim_program_image *image)
+{
+	image->n_blocks  = 2;
+	image->instrs[0] = instr_a(HW_INSTR_LSH, 0, 0, R_ZERO, 1, R_ZERO, 1, 1, 5, 0);
+	image->instrs[1] = instr_a(HW_INSTR_RSH, 1, 0, R_ZERO, 1, R_ZERO, 1, 0, 6, 0);
+}
+
+// Stage 2 of the misc branch took the saturate disable of whatever was
+// entering stage 1, not of the operation it was passing on. A MOV_ACC
+// without saturation followed by one with gets it wrong
+static void directed_misc_saturate(sim_program_image *image)
+{
+	image->n_blocks  = 3;
+	image->instrs[0] = instr_a(HW_INSTR_MACZ, 0, 1, 1, 1, R_ZERO, 1, 0, 4, 0);
+	image->instrs[1] = instr_a(HW_INSTR_MOV_ACC, R_ZERO, 1, R_ZERO, 1, R_ZERO, 1, 0, 0, 1u << 30);
+	image->instrs[2] = instr_a(HW_INSTR_MOV_ACC, R_ZERO, 1, R_ZERO, 1, R_ZERO, 1, 1, 0, 0);
+
+	image->regs[0][0] = 0x7FFF;
+	image->regs[0][1] = 0x7FFF;
+}
+
+// delay_master clamped a write's increment against the delay and size
+// of the buffer written before it. Here that's one already at its
+// longest delay, which holds the other's delay where it starts
+static void directed_delay_clamp(sim_program_image *image)
+{
+	set_delay(image, 0, 2,  2 << 8);
+	set_delay(image, 1, 16, 8 << 8);
+
+	image->n_blocks  = 3;
+	image->instrs[0] = instr_b(HW_INSTR_DELAY_WRITE, 0, 0, 0, 1, 0, 0);
+	image->instrs[1] = instr_b(HW_INSTR_DELAY_WRITE, 0, 0, 0, 1, 0, 1);
+	image->instrs[2] = instr_b(HW_INSTR_DELAY_READ, R_ZERO, 1, R_ZERO, 1, 0, 1);
+
+	image->regs[1][0] = 600;
+}
+
+typedef struct {
+	const char *name;
+	void (*build)(sim_program_image *image);
+} fuzz_directed;
+
+static const fuzz_directed directed[] = {
+	{"LUT read", directed_lut_read},
+	{"misc shifts", directed_misc_shifts},
+	{"misc saturate disable", directed_misc_saturate},
+	{"delay increment clamp", directed_delay_clamp},
+};
+
+#define N_DIRECTED (int)(sizeof(directed) / sizeof(directed[0]))
+
+int sim_fuzz_run_directed()
+{
+	sim_fuzz_case *fc = new sim_fuzz_case;
+	sim_fuzz_result result;
+	int failed = 0;
+
+	for (int i = 0; i < N_DIRECTED; i++)
+	{
+		memset(fc, 0, sizeof(sim_fuzz_case));
+
+		fc->seed 	= i;
+		fc->n_steps = 1;
+		fc->steps[0].type = FUZZ_STEP_PROGRAM;
+
+		directed[i].build(&fc->steps[0].image);
+
+		if (!sim_fuzz_run_case(fc, &result))
+			continue;
+
+		failed++;
+
+		if (result.hung)
+			printf("Directed case \"%s\": the controller never came back\n", directed[i].name);
+		else
+			printf("Directed case \"%s\": pipeline %c, frame %ld: %d in, expected %d, got %d\n", directed[i].name,
+				'a' + result.core, result.frame, result.input, result.expected, result.got);
+	}
+
+	printf("%d of %d directed cases pass\n", N_DIRECTED - failed, N_DIRECTED);
+
+	delete fc;
+
+	return failed;
+}
+
+/**********/
+/* Driver */
+/**********/
+
+int sim_fuzz_run()
+{
+	if (sim_model_load_luts())
+		return 1;
+
+	if (sim_fuzz_run_directed())
+		return 1;
+
+	#ifdef SIM_FUZZ_THREADS
+	int n_threads = SIM_FUZZ_THREADS;
+	#else
+	int n_threads = std::thread::hardware_concurrency();
+	#endif
+
+	if (n_threads < 1)
+		n_threads = 1;
+
+	std::atomic<long> next_case(0);
+	std::atomic<long> cases_run(0);
+	std::atomic<long> frames_run(0);
+	std::atomic<int> found(0);
+
+	sim_fuzz_case *failing = new sim_fuzz_case;
+	sim_fuzz_result failure;
+
+	printf("Fuzzing: %d cases from seed %d on %d threads\n", SIM_FUZZ_CASES, SIM_FUZZ_SEED, n_threads);
+
+	auto start = std::chrono::steady_clock::now();
+
+	auto worker = [&]() {
+		sim_fuzz_case *fc = new sim_fuzz_case;
+		sim_fuzz_result result;
+		long c;
+
+		while (!found && (c = next_case++) < SIM_FUZZ_CASES)
+		{
+			sim_fuzz_generate(fc, SIM_FUZZ_SEED + c);
+			sim_fuzz_run_case(fc, &result);
+
+			frames_run += result.frames;
+			long n = ++cases_run;
+
+			if (result.failed)
+			{
+				if (!found.exchange(1))
+				{
+					*failing = *fc;
+					failure  = result;
+				}
+
+				break;
+			}
+
+			if (n % 16 == 0)
+			{
+				std::lock_guard<std::mutex> guard(fuzz_lock);
+				printf("\r%ld/%d cases  ", n, SIM_FUZZ_CASES);
+				fflush(stdout);
+			}
+		}
+
+		delete fc;
+	};
+
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < n_threads; i++)
+		threads.emplace_back(worker);
+
+	for (auto &thread : threads)
+		thread.join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("\r%ld cases, %ld frames in %.1fs: %.1f cases/s, %.0f frames/s\n", cases_run.load(), frames_run.load(),
+		seconds, cases_run / seconds, frames_run / seconds);
+
+	if (!found)
+	{
+		printf("No mismatches\n");
+		delete failing;
+		return 0;
+	}
+
+	int blocks = 0;
+
+	for (int s = 0; s < failing->n_steps; s++)
+		blocks += (failing->steps[s].type == FUZZ_STEP_PROGRAM) ? failing->steps[s].image.n_blocks : 0;
+
+	printf("Mismatch in case %llu (%d steps, %d blocks); shrinking...\n", (unsigned long long)failing->seed, failing->n_steps, blocks);
+
+	sim_fuzz_shrink(failing, &failure);
+
+	blocks = 0;
+
+	for (int s = 0; s < failing->n_steps; s++)
+		blocks += (failing->steps[s].type == FUZZ_STEP_PROGRAM) ? failing->steps[s].image.n_blocks : 0;
+
+	if (failure.hung)
+		printf("Shrunk to %d steps, %d blocks: the controller never came back after step %d\n",
+			failing->n_steps, blocks, failure.step);
+	else
+		printf("Shrunk to %d steps, %d blocks: step %d, pipeline %c, frame %ld: %d in, expected %d, got %d\n",
+			failing->n_steps, blocks, failure.step, 'a' + failure.core, failure.frame,
+			failure.input, failure.expected, failure.got);
+
+	if (sim_fuzz_write_case(SIM_FUZZ_PATH, failing, &failure) == 0)
+		printf("Written to %s\n", SIM_FUZZ_PATH);
+
+	delete failing;
+
+	return 1;
+}
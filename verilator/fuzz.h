@@ -0,0 +1,75 @@
+#ifndef DSP_SIM_FUZZ_H_
+#define DSP_SIM_FUZZ_H_
+
+#define FUZZ_MAX_STEPS 		6
+#define FUZZ_MAX_BLOCKS 	48
+#define FUZZ_MAX_DELAYS 	4
+
+// Frames to keep checking once the last step is in and the controller
+// has settled, and how long a step may take to get there at most
+#define FUZZ_CHECK_FRAMES 	64
+#define FUZZ_STEP_FRAMES 	1024
+
+// Runs of the RTL a mismatch's shrinking may take
+#define FUZZ_SHRINK_RUNS 	200
+
+#define FUZZ_STEP_PROGRAM 		0
+#define FUZZ_STEP_INPUT_GAIN 	1
+#define FUZZ_STEP_OUTPUT_GAIN 	2
+
+typedef struct {
+	int type;
+
+	sim_program_image image;
+	uint16_t gain;
+} sim_fuzz_step;
+
+// What goes over SPI, a step at a time. Each step waits for the
+// controller to be idle; programs swap in, or are turned down by the
+// health monitor, and either way are checked while they run
+typedef struct {
+	uint64_t seed;
+
+	sim_fuzz_step steps[FUZZ_MAX_STEPS];
+	int n_steps;
+} sim_fuzz_case;
+
+typedef struct {
+	int failed;
+
+	// The controller never came back, so nothing was compared after
+	int hung;
+
+	// The first sample out of line: which step's program, on which core,
+	// how many frames into the case, and what went in and came out
+	int step;
+	int core;
+	long frame;
+
+	int16_t input;
+	int16_t expected;
+	int16_t got;
+
+	long frames;
+} sim_fuzz_result;
+
+void sim_fuzz_generate(sim_fuzz_case *fc, uint64_t seed);
+
+// Run a case through a Vtop of its own, on the calling thread
+int sim_fuzz_run_case(const sim_fuzz_case *fc, sim_fuzz_result *result);
+
+// Cut a failing case down to what still fails, within FUZZ_SHRINK_RUNS
+void sim_fuzz_shrink(sim_fuzz_case *fc, sim_fuzz_result *result);
+
+int sim_fuzz_write_case(const char *path, const sim_fuzz_case *fc, const sim_fuzz_result *result);
+
+// Run each directed case, a program written to show a bug the fuzzer
+// once found, and report those that fail. Nonzero if any did
+int sim_fuzz_run_directed();
+
+// Run the directed cases, then SIM_FUZZ_CASES cases across every
+// thread; stop at the first mismatch, and shrink and write it out.
+// Nonzero if one was found
+int sim_fuzz_run();
+
+#endif
@@ -0,0 +1,173 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "latency.h"
+#include "Vtop___024root.h"
+
+/*
+ * Round trip latency, framed and low-latency.
+ *
+ * Each mode gets an engine of its own, through the session API, with the
+ * same program in it. Impulses go in one at a time on silence, and the
+ * frame the largest sample comes out on is taken to be the latency,
+ * counted as measure.cpp counts it, from the frame a sample is put in to
+ * the frame its response is read out. That takes in both trips through
+ * the I2S shift registers as well as the engine, so the difference
+ * between the two modes is what's interesting: a frame, when every
+ * low-latency frame makes its deadline.
+ *
+ * The engine's count of frames it dropped is read as it runs, so a
+ * program too long to be done in time shows up as misses, and a latency
+ * that comes and goes.
+ */
+
+static const char *mode_names[2] = {"Framed", "Low-latency"};
+
+static int misses(const sim_session *session)
+{
+	return session->top->rootp->top__DOT__engine__DOT__direct_misses;
+}
+
+static int settle(sim_session *session)
+{
+	int16_t zero = 0;
+
+	for (int i = 0; i < SESSION_LOAD_FRAMES; i++)
+	{
+		sim_session_process(session, &zero, NULL, 1);
+
+		if (sim_session_idle(session))
+			return 0;
+	}
+
+	return 1;
+}
+
+int sim_latency_measure(int mode, const char *effect, sim_latency_result *result)
+{
+	static int16_t in[LATENCY_SPACING];
+	static int16_t out[LATENCY_SPACING];
+
+	uint8_t command[2] = {COMMAND_SET_DIRECT, (uint8_t)(mode == LATENCY_DIRECT)};
+	sim_session *session = sim_session_new(1);
+
+	memset(result, 0, sizeof(sim_latency_result));
+	result->mode = mode;
+	result->min_latency = -1;
+	result->max_latency = -1;
+
+	if (!session)
+		return 1;
+
+	if (effect)
+	{
+		m_fpga_transfer_batch batch;
+
+		if (sim_session_effect_batch(effect, &batch))
+		{
+			fprintf(stderr, "Latency: can't read %s\n", effect);
+			sim_session_free(session);
+			return 1;
+		}
+
+		int outcome = sim_session_load_program(session, batch);
+		free(batch.buf);
+
+		if (outcome != SESSION_LOAD_SWAPPED)
+		{
+			fprintf(stderr, "Latency: %s wasn't swapped in\n", effect);
+			sim_session_free(session);
+			return 1;
+		}
+	}
+
+	sim_session_send_command(session, command, 2);
+
+	if (settle(session))
+	{
+		sim_session_free(session);
+		return 1;
+	}
+
+	memset(in, 0, sizeof(in));
+
+	// Let the swap's crossfade and anything left in the pipelines out
+	for (int i = 0; i < 4; i++)
+		sim_session_process(session, in, NULL, LATENCY_SPACING);
+
+	int misses_before = misses(session);
+
+	in[0] = 16383;
+
+	for (int n = 0; n < LATENCY_IMPULSES; n++)
+	{
+		sim_session_process(session, in, out, LATENCY_SPACING);
+
+		int peak = 0;
+		int latency = -1;
+
+		for (int i = 0; i < LATENCY_SPACING; i++)
+		{
+			if (abs(out[i]) > peak)
+			{
+				peak = abs(out[i]);
+				latency = i;
+			}
+		}
+
+		if (latency < 0)
+		{
+			result->min_latency = -1;
+			result->max_latency = -1;
+			break;
+		}
+
+		if (result->min_latency < 0 || latency < result->min_latency)
+			result->min_latency = latency;
+
+		if (latency > result->max_latency)
+			result->max_latency = latency;
+	}
+
+	result->misses = misses(session) - misses_before;
+
+	sim_session_free(session);
+
+	return 0;
+}
+
+int sim_latency_bench()
+{
+	sim_latency_result results[2];
+	const char *effect = SIM_LATENCY_EFFECT;
+
+	for (int mode = LATENCY_FRAMED; mode <= LATENCY_DIRECT; mode++)
+	{
+		if (sim_latency_measure(mode, effect, &results[mode]))
+		{
+			fprintf(stderr, "Latency: %s run didn't start\n", mode_names[mode]);
+			return 1;
+		}
+
+		if (results[mode].min_latency < 0)
+		{
+			printf("%s: no response within %d frames\n", mode_names[mode], LATENCY_SPACING);
+			continue;
+		}
+
+		if (results[mode].min_latency == results[mode].max_latency)
+			printf("%s: %d samples round trip", mode_names[mode], results[mode].min_latency);
+		else
+			printf("%s: %d to %d samples round trip", mode_names[mode], results[mode].min_latency, results[mode].max_latency);
+
+		printf(", %d deadline misses over %d impulses\n", results[mode].misses, LATENCY_IMPULSES);
+	}
+
+	if (results[LATENCY_FRAMED].max_latency >= 0 && results[LATENCY_DIRECT].max_latency >= 0)
+		printf("Low-latency mode saves %d samples\n", results[LATENCY_FRAMED].max_latency - results[LATENCY_DIRECT].max_latency);
+
+	return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef DSP_SIM_LATENCY_H_
+#define DSP_SIM_LATENCY_H_
+
+#define LATENCY_FRAMED 	0
+#define LATENCY_DIRECT 	1
+
+// Impulses per mode, each given this many frames to come out in
+#define LATENCY_IMPULSES 	16
+#define LATENCY_SPACING 	256
+
+typedef struct {
+	int mode;
+
+	// Frames from an impulse going in to its peak coming out, across the
+	// impulses; -1 if one never came out
+	int min_latency;
+	int max_latency;
+
+	// Low-latency frames the engine dropped over the run
+	int misses;
+} sim_latency_result;
+
+// Load `effect', or nothing if it's NULL, into an engine of its own in
+// `mode' and time impulses through it
+int sim_latency_measure(int mode, const char *effect, sim_latency_result *result);
+
+// Both modes, one after the other, and how far apart they are
+int sim_latency_bench();
+
+#endif
@@ -0,0 +1,617 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "link.h"
+
+/*
+ * Chain linking: channel allocation across effects.
+ *
+ * Every effect is written as if it had the channels to itself, and keeps
+ * anything it needs from one sample to the next in memory, reading it
+ * back at the top of the pass and writing it out again further down. In
+ * a chain, that is a round trip through the memory branch per word per
+ * sample, for state that could just as well have stayed in a channel.
+ *
+ * The linker renames every value the chain computes, treating a memory
+ * word that is both read and written as a value carried round from the
+ * end of one pass to the start of the next, like channel 0 is. Values
+ * are then given channels by interval colouring, with each carried
+ * value held in the one channel from its last write to its first read.
+ * Where a carried value can't stay put -- it is the sample going out on
+ * channel 0, say, or is overwritten while its old self is still being
+ * read -- a shift by nothing copies it to a channel of its own. If the
+ * channels run out, words are given back to memory until they fit.
+ *
+ * The result is checked over several passes by value numbering against
+ * the chain as it was: same samples out, same state carried over.
+ */
+
+#define LINK_N_CHANNELS 	16
+#define LINK_N_MEM 			256
+#define LINK_CHECK_PASSES 	3
+
+typedef struct {
+	int block;
+	uint32_t word;
+	uint16_t regs[2];
+
+	// Values read by each operand and written by the block, or -1
+	int src[3];
+	int dest;
+} link_op;
+
+typedef struct {
+	int def;
+	int last_use;
+	int carried;
+	int group;
+	int channel;
+} link_value;
+
+// A value carried over the end of the pass, into what the next pass
+// starts with: the same channel at both ends
+typedef struct {
+	int start;
+	int end;
+	int cell;
+	int channel;
+	int live;
+} link_pair;
+
+typedef struct {
+	std::vector<link_op> ops;
+	std::vector<link_value> values;
+	std::vector<link_pair> pairs;
+} link_state;
+
+static int new_value(link_state *ls, int def)
+{
+	link_value v;
+
+	v.def = def;
+	v.last_use = -2;
+	v.carried = 0;
+	v.group = -1;
+	v.channel = -1;
+
+	ls->values.push_back(v);
+
+	return ls->values.size() - 1;
+}
+
+static int promotable(const sim_program_image *in, int *promote)
+{
+	int read[LINK_N_MEM];
+	int written[LINK_N_MEM];
+	int n = 0;
+
+	memset(read, 0, sizeof(read));
+	memset(written, 0, sizeof(written));
+
+	for (int i = 0; i < in->n_blocks; i++)
+	{
+		sim_decoded_instr instr;
+		sim_decode_instr(in->instrs[i], &instr);
+
+		if (instr.operation == HW_INSTR_MEM_READ)
+			read[instr.res_addr] = 1;
+
+		// A word written from a block register has no channel to live in
+		if (instr.operation == HW_INSTR_MEM_WRITE && written[instr.res_addr] >= 0)
+			written[instr.res_addr] = instr.src_reg[0] ? -1 : 1;
+	}
+
+	for (int m = 0; m < LINK_N_MEM; m++)
+	{
+		promote[m] = (read[m] && written[m] > 0);
+		n += promote[m];
+	}
+
+	return n;
+}
+
+// Rename every value the chain computes, with promoted words read and
+// written in place rather than through memory
+static void build(link_state *ls, const sim_program_image *in, const int *promote)
+{
+	int channel_in[LINK_N_CHANNELS];
+	int cell_in[LINK_N_MEM];
+	int channel[LINK_N_CHANNELS];
+	int cell[LINK_N_MEM];
+
+	ls->ops.clear();
+	ls->values.clear();
+	ls->pairs.clear();
+
+	for (int k = 0; k < LINK_N_CHANNELS; k++)
+		channel[k] = channel_in[k] = new_value(ls, -1);
+
+	for (int m = 0; m < LINK_N_MEM; m++)
+		cell[m] = cell_in[m] = promote[m] ? new_value(ls, -1) : -1;
+
+	for (int i = 0; i < in->n_blocks; i++)
+	{
+		sim_decoded_instr instr;
+		sim_decode_instr(in->instrs[i], &instr);
+
+		if (instr.operation == HW_INSTR_MEM_READ && promote[instr.res_addr])
+		{
+			channel[instr.dest] = cell[instr.res_addr];
+			continue;
+		}
+
+		if (instr.operation == HW_INSTR_MEM_WRITE && promote[instr.res_addr])
+		{
+			cell[instr.res_addr] = channel[instr.src[0]];
+			continue;
+		}
+
+		link_op op;
+
+		op.block = i;
+		op.word = in->instrs[i];
+		op.regs[0] = in->regs[i][0];
+		op.regs[1] = in->regs[i][1];
+
+		for (int k = 0; k < 3; k++)
+			op.src[k] = (instr.arg_needed[k] && !instr.src_reg[k]) ? channel[instr.src[k]] : -1;
+
+		op.dest = -1;
+
+		if (instr.writes_channel)
+			op.dest = channel[instr.dest] = new_value(ls, ls->ops.size());
+
+		ls->ops.push_back(op);
+	}
+
+	// Channel 0 goes out and comes back in as the next sample; the other
+	// channels are only carried over if the chain reads them before it
+	// writes them. Promoted words likewise
+	for (int k = 0; k < LINK_N_CHANNELS; k++)
+	{
+		link_pair pair = {channel_in[k], channel[k], SIM_CELL_CHANNEL(k), (k == 0) ? 0 : -1, 0};
+		ls->pairs.push_back(pair);
+	}
+
+	for (int m = 0; m < LINK_N_MEM; m++)
+	{
+		if (promote[m])
+		{
+			link_pair pair = {cell_in[m], cell[m], SIM_CELL_MEM(m), -1, 0};
+			ls->pairs.push_back(pair);
+		}
+	}
+}
+
+static void liveness(link_state *ls)
+{
+	for (size_t v = 0; v < ls->values.size(); v++)
+	{
+		ls->values[v].last_use = -2;
+		ls->values[v].carried = 0;
+	}
+
+	for (size_t i = 0; i < ls->ops.size(); i++)
+	{
+		if (ls->ops[i].dest >= 0)
+			ls->values[ls->ops[i].dest].def = i;
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (ls->ops[i].src[k] >= 0)
+				ls->values[ls->ops[i].src[k]].last_use = i;
+		}
+	}
+
+	// A carried value is needed if the pass reads it, or carries it on
+	// into something that is needed
+	for (auto &pair : ls->pairs)
+		pair.live = (pair.channel == 0 || ls->values[pair.start].last_use >= 0);
+
+	for (int changed = 1; changed; )
+	{
+		changed = 0;
+
+		for (auto &carrier : ls->pairs)
+		{
+			if (!carrier.live)
+				continue;
+
+			for (auto &pair : ls->pairs)
+			{
+				if (!pair.live && pair.start == carrier.end)
+				{
+					pair.live = 1;
+					changed = 1;
+				}
+			}
+		}
+	}
+}
+
+static int pair_live(const link_state *ls, const link_pair *pair)
+{
+	return pair->live;
+}
+
+// Make sure each carried value can sit in one channel from its last
+// write round to its last read, copying it where it can't. A copy can
+// keep another carried value alive for longer, so go round until none
+// is needed, or give up
+static int place_copies(link_state *ls)
+{
+	int n_copies = 0;
+
+	for (int round = 0; round < 4 * LINK_N_CHANNELS; round++)
+	{
+		std::vector<int> claimed(ls->values.size(), 0);
+		link_pair *clash = NULL;
+
+		liveness(ls);
+
+		for (auto &pair : ls->pairs)
+		{
+			if (pair_live(ls, &pair))
+				claimed[pair.start]++;
+		}
+
+		for (auto &pair : ls->pairs)
+		{
+			if (!pair_live(ls, &pair) || pair.end == pair.start)
+				continue;
+
+			const link_value *start = &ls->values[pair.start];
+			const link_value *end = &ls->values[pair.end];
+
+			if (claimed[pair.end] || end->def < start->last_use)
+			{
+				clash = &pair;
+				break;
+			}
+
+			claimed[pair.end]++;
+		}
+
+		if (!clash)
+			return n_copies;
+
+		const link_value *start = &ls->values[clash->start];
+		const link_value *end = &ls->values[clash->end];
+
+		int at = (end->def > start->last_use) ? end->def : start->last_use;
+
+		link_op copy;
+
+		copy.block = -1;
+		copy.word = HW_INSTR_LSH;
+		copy.regs[0] = 0;
+		copy.regs[1] = 0;
+		copy.src[0] = clash->end;
+		copy.src[1] = -1;
+		copy.src[2] = -1;
+		copy.dest = new_value(ls, -1);
+
+		clash->end = copy.dest;
+
+		ls->ops.insert(ls->ops.begin() + at + 1, copy);
+		n_copies++;
+	}
+
+	return -1;
+}
+
+// Interval colouring, in gaps between blocks: gap g is just after block
+// g, and gap -1 is the start of the pass
+static int colour(link_state *ls)
+{
+	int n_ops = ls->ops.size();
+	int n_gaps = n_ops + 1;
+
+	std::vector<std::vector<char>> busy(LINK_N_CHANNELS, std::vector<char>(n_gaps, 0));
+	std::vector<std::vector<int>> groups;
+	std::vector<int> fixed;
+
+	liveness(ls);
+
+	for (auto &pair : ls->pairs)
+	{
+		if (!pair_live(ls, &pair))
+			continue;
+
+		ls->values[pair.end].carried = 1;
+		ls->values[pair.start].group = ls->values[pair.end].group = groups.size();
+
+		if (pair.start == pair.end)
+		{
+			groups.push_back({pair.start});
+		}
+		else
+		{
+			// The two halves of a pair share a channel, so mustn't overlap
+			if (ls->values[pair.end].def < ls->values[pair.start].last_use)
+				return 1;
+
+			groups.push_back({pair.start, pair.end});
+		}
+
+		fixed.push_back(pair.channel);
+	}
+
+	for (size_t v = 0; v < ls->values.size(); v++)
+	{
+		if (ls->values[v].group < 0 && (ls->values[v].def >= 0))
+		{
+			ls->values[v].group = groups.size();
+			groups.push_back({(int)v});
+			fixed.push_back(-1);
+		}
+	}
+
+	for (size_t g = 0; g < groups.size(); g++)
+	{
+		int choice = -1;
+
+		for (int c = 0; c < LINK_N_CHANNELS && choice < 0; c++)
+		{
+			if (fixed[g] >= 0 && c != fixed[g])
+				continue;
+
+			int free = 1;
+
+			for (int v : groups[g])
+			{
+				const link_value *value = &ls->values[v];
+				int first = value->def;
+				int last  = value->carried ? n_ops - 1 : (value->last_use >= 0 ? value->last_use - 1 : value->def);
+
+				for (int gap = first; gap <= last && free; gap++)
+					free = !busy[c][gap + 1];
+			}
+
+			if (free)
+				choice = c;
+		}
+
+		if (choice < 0)
+			return 1;
+
+		for (int v : groups[g])
+		{
+			link_value *value = &ls->values[v];
+			int first = value->def;
+			int last  = value->carried ? n_ops - 1 : (value->last_use >= 0 ? value->last_use - 1 : value->def);
+
+			for (int gap = first; gap <= last; gap++)
+				busy[choice][gap + 1] = 1;
+
+			value->channel = choice;
+		}
+	}
+
+	for (auto &pair : ls->pairs)
+	{
+		if (pair_live(ls, &pair))
+			pair.channel = ls->values[pair.start].channel;
+	}
+
+	return 0;
+}
+
+static void emit(sim_program_image *out, int *block_map, const link_state *ls, const sim_program_image *in)
+{
+	static const int src_shift[3] = {6, 11, 16};
+
+	*out = *in;
+	out->n_blocks = ls->ops.size();
+
+	for (int i = 0; i < in->n_blocks; i++)
+		block_map[i] = -1;
+
+	for (size_t i = 0; i < ls->ops.size(); i++)
+	{
+		const link_op *op = &ls->ops[i];
+		uint32_t word = op->word;
+		int format = (word >> 5) & 1;
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (op->src[k] >= 0)
+				word = (word & ~(0xFu << src_shift[k])) | ((uint32_t)ls->values[op->src[k]].channel << src_shift[k]);
+		}
+
+		if (op->dest >= 0)
+		{
+			int shift = format ? 16 : 21;
+			word = (word & ~(0xFu << shift)) | ((uint32_t)ls->values[op->dest].channel << shift);
+		}
+
+		out->instrs[i] = word;
+		out->regs[i][0] = op->regs[0];
+		out->regs[i][1] = op->regs[1];
+
+		if (op->block >= 0)
+			block_map[op->block] = i;
+	}
+}
+
+// Run both a few passes from the same state, the carried values of the
+// linked chain starting where the original keeps them
+static int link_equivalent(const sim_program_image *in, const sim_program_image *out, const link_state *ls, const int *promote)
+{
+	sim_value_table table;
+	std::vector<uint32_t> a;
+	std::vector<uint32_t> b;
+
+	sim_number_init(&table, &a, 0);
+	sim_number_init(&table, &b, 1);
+
+	b[SIM_CELL_ACC] = a[SIM_CELL_ACC];
+
+	for (int h = 0; h < 256; h++)
+		b[SIM_CELL_DELAY(h)] = a[SIM_CELL_DELAY(h)];
+
+	for (int m = 0; m < LINK_N_MEM; m++)
+	{
+		if (!promote[m])
+			b[SIM_CELL_MEM(m)] = a[SIM_CELL_MEM(m)];
+	}
+
+	for (auto &pair : ls->pairs)
+	{
+		if (pair_live(ls, &pair))
+			b[SIM_CELL_CHANNEL(pair.channel)] = a[pair.cell];
+	}
+
+	for (int p = 0; p < LINK_CHECK_PASSES; p++)
+	{
+		a[SIM_CELL_CHANNEL(0)] = b[SIM_CELL_CHANNEL(0)] = sim_value_number(&table, {0xFFFFFFFE, (uint32_t)p});
+
+		sim_number_pass(&table, in, &a);
+		sim_number_pass(&table, out, &b);
+
+		if (a[SIM_CELL_CHANNEL(0)] != b[SIM_CELL_CHANNEL(0)])
+			return 0;
+	}
+
+	if (a[SIM_CELL_ACC] != b[SIM_CELL_ACC])
+		return 0;
+
+	for (int h = 0; h < 256; h++)
+	{
+		if (a[SIM_CELL_DELAY(h)] != b[SIM_CELL_DELAY(h)])
+			return 0;
+	}
+
+	for (int m = 0; m < LINK_N_MEM; m++)
+	{
+		if (!promote[m] && a[SIM_CELL_MEM(m)] != b[SIM_CELL_MEM(m)])
+			return 0;
+	}
+
+	for (auto &pair : ls->pairs)
+	{
+		if (pair_live(ls, &pair) && a[pair.cell] != b[SIM_CELL_CHANNEL(pair.channel)])
+			return 0;
+	}
+
+	return 1;
+}
+
+int sim_link_program(sim_program_image *out, int *block_map, const sim_program_image *in,
+	const sim_cycle_params *params, sim_link_report *report)
+{
+	sim_program_image linked;
+	sim_link_report local;
+	int promote[LINK_N_MEM];
+	link_state ls;
+
+	if (!out || !block_map || !in || !params)
+		return 1;
+
+	if (!report)
+		report = &local;
+
+	memset(report, 0, sizeof(sim_link_report));
+
+	int n_promoted = promotable(in, promote);
+	int copies = 0;
+	int linked_ok = 0;
+
+	// Give words back to memory, the last first, until the rest fit
+	while (n_promoted > 0)
+	{
+		build(&ls, in, promote);
+		liveness(&ls);
+		copies = place_copies(&ls);
+
+		// Copies can outnumber the memory blocks taken out, just
+		if (copies >= 0 && ls.ops.size() <= PATCH_MAX_BLOCKS && colour(&ls) == 0)
+		{
+			linked_ok = 1;
+			break;
+		}
+
+		for (int m = LINK_N_MEM - 1; m >= 0; m--)
+		{
+			if (promote[m])
+			{
+				promote[m] = 0;
+				n_promoted--;
+				break;
+			}
+		}
+	}
+
+	sim_cycle_estimate before;
+	sim_cycle_estimate after;
+
+	sim_estimate_cycles(in, params, &before);
+
+	report->cycles_before = report->cycles_after = before.pass_cycles;
+	report->equivalent = 1;
+
+	if (linked_ok)
+	{
+		emit(&linked, block_map, &ls, in);
+		sim_estimate_cycles(&linked, params, &after);
+
+		report->equivalent = link_equivalent(in, &linked, &ls, promote);
+
+		if (report->equivalent && after.pass_cycles <= before.pass_cycles)
+		{
+			*out = linked;
+
+			report->cells_promoted = n_promoted;
+			report->mem_removed = in->n_blocks - (linked.n_blocks - copies);
+			report->copies_added = copies;
+			report->cycles_after = after.pass_cycles;
+
+			return 0;
+		}
+	}
+
+	*out = *in;
+
+	for (int i = 0; i < in->n_blocks; i++)
+		block_map[i] = i;
+
+	return 0;
+}
+
+int sim_link_batch(m_fpga_transfer_batch *batch, const sim_cycle_params *params, sim_link_report *report)
+{
+	sim_program_image image;
+	sim_program_image linked;
+	int block_map[PATCH_MAX_BLOCKS];
+	sim_link_report local;
+
+	if (!batch || !params)
+		return 1;
+
+	if (!report)
+		report = &local;
+
+	memset(&image, 0, sizeof(image));
+
+	if (sim_program_image_from_batch(&image, *batch))
+		return 2;
+
+	sim_link_program(&linked, block_map, &image, params, report);
+
+	if (!report->equivalent)
+		return 3;
+
+	if (!report->mem_removed)
+		return 0;
+
+	m_fpga_transfer_batch linked_batch = m_new_fpga_transfer_batch();
+	sim_encode_program(&linked_batch, &linked);
+
+	free(batch->buf);
+	*batch = linked_batch;
+
+	return 0;
+}
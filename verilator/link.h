@@ -0,0 +1,27 @@
+#ifndef DSP_SIM_LINK_H_
+#define DSP_SIM_LINK_H_
+
+typedef struct {
+	int cells_promoted;
+	int mem_removed;
+	int copies_added;
+
+	int cycles_before;
+	int cycles_after;
+
+	int equivalent;
+} sim_link_report;
+
+// Allocate the channels of a whole chain at once, keeping memory words
+// that only carry state from one pass to the next in channels instead.
+// Block i of `in' becomes block block_map[i] of `out', or is gone if -1.
+// If nothing can be kept in a channel, or the result isn't faster,
+// `out' is `in' as it was
+int sim_link_program(sim_program_image *out, int *block_map, const sim_program_image *in,
+	const sim_cycle_params *params, sim_link_report *report);
+
+// Link the program a batch uploads, and swap the batch for an upload of
+// the linked one. Only for batches that do nothing but upload
+int sim_link_batch(m_fpga_transfer_batch *batch, const sim_cycle_params *params, sim_link_report *report);
+
+#endif
@@ -0,0 +1,348 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <complex>
+
+#include "sim_main.h"
+#include "measure.h"
+
+/*
+ * Frequency, phase and latency response in one run.
+ *
+ * Once the program is in, the input is an exponential sine sweep across
+ * the audio band, or a maximum length sequence, and then silence for the
+ * tail. Dividing the spectrum of what came out by the spectrum of what
+ * went in gives the impulse response, bar whatever the program did that
+ * wasn't linear, which the sweep pushes out ahead of the main response,
+ * to the end of the buffer, where it's left out. The division is
+ * regularised, so the bins the stimulus barely touched, below and above
+ * the band, come out near nothing rather than noise.
+ *
+ * The magnitude and phase are read off the first part of the impulse
+ * response, the phase with the latency taken out. Group delay is
+ * Re(FFT(n h[n]) / FFT(h[n])), which needs no unwrapping. Latency is
+ * where the impulse response peaks, counted from the frame a sample is
+ * put in to the frame its response is read out: for the engine that is
+ * the whole trip through I2S and both pipelines.
+ */
+
+typedef std::complex<double> cplx;
+
+typedef struct {
+	std::vector<double> ir;
+	int latency;
+
+	std::vector<cplx> spectrum;
+	std::vector<double> group_delay;
+} measure_response;
+
+static void fft(std::vector<cplx> &a, int inverse)
+{
+	int n = a.size();
+
+	for (int i = 1, j = 0; i < n; i++)
+	{
+		int bit = n >> 1;
+
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+
+		j ^= bit;
+
+		if (i < j)
+			std::swap(a[i], a[j]);
+	}
+
+	for (int len = 2; len <= n; len <<= 1)
+	{
+		double angle = 2 * M_PI / len * (inverse ? 1 : -1);
+
+		for (int k = 0; k < len / 2; k++)
+		{
+			cplx w(cos(angle * k), sin(angle * k));
+
+			for (int i = 0; i < n; i += len)
+			{
+				cplx u = a[i + k];
+				cplx v = a[i + k + len / 2] * w;
+
+				a[i + k] = u + v;
+				a[i + k + len / 2] = u - v;
+			}
+		}
+	}
+
+	if (inverse)
+	{
+		for (int i = 0; i < n; i++)
+			a[i] /= n;
+	}
+}
+
+static double quantise(double x)
+{
+	return round(x * 32767.0) / 32768.0;
+}
+
+int sim_measure_init(sim_measure *m, int kind, double sample_rate)
+{
+	if (!m || sample_rate <= 0)
+		return 1;
+
+	m->kind = kind;
+	m->sample_rate = sample_rate;
+	m->started_at = -1;
+	m->n_frames = MEASURE_STIMULUS_FRAMES + MEASURE_TAIL_FRAMES;
+	m->have_emulator = 0;
+
+	m->stimulus.assign(m->n_frames, 0.0);
+	m->dut.assign(m->n_frames, 0.0);
+	m->emulated.assign(m->n_frames, 0.0);
+
+	int n = MEASURE_STIMULUS_FRAMES;
+
+	if (kind == MEASURE_MLS)
+	{
+		uint32_t lfsr = 1;
+
+		for (int i = 0; i < n; i++)
+		{
+			m->stimulus[i] = quantise((lfsr & 1) ? MEASURE_LEVEL : -MEASURE_LEVEL);
+			lfsr = (lfsr >> 1) ^ ((lfsr & 1) ? 0xB400 : 0);
+		}
+
+		return 0;
+	}
+
+	// Farina's sweep, faded in and out so it doesn't click
+	double duration = n / sample_rate;
+	double rate = duration / log(MEASURE_SWEEP_TO / MEASURE_SWEEP_FROM);
+	int fade_in  = 1024;
+	int fade_out = 256;
+
+	for (int i = 0; i < n; i++)
+	{
+		double t = i / sample_rate;
+		double x = MEASURE_LEVEL * sin(2 * M_PI * MEASURE_SWEEP_FROM * rate * (exp(t / rate) - 1));
+
+		if (i < fade_in)
+			x *= 0.5 - 0.5 * cos(M_PI * i / fade_in);
+		else if (i >= n - fade_out)
+			x *= 0.5 - 0.5 * cos(M_PI * (n - 1 - i) / fade_out);
+
+		m->stimulus[i] = quantise(x);
+	}
+
+	return 0;
+}
+
+int16_t sim_measure_input(const sim_measure *m, int frame)
+{
+	if (frame < 0 || frame >= m->n_frames)
+		return 0;
+
+	return (int16_t)round(m->stimulus[frame] * 32768.0);
+}
+
+void sim_measure_output(sim_measure *m, int frame, int16_t dut, int16_t emulated, int have_emulator)
+{
+	if (frame < 0 || frame >= m->n_frames)
+		return;
+
+	m->dut[frame] 	   = dut / 32768.0;
+	m->emulated[frame] = emulated / 32768.0;
+	m->have_emulator   = have_emulator;
+}
+
+// Time of sample i of a measured impulse response
+static int ir_time(int i)
+{
+	return (i < MEASURE_IR_FRAMES - MEASURE_IR_LEAD) ? i : i - MEASURE_IR_FRAMES;
+}
+
+static void deconvolve(const sim_measure *m, const std::vector<double> &output, measure_response *r)
+{
+	int n = 1;
+
+	while (n < m->n_frames)
+		n <<= 1;
+
+	std::vector<cplx> x(n, 0.0);
+	std::vector<cplx> y(n, 0.0);
+
+	for (int i = 0; i < m->n_frames; i++)
+	{
+		x[i] = m->stimulus[i];
+		y[i] = output[i];
+	}
+
+	fft(x, 0);
+	fft(y, 0);
+
+	double peak = 0;
+
+	for (int k = 0; k < n; k++)
+		peak = std::max(peak, std::norm(x[k]));
+
+	for (int k = 0; k < n; k++)
+		y[k] = y[k] * std::conj(x[k]) / (std::norm(x[k]) + 1e-6 * peak);
+
+	fft(y, 1);
+
+	// Kept in the order the FFT wants it: the few samples before time 0
+	// the regularisation rings into go at the end
+	r->ir.resize(MEASURE_IR_FRAMES);
+	r->latency = 0;
+
+	for (int i = 0; i < MEASURE_IR_FRAMES; i++)
+	{
+		r->ir[i] = (i < MEASURE_IR_FRAMES - MEASURE_IR_LEAD) ? y[i].real() : y[n - MEASURE_IR_FRAMES + i].real();
+
+		if (i < MEASURE_IR_FRAMES - MEASURE_IR_LEAD && fabs(r->ir[i]) > fabs(r->ir[r->latency]))
+			r->latency = i;
+	}
+
+	std::vector<cplx> h(MEASURE_IR_FRAMES);
+	std::vector<cplx> nh(MEASURE_IR_FRAMES);
+
+	for (int i = 0; i < MEASURE_IR_FRAMES; i++)
+	{
+		h[i]  = r->ir[i];
+		nh[i] = (double)ir_time(i) * r->ir[i];
+	}
+
+	fft(h, 0);
+	fft(nh, 0);
+
+	int bins = MEASURE_IR_FRAMES / 2 + 1;
+
+	r->spectrum.resize(bins);
+	r->group_delay.resize(bins);
+
+	for (int k = 0; k < bins; k++)
+	{
+		r->spectrum[k] = h[k];
+		r->group_delay[k] = (std::abs(h[k]) > 1e-9) ? (nh[k] / h[k]).real() : 0.0;
+	}
+}
+
+static double magnitude_db(const measure_response *r, int k)
+{
+	return 20 * log10(std::abs(r->spectrum[k]) + 1e-12);
+}
+
+// Phase with the latency taken out, in degrees
+static double excess_phase(const measure_response *r, int k)
+{
+	double shift = 2 * M_PI * k * r->latency / MEASURE_IR_FRAMES;
+
+	return std::arg(r->spectrum[k] * cplx(cos(shift), sin(shift))) * 180 / M_PI;
+}
+
+int sim_measure_report(const sim_measure *m, const char *path)
+{
+	if (!m || m->started_at < 0)
+	{
+		printf("Measurement: never started\n");
+		return 1;
+	}
+
+	measure_response dut;
+	measure_response emulated;
+
+	deconvolve(m, m->dut, &dut);
+
+	if (m->have_emulator)
+		deconvolve(m, m->emulated, &emulated);
+
+	double rate = m->sample_rate;
+
+	printf("Measured by %s: latency %d samples (%.2f ms)", (m->kind == MEASURE_MLS) ? "MLS" : "sweep",
+		dut.latency, 1000.0 * dut.latency / rate);
+
+	if (m->have_emulator)
+		printf(", emulator %d samples", emulated.latency);
+
+	printf("\n");
+
+	printf("%8s %9s %9s %9s", "Hz", "dB", "phase", "delay");
+
+	if (m->have_emulator)
+		printf("   %9s %9s %9s", "em dB", "em phase", "em delay");
+
+	printf("\n");
+
+	static const double bands[] = {31.5, 63, 125, 250, 500, 1000, 2000, 4000, 8000, 16000};
+
+	for (size_t b = 0; b < sizeof(bands) / sizeof(bands[0]); b++)
+	{
+		int k = (int)round(bands[b] * MEASURE_IR_FRAMES / rate);
+
+		if (k > MEASURE_IR_FRAMES / 2)
+			break;
+
+		printf("%8.1f %9.2f %9.1f %9.2f", bands[b], magnitude_db(&dut, k), excess_phase(&dut, k), dut.group_delay[k]);
+
+		if (m->have_emulator)
+			printf("   %9.2f %9.1f %9.2f", magnitude_db(&emulated, k), excess_phase(&emulated, k), emulated.group_delay[k]);
+
+		printf("\n");
+	}
+
+	char name[256];
+
+	snprintf(name, sizeof(name), "%s.csv", path);
+	FILE *file = fopen(name, "w");
+
+	if (!file)
+	{
+		printf("Measurement: can't open %s\n", name);
+		return 2;
+	}
+
+	fprintf(file, "hz,db,phase,delay%s\n", m->have_emulator ? ",em_db,em_phase,em_delay" : "");
+
+	for (int k = 1; k <= MEASURE_IR_FRAMES / 2; k++)
+	{
+		fprintf(file, "%.2f,%.4f,%.3f,%.4f", k * rate / MEASURE_IR_FRAMES,
+			magnitude_db(&dut, k), excess_phase(&dut, k), dut.group_delay[k]);
+
+		if (m->have_emulator)
+			fprintf(file, ",%.4f,%.3f,%.4f", magnitude_db(&emulated, k), excess_phase(&emulated, k), emulated.group_delay[k]);
+
+		fprintf(file, "\n");
+	}
+
+	fclose(file);
+
+	snprintf(name, sizeof(name), "%s_ir.csv", path);
+	file = fopen(name, "w");
+
+	if (!file)
+	{
+		printf("Measurement: can't open %s\n", name);
+		return 2;
+	}
+
+	fprintf(file, "n,ir%s\n", m->have_emulator ? ",em_ir" : "");
+
+	for (int t = -MEASURE_IR_LEAD; t < MEASURE_IR_FRAMES - MEASURE_IR_LEAD; t++)
+	{
+		int i = (t < 0) ? t + MEASURE_IR_FRAMES : t;
+
+		fprintf(file, "%d,%.8f", t, dut.ir[i]);
+
+		if (m->have_emulator)
+			fprintf(file, ",%.8f", emulated.ir[i]);
+
+		fprintf(file, "\n");
+	}
+
+	fclose(file);
+
+	printf("Response written to %s.csv and %s_ir.csv\n", path, path);
+
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef DSP_SIM_MEASURE_H_
+#define DSP_SIM_MEASURE_H_
+
+#include <cstdint>
+#include <vector>
+
+#define MEASURE_SWEEP 	0
+#define MEASURE_MLS 	1
+
+// Sweep length, and the silence after it to catch the decay. The MLS
+// is of order 16, one period, the same length
+#define MEASURE_STIMULUS_FRAMES 	65535
+#define MEASURE_TAIL_FRAMES 		16384
+
+#define MEASURE_SWEEP_FROM 		20.0
+#define MEASURE_SWEEP_TO 		20000.0
+#define MEASURE_LEVEL 			0.5
+
+// Samples of impulse response the frequency response is taken from,
+// starting a little before time 0
+#define MEASURE_IR_FRAMES 		8192
+#define MEASURE_IR_LEAD 		256
+
+typedef struct {
+	int kind;
+	double sample_rate;
+
+	// Frame the stimulus starts on, or -1 until it's decided
+	int started_at;
+	int n_frames;
+
+	std::vector<double> stimulus;
+	std::vector<double> dut;
+	std::vector<double> emulated;
+	int have_emulator;
+} sim_measure;
+
+int sim_measure_init(sim_measure *m, int kind, double sample_rate);
+
+// What to play on frame `frame' of the measurement, and what came out
+int16_t sim_measure_input(const sim_measure *m, int frame);
+void sim_measure_output(sim_measure *m, int frame, int16_t dut, int16_t emulated, int have_emulator);
+
+// Deconvolve, print the response and latency, and write the curves to
+// <path>.csv and the impulse responses to <path>_ir.csv
+int sim_measure_report(const sim_measure *m, const char *path);
+
+#endif
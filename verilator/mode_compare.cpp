@@ -0,0 +1,199 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "session.h"
+#include "mode_compare.h"
+#include "Vtop___024root.h"
+
+m_effect_desc *m_read_eff_desc_from_file(char *fname);
+
+/*
+ * The engine modes, side by side.
+ *
+ * The test chain, a delay and then a gain, goes into three engines, one
+ * for each mode, through the session API: as one program into the
+ * first, swapped in as any program is, and split into the other two,
+ * the delay as a program of its own and then the gain as the second
+ * segment, in series and in parallel. Each then gets the same tone, and
+ * what comes out is set against the swap run's sample for sample.
+ *
+ * Series should match swap to within a sample's rounding once both are
+ * in, since it's the same arithmetic over two pipelines. Parallel is a
+ * different chain, the two segments mixed rather than one after the
+ * other, so its difference is there to be looked at, not checked.
+ *
+ * A split segment the back pipeline can't get through in a frame is
+ * turned down by the controller, and the engine left in swap mode with
+ * the first segment alone; that's reported here as the segment rejected
+ * with an overrun, and the output then differs by the gain.
+ */
+
+static const char *mode_names[3] = {"Swap", "Series", "Parallel"};
+static const char *outcome_names[3] = {"in", "rejected", "timed out"};
+
+static int engine_mode(const sim_session *session)
+{
+	return session->top->rootp->top__DOT__engine__DOT__controller__DOT__engine_mode;
+}
+
+static int split_overrun(const sim_session *session)
+{
+	return session->top->rootp->top__DOT__engine__DOT__controller__DOT__split_overrun;
+}
+
+// A program of the effects in `paths', in order, ending as `split_mode'
+// says: -1 for END_PROGRAM, or the mode to END_PROGRAM_SPLIT into
+static int chain_batch(const char **paths, int n, int split_mode, m_fpga_transfer_batch *batch)
+{
+	m_eff_resource_report res;
+	int pos = 0;
+
+	res.memory = 0;
+	res.delays = 0;
+
+	*batch = m_new_fpga_transfer_batch();
+
+	m_fpga_batch_append(batch, COMMAND_BEGIN_PROGRAM);
+
+	for (int i = 0; i < n; i++)
+	{
+		m_effect_desc *desc = m_read_eff_desc_from_file((char*)paths[i]);
+		m_transformer trans;
+
+		if (!desc)
+		{
+			free(batch->buf);
+			return 1;
+		}
+
+		init_transformer_from_effect_desc(&trans, desc);
+		m_fpga_batch_append_transformer(batch, &trans, &res, &pos);
+	}
+
+	if (split_mode < 0)
+	{
+		m_fpga_batch_append(batch, COMMAND_END_PROGRAM);
+	}
+	else
+	{
+		m_fpga_batch_append(batch, COMMAND_END_PROGRAM_SPLIT);
+		m_fpga_batch_append(batch, split_mode);
+	}
+
+	return 0;
+}
+
+// Send a batch and wait for the controller to be done with it; the
+// pipelines don't change places for a split segment, so whether it went
+// in is read off the engine's mode
+static int load(sim_session *session, const char **paths, int n, int split_mode)
+{
+	m_fpga_transfer_batch batch;
+
+	if (chain_batch(paths, n, split_mode, &batch))
+		return -1;
+
+	int outcome = sim_session_load_program(session, batch);
+	free(batch.buf);
+
+	return outcome;
+}
+
+static int start_mode(sim_session *session, int mode, sim_mode_result *result)
+{
+	static const char *chain[2] = {"eff/del.eff", "eff/gain.eff"};
+
+	memset(result, 0, sizeof(sim_mode_result));
+	result->mode = mode;
+	result->second_outcome = -1;
+
+	if (mode == ENGINE_MODE_SWAP)
+	{
+		result->first_outcome = load(session, chain, 2, -1);
+	}
+	else
+	{
+		result->first_outcome = load(session, chain, 1, -1);
+
+		if (result->first_outcome == SESSION_LOAD_SWAPPED)
+		{
+			result->second_outcome = load(session, chain + 1, 1, mode);
+
+			if (result->second_outcome < 0)
+				return 1;
+		}
+
+		result->overrun = split_overrun(session);
+	}
+
+	result->engine_mode = engine_mode(session);
+	result->load_frames = session->sched.frame;
+
+	return result->first_outcome < 0;
+}
+
+int sim_mode_compare()
+{
+	sim_session *sessions[3];
+	sim_mode_result results[3];
+	int16_t in[MODE_COMPARE_BLOCK];
+	int16_t out[3][MODE_COMPARE_BLOCK];
+
+	for (int mode = ENGINE_MODE_SWAP; mode <= ENGINE_MODE_PARALLEL; mode++)
+	{
+		sessions[mode] = sim_session_new(1);
+
+		if (!sessions[mode] || start_mode(sessions[mode], mode, &results[mode]))
+		{
+			fprintf(stderr, "Mode compare: %s run didn't start\n", mode_names[mode]);
+			return 1;
+		}
+	}
+
+	// Whatever the loads took, every engine sees the same tone from here
+	for (int done = 0; done < MODE_COMPARE_FRAMES; done += MODE_COMPARE_BLOCK)
+	{
+		for (int i = 0; i < MODE_COMPARE_BLOCK; i++)
+			in[i] = (int16_t)(sinf(6.28f * 440.0f * (done + i) / 44100.0f) * 16383.0f);
+
+		for (int mode = ENGINE_MODE_SWAP; mode <= ENGINE_MODE_PARALLEL; mode++)
+			sim_session_process(sessions[mode], in, out[mode], MODE_COMPARE_BLOCK);
+
+		for (int mode = ENGINE_MODE_SWAP; mode <= ENGINE_MODE_PARALLEL; mode++)
+		{
+			for (int i = 0; i < MODE_COMPARE_BLOCK; i++)
+			{
+				int difference = abs(out[mode][i] - out[ENGINE_MODE_SWAP][i]);
+
+				if (abs(out[mode][i]) > results[mode].peak)
+					results[mode].peak = abs(out[mode][i]);
+
+				if (difference > results[mode].max_difference)
+					results[mode].max_difference = difference;
+			}
+		}
+	}
+
+	printf("%-10s %-10s %-10s %-8s %-10s %-8s %-8s %s\n",
+		"Mode", "Program", "Segment", "Overrun", "Left in", "Frames", "Peak", "Max diff");
+
+	for (int mode = ENGINE_MODE_SWAP; mode <= ENGINE_MODE_PARALLEL; mode++)
+	{
+		sim_mode_result *result = &results[mode];
+
+		printf("%-10s %-10s %-10s %-8s %-10s %-8ld %-8d %d\n",
+			mode_names[mode],
+			outcome_names[result->first_outcome],
+			(result->second_outcome < 0) ? "-" : outcome_names[result->second_outcome],
+			result->overrun ? "yes" : "no",
+			mode_names[result->engine_mode % 3],
+			result->load_frames, result->peak, result->max_difference);
+
+		sim_session_free(sessions[mode]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef DSP_SIM_MODE_COMPARE_H_
+#define DSP_SIM_MODE_COMPARE_H_
+
+// Frames of tone each mode is run for, once its programs are in
+#define MODE_COMPARE_FRAMES 	8192
+#define MODE_COMPARE_BLOCK 		64
+
+typedef struct {
+	int mode;
+
+	// SESSION_LOAD_* for the program, or the first segment, and for the
+	// second segment in the split modes
+	int first_outcome;
+	int second_outcome;
+
+	// Whether the back pipeline ran past a tick while the second segment
+	// warmed up, and the mode the engine was left in
+	int overrun;
+	int engine_mode;
+
+	long load_frames;
+	int peak;
+
+	// Largest difference from the swap run's output, sample for sample
+	int max_difference;
+} sim_mode_result;
+
+// The test chain once as one program, and once split across the
+// pipelines in each of the split modes, an engine each on the same
+// input, reported side by side
+int sim_mode_compare();
+
+#endif
@@ -0,0 +1,297 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "model.h"
+
+/*
+ * A core, bit for bit, as a program sees it.
+ *
+ * Blocks run one after another, each finishing before the next starts,
+ * which is what the core's scoreboard and in-order commits are there to
+ * make it look like. Everything else follows the RTL: the MADD branch's
+ * shift and rounding as madd.v does them, the MAC branch's on a 40 bit
+ * accumulator, the misc ops' two shift stages, lut.v's tables and
+ * linterp.v's interpolation, and delay_master's write, with its clamped
+ * increment and its fade in once the buffer has wrapped.
+ *
+ * What the RTL leaves to timing, it leaves out. An argument an operation
+ * doesn't need is fetched from the register or channel it names, but
+ * without waiting for any write still pending to it, so NOP and ARSH,
+ * which go down the MADD branch and use all three, are only modelled
+ * when those arguments are registers.
+ */
+
+static int16_t sin_lut[MODEL_LUT_SIZE];
+static int16_t tanh_lut[MODEL_LUT_SIZE];
+
+static int load_lut(const char *path, int16_t *lut)
+{
+	FILE *file = fopen(path, "r");
+
+	if (!file)
+	{
+		fprintf(stderr, "Model: can't read %s\n", path);
+		return 1;
+	}
+
+	unsigned int value;
+	int n = 0;
+
+	while (n < MODEL_LUT_SIZE && fscanf(file, "%x", &value) == 1)
+		lut[n++] = (int16_t)value;
+
+	fclose(file);
+
+	if (n < MODEL_LUT_SIZE)
+	{
+		fprintf(stderr, "Model: %s has %d entries, not %d\n", path, n, MODEL_LUT_SIZE);
+		return 1;
+	}
+
+	return 0;
+}
+
+int sim_model_load_luts()
+{
+	if (load_lut("luts/sin_q15_full.hex", sin_lut))
+		return 1;
+
+	return load_lut("luts/tanh_q15.hex", tanh_lut);
+}
+
+int sim_model_init(sim_model *model, const sim_program_image *image)
+{
+	memset(model, 0, sizeof(sim_model));
+	model->image = *image;
+
+	for (int h = 0; h < PATCH_MAX_DELAYS; h++)
+	{
+		if (!image->delay_valid[h])
+			continue;
+
+		const uint8_t *alloc = image->delays[h];
+		sim_model_delay *delay = &model->delays[h];
+
+		delay->size  = (alloc[0] << 16) | (alloc[1] << 8) | alloc[2];
+		delay->delay = (alloc[3] << 16) | (alloc[4] << 8) | alloc[5];
+
+		if (delay->size > MODEL_MAX_DELAY)
+			return 1;
+	}
+
+	return 0;
+}
+
+// The accumulator and the branches' intermediates are 40 bits
+static int64_t wrap40(int64_t x)
+{
+	return (int64_t)((uint64_t)x << 24) >> 24;
+}
+
+static int64_t shl40(int64_t x, int n)
+{
+	return wrap40((int64_t)((uint64_t)x << n));
+}
+
+static int64_t saturate(int64_t x)
+{
+	return (x > 32767) ? 32767 : ((x < -32768) ? -32768 : x);
+}
+
+static int16_t operand(const sim_model *model, int block, int src, int src_reg)
+{
+	if (!src_reg)
+		return model->channels[src];
+
+	switch (src)
+	{
+		case 0: return (int16_t)model->image.regs[block][0];
+		case 1: return (int16_t)model->image.regs[block][1];
+
+		case 3: return 0x4000;
+		case 4: return (int16_t)0x8000;
+	}
+
+	return 0;
+}
+
+// shift_stage_1 and shift_stage_2; right shifts for the MADD branch,
+// left for the MAC branch
+static int64_t shift_product(int64_t product, int shift, int shift_disable, int left)
+{
+	int64_t sh2;
+	int rounding_bit = (shift == 0) ? 0 : (((product >> (shift - 1)) & 1) && !shift_disable);
+
+	if (shift > 15)
+		sh2 = 0;
+	else if (shift_disable)
+		return product;
+	else
+		sh2 = left ? shl40(product, shift & 12) : product >> (shift & 12);
+
+	return wrap40((left ? shl40(sh2, shift & 3) : sh2 >> (shift & 3)) + rounding_bit);
+}
+
+// linterp.v's sequential_interp: the difference is halved in steps,
+// each rounding towards zero
+static int16_t halve(int16_t d)
+{
+	return (d < 0) ? (int16_t)-(int16_t)((uint16_t)-d >> 1) : d >> 1;
+}
+
+static int16_t interpolate(int16_t base, int16_t next, int frac)
+{
+	int16_t diff = (int16_t)(next - base);
+	int16_t sum  = (int16_t)(base + ((frac & 8) ? (diff >> 1) : 0));
+	int16_t d 	 = (diff < 0) ? (int16_t)-(int16_t)((uint16_t)-diff >> 2) : diff >> 2;
+
+	if (frac & 4) sum += d;
+	d = halve(d);
+
+	if (frac & 2) sum += d;
+	d = halve(d);
+
+	return (int16_t)(sum + ((frac & 1) ? d : 0));
+}
+
+static int16_t lut_read(int handle, int16_t x)
+{
+	uint16_t u = (uint16_t)x;
+
+	if (handle == MODEL_LUT_SIN)
+	{
+		int base = (u >> 4) & 0x7FF;
+		int next = (base == 2047) ? 0 : base + 1;
+
+		return interpolate(sin_lut[base], sin_lut[next], u & 15);
+	}
+
+	int base = ((uint16_t)(u + 0x8000)) >> 5;
+	int next = (base == 2047) ? 2047 : base + 1;
+
+	return interpolate(tanh_lut[base], tanh_lut[next], (u >> 1) & 15);
+}
+
+static void delay_write(sim_model_delay *delay, int16_t data, int16_t inc)
+{
+	int max_inc = (delay->size << 8) - delay->delay;
+	int min_inc = -delay->delay;
+	int inc_clamped = (inc > max_inc) ? max_inc : ((inc < min_inc) ? min_inc : inc);
+
+	delay->data[delay->position] = data;
+
+	int offset = delay->delay >> 8;
+	int index  = (offset > delay->position) ? delay->position - offset + delay->size : delay->position - offset;
+
+	delay->out = (int16_t)(((int32_t)delay->data[index] * delay->gain) >> 15);
+	delay->delay += inc_clamped;
+
+	if (delay->wrapped && delay->gain < 0x4000)
+		delay->gain += 64;
+
+	if (delay->position == delay->size - 1)
+	{
+		delay->wrapped  = 1;
+		delay->position = 0;
+	}
+	else
+	{
+		delay->position++;
+	}
+}
+
+static void run_block(sim_model *model, int block)
+{
+	uint32_t word = model->image.instrs[block];
+	sim_decoded_instr instr;
+
+	sim_decode_instr(word, &instr);
+
+	int format = (word >> 5) & 1;
+	int shift  = format ? 0 : (word >> 25) & 31;
+	int saturate_disable = format ? 0 : (word >> 30) & 1;
+	int shift_disable 	 = (word >> 31) & 1;
+
+	int16_t a = operand(model, block, instr.src[0], instr.src_reg[0]);
+	int16_t b = operand(model, block, instr.src[1], instr.src_reg[1]);
+	int16_t c = operand(model, block, instr.src[2], instr.src_reg[2]);
+
+	int64_t result = 0;
+
+	switch (instr.operation)
+	{
+		case HW_INSTR_NOP: case HW_INSTR_MADD: case HW_INSTR_ARSH:
+			result = shift_product((int64_t)a * b, (15 - shift) & 31, shift_disable, 0);
+			result = wrap40(result + c);
+			break;
+
+		case HW_INSTR_MACZ: case HW_INSTR_UMACZ: case HW_INSTR_MAC: case HW_INSTR_UMAC:
+			result = shift_product((int64_t)a * b, shift, shift_disable, 1);
+
+			if (instr.operation == HW_INSTR_MAC || instr.operation == HW_INSTR_UMAC)
+				result = wrap40(model->acc + result);
+
+			model->acc = result;
+			return;
+
+		case HW_INSTR_LSH: result = (int16_t)((uint16_t)a << (shift & 15)); break;
+		case HW_INSTR_RSH: result = (int16_t)((uint16_t)a >> (shift & 15)); break;
+		case HW_INSTR_ABS: result = (int16_t)((a < 0) ? -a : a); break;
+		case HW_INSTR_MIN: result = (a < b) ? a : b; break;
+		case HW_INSTR_MAX: result = (a > b) ? a : b; break;
+
+		case HW_INSTR_CLAMP:
+		{
+			int16_t lo = (c < b) ? c : b;
+			int16_t hi = (c < b) ? b : c;
+
+			result = (a < lo) ? lo : ((a > hi) ? hi : a);
+			break;
+		}
+
+		case HW_INSTR_MOV_ACC: 	result = model->acc >> 15; break;
+		case HW_INSTR_MOV_LACC: result = (int16_t)(model->acc >> 16); break;
+		case HW_INSTR_MOV_UACC: result = (int16_t)model->acc; break;
+
+		case HW_INSTR_LUT_READ:
+			result = lut_read(instr.res_addr, a);
+			break;
+
+		case HW_INSTR_DELAY_READ:
+			result = model->delays[instr.res_addr % PATCH_MAX_DELAYS].out;
+			break;
+
+		case HW_INSTR_DELAY_WRITE:
+			delay_write(&model->delays[instr.res_addr % PATCH_MAX_DELAYS], a, b);
+			return;
+
+		case HW_INSTR_MEM_READ:
+			result = model->mem[instr.res_addr % MODEL_MEMORY_SIZE];
+			break;
+
+		case HW_INSTR_MEM_WRITE:
+			model->mem[instr.res_addr % MODEL_MEMORY_SIZE] = a;
+			return;
+
+		default:
+			return;
+	}
+
+	if (!saturate_disable)
+		result = saturate(result);
+
+	model->channels[instr.dest] = (int16_t)result;
+}
+
+int16_t sim_model_process(sim_model *model, int16_t x)
+{
+	model->channels[0] = x;
+
+	for (int i = 0; i < model->image.n_blocks; i++)
+		run_block(model, i);
+
+	return model->channels[0];
+}
@@ -0,0 +1,51 @@
+#ifndef DSP_SIM_MODEL_H_
+#define DSP_SIM_MODEL_H_
+
+#define MODEL_N_CHANNELS 	16
+#define MODEL_MEMORY_SIZE 	1024
+
+// The longest buffer the model keeps; the engine's can be longer
+#define MODEL_MAX_DELAY 	1024
+
+#define MODEL_LUT_SIZE 		2048
+
+// LUT handles, as lut_master has them
+#define MODEL_LUT_SIN 		0
+#define MODEL_LUT_TANH 		1
+
+typedef struct {
+	int size;
+	int delay;
+	int position;
+	int gain;
+	int wrapped;
+
+	int16_t out;
+	int16_t data[MODEL_MAX_DELAY];
+} sim_model_delay;
+
+// One core's state, as the program sees it
+typedef struct {
+	sim_program_image image;
+
+	int16_t channels[MODEL_N_CHANNELS];
+	int64_t acc;
+
+	int16_t mem[MODEL_MEMORY_SIZE];
+
+	sim_model_delay delays[PATCH_MAX_DELAYS];
+} sim_model;
+
+// Read the LUT contents from luts/, as lut.v does. Once, before any
+// model is run; nonzero if they couldn't be read
+int sim_model_load_luts();
+
+// Start a core on a program, as it stands after a full reset and the
+// program's upload. Nonzero if the program has a buffer longer than
+// MODEL_MAX_DELAY
+int sim_model_init(sim_model *model, const sim_program_image *image);
+
+// Run one pass on a sample; what it leaves in channel 0
+int16_t sim_model_process(sim_model *model, int16_t x);
+
+#endif
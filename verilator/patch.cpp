@@ -0,0 +1,332 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+
+#include "sim_main.h"
+#include "patch.h"
+
+/*
+ * Incremental program patching.
+ *
+ * Rather than re-uploading a whole program to change part of it, the back
+ * pipeline is told to clone the front one, and only the blocks that differ
+ * are written over the top. The encoder works on the bytes of transfer
+ * batches, so it doesn't care how the programs were put together.
+ *
+ * Delay buffers can be cloned too, keeping their handles, in which case
+ * only the buffers that were added, removed or resized are sent.
+ */
+
+int sim_command_arg_bytes(uint8_t command)
+{
+	switch (command)
+	{
+		#define X(command, bytes, block) case command: return bytes;
+		SIM_COMMANDS(X)
+		#undef X
+	}
+
+	return -1;
+}
+
+int sim_command_addresses_block(uint8_t command)
+{
+	switch (command)
+	{
+		#define X(command, bytes, block) case command: return block;
+		SIM_COMMANDS(X)
+		#undef X
+	}
+
+	return 0;
+}
+
+static void image_extend(sim_program_image *image, int block)
+{
+	if (block >= image->n_blocks)
+		image->n_blocks = block + 1;
+}
+
+static int lowest_free_handle(const sim_program_image *image)
+{
+	for (int i = 0; i < PATCH_MAX_DELAYS; i++)
+	{
+		if (!image->delay_valid[i])
+			return i;
+	}
+
+	return -1;
+}
+
+// Replay a batch against the image of what's running. Programming
+// happens into a separate image, which replaces the running one
+// at the end of the program, as the swap would
+int sim_program_image_from_batch(sim_program_image *image, m_fpga_transfer_batch batch)
+{
+	sim_program_image pending;
+	int programming = 0;
+
+	if (!image)
+		return 1;
+
+	int i = 0;
+
+	while (i < batch.len)
+	{
+		uint8_t command = batch.buf[i];
+		int n_args = sim_command_arg_bytes(command);
+
+		if (n_args < 0 || i + 1 + n_args > batch.len)
+			return 2;
+
+		// Commands without arguments may end the batch
+		const uint8_t *args = &batch.buf[i + 1];
+		int block = (n_args > 0) ? args[0] : 0;
+
+		switch (command)
+		{
+			case COMMAND_BEGIN_PROGRAM:
+				memset(&pending, 0, sizeof(pending));
+				programming = 1;
+				break;
+
+			case COMMAND_CLONE_PROGRAM:
+				if (programming)
+				{
+					memcpy(pending.instrs, image->instrs, sizeof(pending.instrs));
+					memcpy(pending.regs,   image->regs,   sizeof(pending.regs));
+					pending.n_blocks = image->n_blocks;
+
+					if (args[0] & CLONE_FLAG_DELAYS)
+					{
+						memcpy(pending.delay_valid, image->delay_valid, sizeof(pending.delay_valid));
+						memcpy(pending.delays, 		image->delays, 		sizeof(pending.delays));
+					}
+				}
+				break;
+
+			case COMMAND_WRITE_BLOCK_INSTR:
+				if (programming)
+				{
+					pending.instrs[block] = ((uint32_t)args[1] << 24) | ((uint32_t)args[2] << 16) | ((uint32_t)args[3] << 8) | args[4];
+					image_extend(&pending, block);
+				}
+				break;
+
+			case COMMAND_WRITE_BLOCK_REG_0:
+			case COMMAND_WRITE_BLOCK_REG_1:
+				if (programming)
+					pending.regs[block][command == COMMAND_WRITE_BLOCK_REG_1] = (args[1] << 8) | args[2];
+				break;
+
+			case COMMAND_UPDATE_BLOCK_REG_0:
+			case COMMAND_UPDATE_BLOCK_REG_1:
+				image->regs[block][command == COMMAND_UPDATE_BLOCK_REG_1] = (args[1] << 8) | args[2];
+				break;
+			
+			// Where the ramp ends up is all that matters to a patch
+			case COMMAND_RAMP_BLOCK_REG_0:
+			case COMMAND_RAMP_BLOCK_REG_1:
+				image->regs[block][command == COMMAND_RAMP_BLOCK_REG_1] = (args[1] << 8) | args[2];
+				break;
+
+			case COMMAND_ALLOC_DELAY:
+				if (programming)
+				{
+					int handle = lowest_free_handle(&pending);
+
+					if (handle >= 0)
+					{
+						memcpy(pending.delays[handle], args, DELAY_ALLOC_BYTES);
+						pending.delay_valid[handle] = 1;
+					}
+				}
+				break;
+
+			case COMMAND_FREE_DELAY:
+				if (programming && args[0] < PATCH_MAX_DELAYS)
+					pending.delay_valid[args[0]] = 0;
+				break;
+
+			case COMMAND_RESIZE_DELAY:
+				if (programming && args[0] < PATCH_MAX_DELAYS)
+					memcpy(pending.delays[args[0]], &args[1], 3);
+				break;
+
+			case COMMAND_END_PROGRAM:
+			case COMMAND_END_PROGRAM_SPLIT:
+				if (programming)
+					*image = pending;
+				programming = 0;
+				break;
+		}
+
+		i += 1 + n_args;
+	}
+
+	return 0;
+}
+
+static void batch_append_instr(m_fpga_transfer_batch *batch, int block, uint32_t instr)
+{
+	m_fpga_batch_append(batch, COMMAND_WRITE_BLOCK_INSTR);
+	m_fpga_batch_append(batch, block);
+	m_fpga_batch_append(batch, (instr >> 24) & 0xFF);
+	m_fpga_batch_append(batch, (instr >> 16) & 0xFF);
+	m_fpga_batch_append(batch, (instr >>  8) & 0xFF);
+	m_fpga_batch_append(batch,  instr 		 & 0xFF);
+}
+
+static void batch_append_reg(m_fpga_transfer_batch *batch, int block, int reg, uint16_t value)
+{
+	m_fpga_batch_append(batch, reg ? COMMAND_WRITE_BLOCK_REG_1 : COMMAND_WRITE_BLOCK_REG_0);
+	m_fpga_batch_append(batch, block);
+	m_fpga_batch_append(batch, (value >> 8) & 0xFF);
+	m_fpga_batch_append(batch,  value 		& 0xFF);
+}
+
+static void batch_append_alloc(m_fpga_transfer_batch *batch, const uint8_t *alloc)
+{
+	m_fpga_batch_append(batch, COMMAND_ALLOC_DELAY);
+
+	for (int j = 0; j < DELAY_ALLOC_BYTES; j++)
+		m_fpga_batch_append(batch, alloc[j]);
+}
+
+// Encode a whole program, as a fresh upload. Buffers are allocated in
+// order of handle, which only keeps their handles if none are missing
+int sim_encode_program(m_fpga_transfer_batch *batch, const sim_program_image *image)
+{
+	if (!batch || !image)
+		return 1;
+
+	m_fpga_batch_append(batch, COMMAND_BEGIN_PROGRAM);
+
+	for (int h = 0; h < PATCH_MAX_DELAYS; h++)
+	{
+		if (image->delay_valid[h])
+			batch_append_alloc(batch, image->delays[h]);
+	}
+
+	for (int i = 0; i < image->n_blocks; i++)
+	{
+		batch_append_instr(batch, i, image->instrs[i]);
+
+		for (int r = 0; r < 2; r++)
+		{
+			if (image->regs[i][r])
+				batch_append_reg(batch, i, r, image->regs[i][r]);
+		}
+	}
+
+	m_fpga_batch_append(batch, COMMAND_END_PROGRAM);
+
+	return 0;
+}
+
+// Whether `next's buffers can be reached from `current's by freeing the
+// ones that went and allocating the new ones in order of handle
+static int delays_patchable(const sim_program_image *current, const sim_program_image *next)
+{
+	sim_program_image scratch;
+
+	memcpy(scratch.delay_valid, current->delay_valid, sizeof(scratch.delay_valid));
+
+	for (int h = 0; h < PATCH_MAX_DELAYS; h++)
+	{
+		if (scratch.delay_valid[h] && !next->delay_valid[h])
+			scratch.delay_valid[h] = 0;
+	}
+
+	for (int h = 0; h < PATCH_MAX_DELAYS; h++)
+	{
+		if (next->delay_valid[h] && !scratch.delay_valid[h])
+		{
+			if (lowest_free_handle(&scratch) != h)
+				return 0;
+
+			scratch.delay_valid[h] = 1;
+		}
+	}
+
+	return 1;
+}
+
+// Encode the transition from `current' to `next' as a clone of the running
+// program plus the blocks that changed. If the delay buffers can keep their
+// handles, their table is cloned and patched as well; otherwise they are
+// all allocated again, starting from silence.
+int sim_encode_program_patch(m_fpga_transfer_batch *batch, const sim_program_image *current, const sim_program_image *next, int clone_flags)
+{
+	if (!batch || !current || !next)
+		return 1;
+
+	if (delays_patchable(current, next))
+		clone_flags |=  CLONE_FLAG_DELAYS;
+	else
+		clone_flags &= ~CLONE_FLAG_DELAYS;
+
+	m_fpga_batch_append(batch, COMMAND_BEGIN_PROGRAM);
+
+	m_fpga_batch_append(batch, COMMAND_CLONE_PROGRAM);
+	m_fpga_batch_append(batch, clone_flags);
+
+	if (clone_flags & CLONE_FLAG_DELAYS)
+	{
+		for (int h = 0; h < PATCH_MAX_DELAYS; h++)
+		{
+			if (current->delay_valid[h] && !next->delay_valid[h])
+			{
+				m_fpga_batch_append(batch, COMMAND_FREE_DELAY);
+				m_fpga_batch_append(batch, h);
+			}
+			else if (current->delay_valid[h] && next->delay_valid[h]
+				&& memcmp(current->delays[h], next->delays[h], 3) != 0)
+			{
+				m_fpga_batch_append(batch, COMMAND_RESIZE_DELAY);
+				m_fpga_batch_append(batch, h);
+
+				for (int j = 0; j < 3; j++)
+					m_fpga_batch_append(batch, next->delays[h][j]);
+			}
+		}
+
+		for (int h = 0; h < PATCH_MAX_DELAYS; h++)
+		{
+			if (next->delay_valid[h] && !current->delay_valid[h])
+				batch_append_alloc(batch, next->delays[h]);
+		}
+	}
+	else
+	{
+		for (int h = 0; h < PATCH_MAX_DELAYS; h++)
+		{
+			if (next->delay_valid[h])
+				batch_append_alloc(batch, next->delays[h]);
+		}
+	}
+
+	int n_blocks = (next->n_blocks > current->n_blocks) ? next->n_blocks : current->n_blocks;
+
+	for (int i = 0; i < n_blocks; i++)
+	{
+		// Blocks past the end of a shorter program are turned into NOPs
+		uint32_t instr = (i < next->n_blocks) ? next->instrs[i] : 0;
+
+		if (i >= current->n_blocks || instr != current->instrs[i])
+			batch_append_instr(batch, i, instr);
+
+		if (i >= next->n_blocks)
+			continue;
+
+		for (int r = 0; r < 2; r++)
+		{
+			if (i >= current->n_blocks || next->regs[i][r] != current->regs[i][r])
+				batch_append_reg(batch, i, r, next->regs[i][r]);
+		}
+	}
+
+	m_fpga_batch_append(batch, COMMAND_END_PROGRAM);
+
+	return 0;
+}
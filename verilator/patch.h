@@ -0,0 +1,29 @@
+#ifndef DSP_SIM_PATCH_H_
+#define DSP_SIM_PATCH_H_
+
+#define PATCH_MAX_BLOCKS 	256
+#define PATCH_MAX_DELAYS 	16
+
+#define CLONE_FLAG_MEM 		1
+#define CLONE_FLAG_DELAYS 	2
+
+// What a program leaves behind in a pipeline, as far as the
+// controller is concerned; rebuilt from the bytes of a batch
+typedef struct {
+	int n_blocks;
+
+	uint32_t instrs[PATCH_MAX_BLOCKS];
+	uint16_t regs[PATCH_MAX_BLOCKS][2];
+
+	// Delay buffers by handle; a new buffer takes the lowest free handle
+	int delay_valid[PATCH_MAX_DELAYS];
+	uint8_t delays[PATCH_MAX_DELAYS][DELAY_ALLOC_BYTES];
+} sim_program_image;
+
+int sim_program_image_from_batch(sim_program_image *image, m_fpga_transfer_batch batch);
+
+int sim_encode_program(m_fpga_transfer_batch *batch, const sim_program_image *image);
+
+int sim_encode_program_patch(m_fpga_transfer_batch *batch, const sim_program_image *current, const sim_program_image *next, int clone_flags);
+
+#endif
@@ -0,0 +1,395 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "sim_main.h"
+#include "profile.h"
+
+#include "svdpi.h"
+// Only generated when the RTL imports something, as it does with the
+// hooks SIM_PROFILE turns on
+#ifdef SIM_PROFILE
+#include "Vtop__Dpi.h"
+#endif
+
+/*
+ * Per-block execution profile, from hooks in the RTL.
+ *
+ * Under Verilator, dsp_core reports each sample tick and each block as
+ * it issues into operand fetch, the operand fetch substages report each
+ * cycle they hold a block and why, and the commit master reports each
+ * block as it commits and from which branch. Which core an event came
+ * from is read off the scope the hook was called in.
+ *
+ * Blocks issue one at a time and in order, so the cycles from one
+ * block's issue to the next one's are charged to the first, bar the
+ * wait for the next sample once the pass has committed: over a run,
+ * that adds up to every cycle the core spent. The cycles a block was
+ * held in operand fetch are broken out of that by what it was waiting
+ * on. A block held further down can hold up the block behind it too, so
+ * the two don't always line up; what the stall frames say is which
+ * blocks waited, and on what.
+ *
+ * A core that goes quiet for over a frame has been swapped out or held
+ * in reset, and the block it issued last isn't charged for the gap.
+ */
+
+static const char *op_names[] = {
+	"nop", "madd", "arsh", "lsh", "rsh", "abs", "min", "max", "clamp",
+	"mov_acc", "mov_lacc", "mov_uacc", "macz", "umacz", "mac", "umac",
+	"lut_read", "delay_read", "delay_write", "mem_read", "mem_write"
+};
+
+static const char *branch_names[HW_N_BRANCHES] = {
+	"madd", "mac", "misc", "delay", "lut", "mem"
+};
+
+typedef struct {
+	int enabled;
+	long clock;
+
+	sim_profile_unit units[PROFILE_MAX_UNITS];
+	int n_units;
+
+	struct {
+		svScope scope;
+		int unit;
+	} scopes[PROFILE_MAX_SCOPES];
+	int n_scopes;
+
+	sim_profile_label labels[PROFILE_MAX_LABELS];
+	int n_labels;
+	int program;
+} sim_profile;
+
+static sim_profile profile;
+
+void sim_profile_begin()
+{
+	profile.enabled = 1;
+	profile.clock = 0;
+	profile.n_units = 0;
+	profile.n_scopes = 0;
+}
+
+void sim_profile_clock()
+{
+	profile.clock++;
+}
+
+void sim_profile_name_blocks(int first, int n, const char *source)
+{
+	if (profile.n_labels >= PROFILE_MAX_LABELS || n <= 0)
+		return;
+
+	sim_profile_label *label = &profile.labels[profile.n_labels++];
+
+	const char *base = strrchr(source, '/');
+
+	label->program = profile.program;
+	snprintf(label->source, sizeof(label->source), "%s", base ? base + 1 : source);
+	label->first = first;
+	label->n = n;
+}
+
+void sim_profile_next_program()
+{
+	profile.program++;
+}
+
+// The unit the calling hook belongs to: the instance the core sits in
+static sim_profile_unit *calling_unit()
+{
+	svScope scope = svGetScope();
+
+	for (int i = 0; i < profile.n_scopes; i++)
+	{
+		if (profile.scopes[i].scope == scope)
+			return &profile.units[profile.scopes[i].unit];
+	}
+
+	const char *path = svGetNameFromScope(scope);
+	const char *core = strstr(path, ".core");
+	const char *start = core;
+	char name[32];
+
+	while (start && start > path && start[-1] != '.')
+		start--;
+
+	if (core)
+		snprintf(name, sizeof(name), "%.*s", (int)(core - start), start);
+	else
+		snprintf(name, sizeof(name), "core");
+
+	int unit = 0;
+
+	while (unit < profile.n_units && strcmp(profile.units[unit].name, name) != 0)
+		unit++;
+
+	if (unit == profile.n_units)
+	{
+		if (profile.n_units >= PROFILE_MAX_UNITS)
+			return NULL;
+
+		memset(&profile.units[unit], 0, sizeof(sim_profile_unit));
+		snprintf(profile.units[unit].name, sizeof(profile.units[unit].name), "%s", name);
+		profile.units[unit].last_issue = -1;
+		profile.n_units++;
+	}
+
+	if (profile.n_scopes < PROFILE_MAX_SCOPES)
+	{
+		profile.scopes[profile.n_scopes].scope = scope;
+		profile.scopes[profile.n_scopes].unit  = unit;
+		profile.n_scopes++;
+	}
+
+	return &profile.units[unit];
+}
+
+static sim_profile_unit *event_unit()
+{
+	if (!profile.enabled)
+		return NULL;
+
+	sim_profile_unit *unit = calling_unit();
+
+	if (!unit)
+		return NULL;
+
+	if (profile.clock - unit->last_event_at > CYCLE_FRAME_CYCLES)
+		unit->last_issue = -1;
+
+	unit->last_event_at = profile.clock;
+
+	return unit;
+}
+
+void sim_profile_tick()
+{
+	sim_profile_unit *unit = event_unit();
+
+	if (unit)
+		unit->frames++;
+}
+
+void sim_profile_issue(int block, int operation)
+{
+	sim_profile_unit *unit = event_unit();
+
+	if (!unit || block < 0 || block >= PATCH_MAX_BLOCKS)
+		return;
+
+	if (unit->last_issue >= 0)
+	{
+		long until = profile.clock;
+
+		// Round to the top of the program: the last block is done with
+		// once the pass has committed, and the rest is waiting
+		if (block <= unit->last_issue)
+		{
+			until = (unit->last_commit_at < until) ? unit->last_commit_at : until;
+			until = (until > unit->last_issue_at) ? until : unit->last_issue_at;
+
+			unit->idle += profile.clock - until;
+		}
+
+		unit->blocks[unit->last_issue].cycles += until - unit->last_issue_at;
+	}
+
+	unit->last_issue 	= block;
+	unit->last_issue_at = profile.clock;
+	unit->issued_at[block] = profile.clock;
+
+	unit->blocks[block].issues++;
+	unit->blocks[block].operation = operation;
+}
+
+void sim_profile_stall(int block, int reason, int channel)
+{
+	sim_profile_unit *unit = event_unit();
+
+	if (!unit || block < 0 || block >= PATCH_MAX_BLOCKS)
+		return;
+
+	unit->blocks[block].stalls[reason ? PROFILE_STALL_ACCUMULATOR : (channel & 0xF)]++;
+}
+
+void sim_profile_commit(int block, int branch)
+{
+	sim_profile_unit *unit = event_unit();
+
+	if (!unit || block < 0 || block >= PATCH_MAX_BLOCKS)
+		return;
+
+	unit->blocks[block].commits++;
+	unit->blocks[block].latency += profile.clock - unit->issued_at[block];
+	unit->blocks[block].branch = branch;
+
+	unit->last_commit_at = profile.clock;
+}
+
+// Blocks in a program, as named
+static int program_length(int program)
+{
+	int length = 0;
+
+	for (int i = 0; i < profile.n_labels; i++)
+	{
+		const sim_profile_label *label = &profile.labels[i];
+
+		if (label->program == program && label->first + label->n > length)
+			length = label->first + label->n;
+	}
+
+	return length;
+}
+
+// Which program a unit was running: the one as long as what it ran,
+// or failing that the last one long enough. Either pipeline can end up
+// with any program, so the blocks it issued are all there is to go on
+static int unit_program(const sim_profile_unit *unit)
+{
+	int length = 0;
+	int fallback = -1;
+
+	for (int i = 0; i < PATCH_MAX_BLOCKS; i++)
+	{
+		if (unit->blocks[i].issues)
+			length = i + 1;
+	}
+
+	for (int program = profile.program; program >= 0; program--)
+	{
+		int n = program_length(program);
+
+		if (n == length)
+			return program;
+
+		if (n >= length && fallback < 0)
+			fallback = program;
+	}
+
+	return fallback;
+}
+
+// Where block `block' of a program came from, and its index in there
+static const char *block_source(int program, int block, int *offset)
+{
+	for (int i = 0; i < profile.n_labels; i++)
+	{
+		const sim_profile_label *label = &profile.labels[i];
+
+		if (label->program == program && block >= label->first && block < label->first + label->n)
+		{
+			*offset = block - label->first;
+			return label->source;
+		}
+	}
+
+	*offset = block;
+	return "program";
+}
+
+static long block_stalls(const sim_profile_block *b)
+{
+	long total = 0;
+
+	for (int r = 0; r < PROFILE_N_STALLS; r++)
+		total += b->stalls[r];
+
+	return total;
+}
+
+int sim_profile_write(const char *path)
+{
+	FILE *file = fopen(path, "w");
+
+	if (!file)
+	{
+		printf("Profile: can't open %s\n", path);
+		return 1;
+	}
+
+	for (int u = 0; u < profile.n_units; u++)
+	{
+		const sim_profile_unit *unit = &profile.units[u];
+		int program = unit_program(unit);
+		std::vector<int> order;
+
+		for (int i = 0; i < PATCH_MAX_BLOCKS; i++)
+		{
+			const sim_profile_block *b = &unit->blocks[i];
+
+			if (!b->issues)
+				continue;
+
+			order.push_back(i);
+
+			int offset;
+			const char *source = block_source(program, i, &offset);
+			const char *op = (b->operation < (int)(sizeof(op_names) / sizeof(op_names[0]))) ? op_names[b->operation] : "?";
+
+			char stack[160];
+			snprintf(stack, sizeof(stack), "%s;%s;block %d: %s", unit->name, source, offset, op);
+
+			long stalls = block_stalls(b);
+
+			if (b->cycles > stalls)
+				fprintf(file, "%s %ld\n", stack, b->cycles - stalls);
+
+			for (int r = 0; r < PROFILE_N_STALLS; r++)
+			{
+				if (!b->stalls[r])
+					continue;
+
+				if (r == PROFILE_STALL_ACCUMULATOR)
+					fprintf(file, "%s;accumulator %ld\n", stack, b->stalls[r]);
+				else
+					fprintf(file, "%s;channel %d %ld\n", stack, r, b->stalls[r]);
+			}
+		}
+
+		if (order.empty())
+			continue;
+
+		fprintf(file, "%s;idle %ld\n", unit->name, unit->idle);
+
+		std::sort(order.begin(), order.end(), [unit](int a, int b) {
+			return unit->blocks[a].cycles > unit->blocks[b].cycles;
+		});
+
+		long frames = unit->frames ? unit->frames : 1;
+
+		printf("Profile of %s over %ld frames, %.1f cycles per frame idle; costliest blocks, in cycles per frame:\n",
+			unit->name, unit->frames, (double)unit->idle / frames);
+		printf("%6s  %-24s %-12s %-6s %8s %8s %8s %8s\n", "block", "source", "op", "branch",
+			"cycles", "operand", "acc", "latency");
+
+		for (size_t k = 0; k < order.size() && k < 16; k++)
+		{
+			const sim_profile_block *b = &unit->blocks[order[k]];
+			int offset;
+			const char *source = block_source(program, order[k], &offset);
+			char where[64];
+
+			snprintf(where, sizeof(where), "%s+%d", source, offset);
+
+			printf("%6d  %-24s %-12s %-6s %8.1f %8.1f %8.1f %8.1f\n", order[k], where,
+				(b->operation < (int)(sizeof(op_names) / sizeof(op_names[0]))) ? op_names[b->operation] : "?",
+				b->commits ? branch_names[b->branch % HW_N_BRANCHES] : "-",
+				(double)b->cycles / frames,
+				(double)(block_stalls(b) - b->stalls[PROFILE_STALL_ACCUMULATOR]) / frames,
+				(double)b->stalls[PROFILE_STALL_ACCUMULATOR] / frames,
+				b->commits ? (double)b->latency / b->commits : 0.0);
+		}
+	}
+
+	fclose(file);
+
+	printf("Profile written to %s\n", path);
+
+	return 0;
+}
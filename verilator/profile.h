@@ -0,0 +1,72 @@
+#ifndef DSP_SIM_PROFILE_H_
+#define DSP_SIM_PROFILE_H_
+
+#define PROFILE_MAX_UNITS 		4
+#define PROFILE_MAX_SCOPES 		32
+#define PROFILE_MAX_LABELS 		64
+
+// Why a block was held in operand fetch: waiting on one of the
+// channels, or on the accumulator
+#define PROFILE_STALL_ACCUMULATOR 	16
+#define PROFILE_N_STALLS 			17
+
+typedef struct {
+	long issues;
+	long commits;
+
+	// Cycles from the block's issue to the next one's, and of those, the
+	// cycles it was held in operand fetch, by reason
+	long cycles;
+	long stalls[PROFILE_N_STALLS];
+
+	// Cycles from issue to commit, summed over commits
+	long latency;
+
+	int operation;
+	int branch;
+} sim_profile_block;
+
+// Everything seen from one dsp_core
+typedef struct {
+	char name[32];
+
+	long frames;
+	long last_event_at;
+
+	// Cycles from the last commit of a pass to the first issue of the
+	// next, waiting on the sample
+	long idle;
+	long last_commit_at;
+
+	int last_issue;
+	long last_issue_at;
+	long issued_at[PATCH_MAX_BLOCKS];
+
+	sim_profile_block blocks[PATCH_MAX_BLOCKS];
+} sim_profile_unit;
+
+// Blocks [first, first + n) of one of the programs uploaded came from
+// `source'
+typedef struct {
+	int program;
+	char source[64];
+	int first;
+	int n;
+} sim_profile_label;
+
+// Start collecting; until then the hooks in the RTL do nothing
+void sim_profile_begin();
+
+// One sys_clk cycle has gone by
+void sim_profile_clock();
+
+// Name blocks of the program being put together after the effect they
+// came from, and move on to the next program
+void sim_profile_name_blocks(int first, int n, const char *source);
+void sim_profile_next_program();
+
+// Write what was collected as folded stacks, pipeline;source;block;stall
+// with the cycles spent in each, and print the costliest blocks
+int sim_profile_write(const char *path);
+
+#endif
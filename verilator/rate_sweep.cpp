@@ -0,0 +1,252 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+
+#include "sim_main.h"
+#include "rate_sweep.h"
+
+m_effect_desc *m_read_eff_desc_from_file(char *fname);
+
+/*
+ * How long a chain each effect can run in at each sample rate.
+ *
+ * A higher rate shortens the frame, and with it the cycles a pass has.
+ * For each effect in eff/, chains of it back to back are built one copy
+ * longer at a time, and run through the static cycle estimate with the
+ * frame of each rate, until the pass no longer finishes inside the frame
+ * or the chain no longer fits the engine. The longest that fits at each
+ * rate is then loaded into the RTL, run at that rate, and its commit
+ * span measured, to check the estimate's call.
+ *
+ * Frames are in sys_clk cycles and scaled from 44.1kHz's 1280, as the
+ * I2S clocks in top.v make them.
+ */
+
+const sim_rate sim_rates[SIM_N_RATES] = {
+	{"44.1kHz", SAMPLE_RATE_44K1, 1280},
+	{"48kHz",   SAMPLE_RATE_48K,  1176},
+	{"88.2kHz", SAMPLE_RATE_88K2, 640},
+	{"96kHz",   SAMPLE_RATE_96K,  588},
+	{"192kHz",  SAMPLE_RATE_192K, 294}
+};
+
+static const char *limit_names[] = {"time", "blocks", "delays", "memory"};
+
+static void build_chain(m_fpga_transfer_batch *batch, m_transformer *trans, int copies, m_eff_resource_report *res)
+{
+	int pos = 0;
+
+	*batch = m_new_fpga_transfer_batch();
+
+	res->memory = 0;
+	res->delays = 0;
+
+	m_fpga_batch_append(batch, COMMAND_BEGIN_PROGRAM);
+
+	for (int i = 0; i < copies; i++)
+		m_fpga_batch_append_transformer(batch, trans, res, &pos);
+
+	m_fpga_batch_append(batch, COMMAND_END_PROGRAM);
+}
+
+// Grow the chain until every rate has found its longest
+static void sweep_effect(sim_rate_sweep *sweep, sim_rate_sweep_effect *effect)
+{
+	sim_program_image image;
+	int done[SIM_N_RATES];
+
+	memset(done, 0, sizeof(done));
+
+	for (int copies = 1; ; copies++)
+	{
+		m_fpga_transfer_batch batch;
+		m_eff_resource_report res;
+		int limit = -1;
+
+		build_chain(&batch, &effect->trans, copies, &res);
+
+		memset(&image, 0, sizeof(sim_program_image));
+		sim_program_image_from_batch(&image, batch);
+		free(batch.buf);
+
+		if (copies == 1)
+			effect->blocks = image.n_blocks;
+
+		if (image.n_blocks > RATE_SWEEP_MAX_BLOCKS)
+			limit = RATE_SWEEP_LIMIT_BLOCKS;
+		else if (res.delays > RATE_SWEEP_MAX_DELAYS)
+			limit = RATE_SWEEP_LIMIT_DELAYS;
+		else if (res.memory > RATE_SWEEP_MAX_MEMORY)
+			limit = RATE_SWEEP_LIMIT_MEMORY;
+
+		int n_done = 0;
+
+		for (int r = 0; r < SIM_N_RATES; r++)
+		{
+			if (!done[r])
+			{
+				sim_cycle_params params = sweep->params;
+				sim_cycle_estimate est;
+
+				params.frame_cycles = sim_rates[r].frame_cycles;
+
+				if (limit < 0)
+				{
+					sim_estimate_cycles(&image, &params, &est);
+
+					if (est.overruns || est.pass_cycles >= params.frame_cycles)
+						limit = RATE_SWEEP_LIMIT_TIME;
+				}
+
+				if (limit >= 0)
+				{
+					effect->limit[r] = limit;
+					done[r] = 1;
+				}
+				else
+				{
+					effect->longest[r] = copies;
+					effect->estimated[r] = est.commit_span;
+				}
+
+				// Resource limits hold at every rate; time only at this one
+				// and the ones above it, which are checked in turn
+				if (limit == RATE_SWEEP_LIMIT_TIME)
+					limit = -1;
+			}
+
+			n_done += done[r];
+		}
+
+		// An empty effect never runs out of anything
+		if (n_done == SIM_N_RATES || image.n_blocks == 0)
+			break;
+	}
+}
+
+int sim_rate_sweep_plan(sim_rate_sweep *sweep, const sim_cycle_params *params)
+{
+	DIR *dir = opendir("eff");
+	struct dirent *entry;
+
+	memset(sweep, 0, sizeof(sim_rate_sweep));
+	sweep->params = *params;
+
+	if (!dir)
+		return 1;
+
+	while ((entry = readdir(dir)) && sweep->n_effects < RATE_SWEEP_MAX_EFFECTS)
+	{
+		int len = strlen(entry->d_name);
+
+		if (len < 5 || strcmp(entry->d_name + len - 4, ".eff") != 0)
+			continue;
+
+		char path[300];
+		snprintf(path, sizeof(path), "eff/%s", entry->d_name);
+
+		m_effect_desc *desc = m_read_eff_desc_from_file(path);
+
+		if (!desc)
+			continue;
+
+		sim_rate_sweep_effect *effect = &sweep->effects[sweep->n_effects];
+
+		snprintf(effect->name, sizeof(effect->name), "%.*s", len - 4, entry->d_name);
+		init_transformer_from_effect_desc(&effect->trans, desc);
+
+		sweep_effect(sweep, effect);
+
+		sweep->n_effects++;
+	}
+
+	closedir(dir);
+
+	return 0;
+}
+
+int sim_rate_sweep_n_chains(const sim_rate_sweep *sweep)
+{
+	return SIM_N_RATES * sweep->n_effects;
+}
+
+int sim_rate_sweep_chain_batch(sim_rate_sweep *sweep, int chain, m_fpga_transfer_batch *batch)
+{
+	int r = chain / sweep->n_effects;
+	sim_rate_sweep_effect *effect = &sweep->effects[chain % sweep->n_effects];
+
+	if (effect->longest[r] == 0)
+		return 1;
+
+	m_eff_resource_report res;
+	m_fpga_transfer_batch program;
+
+	build_chain(&program, &effect->trans, effect->longest[r], &res);
+
+	*batch = m_new_fpga_transfer_batch();
+
+	m_fpga_batch_append(batch, COMMAND_SET_SAMPLE_RATE);
+	m_fpga_batch_append(batch, sim_rates[r].code);
+
+	for (int i = 0; i < program.len; i++)
+		m_fpga_batch_append(batch, program.buf[i]);
+
+	free(program.buf);
+
+	return 0;
+}
+
+void sim_rate_sweep_measured(sim_rate_sweep *sweep, int chain, int span)
+{
+	sweep->effects[chain % sweep->n_effects].measured[chain / sweep->n_effects] = span;
+}
+
+void sim_rate_sweep_report(const sim_rate_sweep *sweep)
+{
+	printf("\n%-20s %-8s %6s %6s %7s %9s %9s %6s\n", "effect", "rate", "blocks", "copies", "limit", "estimate", "measured", "frame");
+
+	for (int e = 0; e < sweep->n_effects; e++)
+	{
+		const sim_rate_sweep_effect *effect = &sweep->effects[e];
+
+		for (int r = 0; r < SIM_N_RATES; r++)
+		{
+			char measured[16];
+
+			if (effect->measured[r] > 0)
+				snprintf(measured, sizeof(measured), "%d", effect->measured[r]);
+			else
+				snprintf(measured, sizeof(measured), "%s", effect->measured[r] < 0 ? "rejected" : "-");
+
+			printf("%-20s %-8s %6d %6d %7s %9d %9s %6d%s\n", effect->name, sim_rates[r].name,
+				effect->blocks * effect->longest[r], effect->longest[r], limit_names[effect->limit[r]],
+				effect->estimated[r], measured, sim_rates[r].frame_cycles,
+				(effect->measured[r] >= sim_rates[r].frame_cycles - 1) ? "  over" : "");
+		}
+	}
+
+	// Copies at each rate, as a share of what 44.1kHz takes
+	printf("\n%-20s", "effect");
+	for (int r = 0; r < SIM_N_RATES; r++)
+		printf(" %9s", sim_rates[r].name);
+	printf("\n");
+
+	for (int e = 0; e < sweep->n_effects; e++)
+	{
+		const sim_rate_sweep_effect *effect = &sweep->effects[e];
+
+		printf("%-20s", effect->name);
+
+		for (int r = 0; r < SIM_N_RATES; r++)
+		{
+			if (effect->longest[0])
+				printf(" %4d %3d%%", effect->longest[r], 100 * effect->longest[r] / effect->longest[0]);
+			else
+				printf(" %4d %4s", effect->longest[r], "-");
+		}
+
+		printf("\n");
+	}
+}
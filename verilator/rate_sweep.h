@@ -0,0 +1,69 @@
+#ifndef DSP_SIM_RATE_SWEEP_H_
+#define DSP_SIM_RATE_SWEEP_H_
+
+// Sample rates as include/engine.vh numbers them
+#define SAMPLE_RATE_44K1 	0
+#define SAMPLE_RATE_48K 	1
+#define SAMPLE_RATE_88K2 	2
+#define SAMPLE_RATE_96K 	3
+#define SAMPLE_RATE_192K 	4
+#define SIM_N_RATES 		5
+
+#define RATE_SWEEP_MAX_EFFECTS 	16
+
+// What a program can have, as the engine is built
+#define RATE_SWEEP_MAX_BLOCKS 	255
+#define RATE_SWEEP_MAX_DELAYS 	16
+#define RATE_SWEEP_MAX_MEMORY 	1024
+
+// What stopped a chain getting any longer
+#define RATE_SWEEP_LIMIT_TIME 		0
+#define RATE_SWEEP_LIMIT_BLOCKS 	1
+#define RATE_SWEEP_LIMIT_DELAYS 	2
+#define RATE_SWEEP_LIMIT_MEMORY 	3
+
+typedef struct {
+	const char *name;
+	int code;
+	int frame_cycles;
+} sim_rate;
+
+extern const sim_rate sim_rates[SIM_N_RATES];
+
+typedef struct {
+	char name[64];
+	m_transformer trans;
+	int blocks;
+
+	// At each rate: the most copies of the effect in a row that the
+	// estimate has finishing inside the frame, what stopped it there,
+	// its estimated commit span, and the one measured on the RTL, or 0
+	// until it has been and -1 if the engine wouldn't take it
+	int longest[SIM_N_RATES];
+	int limit[SIM_N_RATES];
+	int estimated[SIM_N_RATES];
+	int measured[SIM_N_RATES];
+} sim_rate_sweep_effect;
+
+typedef struct {
+	sim_cycle_params params;
+
+	sim_rate_sweep_effect effects[RATE_SWEEP_MAX_EFFECTS];
+	int n_effects;
+} sim_rate_sweep;
+
+// Load every effect in eff/ and find its longest chain at each rate
+int sim_rate_sweep_plan(sim_rate_sweep *sweep, const sim_cycle_params *params);
+
+// The chains to check on the RTL are numbered rate by rate, effect by
+// effect. Build chain `chain': the rate command, then the program.
+// Nonzero if there's nothing to check, as no copies fit at all
+int sim_rate_sweep_n_chains(const sim_rate_sweep *sweep);
+int sim_rate_sweep_chain_batch(sim_rate_sweep *sweep, int chain, m_fpga_transfer_batch *batch);
+
+void sim_rate_sweep_measured(sim_rate_sweep *sweep, int chain, int span);
+
+// Print each effect's longest chain at each rate, estimated and measured
+void sim_rate_sweep_report(const sim_rate_sweep *sweep);
+
+#endif
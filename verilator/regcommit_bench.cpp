@@ -0,0 +1,188 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "session.h"
+#include "regcommit_bench.h"
+#include "Vtop___024root.h"
+
+/*
+ * Register commit latency and throughput, on the engine itself.
+ *
+ * A program of NOPs a given number of blocks long goes into an engine of
+ * its own, through the session API. Batches of UPDATE_BLOCK_REG_0 to
+ * distinct blocks chosen at random then go in, each ended by a
+ * COMMIT_REG_UPDATES, one after another as the host would send them, and
+ * each is timed to the cycle: from its last byte leaving the SPI master
+ * to the front pipeline's regfiles_syncing falling, which is the commit
+ * done with and the controller free to take the next update; and from
+ * its first byte to the same, for the rate updates go in at.
+ *
+ * The bank flip waits for the fetcher to wrap round to block 0, so the
+ * latency goes with the program's length, and then a cycle per dirty
+ * block. SPI is slow beside either, so the rate is mostly its.
+ */
+
+#define REGCOMMIT_BENCH_SEED 	4321
+
+static int front_syncing(const sim_session *session)
+{
+	int front = session->top->rootp->top__DOT__engine__DOT__controller__DOT__current_pipeline;
+
+	return (session->top->rootp->top__DOT__engine__DOT__pipeline_regfiles_syncing >> front) & 1;
+}
+
+static int load_nops(sim_session *session, int n_blocks)
+{
+	sim_program_image image;
+	m_fpga_transfer_batch batch = m_new_fpga_transfer_batch();
+
+	memset(&image, 0, sizeof(sim_program_image));
+	image.n_blocks = n_blocks;
+
+	sim_encode_program(&batch, &image);
+
+	int outcome = sim_session_load_program(session, batch);
+	free(batch.buf);
+
+	return outcome;
+}
+
+// The batch's updates and its commit; the blocks are distinct, so each
+// is a dirty block to copy
+static void queue_batch(sim_session *session, int n_blocks, int batch)
+{
+	uint8_t bytes[4 * PATCH_MAX_BLOCKS + 1];
+	int taken[PATCH_MAX_BLOCKS];
+	int n = 0;
+
+	memset(taken, 0, sizeof(taken));
+
+	for (int i = 0; i < batch; i++)
+	{
+		int block = rand() % n_blocks;
+
+		while (taken[block])
+			block = (block + 1) % n_blocks;
+
+		taken[block] = 1;
+
+		bytes[n++] = COMMAND_UPDATE_BLOCK_REG_0;
+		bytes[n++] = block;
+		bytes[n++] = rand() >> 8;
+		bytes[n++] = rand() >> 8;
+	}
+
+	bytes[n++] = COMMAND_COMMIT_REG_UPDATES;
+
+	sim_session_send_command(session, bytes, n);
+}
+
+int sim_regcommit_measure(int n_blocks, int batch, sim_regcommit *rc)
+{
+	memset(rc, 0, sizeof(sim_regcommit));
+	rc->n_blocks = n_blocks;
+	rc->batch 	 = batch;
+
+	if (batch > n_blocks)
+		batch = n_blocks;
+
+	sim_session *session = sim_session_new(1);
+
+	if (!session)
+		return 1;
+
+	if (load_nops(session, n_blocks) != SESSION_LOAD_SWAPPED)
+	{
+		fprintf(stderr, "Regcommit: a program of %d blocks wasn't swapped in\n", n_blocks);
+		sim_session_free(session);
+		return 1;
+	}
+
+	for (int round = 0; round < REGCOMMIT_ROUNDS; round++)
+	{
+		queue_batch(session, n_blocks, batch);
+
+		// Sent once the controller's settled
+		while (!session->queue.sending)
+			sim_session_step(session);
+
+		long first_byte = session->sched.cycle;
+
+		while (session->queue.sending || session->io.spi_sending
+			|| session->io.spi_read_head != session->io.spi_write_head)
+			sim_session_step(session);
+
+		long last_byte = session->sched.cycle;
+		int seen = 0;
+
+		// The commit is done with once syncing has come and gone
+		while (session->sched.cycle - last_byte < REGCOMMIT_TIMEOUT)
+		{
+			sim_session_step(session);
+
+			if (front_syncing(session))
+				seen = 1;
+			else if (seen)
+				break;
+		}
+
+		if (!seen || front_syncing(session))
+		{
+			rc->stuck++;
+			continue;
+		}
+
+		long latency = session->sched.cycle - last_byte;
+
+		rc->latency += latency;
+		rc->total 	+= session->sched.cycle - first_byte;
+		rc->rounds++;
+
+		if (latency > rc->worst_latency)
+			rc->worst_latency = latency;
+	}
+
+	sim_session_free(session);
+
+	return 0;
+}
+
+int sim_regcommit_bench()
+{
+	const int n_blocks[] = {16, 64, 128, 255};
+	const int batches[]  = {1, 4, 16};
+
+	printf("Register commit benchmark: %d batches each, %.1f MHz\n\n", REGCOMMIT_ROUNDS, REGCOMMIT_CLOCK_HZ / 1e6);
+	printf("%7s %6s %14s %14s %14s %6s\n", "blocks", "batch", "updates/s", "mean latency", "worst latency", "stuck");
+
+	srand(REGCOMMIT_BENCH_SEED);
+
+	for (unsigned i = 0; i < sizeof(n_blocks) / sizeof(n_blocks[0]); i++)
+	{
+		for (unsigned j = 0; j < sizeof(batches) / sizeof(batches[0]); j++)
+		{
+			sim_regcommit rc;
+
+			if (sim_regcommit_measure(n_blocks[i], batches[j], &rc))
+				return 1;
+
+			if (!rc.rounds)
+			{
+				printf("%7d %6d %14s %14s %14s %6ld\n", n_blocks[i], batches[j], "-", "-", "-", rc.stuck);
+				continue;
+			}
+
+			double seconds = rc.total / (double)REGCOMMIT_CLOCK_HZ;
+
+			printf("%7d %6d %14.0f %14.1f %14ld %6ld\n", n_blocks[i], batches[j],
+				rc.rounds * batches[j] / seconds,
+				rc.latency / (double)rc.rounds,
+				rc.worst_latency, rc.stuck);
+		}
+	}
+
+	return 0;
+}
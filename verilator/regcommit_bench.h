@@ -0,0 +1,34 @@
+#ifndef DSP_SIM_REGCOMMIT_BENCH_H_
+#define DSP_SIM_REGCOMMIT_BENCH_H_
+
+// sys_clk, for turning cycles into rates
+#define REGCOMMIT_CLOCK_HZ 		112500000
+
+// Batches of updates timed for each program length and batch size
+#define REGCOMMIT_ROUNDS 		16
+
+// Cycles a commit is given to be done in before it's counted as stuck
+#define REGCOMMIT_TIMEOUT 		(4 * 1280)
+
+typedef struct {
+	int n_blocks;
+	int batch;
+
+	long rounds;
+	long stuck;
+
+	// sys_clk cycles from the commit's last byte going out to the front
+	// pipeline's regfiles no longer syncing, and from the batch's first
+	// byte to the same
+	long latency;
+	long worst_latency;
+	long total;
+} sim_regcommit;
+
+// Updates to `batch' blocks of a program `n_blocks' long, each batch
+// followed by COMMIT_REG_UPDATES, timed on an engine of its own
+int sim_regcommit_measure(int n_blocks, int batch, sim_regcommit *rc);
+
+int sim_regcommit_bench();
+
+#endif
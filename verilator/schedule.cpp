@@ -0,0 +1,471 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "schedule.h"
+
+/*
+ * Instruction scheduling for uploaded programs.
+ *
+ * Effects come out of the compiler as straight-line chains, each block
+ * reading what the one before it wrote, so the core spends most of a
+ * pass with an operand fetch substage held on the scoreboard. Blocks
+ * that don't depend on each other can go in any order, and filling
+ * those waits with them is free time.
+ *
+ * The blocks are put into a dependency graph over the channels, the
+ * accumulator, and each delay buffer and memory word: a block goes after
+ * any block whose result it reads, and after any that reads or writes
+ * what it writes. List scheduling then issues a block a cycle, taking
+ * whichever ready block has the longest chain of latencies still behind
+ * it, from the branch latencies the cycle estimate uses.
+ *
+ * A reordering is only kept if the estimate says it is faster, and the
+ * two programs can be checked to compute the same thing by numbering the
+ * values each one produces: two values are the same if they come from
+ * the same operation on the same values, so if every channel and every
+ * buffer ends a pass holding the same value in both, the programs can't
+ * be told apart, whatever the operations do.
+ *
+ * The numbering only knows which operations are the same, not what they
+ * do, so an upload is also run through the emulator both ways, on the
+ * same noise, and the scheduled one is only sent if every sample comes
+ * out the same. Anything sent afterwards that's addressed to a block by
+ * number has to be renumbered to match, from the order it was given.
+ */
+
+void sim_cells_of(const sim_decoded_instr *instr, sim_block_cells *cells)
+{
+	cells->n_reads = 0;
+	cells->writes = -1;
+
+	for (int k = 0; k < 3; k++)
+	{
+		if (instr->arg_needed[k] && !instr->src_reg[k])
+			cells->reads[cells->n_reads++] = SIM_CELL_CHANNEL(instr->src[k]);
+	}
+
+	if (instr->reads_acc)
+		cells->reads[cells->n_reads++] = SIM_CELL_ACC;
+
+	// A delay read moves nothing, but a write moves the buffer on
+	if (instr->branch == HW_BRANCH_DELAY)
+		cells->reads[cells->n_reads++] = SIM_CELL_DELAY(instr->res_addr);
+	else if (instr->operation == HW_INSTR_MEM_READ)
+		cells->reads[cells->n_reads++] = SIM_CELL_MEM(instr->res_addr);
+
+	if (instr->writes_acc)
+		cells->writes = SIM_CELL_ACC;
+	else if (instr->operation == HW_INSTR_DELAY_WRITE)
+		cells->writes = SIM_CELL_DELAY(instr->res_addr);
+	else if (instr->operation == HW_INSTR_MEM_WRITE)
+		cells->writes = SIM_CELL_MEM(instr->res_addr);
+	else if (instr->writes_channel)
+		cells->writes = SIM_CELL_CHANNEL(instr->dest);
+}
+
+static int max2(int a, int b)
+{
+	return (a > b) ? a : b;
+}
+
+int sim_schedule_program(sim_program_image *out, int *order, const sim_program_image *in,
+	const sim_cycle_params *params, sim_schedule_report *report)
+{
+	if (!out || !order || !in || !params)
+		return 1;
+
+	int n = in->n_blocks;
+
+	sim_decoded_instr instrs[PATCH_MAX_BLOCKS];
+	sim_block_cells cells[PATCH_MAX_BLOCKS];
+
+	// Latency from each block to each block that has to follow it
+	std::vector<int> edges((size_t)n * n, -1);
+	auto edge = [&](int from, int to) -> int & { return edges[from * n + to]; };
+
+	int n_preds[PATCH_MAX_BLOCKS];
+	int latency[PATCH_MAX_BLOCKS];
+	int height[PATCH_MAX_BLOCKS];
+	int earliest[PATCH_MAX_BLOCKS];
+	int done[PATCH_MAX_BLOCKS];
+
+	int last_writer[SIM_N_CELLS];
+	std::vector<int> readers[SIM_N_CELLS];
+
+	for (int c = 0; c < SIM_N_CELLS; c++)
+		last_writer[c] = -1;
+
+	for (int i = 0; i < n; i++)
+	{
+		sim_decode_instr(in->instrs[i], &instrs[i]);
+		sim_cells_of(&instrs[i], &cells[i]);
+
+		latency[i] = sim_branch_latency(params, &instrs[i]) + params->commit_latency;
+		n_preds[i] = 0;
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		for (int r = 0; r < cells[i].n_reads; r++)
+		{
+			int c = cells[i].reads[r];
+			int w = last_writer[c];
+
+			if (w >= 0)
+			{
+				// The MAC branch keeps its running sum to itself, so only
+				// moving the accumulator out has to wait for it
+				int wait = (c == SIM_CELL_ACC && !instrs[i].accumulator_needed) ? 1 : latency[w];
+
+				edge(w, i) = max2(edge(w, i), wait);
+			}
+
+			readers[c].push_back(i);
+		}
+
+		int c = cells[i].writes;
+
+		if (c < 0)
+			continue;
+
+		// In order behind the last write and every read since
+		if (last_writer[c] >= 0)
+			edge(last_writer[c], i) = max2(edge(last_writer[c], i), 1);
+
+		for (int j : readers[c])
+		{
+			if (j != i)
+				edge(j, i) = max2(edge(j, i), 1);
+		}
+
+		readers[c].clear();
+		last_writer[c] = i;
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < i; j++)
+		{
+			if (edge(j, i) >= 0)
+				n_preds[i]++;
+		}
+	}
+
+	// Longest path to the end of the pass, for priority
+	for (int i = n - 1; i >= 0; i--)
+	{
+		height[i] = latency[i];
+
+		for (int j = i + 1; j < n; j++)
+		{
+			if (edge(i, j) >= 0)
+				height[i] = max2(height[i], edge(i, j) + height[j]);
+		}
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		earliest[i] = 0;
+		done[i] = 0;
+	}
+
+	int cycle = 0;
+
+	for (int slot = 0; slot < n; slot++)
+	{
+		int pick = -1;
+
+		// The ready block with the most behind it; failing that, the
+		// one that will be ready soonest. Ties go to program order
+		for (int i = 0; i < n; i++)
+		{
+			if (done[i] || n_preds[i])
+				continue;
+
+			if (pick < 0)
+			{
+				pick = i;
+				continue;
+			}
+
+			int ready_i = earliest[i] <= cycle;
+			int ready_p = earliest[pick] <= cycle;
+
+			if (ready_i != ready_p)
+			{
+				if (ready_i)
+					pick = i;
+			}
+			else if (!ready_i && earliest[i] != earliest[pick])
+			{
+				if (earliest[i] < earliest[pick])
+					pick = i;
+			}
+			else if (height[i] > height[pick])
+			{
+				pick = i;
+			}
+		}
+
+		cycle = max2(cycle, earliest[pick]);
+
+		order[slot] = pick;
+		done[pick] = 1;
+
+		for (int j = pick + 1; j < n; j++)
+		{
+			if (edge(pick, j) < 0)
+				continue;
+
+			n_preds[j]--;
+			earliest[j] = max2(earliest[j], cycle + edge(pick, j));
+		}
+
+		cycle++;
+	}
+
+	sim_program_image scheduled = *in;
+
+	for (int i = 0; i < n; i++)
+	{
+		scheduled.instrs[i] = in->instrs[order[i]];
+		scheduled.regs[i][0] = in->regs[order[i]][0];
+		scheduled.regs[i][1] = in->regs[order[i]][1];
+	}
+
+	sim_cycle_estimate before;
+	sim_cycle_estimate after;
+
+	sim_estimate_cycles(in, params, &before);
+	sim_estimate_cycles(&scheduled, params, &after);
+
+	int keep = after.pass_cycles < before.pass_cycles;
+
+	if (keep)
+	{
+		*out = scheduled;
+	}
+	else
+	{
+		*out = *in;
+
+		for (int i = 0; i < n; i++)
+			order[i] = i;
+	}
+
+	if (report)
+	{
+		report->cycles_before = before.pass_cycles;
+		report->cycles_after  = keep ? after.pass_cycles : before.pass_cycles;
+		report->blocks_moved  = 0;
+
+		for (int i = 0; i < n; i++)
+		{
+			if (order[i] != i)
+				report->blocks_moved++;
+		}
+
+		report->equivalent = sim_schedule_equivalent(in, out);
+	}
+
+	return 0;
+}
+
+uint32_t sim_value_number(sim_value_table *table, const std::vector<uint32_t> &key)
+{
+	auto found = table->find(key);
+
+	if (found != table->end())
+		return found->second;
+
+	uint32_t number = table->size();
+	(*table)[key] = number;
+
+	return number;
+}
+
+void sim_number_init(sim_value_table *table, std::vector<uint32_t> *state, uint32_t tag)
+{
+	state->resize(SIM_N_CELLS);
+
+	for (int c = 0; c < SIM_N_CELLS; c++)
+		(*state)[c] = sim_value_number(table, {0xFFFFFFFF, tag, (uint32_t)c});
+}
+
+void sim_number_pass(sim_value_table *table, const sim_program_image *image, std::vector<uint32_t> *state)
+{
+	for (int i = 0; i < image->n_blocks; i++)
+	{
+		sim_decoded_instr instr;
+		sim_block_cells cells;
+
+		sim_decode_instr(image->instrs[i], &instr);
+		sim_cells_of(&instr, &cells);
+
+		if (cells.writes < 0)
+			continue;
+
+		// Memory hands back what it was given, and a shift by nothing
+		// is a copy
+		if (instr.operation == HW_INSTR_MEM_READ
+			|| (instr.operation == HW_INSTR_MEM_WRITE && !instr.src_reg[0])
+			|| (instr.operation == HW_INSTR_LSH && !instr.src_reg[0] && !((image->instrs[i] >> 25) & 0x1F)))
+		{
+			int from = (instr.operation == HW_INSTR_MEM_READ) ? SIM_CELL_MEM(instr.res_addr) : SIM_CELL_CHANNEL(instr.src[0]);
+
+			(*state)[cells.writes] = (*state)[from];
+			continue;
+		}
+
+		// What the block does, less where it finds its operands and
+		// where it puts its result, plus the values it works on
+		uint32_t word = image->instrs[i];
+
+		static const int src_shift[3] = {6, 11, 16};
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (instr.arg_needed[k] && !instr.src_reg[k])
+				word &= ~(0xFu << src_shift[k]);
+		}
+
+		if (instr.writes_channel)
+			word &= (image->instrs[i] & (1 << 5)) ? ~(0xFu << 16) : ~(0xFu << 21);
+
+		std::vector<uint32_t> key = {word, image->regs[i][0], image->regs[i][1]};
+
+		for (int r = 0; r < cells.n_reads; r++)
+			key.push_back((*state)[cells.reads[r]]);
+
+		(*state)[cells.writes] = sim_value_number(table, key);
+	}
+}
+
+int sim_schedule_equivalent(const sim_program_image *a, const sim_program_image *b)
+{
+	if (!a || !b)
+		return 0;
+
+	sim_value_table table;
+	std::vector<uint32_t> state_a;
+	std::vector<uint32_t> state_b;
+
+	sim_number_init(&table, &state_a, 0);
+	sim_number_init(&table, &state_b, 0);
+
+	sim_number_pass(&table, a, &state_a);
+	sim_number_pass(&table, b, &state_b);
+
+	return state_a == state_b;
+}
+
+// Only for batches that do nothing but upload
+int sim_schedule_batch(m_fpga_transfer_batch *batch, int *order, const sim_cycle_params *params, sim_schedule_report *report)
+{
+	sim_program_image image;
+	sim_program_image scheduled;
+	sim_schedule_report local;
+
+	if (!batch || !order || !params)
+		return 1;
+
+	if (!report)
+		report = &local;
+
+	for (int i = 0; i < PATCH_MAX_BLOCKS; i++)
+		order[i] = i;
+
+	report->emulated_mismatch = -1;
+
+	memset(&image, 0, sizeof(image));
+
+	if (sim_program_image_from_batch(&image, *batch))
+		return 2;
+
+	sim_schedule_program(&scheduled, order, &image, params, report);
+
+	if (!report->equivalent)
+		return 3;
+
+	if (!report->blocks_moved)
+		return 0;
+
+	m_fpga_transfer_batch scheduled_batch = m_new_fpga_transfer_batch();
+	sim_encode_program(&scheduled_batch, &scheduled);
+
+	report->emulated_mismatch = sim_schedule_emulate(*batch, scheduled_batch, SCHEDULE_CHECK_SAMPLES);
+
+	if (report->emulated_mismatch >= 0)
+	{
+		free(scheduled_batch.buf);
+
+		for (int i = 0; i < PATCH_MAX_BLOCKS; i++)
+			order[i] = i;
+
+		return 4;
+	}
+
+	free(batch->buf);
+	*batch = scheduled_batch;
+
+	return 0;
+}
+
+int sim_schedule_emulate(m_fpga_transfer_batch a, m_fpga_transfer_batch b, int n)
+{
+	sim_engine *engine_a = new_sim_engine();
+	sim_engine *engine_b = new_sim_engine();
+	uint32_t noise = 1;
+	int mismatch = -1;
+
+	sim_handle_transfer_batch(engine_a, a);
+	sim_handle_transfer_batch(engine_b, b);
+
+	for (int i = 0; i < n && mismatch < 0; i++)
+	{
+		noise = noise * 1664525 + 1013904223;
+
+		int16_t x = (int16_t)(noise >> 16);
+
+		if (sim_process_sample(engine_a, x) != sim_process_sample(engine_b, x))
+			mismatch = i;
+	}
+
+	// The delay buffers go with them; libM has nothing to free those with
+	free(engine_a);
+	free(engine_b);
+
+	return mismatch;
+}
+
+int sim_schedule_remap_batch(m_fpga_transfer_batch *batch, const int *order)
+{
+	int where[PATCH_MAX_BLOCKS];
+
+	if (!batch || !order)
+		return 1;
+
+	for (int i = 0; i < PATCH_MAX_BLOCKS; i++)
+		where[order[i]] = i;
+
+	int i = 0;
+
+	while (i < batch->len)
+	{
+		uint8_t command = batch->buf[i];
+		int n_args = sim_command_arg_bytes(command);
+
+		if (n_args < 0 || i + 1 + n_args > batch->len)
+			return 1;
+
+		if (sim_command_addresses_block(command))
+			batch->buf[i + 1] = where[batch->buf[i + 1]];
+
+		i += 1 + n_args;
+	}
+
+	return 0;
+}
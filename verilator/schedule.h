@@ -0,0 +1,73 @@
+#ifndef DSP_SIM_SCHEDULE_H_
+#define DSP_SIM_SCHEDULE_H_
+
+// State a block can read or write, numbered for the dependency graph
+#define SIM_CELL_CHANNEL(c) 	(c)
+#define SIM_CELL_ACC 			16
+#define SIM_CELL_DELAY(h) 		(17 + (h))
+#define SIM_CELL_MEM(a) 		(17 + 256 + (a))
+#define SIM_N_CELLS 			(17 + 256 + 256)
+
+typedef struct {
+	int reads[5];
+	int n_reads;
+	int writes;
+} sim_block_cells;
+
+typedef std::map<std::vector<uint32_t>, uint32_t> sim_value_table;
+
+// Samples of noise a scheduled batch and the batch it came from are run
+// on in the emulator, and have to come out of it the same, bit for bit
+#define SCHEDULE_CHECK_SAMPLES 	16384
+
+typedef struct {
+	int cycles_before;
+	int cycles_after;
+	int blocks_moved;
+	int equivalent;
+
+	// Samples into the emulator check the two batches first differ at;
+	// -1 if they never do
+	int emulated_mismatch;
+} sim_schedule_report;
+
+// Reorder the blocks of a program so independent work fills the time
+// spent waiting on results. Block i of `out' is block order[i] of `in';
+// register updates addressed to the old blocks must go through it. If
+// the reordering doesn't come out faster, `out' is `in' as it was
+int sim_schedule_program(sim_program_image *out, int *order, const sim_program_image *in,
+	const sim_cycle_params *params, sim_schedule_report *report);
+
+// Whether two programs compute the same thing: every channel, the
+// accumulator and every delay buffer and memory word come out of a pass
+// as the same function of what went in
+int sim_schedule_equivalent(const sim_program_image *a, const sim_program_image *b);
+
+void sim_cells_of(const sim_decoded_instr *instr, sim_block_cells *cells);
+
+// Value numbering: two values get the same number if they come from the
+// same operation on the same values
+uint32_t sim_value_number(sim_value_table *table, const std::vector<uint32_t> &key);
+
+// Give every cell a number of its own, distinct for each tag
+void sim_number_init(sim_value_table *table, std::vector<uint32_t> *state, uint32_t tag);
+
+// Run a pass symbolically, leaving in `state' the number each cell holds
+void sim_number_pass(sim_value_table *table, const sim_program_image *image, std::vector<uint32_t> *state);
+
+// Schedule the program a batch uploads, and swap the batch for an upload
+// of the scheduled one if it checks equivalent and runs the same in the
+// emulator. Block i of the new program is block order[i] of the old, for
+// all PATCH_MAX_BLOCKS; 0 if the batch was scheduled or left as it was,
+// 2 if it can't be read, 3 or 4 if it failed the check or the emulator
+int sim_schedule_batch(m_fpga_transfer_batch *batch, int *order, const sim_cycle_params *params, sim_schedule_report *report);
+
+// Run two batches through an emulator each, on the same noise, and find
+// the first of `n' samples they differ at; -1 if none
+int sim_schedule_emulate(m_fpga_transfer_batch a, m_fpga_transfer_batch b, int n);
+
+// Renumber the blocks a batch addresses, written for the program before
+// it was scheduled, to where `order' put them. Nonzero if it can't be read
+int sim_schedule_remap_batch(m_fpga_transfer_batch *batch, const int *order);
+
+#endif
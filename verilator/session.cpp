@@ -0,0 +1,272 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "sim_main.h"
+#include "session.h"
+#include "Vtop___024root.h"
+
+m_effect_desc *m_read_eff_desc_from_file(char *fname);
+
+/*
+ * The engine as something to call, rather than a process to run.
+ *
+ * A session holds everything the harness otherwise keeps in globals:
+ * the model, in a VerilatedContext of its own, the I2S and SPI state,
+ * and a scheduler with the same SPI driver the main harness sends its
+ * queue with, so batches go in as they do there, each once the
+ * controller is idle, and the controller's FIFO never backs up behind
+ * a swap. It's clocked only from inside its own calls: step runs the
+ * scheduler a cycle, and process a frame at a time, putting a sample in
+ * each frame and taking out what the last one left.
+ *
+ * Nothing here writes files or reads the command line; the waveform and
+ * transaction log stay with the main harness.
+ */
+
+static int spi_idle(const sim_session *session)
+{
+	return !session->io.spi_sending && session->io.spi_read_head == session->io.spi_write_head;
+}
+
+int sim_session_step(sim_session *session)
+{
+	long frame = session->sched.frame;
+
+	sim_scheduler_run(&session->sched, 1);
+
+	// The sample that goes out is left for the caller to take
+	return session->sched.frame != frame;
+}
+
+static int current_pipeline(const sim_session *session)
+{
+	return session->top->rootp->top__DOT__engine__DOT__controller__DOT__current_pipeline;
+}
+
+static int engine_mode(const sim_session *session)
+{
+	return session->top->rootp->top__DOT__engine__DOT__controller__DOT__engine_mode;
+}
+
+static void run_frame(sim_session *session)
+{
+	while (!sim_session_step(session));
+}
+
+sim_session *sim_session_new(int seed)
+{
+	sim_session *session = new sim_session();
+
+	session->context = new VerilatedContext;
+	session->context->randReset(2);
+	session->context->randSeed(seed);
+
+	session->top = new Vtop(session->context);
+
+	sim_io_init(&session->io);
+
+	sim_scheduler_init(&session->sched, session->top, &session->io);
+	sim_spi_queue_init(&session->queue);
+
+	sim_scheduler_spawn(&session->sched, sim_agent_spi_driver(&session->sched, &session->queue));
+
+	// Out of reset once the front pipeline's cleared and enabled
+	for (int i = 0; !session->top->led1; i++)
+	{
+		if (i == SESSION_RESET_FRAMES)
+		{
+			sim_session_free(session);
+			return NULL;
+		}
+
+		run_frame(session);
+	}
+
+	return session;
+}
+
+void sim_session_free(sim_session *session)
+{
+	if (!session)
+		return;
+
+	sim_scheduler_free(&session->sched);
+	sim_spi_queue_free(&session->queue);
+
+	session->top->final();
+
+	delete session->top;
+	delete session->context;
+	delete session;
+}
+
+int sim_session_send_command(sim_session *session, const uint8_t *bytes, int n)
+{
+	if (!session || session->queue.count == AGENTS_MAX_BATCHES)
+		return 1;
+
+	if (n <= 0)
+		return 0;
+
+	m_fpga_transfer_batch batch = m_new_fpga_transfer_batch();
+
+	for (int i = 0; i < n; i++)
+		m_fpga_batch_append(&batch, bytes[i]);
+
+	return sim_spi_queue_put(&session->sched, &session->queue, batch);
+}
+
+int sim_session_idle(const sim_session *session)
+{
+	const sim_spi_queue *queue = &session->queue;
+
+	return !queue->count && !queue->sending && !queue->settling && spi_idle(session) && session->top->led1;
+}
+
+int sim_session_load_program(sim_session *session, m_fpga_transfer_batch batch)
+{
+	if (sim_session_send_command(session, batch.buf, batch.len))
+		return SESSION_LOAD_TIMED_OUT;
+
+	int pipeline = current_pipeline(session);
+	int mode = engine_mode(session);
+
+	for (int i = 0; i < SESSION_LOAD_FRAMES; i++)
+	{
+		session->io.sample_in 	= 0;
+		session->io.sample_in_r = 0;
+
+		run_frame(session);
+
+		if (!sim_session_idle(session))
+			continue;
+
+		// A program swaps the pipelines; a split segment stays in the
+		// back one, and the engine leaves swap mode for it. Either is
+		// undone if it's turned down
+		if (current_pipeline(session) != pipeline)
+			return SESSION_LOAD_SWAPPED;
+
+		if (mode == ENGINE_MODE_SWAP && engine_mode(session) != ENGINE_MODE_SWAP)
+			return SESSION_LOAD_SWAPPED;
+
+		return SESSION_LOAD_REJECTED;
+	}
+
+	return SESSION_LOAD_TIMED_OUT;
+}
+
+void sim_session_process(sim_session *session, const int16_t *in, int16_t *out, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		run_frame(session);
+
+		if (out)
+			out[i] = session->io.sample_out;
+
+		session->io.sample_in 	= in[i];
+		session->io.sample_in_r = in[i];
+	}
+}
+
+int sim_session_effect_batch(const char *path, m_fpga_transfer_batch *batch)
+{
+	m_effect_desc *desc = m_read_eff_desc_from_file((char*)path);
+	m_eff_resource_report res;
+	m_transformer trans;
+	int pos = 0;
+
+	if (!desc)
+		return 1;
+
+	// libM has nothing to free either of these with, so they're left
+	// behind: a desc and a transformer per call
+	init_transformer_from_effect_desc(&trans, desc);
+
+	res.memory = 0;
+	res.delays = 0;
+
+	*batch = m_new_fpga_transfer_batch();
+
+	m_fpga_batch_append(batch, COMMAND_BEGIN_PROGRAM);
+	m_fpga_batch_append_transformer(batch, &trans, &res, &pos);
+	m_fpga_batch_append(batch, COMMAND_END_PROGRAM);
+
+	return 0;
+}
+
+/*********/
+/* Bench */
+/*********/
+
+#define SESSION_BENCH_FRAMES 	44100
+#define SESSION_BENCH_BLOCK 	64
+
+int sim_session_bench()
+{
+	static const char *paths[2] = {"eff/lpf.eff", "eff/del.eff"};
+	static const char *outcomes[] = {"swapped in", "rejected", "timed out"};
+
+	sim_session *sessions[2];
+	int16_t in[SESSION_BENCH_BLOCK];
+	int16_t out[SESSION_BENCH_BLOCK];
+	int peak[2] = {0, 0};
+	double seconds[2] = {0, 0};
+
+	for (int s = 0; s < 2; s++)
+	{
+		m_fpga_transfer_batch batch;
+
+		sessions[s] = sim_session_new(s + 1);
+
+		if (!sessions[s] || sim_session_effect_batch(paths[s], &batch))
+		{
+			fprintf(stderr, "Session bench: can't start a session on %s\n", paths[s]);
+
+			for (int i = 0; i <= s; i++)
+				sim_session_free(sessions[i]);
+
+			return 1;
+		}
+
+		int outcome = sim_session_load_program(sessions[s], batch);
+		free(batch.buf);
+
+		printf("Session %d: %s %s after %ld frames\n", s, paths[s], outcomes[outcome], sessions[s]->sched.frame);
+	}
+
+	// Interleaved a block at a time, as a host juggling two would
+	for (int done = 0; done < SESSION_BENCH_FRAMES; done += SESSION_BENCH_BLOCK)
+	{
+		for (int i = 0; i < SESSION_BENCH_BLOCK; i++)
+			in[i] = (int16_t)(sinf(6.28f * 1500.0f * (done + i) / 44100.0f) * 16383.0f);
+
+		for (int s = 0; s < 2; s++)
+		{
+			auto start = std::chrono::steady_clock::now();
+
+			sim_session_process(sessions[s], in, out, SESSION_BENCH_BLOCK);
+
+			seconds[s] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			for (int i = 0; i < SESSION_BENCH_BLOCK; i++)
+				peak[s] = (abs(out[i]) > peak[s]) ? abs(out[i]) : peak[s];
+		}
+	}
+
+	double audio = (double)SESSION_BENCH_FRAMES / sim_io_sample_rate(&sessions[0]->io);
+
+	for (int s = 0; s < 2; s++)
+	{
+		printf("Session %d: %d frames in blocks of %d, %.2fs for %.2fs of audio (%.3fx real time), output peak %d\n",
+			s, SESSION_BENCH_FRAMES, SESSION_BENCH_BLOCK, seconds[s], audio, audio / seconds[s], peak[s]);
+
+		sim_session_free(sessions[s]);
+	}
+
+	return 0;
+}
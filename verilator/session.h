@@ -0,0 +1,63 @@
+#ifndef DSP_SIM_SESSION_H_
+#define DSP_SIM_SESSION_H_
+
+// Frames load_program waits for a program to be swapped in or turned
+// down; warmup alone is some 255
+#define SESSION_LOAD_FRAMES 	4096
+
+// Frames new waits for the engine to come out of reset
+#define SESSION_RESET_FRAMES 	4096
+
+#define SESSION_LOAD_SWAPPED 	0
+#define SESSION_LOAD_REJECTED 	1
+#define SESSION_LOAD_TIMED_OUT 	2
+
+// An engine of its own: a Vtop in a context of its own, its I2S and SPI,
+// and a scheduler of its own to clock it, with the SPI driver the main
+// harness sends with as its one agent. Sessions don't share anything,
+// so any number can run in one process, each on one thread at a time
+typedef struct {
+	VerilatedContext *context;
+	Vtop *top;
+
+	sim_io_state io;
+
+	// Frames and cycles run so far are sched.frame and sched.cycle
+	sim_scheduler sched;
+	sim_spi_queue queue;
+} sim_session;
+
+// Start an engine and run it until its controller is ready. `seed' is
+// what the X bits start as. NULL if it doesn't come out of reset
+sim_session *sim_session_new(int seed);
+void sim_session_free(sim_session *session);
+
+// Queue bytes to send, copied; they go in as process is called.
+// Nonzero if the queue is full
+int sim_session_send_command(sim_session *session, const uint8_t *bytes, int n);
+
+// Send a program and run on silence until it's been swapped in, or put
+// in the back pipeline as a split segment, or turned down; one of
+// SESSION_LOAD_*
+int sim_session_load_program(sim_session *session, m_fpga_transfer_batch batch);
+
+// Run n frames: a sample in for each and what came out of the frame
+// before. `out' may be NULL
+void sim_session_process(sim_session *session, const int16_t *in, int16_t *out, size_t n);
+
+// One sys_clk cycle, for callers timing something finer than a frame.
+// Nonzero if it ended a frame; the inputs stay as the last frame left them
+int sim_session_step(sim_session *session);
+
+// Whether everything queued has gone in and been dealt with
+int sim_session_idle(const sim_session *session);
+
+// A program of the one effect in `path', for load_program. Nonzero if it
+// can't be read
+int sim_session_effect_batch(const char *path, m_fpga_transfer_batch *batch);
+
+// Two sessions side by side, each on a chain of its own, processed in
+// blocks, and how close to real time each one ran
+int sim_session_bench();
+
+#endif
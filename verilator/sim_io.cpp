@@ -56,12 +56,17 @@ void sim_io_init(sim_io_state *io)
 	
 	io->sample_bit_ctr = 0;
 	
-	io->sample_out_sr = 0;
+	io->sample_out_sr 	= 0;
+	io->sample_out_sr_r = 0;
+	io->i2s_slot 		= 0;
 	
 	io->cs  = 1;
 	io->sck = 1;
 	
 	io->spi_sending 	= 0;
+	io->miso_sr 		= 0;
+	io->miso_byte 		= 0;
+	io->miso_valid 		= 0;
 	io->sys_clk_prev 	= 0;
 	io->mclk_prev 		= 0;
 	io->bclk_prev 		= 0;
@@ -69,9 +74,23 @@ void sim_io_init(sim_io_state *io)
 	
 	io->i2s_ready = 1;
 	io->i2s_skip = 1;
+	
+	io->cycles 			 = 0;
+	io->frame_started_at = 0;
+	io->frame_cycles 	 = SIM_IO_BASE_FRAME;
+}
+
+double sim_io_sample_rate(const sim_io_state *io)
+{
+	return SIM_IO_BASE_RATE * SIM_IO_BASE_FRAME / io->frame_cycles;
 }
 
 int sim_io_update(sim_io_state *io)
+{
+	return sim_io_drive(io, dut);
+}
+
+int sim_io_drive(sim_io_state *io, Vtop *dut)
 {
 	if (!dut || !io)
 		return 1;
@@ -82,6 +101,8 @@ int sim_io_update(sim_io_state *io)
 	
 	if (dut->sys_clk)
 	{
+		io->cycles++;
+		
 		if (io->spi_sending)
 		{
 			if (io->sck_counter == (SCK_RATE - 1) / 2)
@@ -100,8 +121,14 @@ int sim_io_update(sim_io_state *io)
 				
 				if (!io->sck)
 				{
+					// Each bit is out a half period after the edge it was sampled on
+					io->miso_sr = (io->miso_sr << 1) | !!dut->miso;
+					
 					if (io->spi_bit == 8)
 					{
+						io->miso_byte  = io->miso_sr;
+						io->miso_valid = 1;
+						
 						io->spi_sending = 0;
 						io->spi_bit = 0;
 						io->cs = 1;
@@ -137,24 +164,41 @@ int sim_io_update(sim_io_state *io)
 		}
 		else if (io->i2s_bit < 16)
 		{
-			io->sample_out_sr = (io->sample_out_sr << 1) + !!dut->i2s_dout;
+			if (io->i2s_slot)
+				io->sample_out_sr_r = (io->sample_out_sr_r << 1) + !!dut->i2s_dout;
+			else
+				io->sample_out_sr = (io->sample_out_sr << 1) + !!dut->i2s_dout;
 			io->i2s_bit++;
 		}
 	}
 	else if (bclk_edge == -1)
 	{
-		if (lrclk_edge == 1)
+		if (lrclk_edge == -1)
 		{
 			io->i2s_ready = 1;
-			io->sample_out = (int16_t)io->sample_out_sr;
+			
+			if (io->frame_started_at)
+				io->frame_cycles = io->cycles - io->frame_started_at;
+			io->frame_started_at = io->cycles;
+			
+			io->sample_out 	 = (int16_t)io->sample_out_sr;
+			io->sample_out_r = (int16_t)io->sample_out_sr_r;
+			io->i2s_bit = 0;
+			io->i2s_skip = 1;
+			io->i2s_slot = 0;
+		}
+		else if (lrclk_edge == 1)
+		{
 			io->i2s_bit = 0;
 			io->i2s_skip = 1;
+			io->i2s_slot = 1;
 		}
 		else 
 		{
 			if (io->i2s_bit < 16)
 			{
-				io->i2s_din = !!(io->sample_in & (1 << (15 - io->i2s_bit)));
+				int16_t sample = io->i2s_slot ? io->sample_in_r : io->sample_in;
+				io->i2s_din = !!(sample & (1 << (15 - io->i2s_bit)));
 			}
 			else
 			{
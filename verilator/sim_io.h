@@ -4,6 +4,11 @@
 #define SPI_SEND_QUEUE_DEPTH 	1024
 #define SCK_RATE				10
 
+// The frame the sample rates are scaled from: 44.1kHz is 1280 sys_clk
+// cycles, as the I2S clocks in top.v have it
+#define SIM_IO_BASE_RATE 		44100.0
+#define SIM_IO_BASE_FRAME 		1280
+
 typedef struct {
 	int sys_clk_prev;
 
@@ -15,6 +20,12 @@ typedef struct {
 	int spi_bit;
 	uint8_t spi_byte;
 	
+	// What came back on MISO; miso_valid is set as each byte completes,
+	// for whoever's reading them to clear
+	uint8_t miso_sr;
+	uint8_t miso_byte;
+	int miso_valid;
+	
 	int i2s_din;
 	int i2s_dou;
 	
@@ -26,7 +37,22 @@ typedef struct {
 	int16_t sample_in;
 	int16_t sample_out;
 	
+	// The right channel, in the lrclk-high slot. Without SIM_STEREO it
+	// goes out as a copy of the left and what comes back is ignored
+	int16_t sample_in_r;
+	int16_t sample_out_r;
+	
 	uint16_t sample_out_sr;
+	uint16_t sample_out_sr_r;
+	
+	// 0 in the lrclk-low (left) slot, 1 in the high (right)
+	int i2s_slot;
+	
+	// sys_clk cycles from the last lrclk fall to the one before, so
+	// whatever rate the engine has been set to
+	long cycles;
+	long frame_started_at;
+	int frame_cycles;
 	
 	int i2s_ready;
 	int i2s_bit;
@@ -50,6 +76,12 @@ int io_update(sim_io_state *io);
 
 int sim_io_update(sim_io_state *io);
 
+// The same, for a Vtop other than the global one
+int sim_io_drive(sim_io_state *io, Vtop *dut);
+
+// The sample rate the last frame went at
+double sim_io_sample_rate(const sim_io_state *io);
+
 int spi_send(uint8_t byte);
 
 extern sim_io_state io;
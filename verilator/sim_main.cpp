@@ -1,6 +1,17 @@
 #include <time.h>
+#include <dirent.h>
 #include "sim_main.h"
 
+#if defined(SIM_FETCH_COUNTERS) || defined(SIM_CYCLE_ESTIMATE) || defined(SIM_TXLOG) || defined(SIM_STEREO_BENCH) || defined(SIM_RATE_SWEEP)
+#include "Vtop___024root.h"
+#endif
+
+// The batch cache stands in for building the test chain, unless
+// something needs the effects themselves
+#if defined(SIM_BATCH_CACHE) && !defined(SIM_PATCH_TEST) && !defined(SIM_LINK) && !defined(SIM_SCHEDULE) && !defined(SIM_PROFILE)
+#define USE_BATCH_CACHE
+#endif
+
 int samples_processed = 0;
 
 m_effect_desc *m_read_eff_desc_from_file(char *fname);
@@ -25,9 +36,11 @@ struct WavHeader {
 };
 #pragma pack(pop)
 
-static bool read_wav16_mono(const char* path,
-                            WavHeader& header,
-                            std::vector<int16_t>& samples)
+// Mono or stereo; a mono file gives the same samples on both sides
+static bool read_wav16(const char* path,
+                       WavHeader& header,
+                       std::vector<int16_t>& samples,
+                       std::vector<int16_t>& samples_r)
 {
     std::ifstream f(path, std::ios::binary);
     if (!f) return false;
@@ -39,24 +52,37 @@ static bool read_wav16_mono(const char* path,
         std::strncmp(header.wave, "WAVE", 4) != 0 ||
         header.audio_format != 1 ||
         header.bits_per_sample != 16 ||
-        header.num_channels != 1) {
+        (header.num_channels != 1 && header.num_channels != 2)) {
         std::cerr << "Unsupported WAV format\n";
         return false;
     }
 
-    size_t n = header.data_size / sizeof(int16_t);
+    std::vector<int16_t> interleaved(header.data_size / sizeof(int16_t));
+    f.read(reinterpret_cast<char*>(interleaved.data()), header.data_size);
+
+    size_t n = interleaved.size() / header.num_channels;
     samples.resize(n);
-    f.read(reinterpret_cast<char*>(samples.data()), header.data_size);
+    samples_r.resize(n);
+
+    for (size_t i = 0; i < n; i++) {
+        samples[i]   = interleaved[i * header.num_channels];
+        samples_r[i] = interleaved[i * header.num_channels + header.num_channels - 1];
+    }
+
     return true;
 }
 
-static bool write_wav16_mono(const char* path,
-                             uint32_t sample_rate,
-                             const std::vector<int16_t>& samples)
+// Stereo if given the right channel too
+static bool write_wav16(const char* path,
+                        uint32_t sample_rate,
+                        const std::vector<int16_t>& samples,
+                        const std::vector<int16_t>* samples_r = NULL)
 {
     std::ofstream f(path, std::ios::binary);
     if (!f) return false;
 
+    int channels = samples_r ? 2 : 1;
+
     WavHeader h{};
     std::memcpy(h.riff, "RIFF", 4);
     std::memcpy(h.wave, "WAVE", 4);
@@ -65,22 +91,25 @@ static bool write_wav16_mono(const char* path,
 
     h.subchunk1_size = 16;
     h.audio_format   = 1;   // PCM
-    h.num_channels   = 1;
+    h.num_channels   = channels;
     h.sample_rate    = sample_rate;
     h.bits_per_sample = 16;
-    h.block_align     = 2;
-    h.byte_rate       = sample_rate * 2;
+    h.block_align     = 2 * channels;
+    h.byte_rate       = sample_rate * 2 * channels;
 
-    h.data_size  = samples.size() * 2;
+    h.data_size  = samples.size() * 2 * channels;
     h.chunk_size = 36 + h.data_size;
 
     f.write(reinterpret_cast<const char*>(&h), sizeof(h));
 
-    for (int16_t s : samples) {
-        uint8_t lo = s & 0xFF;
-        uint8_t hi = (s >> 8) & 0xFF;
-        f.put(lo);
-        f.put(hi);
+    for (size_t i = 0; i < samples.size(); i++) {
+        for (int c = 0; c < channels; c++) {
+            int16_t s = (c && i < samples_r->size()) ? (*samples_r)[i] : samples[i];
+            uint8_t lo = s & 0xFF;
+            uint8_t hi = (s >> 8) & 0xFF;
+            f.put(lo);
+            f.put(hi);
+        }
     }
 
     return true;
@@ -90,6 +119,10 @@ static bool write_wav16_mono(const char* path,
 VerilatedFstC* tfp = NULL;
 static uint64_t ticks = 0;
 
+#ifdef SIM_TXLOG
+static sim_txlog txlog;
+#endif
+
 void print_state()
 {
 	printf("\nSystem state: tick %d\n", (int)ticks);
@@ -112,14 +145,23 @@ void print_state()
 	printf("io.spi_byte    = 0x%04x\n", (int)io.spi_byte);
 	printf("io.sample_in   = %d\n", (int)io.sample_in);
 	printf("io.sample_out  = %d\n", (int)io.sample_out);
+	#ifdef SIM_STEREO
+	printf("io.sample_in_r = %d\n", (int)io.sample_in_r);
+	printf("io.sample_out_r= %d\n", (int)io.sample_out_r);
+	#endif
 	printf("io.i2s_bit     = %d\n", (int)io.i2s_bit);
 }
 
 typedef struct sim_spi_send {
 	m_fpga_transfer_batch batch;
 	int tick;
-	int started;
-	int position;
+	int started_at;
+	
+	// Which measured chain the batch loads, if any
+	int chain;
+	
+	// A batch still being built, to be waited for when it's due
+	sim_batch_job *job;
 	
 	struct sim_spi_send *next;
 } sim_spi_send;
@@ -134,8 +176,9 @@ int append_send_queue(m_fpga_transfer_batch batch, int when)
 	
 	new_send->batch 	= batch;
 	new_send->tick 		= when;
-	new_send->started 	= 0;
-	new_send->position 	= 0;
+	new_send->started_at = 0;
+	new_send->chain 	= -1;
+	new_send->job 		= NULL;
 	new_send->next 		= NULL;
 	
 	if (!send_queue)
@@ -155,6 +198,206 @@ int append_send_queue(m_fpga_transfer_batch batch, int when)
 	return 0;
 }
 
+#if defined(SIM_CYCLE_ESTIMATE) || defined(SIM_STEREO_BENCH)
+static sim_program_image cycle_images[CYCLE_MAX_CHAINS];
+static int cycle_measured[CYCLE_MAX_CHAINS];
+static char cycle_names[CYCLE_MAX_CHAINS][64];
+
+// Queue one program per chain in eff/, after whatever else is queued
+static int queue_cycle_chains(int when)
+{
+	DIR *dir = opendir("eff");
+	struct dirent *entry;
+	int n_chains = 0;
+	
+	if (!dir)
+		return 0;
+	
+	while ((entry = readdir(dir)) && n_chains < CYCLE_MAX_CHAINS)
+	{
+		int len = strlen(entry->d_name);
+		
+		if (len < 5 || strcmp(entry->d_name + len - 4, ".eff") != 0)
+			continue;
+		
+		char path[300];
+		snprintf(path, sizeof(path), "eff/%s", entry->d_name);
+		
+		m_effect_desc *desc = m_read_eff_desc_from_file(path);
+		
+		if (!desc)
+			continue;
+		
+		// Never freed; libM has no way to. It's once per chain, per run
+		m_transformer trans;
+		init_transformer_from_effect_desc(&trans, desc);
+		
+		m_fpga_transfer_batch batch = m_new_fpga_transfer_batch();
+		
+		m_eff_resource_report res;
+		res.memory = 0;
+		res.delays = 0;
+		int pos = 0;
+		
+		m_fpga_batch_append(&batch, COMMAND_BEGIN_PROGRAM);
+		m_fpga_batch_append_transformer(&batch, &trans, &res, &pos);
+		m_fpga_batch_append(&batch, COMMAND_END_PROGRAM);
+		
+		memset(&cycle_images[n_chains], 0, sizeof(sim_program_image));
+		sim_program_image_from_batch(&cycle_images[n_chains], batch);
+		
+		snprintf(cycle_names[n_chains], sizeof(cycle_names[n_chains]), "%.*s", len - 4, entry->d_name);
+		cycle_measured[n_chains] = 0;
+		
+		if (append_send_queue(batch, when) == 0)
+		{
+			sim_spi_send *tail = send_queue;
+			
+			while (tail->next)
+				tail = tail->next;
+			
+			tail->chain = n_chains;
+		}
+		
+		n_chains++;
+	}
+	
+	closedir(dir);
+	
+	return n_chains;
+}
+#endif
+
+#ifdef SIM_RATE_SWEEP
+static sim_rate_sweep rate_sweep;
+
+// Queue the first of the sweep's chains from `from' on that has anything
+// to measure; returns which, or -1 once there are none left
+static int queue_rate_sweep_chain(int from, int when)
+{
+	for (int chain = from; chain < sim_rate_sweep_n_chains(&rate_sweep); chain++)
+	{
+		m_fpga_transfer_batch batch;
+		
+		if (sim_rate_sweep_chain_batch(&rate_sweep, chain, &batch))
+			continue;
+		
+		if (append_send_queue(batch, when) == 0)
+		{
+			sim_spi_send *tail = send_queue;
+			
+			while (tail->next)
+				tail = tail->next;
+			
+			tail->chain = chain;
+		}
+		
+		return chain;
+	}
+	
+	return -1;
+}
+#endif
+
+// Append an effect to a program; with SIM_PROFILE, its blocks are named
+// after the file it came from
+static void append_effect(m_fpga_transfer_batch *batch, m_transformer *trans, const char *source,
+	m_eff_resource_report *res, int *pos)
+{
+	#ifdef SIM_PROFILE
+	int first = *pos;
+	#endif
+	
+	m_fpga_batch_append_transformer(batch, trans, res, pos);
+	
+	#ifdef SIM_PROFILE
+	sim_profile_name_blocks(first, *pos - first, source);
+	#endif
+}
+
+#ifdef SIM_LINK
+static void link_batch(const char *name, m_fpga_transfer_batch *batch)
+{
+	sim_cycle_params params;
+	sim_link_report report;
+
+	sim_cycle_params_default(&params);
+
+	if (sim_link_batch(batch, &params, &report) == 3)
+	{
+		printf("Link of %s failed the equivalence check; uploading it as it was\n", name);
+		return;
+	}
+
+	printf("Link of %s: %d words kept in channels, %d MEM instructions removed, %d copies added, "
+		"estimated %d -> %d cycles per pass\n", name, report.cells_promoted, report.mem_removed,
+		report.copies_added, report.cycles_before, report.cycles_after);
+}
+#endif
+
+#ifdef SIM_SCHEDULE
+// Where the scheduler put each block of the program and the edit, for
+// the batches sent to them afterwards
+static int program_order[PATCH_MAX_BLOCKS];
+static int edit_order[PATCH_MAX_BLOCKS];
+
+static void schedule_batch(const char *name, m_fpga_transfer_batch *batch, int *order)
+{
+	sim_cycle_params params;
+	sim_schedule_report report;
+
+	for (int i = 0; i < PATCH_MAX_BLOCKS; i++)
+		order[i] = i;
+
+	#ifdef SIM_BRIDGE
+	// Nothing to renumber what the client sends by
+	printf("Schedule of %s skipped: the bridge's client addresses its blocks as they were compiled\n", name);
+	return;
+	#endif
+
+	sim_cycle_params_default(&params);
+
+	int ret = sim_schedule_batch(batch, order, &params, &report);
+
+	if (ret == 3)
+	{
+		printf("Schedule of %s failed the equivalence check; uploading it as it was\n", name);
+		return;
+	}
+
+	if (ret == 4)
+	{
+		printf("Schedule of %s differed in the emulator from sample %d; uploading it as it was\n", name, report.emulated_mismatch);
+		return;
+	}
+
+	printf("Schedule of %s: %d blocks moved, estimated %d -> %d cycles per pass (%.1f%% fewer)%s\n", name,
+		report.blocks_moved, report.cycles_before, report.cycles_after,
+		report.cycles_before ? 100.0 * (report.cycles_before - report.cycles_after) / report.cycles_before : 0.0,
+		report.blocks_moved ? ", same in the emulator" : "");
+}
+#endif
+
+#ifdef USE_BATCH_CACHE
+static sim_batch_cache batch_cache;
+
+static void append_send_job(sim_batch_job *job, int when)
+{
+	m_fpga_transfer_batch pending;
+	memset(&pending, 0, sizeof(pending));
+	
+	if (append_send_queue(pending, when) == 0)
+	{
+		sim_spi_send *tail = send_queue;
+		
+		while (tail->next)
+			tail = tail->next;
+		
+		tail->job = job;
+	}
+}
+#endif
+
 void pop_send_queue()
 {
 	if (!send_queue)
@@ -169,6 +412,37 @@ void pop_send_queue()
 	free(ol);
 }
 
+#if defined(SIM_BRIDGE) && defined(SIM_BRIDGE_EMULATOR)
+// The emulator alone behind the bridge, as fast as it goes
+static int run_emulator_bridge()
+{
+	sim_bridge bridge;
+	sim_engine *emulator = new_sim_engine();
+	int16_t x;
+	
+	if (sim_bridge_open(&bridge, BRIDGE_NAME, "emulator", 44100))
+		return 1;
+	
+	while (!sim_bridge_next_sample(&bridge, &x))
+	{
+		m_fpga_transfer_batch batch;
+		
+		while (sim_bridge_poll_control(&bridge, &batch))
+		{
+			sim_handle_transfer_batch(emulator, batch);
+			free(batch.buf);
+		}
+		
+		sim_bridge_put_sample(&bridge, sim_process_sample(emulator, x));
+	}
+	
+	sim_bridge_report(&bridge);
+	sim_bridge_close(&bridge);
+	
+	return 0;
+}
+#endif
+
 int tick()
 {
 	if (!dut)
@@ -177,6 +451,12 @@ int tick()
 	dut->sys_clk = 1;
 	sim_io_update(&io);
 	dut->eval();
+	#ifdef SIM_PROFILE
+	sim_profile_clock();
+	#endif
+	#ifdef SIM_TXLOG
+	sim_txlog_cycle(&txlog);
+	#endif
 	#ifdef DUMP_WAVEFORM
 	if (tfp) tfp->dump(ticks++);
 	#endif
@@ -201,13 +481,53 @@ int tick()
 
 int main(int argc, char** argv)
 {
+	#ifdef SIM_DELAY_ALLOC_BENCH
+	return sim_delay_alloc_bench();
+	#endif
+	
+	#ifdef SIM_AUTOMATION_BENCH
+	return sim_automation_bench();
+	#endif
+	
+	#ifdef SIM_REGCOMMIT_BENCH
+	return sim_regcommit_bench();
+	#endif
+	
+	#ifdef SIM_FUZZ
+	return sim_fuzz_run();
+	#endif
+	
+	#ifdef SIM_SESSION_BENCH
+	return sim_session_bench();
+	#endif
+	
+	#ifdef SIM_LATENCY_BENCH
+	return sim_latency_bench();
+	#endif
+	
+	#ifdef SIM_DELAY_POOL_BENCH
+	return sim_delay_pool_bench();
+	#endif
+	
+	#ifdef SIM_AGENTS_BENCH
+	return sim_agents_bench();
+	#endif
+	
+	#ifdef SIM_MODE_COMPARE
+	return sim_mode_compare();
+	#endif
+	
+	#if defined(SIM_BRIDGE) && defined(SIM_BRIDGE_EMULATOR)
+	return run_emulator_bridge();
+	#endif
+	
 	srand(time(0));
     Verilated::commandArgs(argc, argv);
     Verilated::randReset(2);
 
     if (argc < 3)
     {
-        std::cerr << "Usage: " << argv[0] << " in.wav out.wav\n";
+        std::cerr << "Usage: " << argv[0] << " in.wav out.wav [ref.wav [offset]]\n";
         return 1;
     }
     
@@ -221,12 +541,14 @@ int main(int argc, char** argv)
 
     WavHeader header;
     std::vector<int16_t> in_samples;
-    if (!read_wav16_mono(in_path, header, in_samples)) {
+    std::vector<int16_t> in_samples_r;
+    if (!read_wav16(in_path, header, in_samples, in_samples_r)) {
         std::cerr << "Failed to read WAV\n";
         return 1;
     }
 
     std::vector<int16_t> out_samples;
+    std::vector<int16_t> out_samples_r;
     std::vector<int16_t> out_samples_emulated;
     
     int n_samples = in_samples.size();
@@ -242,12 +564,22 @@ int main(int argc, char** argv)
 	dut->trace(tfp, 99);
 	tfp->open("./verilator/waveform.fst");
 	#endif
+	
+	#ifdef SIM_TXLOG
+	sim_txlog_open(&txlog, SIM_TXLOG_PATH);
+	#endif
+	
+	#ifdef SIM_TELEMETRY
+	sim_telemetry telemetry;
+	sim_telemetry_open(&telemetry, SIM_TELEMETRY_PATH);
+	#endif
 
 	for (int i = 0; i < 16; i++)
 		tick();
 	
 	printf("Starting...\n");
 	
+	#ifndef USE_BATCH_CACHE
 	printf("Load delay...\n");
 	m_effect_desc *delay_desc = m_read_eff_desc_from_file("eff/del.eff");
 	printf("Load gain...\n");
@@ -287,14 +619,241 @@ int main(int argc, char** argv)
 
 	m_fpga_batch_append(&batch, COMMAND_BEGIN_PROGRAM);
 	
-	m_fpga_batch_append_transformer(&batch, &delay_trans, &res, &pos);
+	#ifdef SIM_PATCH_TEST
+	append_effect(&batch, &lpf_trans, "eff/lpf.eff", &res, &pos);
+	append_effect(&batch, &hpf_trans, "eff/hpf.eff", &res, &pos);
+	append_effect(&batch, &bpf_trans, "eff/bpf.eff", &res, &pos);
+	append_effect(&batch, &bsf_trans, "eff/bsf.eff", &res, &pos);
+	#endif
+	
+	append_effect(&batch, &delay_trans, "eff/del.eff", &res, &pos);
 	
 	m_fpga_batch_append(&batch, COMMAND_END_PROGRAM);
 	
+	#ifdef SIM_PROFILE
+	sim_profile_next_program();
+	#endif
+	
+	#ifdef SIM_LINK
+	link_batch("program", &batch);
+	#endif
+	
+	#ifdef SIM_SCHEDULE
+	schedule_batch("program", &batch, program_order);
+	#endif
+	
+	#ifdef SIM_PATCH_TEST
+	// The edit: the same chain with a gain stage on the end
+	m_fpga_transfer_batch edit_batch = m_new_fpga_transfer_batch();
+	
+	res.memory = 0;
+	res.delays = 0;
+	pos = 0;
+	
+	m_fpga_batch_append(&edit_batch, COMMAND_BEGIN_PROGRAM);
+	append_effect(&edit_batch, &lpf_trans, "eff/lpf.eff", &res, &pos);
+	append_effect(&edit_batch, &hpf_trans, "eff/hpf.eff", &res, &pos);
+	append_effect(&edit_batch, &bpf_trans, "eff/bpf.eff", &res, &pos);
+	append_effect(&edit_batch, &bsf_trans, "eff/bsf.eff", &res, &pos);
+	append_effect(&edit_batch, &delay_trans, "eff/del.eff", &res, &pos);
+	append_effect(&edit_batch, &gain_trans, "eff/gain.eff", &res, &pos);
+	m_fpga_batch_append(&edit_batch, COMMAND_END_PROGRAM);
+	
+	#ifdef SIM_PROFILE
+	sim_profile_next_program();
+	#endif
+	
+	#ifdef SIM_LINK
+	link_batch("edit", &edit_batch);
+	#endif
+	
+	#ifdef SIM_SCHEDULE
+	schedule_batch("edit", &edit_batch, edit_order);
+	#endif
+	
+	sim_program_image base_image;
+	sim_program_image edit_image;
+	
+	memset(&base_image, 0, sizeof(base_image));
+	sim_program_image_from_batch(&base_image, batch);
+	edit_image = base_image;
+	sim_program_image_from_batch(&edit_image, edit_batch);
+	
+	m_fpga_transfer_batch patch_batch = m_new_fpga_transfer_batch();
+	sim_encode_program_patch(&patch_batch, &base_image, &edit_image, 0);
+	
+	printf("Program edit: %d blocks -> %d blocks. Full upload: %d bytes. Patch: %d bytes (%.1f%%)\n",
+		base_image.n_blocks, edit_image.n_blocks, edit_batch.len, patch_batch.len, 100.0f * patch_batch.len / edit_batch.len);
+	
+	free(edit_batch.buf);
+	#endif
+	#else
+	static sim_batch_job program_job;
+	
+	sim_batch_cache_open(&batch_cache, SIM_BATCH_CACHE_PATH);
+	
+	sim_batch_recipe_init(&program_job.recipe);
+	sim_batch_recipe_add(&program_job.recipe, "eff/del.eff");
+	sim_batch_cache_request(&batch_cache, &program_job);
+	
+	#if SIM_ENGINE_MODE != ENGINE_MODE_SWAP
+	static sim_batch_job split_job;
+	
+	sim_batch_recipe_init(&split_job.recipe);
+	sim_batch_recipe_add(&split_job.recipe, "eff/gain.eff");
+	split_job.recipe.split_mode = SIM_ENGINE_MODE;
+	sim_batch_cache_request(&batch_cache, &split_job);
+	#endif
+	
+	// Built while the engine comes out of reset, and waited for if
+	// need be when it's time to send them
+	sim_batch_cache_start(&batch_cache);
+	#endif
+	
+	#ifdef SIM_SAMPLE_RATE
+	m_fpga_transfer_batch rate_batch = m_new_fpga_transfer_batch();
+	
+	m_fpga_batch_append(&rate_batch, COMMAND_SET_SAMPLE_RATE);
+	m_fpga_batch_append(&rate_batch, SIM_SAMPLE_RATE);
+	
+	append_send_queue(rate_batch, 70);
+	#endif
+	
+	#ifdef SIM_DIRECT
+	m_fpga_transfer_batch direct_batch = m_new_fpga_transfer_batch();
+	
+	m_fpga_batch_append(&direct_batch, COMMAND_SET_DIRECT);
+	m_fpga_batch_append(&direct_batch, 1);
+	
+	append_send_queue(direct_batch, 70);
+	#endif
+	
+	#ifdef USE_BATCH_CACHE
+	append_send_job(&program_job, 70);
+	#else
 	append_send_queue(batch, 70);
+	#endif
+	
+	#ifdef SIM_TELEMETRY
+	m_fpga_transfer_batch telemetry_batch = m_new_fpga_transfer_batch();
+	
+	m_fpga_batch_append(&telemetry_batch, COMMAND_SET_TELEMETRY);
+	m_fpga_batch_append(&telemetry_batch, 1);
+	
+	append_send_queue(telemetry_batch, 70);
+	#endif
+	
+	#ifdef SIM_PATCH_TEST
+	append_send_queue(patch_batch, SIM_PATCH_AT);
+	#endif
+	
+	#if SIM_ENGINE_MODE != ENGINE_MODE_SWAP
+	// Second segment goes to the back pipeline, which then stays live
+	// alongside the front one rather than replacing it
+	#ifdef USE_BATCH_CACHE
+	append_send_job(&split_job, SIM_SPLIT_AT);
+	#else
+	m_fpga_transfer_batch split_batch = m_new_fpga_transfer_batch();
+	
+	res.memory = 0;
+	res.delays = 0;
+	pos = 0;
+	
+	m_fpga_batch_append(&split_batch, COMMAND_BEGIN_PROGRAM);
+	
+	append_effect(&split_batch, &gain_trans, "eff/gain.eff", &res, &pos);
+	
+	m_fpga_batch_append(&split_batch, COMMAND_END_PROGRAM_SPLIT);
+	m_fpga_batch_append(&split_batch, SIM_ENGINE_MODE);
+	
+	#ifdef SIM_PROFILE
+	sim_profile_next_program();
+	#endif
+	
+	append_send_queue(split_batch, SIM_SPLIT_AT);
+	#endif
+	#endif
 	
 	int samples_to_process = (n_samples < MAX_SAMPLES) ? n_samples : MAX_SAMPLES;
 	
+	#ifdef SIM_AUTOMATION_TEST
+	// One knob, turned over the rest of the run; each instant's
+	// messages go out as a batch of their own
+	static sim_automation_workload automation;
+	sim_automation_map automation_map;
+	
+	automation_map.block[0] = SIM_AUTOMATION_BLOCK;
+	automation_map.reg[0] 	= SIM_AUTOMATION_REG;
+	
+	sim_automation_generate(&automation, 1, samples_to_process - SIM_AUTOMATION_AT, time(0));
+	
+	#ifdef SIM_AUTOMATION_PERIOD
+	const int automation_period = SIM_AUTOMATION_PERIOD;
+	const int automation_ramped = 0;
+	#else
+	const int automation_period = 16;
+	const int automation_ramped = 1;
+	#endif
+	
+	int automation_bytes = 0;
+	
+	for (int t = 0; t < automation.duration; t += automation_period)
+	{
+		m_fpga_transfer_batch automation_batch = m_new_fpga_transfer_batch();
+		
+		sim_automation_encode(&automation_batch, &automation, &automation_map, t, t + automation_period, automation_ramped, automation_period);
+		
+		if (automation_batch.len == 0)
+		{
+			free(automation_batch.buf);
+			continue;
+		}
+		
+		#ifdef SIM_SCHEDULE
+		#ifdef SIM_PATCH_TEST
+		// Sent after the patch, so it's the edit's blocks by then
+		sim_schedule_remap_batch(&automation_batch, (SIM_AUTOMATION_AT + t >= SIM_PATCH_AT) ? edit_order : program_order);
+		#else
+		sim_schedule_remap_batch(&automation_batch, program_order);
+		#endif
+		#endif
+		
+		automation_bytes += automation_batch.len;
+		append_send_queue(automation_batch, SIM_AUTOMATION_AT + t);
+	}
+	
+	printf("Automation: %d segments, %d bytes (%.1f bytes/s)\n", automation.n_segments, automation_bytes,
+		automation_bytes * 44100.0f / automation.duration);
+	#endif
+	
+	#if defined(SIM_CYCLE_ESTIMATE) || defined(SIM_STEREO_BENCH)
+	int cycle_chains = queue_cycle_chains(70);
+	int cycle_chain = -1;
+	int cycle_loaded_at = 0;
+	
+	// Run on until the last chain has been measured
+	samples_to_process = 1 << 30;
+	#endif
+	
+	#ifdef SIM_RATE_SWEEP
+	{
+		sim_cycle_params params;
+		sim_cycle_params_default(&params);
+		
+		sim_rate_sweep_plan(&rate_sweep, &params);
+	}
+	
+	// One chain at a time, each once the last has been measured
+	int sweep_chain = -1;
+	int sweep_pipeline = 0;
+	int sweep_loaded_at = 0;
+	int sweep_live_at = -1;
+	int sweep_span = 0;
+	
+	if (queue_rate_sweep_chain(0, 70) >= 0)
+		samples_to_process = 1 << 30;
+	#endif
+	
 	#ifdef RUN_EMULATOR
 	sim_engine *emulator = new_sim_engine();
 	#endif
@@ -304,56 +863,267 @@ int main(int argc, char** argv)
 	
 	float t = 0;
 	
-	const float sample_duration = 1.0f / (44.1f * 1000.0f);
+	// Follows the rate the engine is running at
+	float sample_duration = 1.0f / (44.1f * 1000.0f);
 	
-    while (samples_processed < samples_to_process)
-	{
-		tick();
-		
-		if (samples_processed % 128 == 0)
-			printf("\rSamples processed: %d/%d (%.2f%%)  ", samples_processed, samples_to_process, 100.0 * (float)samples_processed/(float)samples_to_process);
-		
-		if (io.i2s_ready)
+	#ifdef SIM_PROFILE
+	sim_profile_begin();
+	#endif
+	
+	#ifdef SIM_MEASURE
+	static sim_measure measure;
+	
+	#ifdef SIM_MEASURE_MLS
+	sim_measure_init(&measure, MEASURE_MLS, 44100.0);
+	#else
+	sim_measure_init(&measure, MEASURE_SWEEP, 44100.0);
+	#endif
+	
+	// Run on until the stimulus has been played out
+	samples_to_process = 1 << 30;
+	#endif
+	
+	#ifdef SIM_BRIDGE
+	sim_bridge bridge;
+	int16_t bridge_in = 0;
+	
+	if (sim_bridge_open(&bridge, BRIDGE_NAME, "Vtop", 44100))
+		return 1;
+	
+	// Run on until the client says stop
+	samples_to_process = 1 << 30;
+	#endif
+	
+	// The run, as agents on the scheduler, clocked by tick: the SPI driver
+	// sends what the sender hands it, a batch at a time, and the frames
+	// agent sees to each sample in and out. They're closures over main's
+	// locals, which outlive the run
+	static sim_scheduler sched;
+	static sim_spi_queue spi_queue;
+	
+	sim_scheduler_init(&sched, dut, &io);
+	sched.clock = tick;
+	
+	sim_spi_queue_init(&spi_queue);
+	
+	// Each batch in the send queue, once it's due, to the driver, and
+	// whatever was waiting on it seen to once it's gone
+	auto sender = [&]() -> sim_agent {
+		for (;;)
 		{
-			if (send_queue)
+			if (!send_queue || samples_processed < send_queue->tick)
 			{
-				if (samples_processed >= send_queue->tick)
-				{
-					if (!send_queue->started)
-					{
-						send_queue->started = 1;
-						send_queue->position = 0;
-						
-						printf("\nSending batch. ");
-						m_fpga_batch_print(send_queue->batch);
-						
-						#ifdef RUN_EMULATOR
-						sim_handle_transfer_batch(emulator, send_queue->batch);
-						#endif
-					}
-					
-					if (send_queue->position >= send_queue->batch.len)
-					{
-						pop_send_queue();
-					}
-					else
-					{
-						if (spi_send(send_queue->batch.buf[send_queue->position]) == 0)
-							send_queue->position++;
-					}
-				}
+				co_await sim_frames(&sched, send_queue ? send_queue->tick - samples_processed : 1);
+				continue;
+			}
+			
+			#ifdef USE_BATCH_CACHE
+			if (send_queue->job)
+			{
+				if (sim_batch_cache_wait(&batch_cache, send_queue->job))
+					printf("\nBatch cache: a program couldn't be built; sending nothing\n");
+				
+				send_queue->batch = send_queue->job->batch;
+				send_queue->job = NULL;
+			}
+			#endif
+			
+			send_queue->started_at = samples_processed;
+			
+			printf("\nSending batch. ");
+			m_fpga_batch_print(send_queue->batch);
+			
+			#ifdef RUN_EMULATOR
+			sim_handle_transfer_batch(emulator, send_queue->batch);
+			#endif
+			
+			// The driver frees it once it's sent
+			sim_spi_queue_put(&sched, &spi_queue, send_queue->batch);
+			send_queue->batch.buf = NULL;
+			
+			co_await sim_wait(&sched, &spi_queue.sent);
+			
+			int frames = samples_processed - send_queue->started_at;
+			printf("\rBatch of %d bytes sent in %d frames (%.2f ms)\n", send_queue->batch.len, frames, 1000.0f * frames * sample_duration);
+			
+			#if defined(SIM_CYCLE_ESTIMATE) || defined(SIM_STEREO_BENCH)
+			if (send_queue->chain >= 0)
+			{
+				cycle_chain = send_queue->chain;
+				cycle_loaded_at = samples_processed;
 			}
+			#endif
+			
+			#ifdef SIM_RATE_SWEEP
+			if (send_queue->chain >= 0)
+			{
+				sweep_chain = send_queue->chain;
+				sweep_pipeline = dut->rootp->top__DOT__engine__DOT__controller__DOT__current_pipeline;
+				sweep_loaded_at = samples_processed;
+				sweep_live_at = -1;
+				sweep_span = 0;
+			}
+			#endif
+			
+			#ifdef SIM_DELAY_POOL
+			sim_delay_pool_report pool_report;
+			sim_delay_pool_read(dut, &pool_report);
+			sim_delay_pool_print(&pool_report);
+			#endif
+			
+			pop_send_queue();
+		}
+	};
+	
+	auto progress = [&]() -> sim_agent {
+		for (;;)
+		{
+			printf("\rSamples processed: %d/%d (%.2f%%)  ", samples_processed, samples_to_process, 100.0 * (float)samples_processed/(float)samples_to_process);
+			
+			co_await sim_frames(&sched, 128);
+		}
+	};
+	
+	#ifdef SIM_TELEMETRY
+	auto telemetry_reader = [&]() -> sim_agent {
+		for (;;)
+		{
+			co_await sim_until(&sched, []() { return io.miso_valid != 0; });
+			
+			sim_telemetry_byte(&telemetry, io.miso_byte, t);
+			io.miso_valid = 0;
+		}
+	};
+	#endif
+	
+	auto i2s = [&]() -> sim_agent {
+		while (samples_processed < samples_to_process)
+		{
+			co_await sim_frames(&sched, 1);
+			
+			#ifdef SIM_BRIDGE
+			m_fpga_transfer_batch bridge_batch;
+			
+			while (sim_bridge_poll_control(&bridge, &bridge_batch))
+				append_send_queue(bridge_batch, samples_processed);
+			#endif
+			
+			#ifdef SIM_TELEMETRY
+			// A zero byte is no command, but still clocks a byte out. Only
+			// while the controller's idle (led1 is lit while it isn't) and
+			// nothing's being sent, so as not to fill its FIFO ahead of the
+			// next batch during a swap
+			if (!spi_queue.count && !spi_queue.sending && dut->led1)
+				spi_send(0);
+			#endif
 			
 			samples_processed++;
+			sample_duration = 1.0f / sim_io_sample_rate(&io);
 			t += sample_duration;
 			
+			#if defined(SIM_BRIDGE)
+			if (sim_bridge_next_sample(&bridge, &bridge_in))
+				samples_to_process = samples_processed;
+			
+			io.sample_in = (uint16_t)bridge_in;
+			#elif defined(SIM_MEASURE)
+			// Start once everything queued has gone in, and let it settle
+			if (measure.started_at < 0 && !send_queue)
+			{
+				measure.started_at = samples_processed + SIM_MEASURE_SETTLE;
+				samples_to_process = measure.started_at + measure.n_frames;
+			}
+			
+			io.sample_in = (uint16_t)sim_measure_input(&measure, samples_processed - measure.started_at);
+			#else
 			io.sample_in = (uint16_t)(roundf(sinf(6.28 * 1500.0f * t/* * ((float)samples_processed / (float)samples_to_process)*/) * 32767.0 * 0.5f));
 			//io.sample_in = static_cast<int16_t>(in_samples[samples_processed]);
+			#endif
+			
+			#ifdef SIM_STEREO
+			io.sample_in_r = (uint16_t)(roundf(sinf(6.28 * 1000.0f * t) * 32767.0 * 0.5f));
+			out_samples_r.push_back(static_cast<int16_t>(io.sample_out_r));
+			#else
+			io.sample_in_r = io.sample_in;
+			#endif
+			
 			y = static_cast<int16_t>(io.sample_out);
 			out_samples.push_back(y);
-			io.i2s_ready = 0;
 			
+			#ifdef SIM_BRIDGE
+			sim_bridge_put_sample(&bridge, y);
+			#endif
+			
+			#ifdef SIM_MEASURE
 			#ifdef RUN_EMULATOR
+			emulated_y = sim_process_sample(emulator, (int16_t)io.sample_in);
+			sim_measure_output(&measure, samples_processed - measure.started_at, y, emulated_y, 1);
+			#else
+			sim_measure_output(&measure, samples_processed - measure.started_at, y, 0, 0);
+			#endif
+			#endif
+			
+			#ifdef SIM_TXLOG
+			sim_txlog_frame(&txlog, io.sample_in, y);
+			#endif
+			
+			#if defined(SIM_CYCLE_ESTIMATE) || defined(SIM_STEREO_BENCH)
+			// The pipeline swapped out is held in reset, and reads 0
+			if (cycle_chain >= 0 && samples_processed - cycle_loaded_at >= SIM_CYCLE_SETTLE)
+			{
+				int span_a = dut->rootp->top__DOT__engine__DOT__pipeline_a__DOT__core__DOT__commit_span;
+				int span_b = dut->rootp->top__DOT__engine__DOT__pipeline_b__DOT__core__DOT__commit_span;
+				int span = (span_a > span_b) ? span_a : span_b;
+				
+				if (span > cycle_measured[cycle_chain])
+					cycle_measured[cycle_chain] = span;
+				
+				if (cycle_chain == cycle_chains - 1 && samples_processed - cycle_loaded_at >= 2 * SIM_CYCLE_SETTLE)
+					samples_to_process = samples_processed;
+			}
+			#endif
+			
+			#ifdef SIM_RATE_SWEEP
+			// Measured once it's been swapped in and settled, or given up
+			// on if the engine never takes it
+			if (sweep_chain >= 0)
+			{
+				int current = dut->rootp->top__DOT__engine__DOT__controller__DOT__current_pipeline;
+				int done = 0;
+				
+				if (sweep_live_at < 0 && current != sweep_pipeline)
+					sweep_live_at = samples_processed;
+				
+				if (sweep_live_at >= 0 && samples_processed - sweep_live_at >= SIM_CYCLE_SETTLE)
+				{
+					int span = current
+						? dut->rootp->top__DOT__engine__DOT__pipeline_b__DOT__core__DOT__commit_span
+						: dut->rootp->top__DOT__engine__DOT__pipeline_a__DOT__core__DOT__commit_span;
+					
+					if (span > sweep_span)
+						sweep_span = span;
+					
+					done = (samples_processed - sweep_live_at >= 2 * SIM_CYCLE_SETTLE);
+				}
+				else if (sweep_live_at < 0 && samples_processed - sweep_loaded_at >= SIM_RATE_SWEEP_TIMEOUT)
+				{
+					sweep_span = -1;
+					done = 1;
+				}
+				
+				if (done)
+				{
+					sim_rate_sweep_measured(&rate_sweep, sweep_chain, sweep_span);
+					
+					if (queue_rate_sweep_chain(sweep_chain + 1, samples_processed) < 0)
+						samples_to_process = samples_processed;
+					
+					sweep_chain = -1;
+				}
+			}
+			#endif
+			
+			#if defined(RUN_EMULATOR) && !defined(SIM_MEASURE)
 			if (samples_processed > 4)
 			{
 				emulated_y = sim_process_sample(emulator, in_samples[samples_processed - 3]);
@@ -367,24 +1137,162 @@ int main(int argc, char** argv)
 			}
 			#endif
 		}
-    }
+		
+		sim_scheduler_stop(&sched);
+	};
+	
+	sim_scheduler_spawn(&sched, sim_agent_spi_driver(&sched, &spi_queue));
+	sim_scheduler_spawn(&sched, sender());
+	sim_scheduler_spawn(&sched, progress());
+	#ifdef SIM_TELEMETRY
+	sim_scheduler_spawn(&sched, telemetry_reader());
+	#endif
+	sim_scheduler_spawn(&sched, i2s());
+	
+	sim_scheduler_run(&sched, 1L << 62);
+	
+	sim_scheduler_free(&sched);
+	sim_spi_queue_free(&spi_queue);
 
 	printf("\rSamples processed: %d/%d (100%%)  \n", samples_to_process, samples_to_process);
 	
+	#ifdef SIM_FETCH_COUNTERS
+	{
+		uint32_t bubbles[2] = {
+			dut->rootp->top__DOT__engine__DOT__pipeline_a__DOT__core__DOT__fetch_decode_stage__DOT__fetch_bubbles,
+			dut->rootp->top__DOT__engine__DOT__pipeline_b__DOT__core__DOT__fetch_decode_stage__DOT__fetch_bubbles
+		};
+		uint32_t blocks[2] = {
+			dut->rootp->top__DOT__engine__DOT__pipeline_a__DOT__core__DOT__fetch_decode_stage__DOT__fetch_blocks,
+			dut->rootp->top__DOT__engine__DOT__pipeline_b__DOT__core__DOT__fetch_decode_stage__DOT__fetch_blocks
+		};
+		
+		for (int i = 0; i < 2; i++)
+		{
+			printf("Pipeline %c: %u blocks decoded, %u fetch bubbles (%.2f per sample)\n", 'a' + i,
+				blocks[i], bubbles[i], bubbles[i] / (double)samples_to_process);
+		}
+	}
+	#endif
+	
+	#ifdef SIM_CYCLE_ESTIMATE
+	{
+		sim_cycle_params params;
+		const char *names[CYCLE_MAX_CHAINS];
+		
+		for (int i = 0; i < cycle_chains; i++)
+			names[i] = cycle_names[i];
+		
+		sim_cycle_params_default(&params);
+		
+		if (sim_cycle_calibrate(&params, cycle_images, cycle_measured, names, cycle_chains) == 0)
+		{
+			if (sim_cycle_params_write(&params, SIM_CYCLE_PARAMS_PATH))
+				fprintf(stderr, "Cycle estimate: can't write %s\n", SIM_CYCLE_PARAMS_PATH);
+			else
+				printf("Cycle estimate: fitted latencies written to %s\n", SIM_CYCLE_PARAMS_PATH);
+		}
+	}
+	#endif
+	
+	#ifdef SIM_RATE_SWEEP
+	sim_rate_sweep_report(&rate_sweep);
+	#endif
+	
+	#ifdef SIM_STEREO_BENCH
+	{
+		const char *names[CYCLE_MAX_CHAINS];
+		
+		for (int i = 0; i < cycle_chains; i++)
+			names[i] = cycle_names[i];
+		
+		sim_stereo_bench_report(cycle_measured, names, cycle_chains, SIM_STEREO_SPANS_PATH);
+	}
+	#endif
+	
+	#ifdef SIM_PROFILE
+	sim_profile_write(SIM_PROFILE_PATH);
+	#endif
+	
+	#ifdef SIM_MEASURE
+	sim_measure_report(&measure, SIM_MEASURE_PATH);
+	#endif
+	
+	#ifdef SIM_BRIDGE
+	sim_bridge_report(&bridge);
+	sim_bridge_close(&bridge);
+	#endif
+	
+	#ifdef SIM_TXLOG
+	sim_txlog_close(&txlog);
+	#endif
+	
+	#ifdef SIM_TELEMETRY
+	sim_telemetry_close(&telemetry);
+	#endif
+	
+	#ifdef USE_BATCH_CACHE
+	sim_batch_cache_close(&batch_cache);
+	#endif
+	
     #ifdef DUMP_WAVEFORM
 	tfp->close();
 	delete tfp;
 	#endif
 	
+	#ifdef SIM_SAMPLE_RATE
+	header.sample_rate = (uint32_t)roundf(sim_io_sample_rate(&io));
+	#endif
+	
 	#ifdef RUN_EMULATOR
-    write_wav16_mono(out_path_em, header.sample_rate, out_samples_emulated);
+    write_wav16(out_path_em, header.sample_rate, out_samples_emulated);
     #endif
     
-    if (!write_wav16_mono(out_path, header.sample_rate, out_samples))
+    #ifdef SIM_STEREO
+    if (!write_wav16(out_path, header.sample_rate, out_samples, &out_samples_r))
+    #else
+    if (!write_wav16(out_path, header.sample_rate, out_samples))
+    #endif
     {
         std::cerr << "Failed to write WAV\n";
         return 1;
     }
+    
+    // Optionally compare against a reference render, e.g. the same
+    // chain run as a single program, skipping `offset` frames of it
+    if (argc > 3)
+    {
+		WavHeader ref_header;
+		std::vector<int16_t> ref_samples;
+		std::vector<int16_t> ref_samples_r;
+		
+		int offset = (argc > 4) ? atoi(argv[4]) : 0;
+		
+		if (!read_wav16(argv[3], ref_header, ref_samples, ref_samples_r))
+		{
+			std::cerr << "Failed to read reference WAV\n";
+			return 1;
+		}
+		
+		int max_err = 0;
+		int max_err_at = 0;
+		
+		for (int i = 0; i < (int)out_samples.size(); i++)
+		{
+			if (i + offset < 0 || i + offset >= (int)ref_samples.size())
+				continue;
+			
+			int err = abs((int)out_samples[i] - (int)ref_samples[i + offset]);
+			
+			if (err > max_err)
+			{
+				max_err = err;
+				max_err_at = i;
+			}
+		}
+		
+		printf("Max error against reference: %d (%.04f%%) at sample %d\n", max_err, 100.0f * max_err / 32768.0f, max_err_at);
+	}
 
     delete dut;
     return 0;
@@ -6,6 +6,7 @@
 #include "verilated_fst_c.h"
 #include <fstream>
 #include <vector>
+#include <map>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
@@ -18,8 +19,222 @@
 #include <libM/m_lib.h>
 
 #include "sim_io.h"
+#include "commands.h"
+#include "automation.h"
+#include "patch.h"
+#include "delay_alloc.h"
+#include "regcommit_bench.h"
+#include "cycle_estimate.h"
+#include "schedule.h"
+#include "link.h"
+#include "profile.h"
+#include "txlog.h"
+#include "measure.h"
+#include "bridge.h"
+#include "stereo.h"
+#include "rate_sweep.h"
+#include "telemetry.h"
+#include "model.h"
+#include "fuzz.h"
+#include "agents.h"
+#include "session.h"
+#include "latency.h"
+#include "batch_cache.h"
+#include "delay_pool.h"
+#include "mode_compare.h"
+
+#define ENGINE_MODE_SWAP 		0
+#define ENGINE_MODE_SERIES 		1
+#define ENGINE_MODE_PARALLEL 	2
 
 #define MAX_SAMPLES		2048
+
+// The engine's geometry, as top.v's parameters have it
+#define SIM_N_BLOCKS 	255
+#define SIM_DATA_WIDTH 	16
+
+// How the test chain is loaded: as one program (swap), or split
+// across both pipelines as two segments (series/parallel)
+#define SIM_ENGINE_MODE ENGINE_MODE_SWAP
+#define SIM_SPLIT_AT	1024
+
+// Load a larger program, then patch a small edit into it rather than
+// re-uploading it, and report the bytes and time each one took
+//#define SIM_PATCH_TEST
+#define SIM_PATCH_AT	1536
+
+// Take the test chain's programs from the batch cache at
+// SIM_BATCH_CACHE_PATH, filed under a hash of the effects' sources,
+// rather than parsing and building them each run; what isn't there is
+// built on a thread of its own while the engine comes out of reset.
+// SIM_PATCH_TEST, SIM_LINK, SIM_SCHEDULE and SIM_PROFILE need the
+// effects themselves, and build them as before
+//#define SIM_BATCH_CACHE
+#define SIM_BATCH_CACHE_PATH 	"./verilator/batch_cache.bin"
+
+// Run the delay allocator stress benchmark instead of the simulation:
+// random allocations, frees and resizes sent to the back pipeline of
+// an engine, each timed by the cycles delay_master is busy with it
+//#define SIM_DELAY_ALLOC_BENCH
+
+// Compare the SPI traffic of streamed register updates against ramps
+// over a scripted automation workload, instead of the simulation
+//#define SIM_AUTOMATION_BENCH
+
+// Play a short automation workload into the running program, as ramps
+// or, with SIM_AUTOMATION_PERIOD set, streamed every so many samples
+//#define SIM_AUTOMATION_TEST
+#define SIM_AUTOMATION_AT 		512
+#define SIM_AUTOMATION_BLOCK 	0
+#define SIM_AUTOMATION_REG 		0
+//#define SIM_AUTOMATION_PERIOD 	32
+
+// Instead of running the simulation, time batches of register updates
+// and their commits on the engine, for a few program lengths and batch
+// sizes, and print the update rate and the commit latency. Mono builds
+// only
+//#define SIM_REGCOMMIT_BENCH
+
+// Count the cycles each core's decoder waits on the block fetcher, and
+// the blocks it takes, and print both at the end of the run. Builds the
+// counters into the RTL as well
+//#define SIM_FETCH_COUNTERS
+
+// Load every chain in eff/ in turn, measure each one's commit span, and
+// fit the static cycle estimate's latencies to them; the defaults are
+// read off the RTL, not fitted. A chain is measured once it has run for
+// SIM_CYCLE_SETTLE samples, until the next replaces it. The fit is
+// written to SIM_CYCLE_PARAMS_PATH, and every later run's estimates,
+// with or without this set, take their latencies from there
+//#define SIM_CYCLE_ESTIMATE
+#define SIM_CYCLE_SETTLE 	16
+#define SIM_CYCLE_PARAMS_PATH 	"./verilator/cycle_params.txt"
+
+// Link each program before it is uploaded, keeping state in channels
+// rather than memory where they go round, and report what it saved
+//#define SIM_LINK
+
+// Reorder the blocks of each program before it is uploaded, and report
+// the estimated cycles saved and whether the result checked equivalent
+// and ran the same in the emulator. The automation test's updates are
+// renumbered to match; the bridge's client's can't be, so with
+// SIM_BRIDGE nothing is reordered
+//#define SIM_SCHEDULE
+
+// Profile the blocks each core runs, from hooks in the RTL, and write
+// the cycles and stalls of each as folded stacks for flame graph tools.
+// Blocks are named after their effects as compiled, so leave SIM_LINK
+// and SIM_SCHEDULE off. The hooks are only built into the RTL while this
+// is set; verilate.sh reads it from here
+//#define SIM_PROFILE
+#define SIM_PROFILE_PATH 	"./verilator/profile.folded"
+
+// Log what goes in and out of the engine, and what the controller makes
+// of it, to a compact binary file; read it or compare two runs with
+// obj_dir/txlog. Cheap enough to leave on where the waveform isn't
+#define SIM_TXLOG
+#define SIM_TXLOG_PATH 		"./verilator/run.txlog"
+
+// Measure the program's response in one run: once everything queued has
+// gone in, play an exponential sweep, or with SIM_MEASURE_MLS a maximum
+// length sequence, and deconvolve what comes out into its impulse,
+// magnitude, phase and group delay response and its latency. With
+// RUN_EMULATOR, the emulator's alongside. It runs for some 80000 frames,
+// so leave DUMP_WAVEFORM off
+//#define SIM_MEASURE
+//#define SIM_MEASURE_MLS
+#define SIM_MEASURE_SETTLE 	4410
+#define SIM_MEASURE_PATH 	"./verilator/measure"
+
+// Take input from, and give output to, a client on the same machine
+// through shared memory (see bridge_client.h), along with transfer
+// batches to send, until it says stop; then report the real-time factor
+// and underruns. With SIM_BRIDGE_EMULATOR and RUN_EMULATOR, the emulator
+// sits behind the bridge instead, and the engine isn't run at all
+//#define SIM_BRIDGE
+//#define SIM_BRIDGE_EMULATOR
+
+// Run stereo: a 1000Hz tone goes in on the right alongside the left's,
+// and the output WAV has both channels. The RTL has to be built stereo
+// too, with +define+CORE_STEREO or in include/core.vh
+//#define SIM_STEREO
+
+// Walk the chains in eff/ as SIM_CYCLE_ESTIMATE does, measuring each
+// one's commit span. A mono build writes them to SIM_STEREO_SPANS_PATH;
+// a SIM_STEREO build then reads them back and reports its own against
+// two mono passes of each chain
+//#define SIM_STEREO_BENCH
+#define SIM_STEREO_SPANS_PATH 	"./verilator/stereo_mono.spans"
+
+// Run at another sample rate (SAMPLE_RATE_*, see rate_sweep.h), set
+// before the program goes in; the output WAV is written at it
+//#define SIM_SAMPLE_RATE 	SAMPLE_RATE_96K
+
+// Run in low-latency mode, each frame's output going out the frame
+// after it came in; set before the program goes in
+//#define SIM_DIRECT
+
+// For each chain in eff/, find by the cycle estimate the most copies of
+// it in a row that still finish inside the frame at each sample rate,
+// then load each of those into the engine at its rate and measure it.
+// One still not swapped in after SIM_RATE_SWEEP_TIMEOUT frames was
+// turned down by the health monitor
+//#define SIM_RATE_SWEEP
+#define SIM_RATE_SWEEP_TIMEOUT 	4096
+
+// Turn telemetry on and keep SPI clocking, a byte a frame when there's
+// nothing else to send, and decode the packets that come back on MISO
+// into a CSV time series of levels and cycles per sample
+//#define SIM_TELEMETRY
+#define SIM_TELEMETRY_PATH 	"./verilator/telemetry.csv"
+
+// Fuzz the cores against the model in verilator/model.cpp instead of
+// running the simulation: the directed cases in verilator/fuzz.cpp,
+// then SIM_FUZZ_CASES cases of random programs and gain changes, each
+// on a Vtop of its own, a thread per CPU unless SIM_FUZZ_THREADS says
+// otherwise. The first mismatch is shrunk to as little as still shows
+// it and written to SIM_FUZZ_PATH. Mono builds only. Like SIM_PROFILE,
+// its hook in the RTL is only built in while this is set
+//#define SIM_FUZZ
+#define SIM_FUZZ_CASES 		1000
+#define SIM_FUZZ_SEED 		1
+//#define SIM_FUZZ_THREADS 	4
+#define SIM_FUZZ_PATH 		"./verilator/fuzz_case.txt"
+
+// Instead of running the simulation, run two engines side by side
+// through the session API in verilator/session.h, a block at a time on
+// a chain each, and print how close to real time each one kept. Mono
+// builds only
+//#define SIM_SESSION_BENCH
+
+// Instead of running the simulation, time impulses through
+// SIM_LATENCY_EFFECT in the framed and the low-latency mode, an engine
+// each, and print the round trip in samples and the deadline misses
+//#define SIM_LATENCY_BENCH
+#define SIM_LATENCY_EFFECT 	"eff/gain.eff"
+
+// Print where the pipelines' delay buffers stand in the shared pool
+// each time a batch has gone in
+//#define SIM_DELAY_POOL
+
+// Instead of running the simulation, load programs of one big buffer
+// each, one after another, and report how much of the shared delay pool
+// each could have, alone and beside the program it replaced. Mono
+// builds only
+//#define SIM_DELAY_POOL_BENCH
+
+// Instead of running the simulation, run a tone through an engine with
+// testbench agents loading effects into it while they watch for swaps,
+// and time it against the same frames clocked bare
+//#define SIM_AGENTS_BENCH
+
+// Instead of running the simulation, load the test chain into three
+// engines, as one program and split in series and in parallel, run the
+// same tone through each, and report them side by side: whether each
+// program or segment went in, whether a segment overran the frame, and
+// how far each output strays from the swap run's. Mono builds only
+//#define SIM_MODE_COMPARE
+
 //#define RUN_EMULATOR
 
 #define DUMP_WAVEFORM
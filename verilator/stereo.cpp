@@ -0,0 +1,103 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "stereo.h"
+
+/*
+ * Stereo against two mono passes, chain by chain.
+ *
+ * Whether the cores are stereo is fixed when the RTL is built, so the
+ * comparison takes two builds: the mono one measures each chain's commit
+ * span and writes them out, and the stereo one (SIM_STEREO, with the RTL
+ * built +define+CORE_STEREO) measures its own and sets them against the
+ * mono ones read back. Running the same program over both channels mono
+ * would take two frames' worth of passes, so that is the span stereo is
+ * held up against; what a stereo core saves on it is the second fetch
+ * and decode of each block, and whatever of one lane's pass it can hide
+ * behind the other's.
+ */
+
+#ifdef SIM_STEREO
+static int load_spans(const char *path, sim_stereo_span *spans, int max)
+{
+	FILE *f = fopen(path, "r");
+	int n = 0;
+
+	if (!f)
+		return -1;
+
+	while (n < max && fscanf(f, "%63s %d", spans[n].name, &spans[n].span) == 2)
+		n++;
+
+	fclose(f);
+
+	return n;
+}
+
+int sim_stereo_bench_report(const int *spans, const char **names, int n_chains, const char *path)
+{
+	sim_stereo_span mono[CYCLE_MAX_CHAINS];
+	int n_mono = load_spans(path, mono, CYCLE_MAX_CHAINS);
+
+	if (n_mono < 0)
+	{
+		fprintf(stderr, "Stereo bench: no mono spans in %s; run the mono build with SIM_STEREO_BENCH first\n", path);
+		return 1;
+	}
+
+	double total_stereo = 0;
+	double total_mono = 0;
+
+	printf("%-24s %8s %8s %8s %8s\n", "chain", "mono", "2x mono", "stereo", "ratio");
+
+	for (int i = 0; i < n_chains; i++)
+	{
+		int m = -1;
+
+		for (int j = 0; j < n_mono; j++)
+		{
+			if (strcmp(mono[j].name, names[i]) == 0)
+				m = mono[j].span;
+		}
+
+		if (m <= 0 || spans[i] <= 0)
+		{
+			printf("%-24s %8s %8s %8d %8s\n", names[i], "-", "-", spans[i], "-");
+			continue;
+		}
+
+		total_mono 	 += 2 * m;
+		total_stereo += spans[i];
+
+		printf("%-24s %8d %8d %8d %8.2f\n", names[i], m, 2 * m, spans[i], spans[i] / (2.0 * m));
+	}
+
+	if (total_mono > 0)
+		printf("Stereo takes %.2f of two mono passes over all chains\n", total_stereo / total_mono);
+
+	return 0;
+}
+#else
+int sim_stereo_bench_report(const int *spans, const char **names, int n_chains, const char *path)
+{
+	FILE *f = fopen(path, "w");
+
+	if (!f)
+	{
+		fprintf(stderr, "Stereo bench: can't write %s\n", path);
+		return 1;
+	}
+
+	for (int i = 0; i < n_chains; i++)
+		fprintf(f, "%s %d\n", names[i], spans[i]);
+
+	fclose(f);
+
+	printf("Stereo bench: mono spans of %d chains written to %s; now run the stereo build\n", n_chains, path);
+
+	return 0;
+}
+#endif
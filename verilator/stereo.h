@@ -0,0 +1,18 @@
+#ifndef DSP_SIM_STEREO_H_
+#define DSP_SIM_STEREO_H_
+
+#define STEREO_MAX_NAME 	64
+
+// Each chain's commit span from a mono build, as the stereo build reads
+// them back
+typedef struct {
+	char name[STEREO_MAX_NAME];
+	int span;
+} sim_stereo_span;
+
+// In a mono build, write each chain's commit span to `path'. In a stereo
+// build, read back the mono build's and print, for each chain, the
+// stereo span against two mono passes
+int sim_stereo_bench_report(const int *spans, const char **names, int n_chains, const char *path);
+
+#endif
@@ -0,0 +1,141 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_main.h"
+#include "telemetry.h"
+
+/*
+ * Telemetry off MISO, into a time series.
+ *
+ * With telemetry on, every SPI transfer gets a byte of the engine's
+ * current packet back, whether it carried a command or was only sent to
+ * clock one out. Packets are picked out of the stream by their sync byte
+ * and checked by their XOR; one that fails is searched for the next sync
+ * byte after its own, so a byte lost in the middle costs a packet or two
+ * rather than losing the framing for good. Gaps in the sequence numbers
+ * are counted as packets lost.
+ *
+ * Each good packet is a line of the CSV, stamped with the time its last
+ * byte came in.
+ */
+
+static int get16(const uint8_t *buf)
+{
+	return (buf[0] << 8) | buf[1];
+}
+
+void sim_telemetry_decode(const uint8_t *buf, sim_telemetry_packet *packet)
+{
+	packet->seq = buf[1];
+
+	for (int p = 0; p < 2; p++)
+	{
+		const uint8_t *fields = &buf[2 + 10 * p];
+
+		packet->in_peak[p] 		= get16(&fields[0]);
+		packet->in_envelope[p] 	= get16(&fields[2]);
+		packet->out_peak[p] 	= get16(&fields[4]);
+		packet->out_envelope[p] = get16(&fields[6]);
+		packet->cycles[p] 		= get16(&fields[8]);
+	}
+
+	packet->clips = get16(&buf[22]);
+
+	packet->current_pipeline = (buf[24] >> TELEMETRY_STATUS_PIPELINE) & 1;
+	packet->health 			 = (buf[24] >> TELEMETRY_STATUS_HEALTH) & 1;
+	packet->sample_rate 	 = (buf[24] >> TELEMETRY_STATUS_RATE) & 7;
+}
+
+int sim_telemetry_open(sim_telemetry *tel, const char *path)
+{
+	memset(tel, 0, sizeof(sim_telemetry));
+
+	tel->last.seq = -1;
+	tel->csv = fopen(path, "w");
+
+	if (!tel->csv)
+	{
+		fprintf(stderr, "Telemetry: can't write %s\n", path);
+		return 1;
+	}
+
+	fprintf(tel->csv, "t,seq,"
+		"a_in_peak,a_in_envelope,a_out_peak,a_out_envelope,a_cycles,"
+		"b_in_peak,b_in_envelope,b_out_peak,b_out_envelope,b_cycles,"
+		"clips,pipeline,health,rate\n");
+
+	return 0;
+}
+
+// Drop the first `n' bytes, and whatever follows up to the next sync
+static void resync(sim_telemetry *tel, int n)
+{
+	while (n < tel->n && tel->buf[n] != TELEMETRY_SYNC)
+		n++;
+
+	tel->skipped_bytes += n;
+	memmove(tel->buf, &tel->buf[n], tel->n - n);
+	tel->n -= n;
+}
+
+int sim_telemetry_byte(sim_telemetry *tel, uint8_t byte, double t)
+{
+	if (tel->n == 0 && byte != TELEMETRY_SYNC)
+	{
+		tel->skipped_bytes++;
+		return 0;
+	}
+
+	tel->buf[tel->n++] = byte;
+
+	if (tel->n < TELEMETRY_PACKET_BYTES)
+		return 0;
+
+	uint8_t check = 0;
+
+	for (int i = 0; i < TELEMETRY_PACKET_BYTES - 1; i++)
+		check ^= tel->buf[i];
+
+	if (check != tel->buf[TELEMETRY_PACKET_BYTES - 1])
+	{
+		tel->bad_packets++;
+		resync(tel, 1);
+		return 0;
+	}
+
+	sim_telemetry_packet packet;
+	sim_telemetry_decode(tel->buf, &packet);
+	tel->n = 0;
+
+	if (tel->last.seq >= 0)
+		tel->lost_packets += (packet.seq - tel->last.seq - 1) & 0xFF;
+
+	tel->last = packet;
+	tel->packets++;
+
+	if (tel->csv)
+	{
+		fprintf(tel->csv, "%.6f,%d", t, packet.seq);
+
+		for (int p = 0; p < 2; p++)
+			fprintf(tel->csv, ",%d,%d,%d,%d,%d", packet.in_peak[p], packet.in_envelope[p],
+				packet.out_peak[p], packet.out_envelope[p], packet.cycles[p]);
+
+		fprintf(tel->csv, ",%d,%d,%d,%d\n", packet.clips, packet.current_pipeline, packet.health, packet.sample_rate);
+	}
+
+	return 1;
+}
+
+void sim_telemetry_close(sim_telemetry *tel)
+{
+	printf("Telemetry: %ld packets, %ld failed their checksum, %ld lost, %ld bytes skipped\n",
+		tel->packets, tel->bad_packets, tel->lost_packets, tel->skipped_bytes);
+
+	if (tel->csv)
+		fclose(tel->csv);
+
+	tel->csv = NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef DSP_SIM_TELEMETRY_H_
+#define DSP_SIM_TELEMETRY_H_
+
+#include <stdio.h>
+#include <cstdint>
+
+// Telemetry packets, as include/engine.vh and src/telemetry.v lay them out
+#define TELEMETRY_SYNC 				0xA5
+#define TELEMETRY_PACKET_BYTES 		26
+
+#define TELEMETRY_STATUS_PIPELINE 	0
+#define TELEMETRY_STATUS_HEALTH 	1
+#define TELEMETRY_STATUS_RATE 		2
+
+typedef struct {
+	int seq;
+
+	// Per pipeline, A then B
+	int in_peak[2];
+	int in_envelope[2];
+	int out_peak[2];
+	int out_envelope[2];
+	int cycles[2];
+
+	int clips;
+
+	int current_pipeline;
+	int health;
+	int sample_rate;
+} sim_telemetry_packet;
+
+// Bytes off MISO, gathered into packets, each written out as a line of
+// CSV as it's completed
+typedef struct {
+	FILE *csv;
+
+	uint8_t buf[TELEMETRY_PACKET_BYTES];
+	int n;
+
+	sim_telemetry_packet last;
+
+	long packets;
+	long bad_packets;
+	long lost_packets;
+	long skipped_bytes;
+} sim_telemetry;
+
+int sim_telemetry_open(sim_telemetry *tel, const char *path);
+
+// Take the byte an SPI transfer clocked out, `t' seconds in. 1 if it
+// finished a good packet, now in tel->last
+int sim_telemetry_byte(sim_telemetry *tel, uint8_t byte, double t);
+
+// Unpack a packet whose checksum has been checked
+void sim_telemetry_decode(const uint8_t *buf, sim_telemetry_packet *packet);
+
+void sim_telemetry_close(sim_telemetry *tel);
+
+#endif
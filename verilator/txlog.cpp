@@ -0,0 +1,190 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "sim_main.h"
+#include "txlog.h"
+#include "Vtop___024root.h"
+
+/*
+ * Engine-level transaction log.
+ *
+ * Most debugging only wants to know what went in and out of the engine
+ * and what the controller made of it, not every net in the design. The
+ * log keeps just that, as fixed-size records in a file mapped into
+ * memory: a record is a store, and the operating system writes it out
+ * in its own time. It is synced every so many frames, and trimmed to
+ * size on close.
+ *
+ * The signals come off dsp_engine and control_unit, read once a cycle
+ * after the rising edge, and a record goes in only when one changes.
+ */
+
+static uint64_t map_size(uint64_t capacity)
+{
+	return sizeof(sim_txlog_header) + capacity * sizeof(sim_txlog_record);
+}
+
+static int map_log(sim_txlog *log, uint64_t capacity)
+{
+	if (ftruncate(log->fd, map_size(capacity)) != 0)
+		return 1;
+
+	void *map = mmap(NULL, map_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, 0);
+
+	if (map == MAP_FAILED)
+		return 2;
+
+	log->map = (uint8_t*)map;
+	log->capacity = capacity;
+
+	return 0;
+}
+
+int sim_txlog_open(sim_txlog *log, const char *path)
+{
+	if (!log)
+		return 1;
+
+	memset(log, 0, sizeof(sim_txlog));
+
+	log->state 		= -1;
+	log->health 	= -1;
+	log->last_byte 	= -1;
+
+	log->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (log->fd < 0 || map_log(log, TXLOG_INITIAL_RECORDS))
+	{
+		printf("Transaction log: can't map %s\n", path);
+
+		if (log->fd >= 0)
+			close(log->fd);
+
+		log->fd = -1;
+		log->map = NULL;
+
+		return 2;
+	}
+
+	sim_txlog_header *header = (sim_txlog_header*)log->map;
+
+	memcpy(header->magic, TXLOG_MAGIC, sizeof(header->magic));
+	header->version 	= TXLOG_VERSION;
+	header->record_size = sizeof(sim_txlog_record);
+	header->n_records 	= 0;
+
+	return 0;
+}
+
+static void append(sim_txlog *log, int kind, int arg, int value)
+{
+	if (!log->map)
+		return;
+
+	sim_txlog_header *header = (sim_txlog_header*)log->map;
+
+	if (header->n_records == log->capacity)
+	{
+		uint64_t n = header->n_records;
+
+		munmap(log->map, map_size(log->capacity));
+		log->map = NULL;
+
+		if (map_log(log, 2 * log->capacity))
+		{
+			printf("Transaction log: can't grow past %lu records\n", (unsigned long)n);
+			return;
+		}
+
+		header = (sim_txlog_header*)log->map;
+	}
+
+	sim_txlog_record *record = (sim_txlog_record*)(log->map + sizeof(sim_txlog_header)) + header->n_records;
+
+	record->cycle = log->cycle;
+	record->kind  = kind;
+	record->arg   = arg;
+	record->value = value;
+
+	header->n_records++;
+}
+
+void sim_txlog_cycle(sim_txlog *log)
+{
+	if (!log->map)
+		return;
+
+	Vtop___024root *root = dut->rootp;
+
+	int state 	 = root->top__DOT__engine__DOT__controller__DOT__state;
+	int health 	 = root->top__DOT__engine__DOT__health;
+	int swapping = root->top__DOT__engine__DOT__pipelines_swapping;
+	int current  = root->top__DOT__engine__DOT__controller__DOT__current_pipeline;
+
+	if (state != log->state)
+	{
+		append(log, TXLOG_CONTROL_STATE, state, log->state);
+		log->state = state;
+	}
+
+	// The byte is still at the head of the FIFO the cycle it's taken
+	if (root->top__DOT__engine__DOT__inp_fifo_next)
+	{
+		log->last_byte = root->top__DOT__engine__DOT__command_byte;
+		append(log, TXLOG_SPI_BYTE, log->last_byte, state);
+	}
+
+	if (root->top__DOT__engine__DOT__controller__DOT__invalid)
+		append(log, TXLOG_INVALID_COMMAND, log->last_byte & 0xFF, 0);
+
+	if (root->top__DOT__engine__DOT__swap_pipelines)
+		append(log, TXLOG_SWAP_START, current, 0);
+
+	if (log->swapping && !swapping)
+		append(log, TXLOG_SWAP_END, current, 0);
+
+	if (health != log->health)
+		append(log, TXLOG_HEALTH, health, 0);
+
+	log->swapping = swapping;
+	log->health = health;
+
+	log->cycle++;
+}
+
+void sim_txlog_frame(sim_txlog *log, int16_t sample_in, int16_t sample_out)
+{
+	if (!log->map)
+		return;
+
+	append(log, TXLOG_FRAME, (uint16_t)sample_in, sample_out);
+
+	if (++log->frames % TXLOG_FLUSH_FRAMES == 0)
+		msync(log->map, map_size(log->capacity), MS_ASYNC);
+}
+
+int sim_txlog_close(sim_txlog *log)
+{
+	if (!log->map)
+		return 1;
+
+	uint64_t n = ((sim_txlog_header*)log->map)->n_records;
+
+	msync(log->map, map_size(log->capacity), MS_SYNC);
+	munmap(log->map, map_size(log->capacity));
+	log->map = NULL;
+
+	int ret = ftruncate(log->fd, map_size(n));
+
+	close(log->fd);
+	log->fd = -1;
+
+	printf("Transaction log: %lu records over %lu cycles\n", (unsigned long)n, (unsigned long)log->cycle);
+
+	return ret;
+}
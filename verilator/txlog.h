@@ -0,0 +1,71 @@
+#ifndef DSP_SIM_TXLOG_H_
+#define DSP_SIM_TXLOG_H_
+
+#include <cstdint>
+
+/*
+ * Transaction log format, shared by the harness that writes it and the
+ * txlog tool that reads it. A header, then fixed-size records in the
+ * order they happened; the header's count is kept up to date as records
+ * go in, so a log cut short by a crash is good up to where it stopped.
+ */
+
+#define TXLOG_MAGIC 		"MFTXLOG"
+#define TXLOG_VERSION 		1
+
+#define TXLOG_FRAME 			1 	// arg: sample in, value: sample out
+#define TXLOG_SPI_BYTE 			2 	// arg: byte taken by the controller, value: its state
+#define TXLOG_SWAP_START 		3 	// arg: pipeline current as the swap starts
+#define TXLOG_SWAP_END 			4 	// arg: pipeline current once it's done
+#define TXLOG_INVALID_COMMAND 	5 	// arg: last byte taken
+#define TXLOG_HEALTH 			6 	// arg: health, on each change
+#define TXLOG_CONTROL_STATE 	7 	// arg: new state, value: old state
+#define TXLOG_N_KINDS 			8
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t n_records;
+	uint64_t reserved;
+} sim_txlog_header;
+
+typedef struct {
+	uint64_t cycle;
+	uint16_t kind;
+	uint16_t arg;
+	int32_t value;
+} sim_txlog_record;
+
+static_assert(sizeof(sim_txlog_header) == 32, "txlog header layout");
+static_assert(sizeof(sim_txlog_record) == 16, "txlog record layout");
+
+#define TXLOG_INITIAL_RECORDS 	(1 << 16)
+#define TXLOG_FLUSH_FRAMES 		4096
+
+// The harness's end: the log mapped in, and what the engine was doing
+// the cycle before, to see what changed
+typedef struct {
+	int fd;
+	uint8_t *map;
+	uint64_t capacity;
+
+	uint64_t cycle;
+	long frames;
+
+	int state;
+	int health;
+	int swapping;
+	int last_byte;
+} sim_txlog;
+
+int sim_txlog_open(sim_txlog *log, const char *path);
+
+// Look over the engine once a sys_clk cycle, and log what changed
+void sim_txlog_cycle(sim_txlog *log);
+
+void sim_txlog_frame(sim_txlog *log, int16_t sample_in, int16_t sample_out);
+
+int sim_txlog_close(sim_txlog *log);
+
+#endif
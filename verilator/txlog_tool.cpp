@@ -0,0 +1,293 @@
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "txlog.h"
+
+/*
+ * Reads the transaction logs the harness writes.
+ *
+ *   txlog dump <log> [kind]
+ *   txlog diff [-t] <a> <b>
+ *
+ * dump prints the records one to a line. diff compares two runs kind by
+ * kind, so that, say, an extra SPI byte doesn't put every frame after it
+ * out of step, and prints where each kind first went its own way. With
+ * -t, only the order of the records matters and not the cycle they were
+ * on, for runs that should do the same thing at a different pace.
+ *
+ * diff exits 0 if the runs match, 1 if they don't, and 2 if a log can't
+ * be read.
+ */
+
+#define DIFF_SHOW 	8
+
+static const char *kind_names[TXLOG_N_KINDS] = {
+	"?", "frame", "spi_byte", "swap_start", "swap_end", "invalid", "health", "state"
+};
+
+typedef struct {
+	const char *path;
+	void *map;
+	size_t size;
+
+	const sim_txlog_record *records;
+	uint64_t n;
+} txlog_file;
+
+static void unload_log(txlog_file *log)
+{
+	if (log->map)
+		munmap(log->map, log->size);
+
+	log->map = NULL;
+}
+
+static int load_log(txlog_file *log, const char *path)
+{
+	memset(log, 0, sizeof(txlog_file));
+	log->path = path;
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(sim_txlog_header))
+	{
+		fprintf(stderr, "%s: can't read\n", path);
+
+		if (fd >= 0)
+			close(fd);
+
+		return 1;
+	}
+
+	log->size = st.st_size;
+	log->map = mmap(NULL, log->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (log->map == MAP_FAILED)
+	{
+		fprintf(stderr, "%s: can't map\n", path);
+		log->map = NULL;
+		return 2;
+	}
+
+	const sim_txlog_header *header = (const sim_txlog_header*)log->map;
+
+	if (memcmp(header->magic, TXLOG_MAGIC, sizeof(TXLOG_MAGIC)) != 0
+		|| header->version != TXLOG_VERSION || header->record_size != sizeof(sim_txlog_record))
+	{
+		fprintf(stderr, "%s: not a version %d transaction log\n", path, TXLOG_VERSION);
+		unload_log(log);
+		return 3;
+	}
+
+	// A run that died leaves the count behind what's on disk, or the
+	// file short of it; either way, take what's there
+	uint64_t on_disk = (log->size - sizeof(sim_txlog_header)) / sizeof(sim_txlog_record);
+
+	log->records = (const sim_txlog_record*)((const uint8_t*)log->map + sizeof(sim_txlog_header));
+	log->n = (header->n_records < on_disk) ? header->n_records : on_disk;
+
+	return 0;
+}
+
+static const char *kind_name(int kind)
+{
+	return (kind > 0 && kind < TXLOG_N_KINDS) ? kind_names[kind] : "?";
+}
+
+static void print_record(const sim_txlog_record *r)
+{
+	printf("%12lu  %-10s ", (unsigned long)r->cycle, kind_name(r->kind));
+
+	switch (r->kind)
+	{
+		case TXLOG_FRAME:
+			printf("in %6d  out %6d\n", (int16_t)r->arg, (int16_t)r->value);
+			break;
+
+		case TXLOG_SPI_BYTE:
+			printf("0x%02x  state %d\n", r->arg, r->value);
+			break;
+
+		case TXLOG_SWAP_START:
+		case TXLOG_SWAP_END:
+			printf("pipeline %c\n", r->arg ? 'b' : 'a');
+			break;
+
+		case TXLOG_INVALID_COMMAND:
+			printf("after 0x%02x\n", r->arg);
+			break;
+
+		case TXLOG_CONTROL_STATE:
+			printf("%d -> %d\n", r->value, r->arg);
+			break;
+
+		default:
+			printf("%d %d\n", r->arg, r->value);
+			break;
+	}
+}
+
+static int dump(const char *path, const char *only)
+{
+	txlog_file log;
+
+	if (load_log(&log, path))
+		return 2;
+
+	for (uint64_t i = 0; i < log.n; i++)
+	{
+		if (only && strcmp(only, kind_name(log.records[i].kind)) != 0)
+			continue;
+
+		print_record(&log.records[i]);
+	}
+
+	unload_log(&log);
+
+	return 0;
+}
+
+static int same_record(const sim_txlog_record *a, const sim_txlog_record *b, int timing)
+{
+	return a->kind == b->kind && a->arg == b->arg && a->value == b->value
+		&& (!timing || a->cycle == b->cycle);
+}
+
+// Walk both logs one kind at a time, in step
+static int diff(const char *path_a, const char *path_b, int timing)
+{
+	txlog_file a;
+	txlog_file b;
+
+	if (load_log(&a, path_a))
+		return 2;
+
+	if (load_log(&b, path_b))
+	{
+		unload_log(&a);
+		return 2;
+	}
+
+	int differ = 0;
+
+	printf("%-10s %10s %10s  %s\n", "kind", path_a, path_b, "first difference");
+
+	for (int kind = 1; kind < TXLOG_N_KINDS; kind++)
+	{
+		uint64_t i = 0;
+		uint64_t j = 0;
+		uint64_t n_a = 0;
+		uint64_t n_b = 0;
+		uint64_t at = 0;
+		int found = 0;
+
+		// The first few records that differ, to show under the counts
+		uint64_t shown_a[DIFF_SHOW];
+		uint64_t shown_b[DIFF_SHOW];
+		int shown = 0;
+
+		while (1)
+		{
+			while (i < a.n && a.records[i].kind != kind)
+				i++;
+			while (j < b.n && b.records[j].kind != kind)
+				j++;
+
+			if (i == a.n || j == b.n)
+				break;
+
+			if (!same_record(&a.records[i], &b.records[j], timing))
+			{
+				if (!found)
+					at = n_a;
+
+				found = 1;
+
+				if (shown < DIFF_SHOW)
+				{
+					shown_a[shown] = i;
+					shown_b[shown] = j;
+					shown++;
+				}
+			}
+
+			i++, j++;
+			n_a++, n_b++;
+		}
+
+		for (; i < a.n; i++)
+			n_a += (a.records[i].kind == kind);
+		for (; j < b.n; j++)
+			n_b += (b.records[j].kind == kind);
+
+		if (!found && n_a != n_b)
+		{
+			found = 1;
+			at = (n_a < n_b) ? n_a : n_b;
+		}
+
+		if (found)
+		{
+			differ = 1;
+			printf("%-10s %10lu %10lu  #%lu\n", kind_names[kind], (unsigned long)n_a, (unsigned long)n_b, (unsigned long)at);
+
+			for (int k = 0; k < shown; k++)
+			{
+				printf("  < ");
+				print_record(&a.records[shown_a[k]]);
+				printf("  > ");
+				print_record(&b.records[shown_b[k]]);
+			}
+		}
+		else if (n_a)
+		{
+			printf("%-10s %10lu %10lu  -\n", kind_names[kind], (unsigned long)n_a, (unsigned long)n_b);
+		}
+	}
+
+	printf(differ ? "Runs differ\n" : "Runs match\n");
+
+	unload_log(&a);
+	unload_log(&b);
+
+	return differ;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: txlog dump <log> [kind]\n");
+	fprintf(stderr, "       txlog diff [-t] <a> <b>\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc >= 3 && strcmp(argv[1], "dump") == 0)
+		return dump(argv[2], (argc > 3) ? argv[3] : NULL);
+
+	if (argc >= 4 && strcmp(argv[1], "diff") == 0)
+	{
+		int timing = 1;
+		int arg = 2;
+
+		if (strcmp(argv[arg], "-t") == 0)
+		{
+			timing = 0;
+			arg++;
+		}
+
+		if (argc - arg == 2)
+			return diff(argv[arg], argv[arg + 1], timing);
+	}
+
+	usage();
+
+	return 2;
+}